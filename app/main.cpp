@@ -1,41 +1,804 @@
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <csignal>
+#include <chrono>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "dependency_analyzer.h"
+#include "fd_stream.h"
 #include "file_parser.h"
+#include "file_watcher.h"
+#include "git_history.h"
+#include "graph_exporter.h"
+#include "graph_snapshot.h"
+#include "impact_analyzer.h"
+#include "include_cost.h"
+#include "layer_rules.h"
+#include "parse_cache.h"
+#include "parse_number.h"
+#include "parse_shard.h"
+#include "profiler.h"
+#include "query_engine.h"
+#include "subprocess.h"
+#include "thread_pool.h"
 
-int main(int argc, char* argv[]) {
-  if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " <file1> <file2> ..." << std::endl;
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " [--jobs N] [--cache FILE [--cache-hash]] [-I DIR]... "
+               "[--exclude GLOB]... [--only GLOB]... [--no-gitignore] "
+               "[--watch [--watch-debounce MS] | --batch | --socket PATH | "
+               "--impact | --include-cost N | --check-layers FILE | "
+               "--export mermaid|dot|json|graphml [--keyword K] "
+               "[--output FILE]] [--save-snapshot FILE] [--profile FILE] "
+               "[--shards N] <dir1> <dir2> ... | --compile-commands FILE | "
+               "--merge-shard FILE...\n"
+               "       "
+            << program
+            << " [--jobs N] [--exclude GLOB]... [--only GLOB]... "
+               "[--no-gitignore] --shard I/N --shard-output FILE <dir1> ...\n"
+               "       "
+            << program
+            << " --snapshot FILE [--export FORMAT [--keyword K] "
+               "[--output FILE]]\n"
+               "       "
+            << program
+            << " [--jobs N] [-I DIR]... [--exclude GLOB]... [--only GLOB]... "
+               "--history REPO < revisions"
+            << std::endl;
+}
+
+// With a path, profiles the run and, when main returns, writes the Chrome
+// trace to the path and the per-phase summary to stderr
+class ProfileReport {
+ public:
+  explicit ProfileReport(std::string path) : path_(std::move(path)) {
+    if (!path_.empty()) {
+      Profiler::Enable();
+    }
+  }
+  ~ProfileReport() {
+    if (path_.empty()) {
+      return;
+    }
+    std::ofstream trace(path_, std::ios::binary | std::ios::trunc);
+    Profiler::WriteChromeTrace(trace);
+    if (!trace) {
+      std::cerr << "Failed to write profile " << path_ << std::endl;
+    }
+    std::cerr << '\n';
+    Profiler::WriteSummary(std::cerr);
+  }
+
+  ProfileReport(const ProfileReport&) = delete;
+  ProfileReport& operator=(const ProfileReport&) = delete;
+
+ private:
+  const std::string path_;
+};
+
+// Keeps the analyzer current with the watched directories, reporting for
+// every batch how long after its first change the graph was up to date
+void WatchForChanges(FileWatcher& watcher, FileParser& parser,
+                     DependencyAnalyzer& analyzer, std::mutex& analyzer_mutex) {
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  while (auto batch = watcher.WaitForChanges()) {
+    const auto batch_ready = std::chrono::steady_clock::now();
+    const FileDelta delta = parser.Reparse(batch->paths);
+    if (delta.empty()) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(analyzer_mutex);
+      analyzer.ApplyDelta(delta);
+    }
+    const auto updated = std::chrono::steady_clock::now();
+    std::cerr << std::fixed << std::setprecision(2) << "Updated "
+              << delta.added.size() << " added, " << delta.modified.size()
+              << " modified, " << delta.removed.size() << " removed file(s) "
+              << "in " << Milliseconds(updated - batch_ready).count()
+              << " ms, " << Milliseconds(updated - batch->first_change).count()
+              << " ms after the first change" << std::endl;
+  }
+  std::cerr << "Stopped watching: failed to read file events" << std::endl;
+}
+
+// Streams the graph export_graph writes to path (stdout when empty) and
+// reports the throughput and the peak memory of the whole run on stderr
+bool ExportAndReport(
+    const std::function<ExportStats(std::ostream&)>& export_graph,
+    const std::string& path) {
+  const int fd = path.empty()
+                     ? STDOUT_FILENO
+                     : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << path << std::endl;
+    return false;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  ExportStats stats;
+  size_t bytes = 0;
+  bool ok;
+  {
+    FdOutputStream out(fd);
+    stats = export_graph(out);
+    out.flush();
+    ok = static_cast<bool>(out);
+    bytes = out.BytesWritten();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (!path.empty() && close(fd) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    std::cerr << "Failed to write " << (path.empty() ? "stdout" : path)
+              << std::endl;
+    return false;
+  }
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  std::cerr << "Exported " << stats.nodes << " components, " << stats.edges
+            << " edges (" << bytes << " bytes) in " << std::fixed
+            << std::setprecision(3) << elapsed.count() << " s ("
+            << std::setprecision(0) << stats.edges / elapsed.count()
+            << " edges/s), peak RSS " << usage.ru_maxrss / 1024 << " MiB"
+            << std::endl;
+  return true;
+}
+
+// Reads changed file paths from stdin, one per line, and lists every file
+// (stem) that depends on any of them, the changed ones included, on stdout
+int ReportImpact(const DependencyAnalyzer& analyzer, ThreadPool* pool) {
+  std::vector<std::string> changed;
+  for (std::string line; std::getline(std::cin, line);) {
+    if (!line.empty()) {
+      changed.push_back(std::move(line));
+    }
+  }
+  const ImpactAnalyzer impact_analyzer(analyzer, pool);
+  const auto start = std::chrono::steady_clock::now();
+  const ImpactResult impact = impact_analyzer.Analyze(changed);
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  for (const auto& file : impact.unknown_files) {
+    std::cerr << "Not an analyzed file: " << file << std::endl;
+  }
+  const NameTable& names = analyzer.GetFileDependencies().Names();
+  std::vector<std::string_view> affected;
+  for (const NodeId file : impact.files) {
+    affected.push_back(names.Name(file));
+  }
+  std::sort(affected.begin(), affected.end());
+  for (const auto name : affected) {
+    std::cout << name << '\n';
+  }
+  std::cout << std::flush;
+  std::cerr << impact.changed_files.size() << " changed file(s) affect "
+            << impact.files.size() << " file(s) in "
+            << impact.components.size() << " component(s), found in "
+            << std::fixed << std::setprecision(3) << elapsed.count() << " ms"
+            << std::endl;
+  return 0;
+}
+
+// Reads revisions of a git repository from stdin, one per line and oldest
+// first (e.g. from `git rev-list --reverse`), and writes the metrics of each
+// as a JSON line on stdout
+int ReportHistory(const std::string& repository,
+                  const WalkOptions& walk_options,
+                  AnalyzerOptions analyzer_options, unsigned jobs) {
+  // git exiting early must fail our writes, not kill us
+  std::signal(SIGPIPE, SIG_IGN);
+  std::unique_ptr<ThreadPool> pool;
+  if (ThreadPool::ResolveThreadCount(jobs) > 1) {
+    pool = std::make_unique<ThreadPool>(jobs);
+  }
+  analyzer_options.pool = pool.get();
+  GitHistoryAnalyzer history(repository, walk_options,
+                             std::move(analyzer_options));
+  const auto start = std::chrono::steady_clock::now();
+  size_t revisions = 0;
+  size_t failed = 0;
+  std::string json;
+  for (std::string revision; std::getline(std::cin, revision);) {
+    if (revision.empty()) {
+      continue;
+    }
+    std::string error;
+    const std::optional<RevisionMetrics> metrics =
+        history.Analyze(revision, &error);
+    if (!metrics) {
+      std::cerr << error << std::endl;
+      ++failed;
+      continue;
+    }
+    ++revisions;
+    json.clear();
+    AppendJson(json, metrics->ToJson());
+    std::cout << json << std::endl;
+  }
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cerr << "Analyzed " << revisions << " revision(s) of " << repository
+            << " in " << std::fixed << std::setprecision(1)
+            << elapsed.count() << " ms, parsing " << history.CachedBlobs()
+            << " distinct blob(s)" << std::endl;
+  return failed == 0 ? 0 : 1;
+}
+
+// Parses slice `index` of `count` of every directory and saves it as a
+// shard, for a process running MergeParseShards
+int RunShardWorker(FileParser& parser,
+                   const std::vector<std::string>& directories, size_t index,
+                   size_t count, const std::string& output) {
+  ParseShard shard;
+  shard.index = index;
+  shard.count = count;
+  for (const auto& directory : directories) {
+    const size_t before = parser.GetParsedFiles().size();
+    ParseShard::Slice& slice = shard.slices.emplace_back();
+    slice.directory = directory;
+    slice.walk_size = parser.ParseSliceOf(directory, index, count);
+    const auto& files = parser.GetParsedFiles();
+    slice.files.assign(files.begin() + before, files.end());
+  }
+  if (!shard.Save(output)) {
+    std::cerr << "Failed to write shard " << output << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// Runs this program once per shard, each worker parsing its slice of the
+// directories, and loads the shards they wrote
+bool ParseInShards(size_t count, const std::vector<std::string>& directories,
+                   const WalkOptions& walk_options, unsigned jobs,
+                   StringArena& arena, std::vector<ParseShard>& shards) {
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  const auto start = std::chrono::steady_clock::now();
+  const std::filesystem::path shard_dir =
+      std::filesystem::temp_directory_path() /
+      ("cpp_deps_shards." + std::to_string(getpid()));
+  std::filesystem::create_directories(shard_dir);
+  // The workers share the threads one process would have used
+  const unsigned worker_jobs =
+      std::max<size_t>(1, ThreadPool::ResolveThreadCount(jobs) / count);
+  std::vector<std::string> paths;
+  std::vector<std::unique_ptr<Subprocess>> workers;
+  bool ok = true;
+  for (size_t i = 0; i < count && ok; ++i) {
+    paths.push_back((shard_dir / ("shard" + std::to_string(i))).string());
+    std::vector<std::string> argv = {
+        "/proc/self/exe", "--shard",
+        std::to_string(i) + "/" + std::to_string(count), "--shard-output",
+        paths.back(),     "--jobs",
+        std::to_string(worker_jobs)};
+    for (const auto& glob : walk_options.exclude) {
+      argv.insert(argv.end(), {"--exclude", glob});
+    }
+    for (const auto& glob : walk_options.only) {
+      argv.insert(argv.end(), {"--only", glob});
+    }
+    if (!walk_options.gitignore) {
+      argv.push_back("--no-gitignore");
+    }
+    argv.insert(argv.end(), directories.begin(), directories.end());
+    workers.push_back(std::make_unique<Subprocess>());
+    ok = workers.back()->Start(argv, /*pipes=*/false);
+  }
+  // Wait for every started worker, even after a failure
+  for (auto& worker : workers) {
+    ok &= worker->Finish();
+  }
+  std::string error;
+  shards.resize(count);
+  for (size_t i = 0; i < count && ok; ++i) {
+    ok = shards[i].Load(paths[i], arena, &error);
+  }
+  std::error_code ignored;
+  std::filesystem::remove_all(shard_dir, ignored);
+  if (!ok) {
+    std::cerr << "Sharded parse failed"
+              << (error.empty() ? "" : ": " + error) << std::endl;
+    return false;
+  }
+  std::cerr << "Parsed " << directories.size() << " director(ies) in "
+            << count << " shards in " << std::fixed << std::setprecision(1)
+            << Milliseconds(std::chrono::steady_clock::now() - start).count()
+            << " ms" << std::endl;
+  return true;
+}
+
+// Writes every violation of the rules on stdout, one per line; fails if
+// there is any
+int ReportLayerViolations(const DependencyAnalyzer& analyzer,
+                          const LayerRules& rules) {
+  const auto start = std::chrono::steady_clock::now();
+  const std::vector<LayerViolation> violations =
+      CheckLayerRules(analyzer, rules);
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  for (const auto& violation : violations) {
+    std::cout << violation.Describe() << '\n';
+  }
+  std::cout << std::flush;
+  std::cerr << violations.size() << " layer rule violation(s) among "
+            << analyzer.GetFileDependencies().size() << " nodes, checked in "
+            << std::fixed << std::setprecision(1) << elapsed.count() << " ms"
+            << std::endl;
+  return violations.empty() ? 0 : 1;
+}
+
+// Answers keyword prompts or an export from a snapshot instead of analyzing
+int RunFromSnapshot(const std::string& path,
+                    std::optional<ExportFormat> export_format,
+                    const std::string& export_keyword,
+                    const std::string& export_path) {
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  const auto start = std::chrono::steady_clock::now();
+  GraphSnapshot snapshot;
+  if (!snapshot.Open(path)) {
+    std::cerr << "Failed to open snapshot " << path << std::endl;
     return 1;
   }
+  std::cerr << "Mapped snapshot " << path << " (" << snapshot.NumFiles()
+            << " files, " << snapshot.NumComponents() << " components, "
+            << snapshot.SizeBytes() << " bytes) in " << std::fixed
+            << std::setprecision(2)
+            << Milliseconds(std::chrono::steady_clock::now() - start).count()
+            << " ms" << std::endl;
+
+  if (export_format) {
+    return ExportAndReport(
+               [&](std::ostream& out) {
+                 return ExportGraph(snapshot, export_keyword, *export_format,
+                                    out);
+               },
+               export_path)
+               ? 0
+               : 1;
+  }
+
+  std::string keyword;
+  std::cout << "Enter keyword for subgraph generation" << std::endl;
+  std::cout << "(please enter keyword...): ";
+  while (std::getline(std::cin, keyword)) {
+    std::cout << "Generate subgraph related to " << keyword << std::endl;
+    ExportGraph(snapshot, keyword, ExportFormat::kMermaid, std::cout);
+    std::cout << std::endl;
+    std::cout << "(please enter keyword...): ";
+  }
+  return 0;
+}
 
-  FileParser parser;
+int main(int argc, char* argv[]) {
+  unsigned jobs = 1;
+  std::string cache_path;
+  bool cache_hash = false;
+  bool watch = false;
+  std::chrono::milliseconds watch_debounce(5);
+  bool batch = false;
+  bool impact = false;
+  size_t include_cost_limit = 0;
+  std::optional<LayerRules> layer_rules;
+  std::string socket_path;
+  std::optional<ExportFormat> export_format;
+  std::string export_keyword;
+  std::string export_path;
+  std::string snapshot_path;
+  std::string save_snapshot_path;
+  std::string compile_commands_path;
+  std::string history_repository;
+  size_t shards = 0;
+  std::optional<std::pair<size_t, size_t>> shard;  // index, count
+  std::string shard_output;
+  std::vector<std::string> merge_shards;
+  std::string profile_path;
+  AnalyzerOptions analyzer_options;
+  WalkOptions walk_options;
+  std::vector<std::string> directories;
 
   for (int i = 1; i < argc; ++i) {
-    std::string targeted_direcotry = argv[i];
-    parser.ParseFilesUnder(targeted_direcotry);
+    std::string arg = argv[i];
+    if (arg == "--jobs" || arg == "-j") {
+      // 0 means "use every hardware thread"
+      const auto value =
+          i + 1 < argc ? ParseNumber<unsigned>(argv[++i]) : std::nullopt;
+      if (!value) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      jobs = *value;
+    } else if (arg == "--cache") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      cache_path = argv[++i];
+    } else if (arg == "--cache-hash") {
+      cache_hash = true;
+    } else if (arg == "--watch") {
+      watch = true;
+    } else if (arg == "--watch-debounce") {
+      // 0 applies every change as soon as it is seen
+      const auto value =
+          i + 1 < argc ? ParseNumber<uint32_t>(argv[++i]) : std::nullopt;
+      if (!value) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      watch_debounce = std::chrono::milliseconds(*value);
+    } else if (arg == "--batch") {
+      batch = true;
+    } else if (arg == "--impact") {
+      impact = true;
+    } else if (arg == "--include-cost") {
+      const auto value =
+          i + 1 < argc ? ParseNumber<size_t>(argv[++i]) : std::nullopt;
+      if (!value || *value == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      include_cost_limit = *value;
+    } else if (arg == "--check-layers") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      // Read up front, so a broken rules file fails before the analysis
+      std::string error;
+      layer_rules = LayerRules::Load(argv[++i], &error);
+      if (!layer_rules) {
+        std::cerr << error << std::endl;
+        return 1;
+      }
+    } else if (arg == "--socket") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      socket_path = argv[++i];
+    } else if (arg == "--export") {
+      if (i + 1 >= argc || !(export_format = ParseExportFormat(argv[++i]))) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+    } else if (arg == "--snapshot") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      snapshot_path = argv[++i];
+    } else if (arg == "--compile-commands") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      compile_commands_path = argv[++i];
+    } else if (arg == "--shards") {
+      const auto value =
+          i + 1 < argc ? ParseNumber<size_t>(argv[++i]) : std::nullopt;
+      if (!value || *value == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      shards = *value;
+    } else if (arg == "--shard") {
+      const std::string_view value = i + 1 < argc ? argv[++i] : "";
+      const size_t slash = value.find('/');
+      const auto index = ParseNumber<size_t>(value.substr(0, slash));
+      const auto count = slash == std::string_view::npos
+                             ? std::nullopt
+                             : ParseNumber<size_t>(value.substr(slash + 1));
+      if (!index || !count || *index >= *count) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      shard.emplace(*index, *count);
+    } else if (arg == "--shard-output") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      shard_output = argv[++i];
+    } else if (arg == "--merge-shard") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      merge_shards.push_back(argv[++i]);
+    } else if (arg == "--history") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      history_repository = argv[++i];
+    } else if (arg == "--save-snapshot") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      save_snapshot_path = argv[++i];
+    } else if (arg == "--profile") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      profile_path = argv[++i];
+    } else if (arg == "--keyword") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      export_keyword = argv[++i];
+    } else if (arg == "--output" || arg == "-o") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      export_path = argv[++i];
+    } else if (arg == "--exclude" || arg == "--only") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      (arg == "--exclude" ? walk_options.exclude : walk_options.only)
+          .push_back(argv[++i]);
+    } else if (arg == "--no-gitignore") {
+      walk_options.gitignore = false;
+    } else if (arg == "-I" || arg == "--include-path") {
+      if (i + 1 >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      analyzer_options.include_paths.push_back(argv[++i]);
+    } else if (arg.starts_with("-I")) {
+      analyzer_options.include_paths.push_back(arg.substr(2));
+    } else {
+      directories.push_back(arg);
+    }
+  }
+
+  const ProfileReport profile(profile_path);
+
+  // A snapshot stands in for the analyzed directories
+  if (!snapshot_path.empty()) {
+    if (!directories.empty() || !compile_commands_path.empty() || watch ||
+        batch || impact || include_cost_limit > 0 || !socket_path.empty() ||
+        !save_snapshot_path.empty() || !history_repository.empty() ||
+        shards > 0 || shard || !merge_shards.empty() ||
+        layer_rules.has_value()) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    return RunFromSnapshot(snapshot_path, export_format, export_keyword,
+                           export_path);
+  }
+
+  // Revisions come from git, not from the analyzed directories
+  if (!history_repository.empty()) {
+    if (!directories.empty() || !compile_commands_path.empty() || watch ||
+        batch || impact || include_cost_limit > 0 || !socket_path.empty() ||
+        export_format || !save_snapshot_path.empty() || !cache_path.empty() ||
+        shards > 0 || shard || !merge_shards.empty() ||
+        layer_rules.has_value()) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    return ReportHistory(history_repository, walk_options,
+                         std::move(analyzer_options), jobs);
+  }
+
+  // Queries are answered over a graph that must not change underneath them.
+  // A compilation database and shards name their own inputs, which the
+  // directory-based watcher cannot follow; sharded parses skip the parse
+  // cache, which one file per process would not share.
+  const bool sharded = shards > 0 || shard.has_value();
+  if ((!directories.empty() + !compile_commands_path.empty() +
+       !merge_shards.empty()) != 1 ||
+      (watch && (!compile_commands_path.empty() || !merge_shards.empty())) ||
+      (sharded && (directories.empty() || watch || !cache_path.empty())) ||
+      shard.has_value() == shard_output.empty() || (shards > 0 && shard) ||
+      (shard && (batch || impact || include_cost_limit > 0 ||
+                 !socket_path.empty() || export_format ||
+                 !save_snapshot_path.empty() || layer_rules.has_value())) ||
+      (watch + batch + impact + (include_cost_limit > 0) +
+       layer_rules.has_value() + !socket_path.empty() +
+       export_format.has_value()) > 1) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  // One pool for parsing and analysis, so the workers are started once
+  std::unique_ptr<ThreadPool> pool;
+  if (ThreadPool::ResolveThreadCount(jobs) > 1) {
+    pool = std::make_unique<ThreadPool>(jobs);
+  }
+  analyzer_options.pool = pool.get();
+  FileParser parser = pool ? FileParser(*pool) : FileParser(1);
+  parser.SetWalkOptions(walk_options);
+  if (!cache_path.empty()) {
+    parser.EnableCache(cache_path, cache_hash);
+  }
+
+  // Watch before the initial parse, so no edit made during it is missed
+  std::unique_ptr<FileWatcher> watcher;
+  if (watch) {
+    watcher = std::make_unique<FileWatcher>(watch_debounce);
+    for (const auto& directory : directories) {
+      if (!watcher->AddDirectory(directory)) {
+        std::cerr << "Failed to watch " << directory << std::endl;
+        return 1;
+      }
+    }
+  }
+
+  if (shard) {
+    return RunShardWorker(parser, directories, shard->first, shard->second,
+                          shard_output);
+  }
+
+  // Files from shards, in place of the parser's
+  StringArena shard_arena;
+  std::vector<ParseShard> loaded_shards;
+  std::vector<File> merged_files;
+  if (shards > 0 && !ParseInShards(shards, directories, walk_options, jobs,
+                                   shard_arena, loaded_shards)) {
+    return 1;
+  }
+  for (const auto& path : merge_shards) {
+    std::string error;
+    if (!loaded_shards.emplace_back().Load(path, shard_arena, &error)) {
+      std::cerr << error << std::endl;
+      return 1;
+    }
+  }
+  if (!loaded_shards.empty()) {
+    std::string error;
+    if (!MergeParseShards(loaded_shards, merged_files, &error)) {
+      std::cerr << "Failed to merge shards: " << error << std::endl;
+      return 1;
+    }
+    loaded_shards.clear();
+  } else {
+    for (const auto& targeted_direcotry : directories) {
+      parser.ParseFilesUnder(targeted_direcotry);
+    }
+  }
+  if (!compile_commands_path.empty() &&
+      !parser.ParseCompileCommands(compile_commands_path)) {
+    return 1;
+  }
+
+  if (const ParseCache* cache = parser.GetCache()) {
+    const auto& stats = cache->GetStats();
+    std::cerr << "Parse cache: " << stats.hits << " hits, " << stats.misses
+              << " misses" << std::endl;
+    if (!parser.SaveCache()) {
+      std::cerr << "Failed to write parse cache " << cache_path << std::endl;
+    }
+  }
+  const std::vector<File>& files =
+      shards > 0 || !merge_shards.empty() ? merged_files
+                                          : parser.GetParsedFiles();
+
+  DependencyAnalyzer analyzer(files, analyzer_options);
+  if (!save_snapshot_path.empty()) {
+    if (!GraphSnapshot::Save(analyzer, save_snapshot_path)) {
+      std::cerr << "Failed to write snapshot " << save_snapshot_path
+                << std::endl;
+      return 1;
+    }
+    std::cerr << "Saved snapshot " << save_snapshot_path << std::endl;
+  }
+
+  if (impact) {
+    return ReportImpact(analyzer, pool.get());
+  }
+
+  if (layer_rules) {
+    return ReportLayerViolations(analyzer, *layer_rules);
+  }
+
+  if (include_cost_limit > 0) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto costs = ComputeIncludeCosts(analyzer, pool.get());
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    WriteIncludeCostReport(analyzer, costs, include_cost_limit, std::cout);
+    std::cerr << "Computed include costs of " << costs.size()
+              << " files in " << std::fixed << std::setprecision(1)
+              << elapsed.count() << " ms" << std::endl;
+    return 0;
+  }
+
+  if (export_format) {
+    return ExportAndReport(
+               [&](std::ostream& out) {
+                 return ExportGraph(analyzer, export_keyword, *export_format,
+                                    out);
+               },
+               export_path)
+               ? 0
+               : 1;
+  }
+
+  // Query modes keep stdout for the responses
+  if (batch || !socket_path.empty()) {
+    const QueryEngine engine(analyzer, pool.get());
+    if (!socket_path.empty()) {
+      std::cerr << "Serving queries on " << socket_path << std::endl;
+      return ServeUnixSocket(engine, socket_path, pool.get()) ? 0 : 1;
+    }
+    std::ios::sync_with_stdio(false);
+    const auto start = std::chrono::steady_clock::now();
+    const size_t answered = engine.Serve(
+        [](std::string& line) {
+          return static_cast<bool>(std::getline(std::cin, line));
+        },
+        [](std::string_view lines) { std::cout << lines << std::flush; },
+        pool.get());
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "Answered " << answered << " queries in " << std::fixed
+              << std::setprecision(3) << elapsed.count() << " s ("
+              << std::setprecision(0) << answered / elapsed.count()
+              << " queries/s)" << std::endl;
+    const auto stats = analyzer.GetRenderCacheStats();
+    std::cerr << "Render cache: " << stats.hits << " hits, " << stats.misses
+              << " misses (" << std::setprecision(1) << stats.HitRate() * 100
+              << "% hit rate)" << std::endl;
+    return 0;
   }
-  const std::vector<File>& files = parser.GetParsedFiles();
 
-  DependencyAnalyzer analyzer(files);
   analyzer.Summary();
 
+  std::mutex analyzer_mutex;
+  std::thread watch_thread;
+  if (watcher) {
+    std::cerr << "Watching " << directories.size()
+              << " director(ies) for changes" << std::endl;
+    watch_thread = std::thread(WatchForChanges, std::ref(*watcher),
+                               std::ref(parser), std::ref(analyzer),
+                               std::ref(analyzer_mutex));
+  }
+
   std::string keyword;
   std::cout << "Enter keyword for subgraph generation" << std::endl;
 
   // Loop waiting for user input
-  while (true) {
-    std::cout << "(please enter keyword...): ";
-    std::getline(std::cin, keyword);
+  std::cout << "(please enter keyword...): ";
+  while (std::getline(std::cin, keyword)) {
     // Respond to the input
     std::cout << "Generate subgraph related to " << keyword << std::endl;
-    std::cout << analyzer.GenerateMermaidGraph(keyword) << std::endl;
+    {
+      std::lock_guard<std::mutex> lock(analyzer_mutex);
+      std::cout << analyzer.GenerateMermaidGraph(keyword) << std::endl;
+    }
+    std::cout << "(please enter keyword...): ";
   }
 
+  // Without input, keep the graph current until interrupted
+  if (watch_thread.joinable()) {
+    watch_thread.join();
+  }
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,292 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dependency_analyzer.h"
+#include "file_parser.h"
+#include "graph_exporter.h"
+#include "graph_snapshot.h"
+#include "parse_number.h"
+#include "reachability.h"
+#include "synthetic_tree.h"
+#include "thread_pool.h"
+
+// Benchmarks of every analysis phase over synthetic trees of 1k files up to
+// --max_files (1M by default). Arguments are (files) or (files, threads);
+// with more than one hardware thread every parallel phase also runs on all
+// of them, so the two rows give the speedup over serial. Pass
+// --benchmark_out=FILE --benchmark_out_format=json to keep results.
+
+namespace {
+
+size_t max_files = 1000000;
+// Parsing reads real files, so it stops at a size that fits a temp directory
+size_t max_parsed_files = 100000;
+
+// Generated trees and analyses are large, so only the last one of each is
+// kept. Benchmarks run one size after the other, so they are rebuilt once
+// per benchmark and size.
+const SyntheticTree& TreeOfSize(size_t num_files) {
+  static std::unique_ptr<SyntheticTree> tree;
+  if (!tree || tree->Files().size() != num_files) {
+    tree.reset();
+    SyntheticTreeOptions options;
+    options.num_files = num_files;
+    tree = std::make_unique<SyntheticTree>(options);
+  }
+  return *tree;
+}
+
+const DependencyAnalyzer& AnalyzerOfSize(size_t num_files) {
+  static std::unique_ptr<DependencyAnalyzer> analyzer;
+  static size_t analyzed_files = 0;
+  if (!analyzer || analyzed_files != num_files) {
+    analyzer.reset();
+    analyzer = std::make_unique<DependencyAnalyzer>(
+        TreeOfSize(num_files).Files());
+    analyzed_files = num_files;
+  }
+  return *analyzer;
+}
+
+// Written once per size and left for later runs
+std::string TreeOnDisk(size_t num_files) {
+  const auto root = std::filesystem::temp_directory_path() /
+                    ("cpp_deps_bench_" + std::to_string(num_files));
+  if (!std::filesystem::exists(root / "complete")) {
+    std::filesystem::remove_all(root);
+    if (!TreeOfSize(num_files).WriteTo(root / "src")) {
+      return {};
+    }
+    std::ofstream(root / "complete");
+  }
+  return (root / "src").string();
+}
+
+std::unique_ptr<ThreadPool> MakePool(int64_t threads) {
+  return threads > 1 ? std::make_unique<ThreadPool>(threads) : nullptr;
+}
+
+// Formats everything but keeps none of it
+class DiscardBuffer : public std::streambuf {
+ public:
+  DiscardBuffer() { setp(buffer_, buffer_ + sizeof(buffer_)); }
+
+ protected:
+  int_type overflow(int_type c) override {
+    setp(buffer_, buffer_ + sizeof(buffer_));
+    return traits_type::not_eof(c);
+  }
+
+ private:
+  char buffer_[64 * 1024];
+};
+
+void SetFilesPerSecond(benchmark::State& state, size_t num_files) {
+  state.counters["files_per_second"] = benchmark::Counter(
+      static_cast<double>(num_files),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
+
+void BM_ParseFiles(benchmark::State& state) {
+  const auto num_files = static_cast<size_t>(state.range(0));
+  const std::string root = TreeOnDisk(num_files);
+  if (root.empty()) {
+    state.SkipWithError("failed to write the tree");
+    return;
+  }
+  const auto pool = MakePool(state.range(1));
+  for (auto _ : state) {
+    FileParser parser = pool ? FileParser(*pool) : FileParser(1);
+    parser.ParseFilesUnder(root);
+    benchmark::DoNotOptimize(parser.GetParsedFiles().data());
+  }
+  SetFilesPerSecond(state, num_files);
+}
+
+// Slower per file as the tree grows: the resolver's and builder's hash
+// tables outgrow the caches, so from 100k files on most lookups miss
+void BM_BuildFileDependencies(benchmark::State& state) {
+  const auto& files = TreeOfSize(static_cast<size_t>(state.range(0))).Files();
+  const auto pool = MakePool(state.range(1));
+  for (auto _ : state) {
+    const FileDepGraph graph = BuildFileDependencies(files, {}, pool.get());
+    benchmark::DoNotOptimize(graph.Graph().NumEdges());
+  }
+  SetFilesPerSecond(state, files.size());
+}
+
+void BM_SCCBuilder(benchmark::State& state) {
+  const auto& files = TreeOfSize(static_cast<size_t>(state.range(0))).Files();
+  const FileDepGraph graph = BuildFileDependencies(files);
+  for (auto _ : state) {
+    const SCCBuilder scc(graph);
+    benchmark::DoNotOptimize(scc.GetSCCComponents().data());
+  }
+  SetFilesPerSecond(state, files.size());
+}
+
+void BM_DepthLevels(benchmark::State& state) {
+  const auto& files = TreeOfSize(static_cast<size_t>(state.range(0))).Files();
+  const FileDepGraph graph = BuildFileDependencies(files);
+  const SCCBuilder scc(graph);
+  const auto pool = MakePool(state.range(1));
+  for (auto _ : state) {
+    const auto levels = ComputeHeightLevels(scc.GetSCCDeps(), pool.get());
+    benchmark::DoNotOptimize(levels.data());
+  }
+  SetFilesPerSecond(state, files.size());
+}
+
+// The edge pruning of DependencyAnalyzer
+void BM_TransitiveReduction(benchmark::State& state) {
+  const auto& files = TreeOfSize(static_cast<size_t>(state.range(0))).Files();
+  const FileDepGraph graph = BuildFileDependencies(files);
+  const SCCBuilder scc(graph);
+  const auto levels = ComputeHeightLevels(scc.GetSCCDeps());
+  const auto pool = MakePool(state.range(1));
+  for (auto _ : state) {
+    const CsrGraph reduced =
+        TransitiveReduction(scc.GetSCCDeps(), levels, pool.get());
+    benchmark::DoNotOptimize(reduced.NumEdges());
+  }
+  state.counters["edges"] = static_cast<double>(scc.GetSCCDeps().NumEdges());
+  SetFilesPerSecond(state, files.size());
+}
+
+// Every phase from parse results to a queryable analyzer
+void BM_Analyze(benchmark::State& state) {
+  const auto& files = TreeOfSize(static_cast<size_t>(state.range(0))).Files();
+  const auto pool = MakePool(state.range(1));
+  AnalyzerOptions options;
+  options.pool = pool.get();
+  for (auto _ : state) {
+    const DependencyAnalyzer analyzer(files, options);
+    benchmark::DoNotOptimize(analyzer.GetTopologicalSortedSCCs().data());
+  }
+  SetFilesPerSecond(state, files.size());
+}
+
+void BM_ExportGraph(benchmark::State& state, ExportFormat format) {
+  const auto& analyzer = AnalyzerOfSize(static_cast<size_t>(state.range(0)));
+  DiscardBuffer discard;
+  std::ostream out(&discard);
+  ExportStats stats;
+  for (auto _ : state) {
+    stats = ExportGraph(analyzer, "", format, out);
+  }
+  state.counters["edges_per_second"] = benchmark::Counter(
+      static_cast<double>(stats.edges),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
+
+void BM_OpenSnapshot(benchmark::State& state) {
+  const auto num_files = static_cast<size_t>(state.range(0));
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "cpp_deps_bench.snapshot")
+          .string();
+  if (!GraphSnapshot::Save(AnalyzerOfSize(num_files), path)) {
+    state.SkipWithError("failed to save the snapshot");
+    return;
+  }
+  GraphSnapshot snapshot;
+  for (auto _ : state) {
+    if (!snapshot.Open(path)) {
+      state.SkipWithError("failed to open the snapshot");
+      break;
+    }
+  }
+  state.counters["bytes"] = static_cast<double>(snapshot.SizeBytes());
+  std::filesystem::remove(path);
+}
+
+void RegisterBenchmarks() {
+  std::vector<int64_t> sizes;
+  for (size_t size = 1000; size <= max_files; size *= 10) {
+    sizes.push_back(static_cast<int64_t>(size));
+  }
+  std::vector<int64_t> threads{1};
+  if (const unsigned hardware = std::thread::hardware_concurrency();
+      hardware > 1) {
+    threads.push_back(hardware);
+  }
+
+  auto register_phase = [&](const char* name, auto fn, bool parallel,
+                            size_t size_limit) {
+    auto* benchmark = benchmark::RegisterBenchmark(name, fn);
+    benchmark->Unit(benchmark::kMillisecond)->UseRealTime();
+    for (const int64_t size : sizes) {
+      if (static_cast<size_t>(size) > size_limit) {
+        continue;
+      }
+      for (const int64_t thread_count : threads) {
+        if (parallel || thread_count == 1) {
+          benchmark->Args(parallel ? std::vector<int64_t>{size, thread_count}
+                                   : std::vector<int64_t>{size});
+        }
+      }
+    }
+    benchmark->ArgNames(parallel ? std::vector<std::string>{"files", "threads"}
+                                 : std::vector<std::string>{"files"});
+  };
+  register_phase("ParseFiles", BM_ParseFiles, true, max_parsed_files);
+  register_phase("BuildFileDependencies", BM_BuildFileDependencies, true,
+                 max_files);
+  register_phase("SCCBuilder", BM_SCCBuilder, false, max_files);
+  register_phase("DepthLevels", BM_DepthLevels, true, max_files);
+  register_phase("TransitiveReduction", BM_TransitiveReduction, true,
+                 max_files);
+  register_phase("Analyze", BM_Analyze, true, max_files);
+  register_phase("OpenSnapshot", BM_OpenSnapshot, false, max_files);
+
+  for (const char* format : {"mermaid", "dot", "json", "graphml"}) {
+    auto* benchmark = benchmark::RegisterBenchmark(
+        ("ExportGraph/" + std::string(format)).c_str(), BM_ExportGraph,
+        *ParseExportFormat(format));
+    benchmark->Unit(benchmark::kMillisecond)->ArgName("files");
+    for (const int64_t size : sizes) {
+      benchmark->Arg(size);
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  // What is left after Google Benchmark took its own flags
+  int kept = 1;
+  for (int i = 1; i < argc; ++i) {
+    constexpr std::string_view kMaxFiles = "--max_files=";
+    const std::string_view arg = argv[i];
+    if (arg.starts_with(kMaxFiles)) {
+      const auto value = ParseNumber<size_t>(arg.substr(kMaxFiles.size()));
+      if (!value || *value < 1000 ||
+          *value > SyntheticTreeOptions::kMaxFiles) {
+        std::cerr << "--max_files takes a number from 1000 to "
+                  << SyntheticTreeOptions::kMaxFiles << std::endl;
+        return 1;
+      }
+      max_files = *value;
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  RegisterBenchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include "parse_number.h"
+#include "synthetic_tree.h"
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " [--files N] [--fan-out N] [--cycle-density F] "
+               "[--depth N] [--seed N] <output dir>\n"
+               "  --files 1.."
+            << SyntheticTreeOptions::kMaxFiles << ", --fan-out 0.."
+            << SyntheticTreeOptions::kMaxFanOut
+            << ", --cycle-density 0..1, --depth 0.."
+            << SyntheticTreeOptions::kMaxDepth << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  SyntheticTreeOptions options;
+  std::string output;
+
+  // A whole number in [min, max], or nullopt
+  auto bounded = [](const char* text, size_t min, size_t max) {
+    const auto value = ParseNumber<size_t>(text);
+    return value && *value >= min && *value <= max ? value : std::nullopt;
+  };
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.starts_with("--") && i + 1 >= argc) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    std::optional<size_t> count;
+    std::optional<double> density;
+    std::optional<uint64_t> seed;
+    if (arg == "--files" &&
+        (count = bounded(argv[++i], 1, SyntheticTreeOptions::kMaxFiles))) {
+      options.num_files = *count;
+    } else if (arg == "--fan-out" &&
+               (count = bounded(argv[++i], 0,
+                                SyntheticTreeOptions::kMaxFanOut))) {
+      options.fan_out = *count;
+    } else if (arg == "--cycle-density" &&
+               (density = ParseNumber<double>(argv[++i])) &&
+               *density >= 0 && *density <= 1) {
+      options.cycle_density = *density;
+    } else if (arg == "--depth" &&
+               (count = bounded(argv[++i], 0,
+                                SyntheticTreeOptions::kMaxDepth))) {
+      options.directory_depth = *count;
+    } else if (arg == "--seed" && (seed = ParseNumber<uint64_t>(argv[++i]))) {
+      options.seed = *seed;
+    } else if (output.empty() && !arg.starts_with("--")) {
+      output = arg;
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (output.empty()) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  const SyntheticTree tree(options);
+  if (!tree.WriteTo(output)) {
+    std::cerr << "Failed to write the tree to " << output << std::endl;
+    return 1;
+  }
+  std::cerr << "Wrote " << tree.Files().size() << " files with "
+            << tree.NumIncludes() << " includes to " << output << std::endl;
+  return 0;
+}
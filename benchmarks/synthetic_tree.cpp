@@ -0,0 +1,139 @@
+#include "synthetic_tree.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+constexpr size_t kFilesPerDirectory = 64;
+// The modules every other module may use, like a base library
+constexpr size_t kCommonModules = 4;
+
+// SplitMix64: unlike the standard distributions, its output is fixed across
+// standard libraries, which keeps trees identical everywhere
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t Next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  // Uniform in [0, bound)
+  size_t Below(size_t bound) { return static_cast<size_t>(Next() % bound); }
+  // Uniform in [0, 1)
+  double Fraction() { return static_cast<double>(Next() >> 11) * 0x1.0p-53; }
+
+ private:
+  uint64_t state_;
+};
+
+std::string FilePath(size_t file, const SyntheticTreeOptions& options) {
+  std::string path;
+  size_t directory = file / kFilesPerDirectory;
+  std::vector<size_t> levels(options.directory_depth);
+  for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+    *level = directory % options.directories_per_level;
+    directory /= options.directories_per_level;
+  }
+  for (const size_t level : levels) {
+    path += 'd';
+    path += std::to_string(level);
+    path += '/';
+  }
+  path += 'f';
+  path += std::to_string(file);
+  path += ".h";
+  return path;
+}
+
+}  // namespace
+
+SyntheticTree::SyntheticTree(const SyntheticTreeOptions& options)
+    : arena_(std::make_unique<StringArena>()) {
+  const size_t num_files = options.num_files;
+  std::vector<std::string_view> paths;
+  paths.reserve(num_files);
+  for (size_t i = 0; i < num_files; ++i) {
+    paths.push_back(arena_->Intern(FilePath(i, options)));
+  }
+
+  Random random(options.seed);
+  const size_t group_size = std::max<size_t>(options.directories_per_level, 1);
+  auto random_file_of = [&](size_t module) {
+    const size_t first = module * kFilesPerDirectory;
+    return first + random.Below(std::min(kFilesPerDirectory,
+                                         num_files - first));
+  };
+  files_.reserve(num_files);
+  std::vector<size_t> targets;
+  for (size_t i = 0; i < num_files; ++i) {
+    const size_t module = i / kFilesPerDirectory;
+    const size_t position = i % kFilesPerDirectory;
+    const size_t module_end =
+        std::min((module + 1) * kFilesPerDirectory, num_files);
+    targets.clear();
+    for (size_t k = 0; k < options.fan_out; ++k) {
+      if (random.Fraction() < options.cycle_density) {
+        if (i + 1 < module_end) {
+          targets.push_back(i + 1 + random.Below(module_end - i - 1));
+        }
+      } else if (k % 2 == 0 && position > 0) {
+        targets.push_back(i - position + random.Below(position));
+      } else if (module % group_size > 0 && random.Below(4) != 0) {
+        const size_t group_first = module - module % group_size;
+        targets.push_back(
+            random_file_of(group_first + random.Below(module - group_first)));
+      } else if (module >= kCommonModules) {
+        targets.push_back(random_file_of(random.Below(kCommonModules)));
+      } else if (position > 0) {
+        targets.push_back(i - position + random.Below(position));
+      }
+    }
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+    File file;
+    file.name = paths[i];
+    for (const size_t target : targets) {
+      file.included_headers.push_back(paths[target]);
+    }
+    file.defined_classes.push_back(
+        arena_->Intern("Class" + std::to_string(i)));
+    num_includes_ += targets.size();
+    files_.push_back(std::move(file));
+  }
+}
+
+bool SyntheticTree::WriteTo(const std::filesystem::path& root) const {
+  std::error_code ec;
+  std::string content;
+  for (const File& file : files_) {
+    const std::filesystem::path path = root / file.name;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec) {
+      return false;
+    }
+    content = "#pragma once\n\n";
+    for (const auto header : file.included_headers) {
+      content += "#include \"";
+      content += header;
+      content += "\"\n";
+    }
+    content += "\nclass ";
+    content += file.defined_classes.front();
+    content += " {};\n";
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << content;
+    if (!out) {
+      return false;
+    }
+  }
+  return true;
+}
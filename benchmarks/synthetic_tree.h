@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file_parser.h"
+#include "string_arena.h"
+
+struct SyntheticTreeOptions {
+  // Upper bounds for options given on the command line. A tree takes a few
+  // hundred bytes per file in memory; more includes than a module has files
+  // or deeper paths only make every file bigger.
+  static constexpr size_t kMaxFiles = 10000000;
+  static constexpr size_t kMaxFanOut = 64;
+  static constexpr size_t kMaxDepth = 16;
+
+  size_t num_files = 1000;
+  // Includes per file; the first files have fewer, as there is less before
+  // them to include
+  size_t fan_out = 4;
+  // Fraction of includes pointing at a later file of the same module. Each
+  // of them may close a cycle, so this controls how many files end up in
+  // strongly connected components.
+  double cycle_density = 0.01;
+  // Every directory is a module of 64 files, this many directories deep
+  size_t directory_depth = 3;
+  size_t directories_per_level = 8;
+  uint64_t seed = 1;
+};
+
+// A deterministic synthetic C++ tree: the same options give the same files
+// on every run and platform. File i is a header declaring one class and
+// including fan_out other files: half of them earlier in its own module, the
+// rest in earlier modules of the same parent directory or in the first few
+// modules, which play the part of a base library. Like in a real codebase,
+// a file then reaches a bounded number of others however large the tree.
+class SyntheticTree {
+ public:
+  explicit SyntheticTree(const SyntheticTreeOptions& options);
+
+  // What FileParser would report for the tree written by WriteTo; the views
+  // point into this tree
+  const std::vector<File>& Files() const { return files_; }
+  size_t NumIncludes() const { return num_includes_; }
+
+  // Writes every file below root, which is created if needed
+  bool WriteTo(const std::filesystem::path& root) const;
+
+ private:
+  std::unique_ptr<StringArena> arena_;
+  std::vector<File> files_;
+  size_t num_includes_ = 0;
+};
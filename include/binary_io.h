@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 64-bit FNV-1a, used for content hashes and file checksums
+uint64_t Fnv1a64(std::string_view data,
+                 uint64_t seed = 0xcbf29ce484222325ULL);
+
+// Appends little-endian fixed-width integers, LEB128 varints and
+// length-prefixed strings to an in-memory buffer.
+class BinaryWriter {
+ public:
+  void WriteU32(uint32_t value);
+  void WriteU64(uint64_t value);
+  void WriteVarint(uint64_t value);
+  void WriteSignedVarint(int64_t value);  // zigzag encoded
+  void WriteString(std::string_view str);
+  void WriteBytes(std::string_view bytes);
+
+  const std::string& Buffer() const { return buffer_; }
+  std::string& Buffer() { return buffer_; }
+
+ private:
+  std::string buffer_;
+};
+
+// Reads what BinaryWriter wrote. Reading past the end or a malformed varint
+// puts the reader into a failed state (Ok() == false) and every further read
+// returns zero / empty values, so callers can check once at the end.
+class BinaryReader {
+ public:
+  explicit BinaryReader(std::string_view data) : data_(data) {}
+
+  uint32_t ReadU32();
+  uint64_t ReadU64();
+  uint64_t ReadVarint();
+  int64_t ReadSignedVarint();
+  std::string_view ReadString();  // view into the underlying data
+  std::string_view ReadBytes(size_t size);
+
+  bool Ok() const { return ok_; }
+  size_t Position() const { return pos_; }
+  size_t Remaining() const { return ok_ ? data_.size() - pos_ : 0; }
+
+ private:
+  std::string_view data_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
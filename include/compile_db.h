@@ -0,0 +1,48 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Header search directories of one translation unit, absolute and lexically
+// normal. For `#include "..."` the compiler tries the including file's
+// directory, then quote_dirs, then dirs; for `#include <...>` only dirs.
+struct IncludeSearchPath {
+  std::vector<std::string> quote_dirs;  // -iquote
+  std::vector<std::string> dirs;        // -I, then -isystem, then -idirafter
+
+  bool operator==(const IncludeSearchPath&) const = default;
+};
+
+// One entry of a compile_commands.json
+struct CompileCommand {
+  std::string file;  // absolute and lexically normal
+  IncludeSearchPath search_path;
+};
+
+// Splits a "command" string into arguments the way a POSIX shell would:
+// whitespace separates, quotes group, and backslashes escape
+std::vector<std::string> SplitCommandLine(std::string_view command);
+
+// As above, into `arguments`, reusing its elements' buffers
+void SplitCommandLine(std::string_view command,
+                      std::vector<std::string>& arguments);
+
+// The search path set up by the -I / -iquote / -isystem / -idirafter
+// arguments (joined or separate values), in compiler order. Relative
+// directories are taken relative to `directory`.
+IncludeSearchPath ExtractIncludeSearchPath(
+    const std::vector<std::string>& arguments, std::string_view directory);
+
+// Streams a compile_commands.json (https://clang.llvm.org/docs/
+// JSONCompilationDatabase.html) and calls on_command for every entry, in
+// file order. The file is read through a fixed buffer and only the
+// "directory", "file", "command" and "arguments" members are decoded, into
+// buffers reused across entries, so memory does not grow with the file.
+// Returns false, with *error set, when the file cannot be read or is not a
+// JSON array of objects; entries before the error were already reported.
+bool ReadCompileCommands(
+    const std::string& path,
+    const std::function<void(const CompileCommand&)>& on_command,
+    std::string* error);
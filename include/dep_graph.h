@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "string_arena.h"
+
+class ThreadPool;
+
+using NodeId = uint32_t;
+
+// Renumbering that deletes some ids from [0, size) and keeps the rest dense.
+// The highest surviving ids move into the freed slots, so only as many ids
+// change as are deleted; everything else keeps its id.
+struct IdCompaction {
+  static constexpr NodeId kRemoved = std::numeric_limits<NodeId>::max();
+
+  size_t new_size = 0;
+  std::vector<NodeId> removed;                   // ascending
+  std::vector<std::pair<NodeId, NodeId>> moves;  // (old, new), ascending
+
+  // New id of an old id, or kRemoved
+  NodeId Map(NodeId id) const;
+  // Old id of a new id
+  NodeId Origin(NodeId id) const;
+};
+
+IdCompaction PlanIdCompaction(size_t size, std::vector<NodeId> removed);
+
+// Maps node names (file stems) to dense NodeIds and back. Names are stored
+// once in an arena; ids are handed out in first-seen order.
+class NameTable {
+ public:
+  NameTable();
+
+  NodeId Intern(std::string_view name);
+  std::optional<NodeId> Find(std::string_view name) const;
+  std::string_view Name(NodeId id) const { return names_[id]; }
+  size_t Size() const { return names_.size(); }
+  void Compact(const IdCompaction& compaction);
+
+ private:
+  std::unique_ptr<StringArena> arena_;  // boxed so the table stays movable
+  std::vector<std::string_view> names_;
+  std::unordered_map<std::string_view, NodeId> ids_;
+};
+
+// Immutable directed graph in compressed sparse row form: the successors of
+// node n are targets_[offsets_[n] .. offsets_[n + 1]), sorted and unique.
+class CsrGraph {
+ public:
+  using Edge = std::pair<NodeId, NodeId>;
+
+  CsrGraph() = default;
+  // Edges may come in any order and contain duplicates.
+  static CsrGraph FromEdges(size_t num_nodes, std::vector<Edge> edges);
+  // fill_row(node, row) appends the successors of node to the empty row;
+  // they may come in any order and contain duplicates.
+  static CsrGraph FromRows(
+      size_t num_nodes,
+      const std::function<void(NodeId, std::vector<NodeId>&)>& fill_row);
+
+  size_t NumNodes() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+  size_t NumEdges() const { return targets_.size(); }
+  std::span<const NodeId> Neighbors(NodeId node) const {
+    return {targets_.data() + offsets_[node],
+            targets_.data() + offsets_[node + 1]};
+  }
+  bool HasEdge(NodeId from, NodeId to) const;
+  // Same nodes with every edge flipped. With a pool, degrees are counted and
+  // rows filled in parallel; the result is identical either way.
+  CsrGraph Reversed(ThreadPool* pool = nullptr) const;
+  // Renumbers the nodes by compaction and replaces the rows in `rows` (keyed
+  // by new id, sorted and unique), in place. Every other row is its origin's,
+  // so it must not name a renumbered id; rows of new ids past the old size
+  // default to empty. Runs of untouched rows are shifted as blocks, and not
+  // at all before the first row that changes size.
+  void Patch(const IdCompaction& compaction,
+             const std::unordered_map<NodeId, std::vector<NodeId>>& rows);
+
+  const std::vector<uint64_t>& Offsets() const { return offsets_; }
+  const std::vector<NodeId>& Targets() const { return targets_; }
+
+ private:
+  std::vector<uint64_t> offsets_;
+  std::vector<NodeId> targets_;
+};
+
+// Keeps reversed, the reverse of graph, in step with graph.Patch(compaction,
+// rows); call it before patching graph. Only the rows of nodes gaining or
+// losing a dependent, or depended on by a renumbered node, are rebuilt.
+void PatchReverse(CsrGraph& reversed, const CsrGraph& graph,
+                  const IdCompaction& compaction,
+                  const std::unordered_map<NodeId, std::vector<NodeId>>& rows);
+
+// Non-owning view of a graph in CSR form, over a CsrGraph or over arrays kept
+// elsewhere, such as a mapped GraphSnapshot
+class CsrView {
+ public:
+  CsrView() = default;
+  CsrView(std::span<const uint64_t> offsets, std::span<const NodeId> targets)
+      : offsets_(offsets), targets_(targets) {}
+  // Implicit, so a CsrGraph can be passed wherever a view is taken
+  CsrView(const CsrGraph& graph)
+      : CsrView(graph.Offsets(), graph.Targets()) {}
+
+  size_t NumNodes() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+  size_t NumEdges() const { return targets_.size(); }
+  std::span<const NodeId> Neighbors(NodeId node) const {
+    return targets_.subspan(offsets_[node],
+                            offsets_[node + 1] - offsets_[node]);
+  }
+
+  std::span<const uint64_t> Offsets() const { return offsets_; }
+  std::span<const NodeId> Targets() const { return targets_; }
+
+ private:
+  std::span<const uint64_t> offsets_;
+  std::span<const NodeId> targets_;
+};
+
+// Groups the nodes of a DAG by height, the length of the longest path from
+// the node to a node without dependencies. Level k only depends on levels
+// below k, so the nodes of one level can be processed concurrently. Levels
+// are built level-synchronously over the reversed graph; every level is
+// sorted by id.
+std::vector<std::vector<NodeId>> ComputeHeightLevels(
+    const CsrGraph& dag, ThreadPool* pool = nullptr);
+
+class FileDepGraphBuilder;
+
+// File level dependency graph: one node per file stem, so that x.h and
+// x.cpp collapse into the same node.
+class FileDepGraph {
+ public:
+  FileDepGraph() = default;
+  FileDepGraph(NameTable names, CsrGraph deps)
+      : names_(std::move(names)), deps_(std::move(deps)) {}
+
+  const NameTable& Names() const { return names_; }
+  const CsrGraph& Graph() const { return deps_; }
+
+  // Container-style access by name, mirroring the former string-keyed map
+  size_t size() const { return names_.Size(); }
+  // Throws std::out_of_range for unknown names
+  std::span<const NodeId> at(std::string_view name) const;
+
+ private:
+  friend class FileDepGraphBuilder;
+
+  NameTable names_;
+  CsrGraph deps_;
+};
@@ -1,26 +1,47 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
-#include <map>
+#include <memory>
 #include <optional>
-#include <set>
+#include <string>
 #include <string_view>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
+#include "dep_graph.h"
+#include "file_dep_builder.h"
 #include "file_parser.h"
+#include "keyword_index.h"
+#include "render_cache.h"
+
+class ReachabilityIndex;
+class ThreadPool;
+
+// include_paths are extra search paths for includes, relative to the analyzed
+// directories (see HeaderResolver). With a pool, includes are resolved in
+// parallel; the graph is the same either way.
+FileDepGraph BuildFileDependencies(
+    const std::vector<File>& files,
+    const std::vector<std::string>& include_paths = {},
+    ThreadPool* pool = nullptr);
+
+struct AnalyzerOptions {
+  std::vector<std::string> include_paths;
+  // Threads for the analysis phases (0 = one per hardware thread). Ignored
+  // when a shared pool is given, which must outlive the analyzer.
+  unsigned jobs = 1;
+  ThreadPool* pool = nullptr;
+  // Bound on the rendered subgraphs kept for repeated keyword queries
+  size_t render_cache_bytes = size_t{64} << 20;
+};
 
-using StrDepMap = std::unordered_map<std::string, std::set<std::string>>;
-
-StrDepMap BuildFileDependencies(const std::vector<File>& files);
-
-using SccIdx = int;
-using SccDepMap = std::unordered_map<SccIdx, std::set<SccIdx>>;
+// Components are the nodes of the condensed graph, so they share NodeId
+using SccIdx = NodeId;
 
 struct SCCComponent {
   std::string name;                  // Concatenated name of SCC members
   std::vector<std::string> members;  // Actual members of the SCC
+  std::vector<NodeId> member_ids;    // The members as file graph nodes
 
   SCCComponent(const std::string& name, const std::vector<std::string>& members)
       : name(name), members(members) {}
@@ -31,71 +52,137 @@ struct SCCComponent {
 
 class SCCBuilder {
  public:
-  explicit SCCBuilder(const StrDepMap& file_deps);
+  // How ApplyFileUpdate changed the components. Components are numbered in
+  // "pre" ids: the ids before the update followed by the components it added.
+  struct Update {
+    size_t old_num_components = 0;
+    IdCompaction compaction;  // pre ids -> ids after the update
+    // Components (new ids) with new members or new dependencies
+    std::vector<SccIdx> changed;
+    // Components (old ids) reaching a removed or moved one, ascending
+    std::vector<SccIdx> renumbered_dependents;
+  };
+
+  explicit SCCBuilder(const FileDepGraph& file_deps);
+
+  // Catches up with file_deps after it was patched as described by
+  // file_update. Only the files of `affected` (old ids) and the new files go
+  // through Tarjan again, so `affected` must cover every component that may
+  // split or merge, including those of removed files. A component whose
+  // members did not change keeps its id.
+  Update ApplyFileUpdate(const FileDepGraphBuilder::Update& file_update,
+                         std::vector<SccIdx> affected);
 
-  std::optional<SccIdx> GetComponentIndex(const std::string& file) const;
+  std::optional<SccIdx> GetComponentIndex(std::string_view file) const;
+  SccIdx GetComponentOf(NodeId file) const { return file_to_component_[file]; }
   const std::vector<SCCComponent>& GetSCCComponents() const {
     return scc_components_;
   };
-  const SccDepMap& GetSCCDeps() const { return component_deps_; };
+  // The condensed graph: an edge per pair of components with a file level
+  // dependency between them
+  const CsrGraph& GetSCCDeps() const { return component_deps_; };
+  // The condensed graph reversed, kept in step with it
+  const CsrGraph& GetSCCDependents() const { return component_dependents_; }
   std::string ToDescription() const;
 
  private:
-  const StrDepMap& file_deps_;  // Store file dependencies
-  std::unordered_map<std::string, SccIdx> file_to_component_;
+  const FileDepGraph& file_deps_;  // Store file dependencies
+  std::vector<SccIdx> file_to_component_;
   std::vector<SCCComponent> scc_components_;
-  SccDepMap component_deps_;
+  CsrGraph component_deps_;
+  CsrGraph component_dependents_;
 
  private:
+  struct TarjanState;
+
   void BuildSCC();
   void BuildSCCNames();
+  void NameComponent(SCCComponent& component) const;
   void BuildSCCDependencies();
-  void TarjanSCC(const std::string& node, std::vector<std::string>& stack,
-                 std::map<std::string, int>& index,
-                 std::map<std::string, int>& lowlink,
-                 std::map<std::string, bool>& on_stack, int& index_counter);
+  void TarjanSCC(NodeId root, TarjanState& state,
+                 std::vector<SCCComponent>& out) const;
 };
 
 class DependencyAnalyzer {
  public:
-  DependencyAnalyzer(const std::vector<File>& files);
+  DependencyAnalyzer(const std::vector<File>& files,
+                     const AnalyzerOptions& options = {});
+  ~DependencyAnalyzer();
+  // Brings every result up to date with the changed files. Work is limited
+  // to the includes naming the changed files, the components that may split
+  // or merge, and the components depending on changed ones; the results are
+  // the same as a rebuild over the updated file list.
+  void ApplyDelta(const FileDelta& delta);
   void Summary();
   std::string GenerateMermaidGraph(const std::string& keyword = "") const;
+  // Components whose name contains keyword, ascending; all of them for an
+  // empty keyword
+  std::vector<SccIdx> FindComponents(std::string_view keyword) const;
+  // Renderings of the current graph, cached under key by an LRU cache that
+  // ApplyDelta clears; key must name everything else the rendering depends
+  // on. Thread safe.
+  std::shared_ptr<const std::string> GetOrRender(
+      const std::string& key, const std::function<std::string()>& render) const;
+  RenderCache::Stats GetRenderCacheStats() const {
+    return render_cache_->GetStats();
+  }
 
  private:
+  std::unique_ptr<ThreadPool> owned_pool_;
+  ThreadPool* pool_;  // null when running on the calling thread
   int max_depth_;
-  StrDepMap file_deps_;
+  std::unique_ptr<FileDepGraphBuilder> file_graph_;
   SCCBuilder scc_;
   const std::vector<SCCComponent>& components_vec_;
   // say A -> {B, C}, B -> {C} in file_deps_
   // we will remove the transisive deps of C in A
   // So it becomes A -> {B}, B -> {C}
   // this is to simplified the mermaid graph
-  SccDepMap simplified_component_deps_;
+  CsrGraph simplified_component_deps_;
+  // Reachability over the components, kept for ApplyDelta
+  std::unique_ptr<ReachabilityIndex> reachability_;
   std::vector<SccIdx> topoplogical_sorted_sccs_;
-  std::unordered_map<SccIdx, int> depth_map_;
-  std::unordered_map<int, std::vector<SccIdx>> depth_to_component_idx_map_;
+  std::vector<int> depth_map_;  // indexed by SccIdx
+  // Components grouped by depth, each group sorted by SccIdx
+  std::vector<std::vector<SccIdx>> depth_to_component_idx_map_;
+  KeywordIndex keyword_index_;  // over component names
+  std::unique_ptr<RenderCache> render_cache_;
 
  public:
   // Getters for const reference access to private members
   const std::vector<SccIdx>& GetTopologicalSortedSCCs() const {
     return topoplogical_sorted_sccs_;
   }
-  const StrDepMap& GetFileDependencies() const { return file_deps_; }
+  const FileDepGraph& GetFileDependencies() const {
+    return file_graph_->Graph();
+  }
   const std::vector<SCCComponent>& GetStronglyConnectedComponents() const {
     return components_vec_;
   }
+  // The condensed graph before transitive edges are removed
+  const CsrGraph& GetComponentDeps() const { return scc_.GetSCCDeps(); }
+  const CsrGraph& GetSimplifiedComponentDeps() const {
+    return simplified_component_deps_;
+  }
+  // Indexed by SccIdx
+  const std::vector<int>& GetComponentDepths() const { return depth_map_; }
+  // What each component reaches in the condensed graph
+  const ReachabilityIndex& GetComponentReachability() const {
+    return *reachability_;
+  }
+  SccIdx GetComponentOf(NodeId file) const { return scc_.GetComponentOf(file); }
+  // The live files, in the order a rebuild would take them
+  std::vector<File> GetFiles() const { return file_graph_->Files(); }
 
  private:
   void PruneTransitiveDependencies();
-  void CollectTransitiveDependencies(
-      SccIdx component_idx, std::unordered_set<SccIdx>& reachable_indices);
   void TopologicalSortSCCDependencies();
-  void Dfs(SccIdx component_idx, std::set<SccIdx>& visited);
   void BuildMinDepthRelation();
+  std::vector<SccIdx> FindAffectedComponents(
+      const FileDepGraphBuilder::Update& file_update) const;
+  void UpdateComponentRelations(const SCCBuilder::Update& update);
 };
 
 std::string GenerateMermaidGraphWithKeyword(
     const std::vector<SCCComponent>& components_vec,
-    const std::unordered_map<int, std::set<int>>& component_deps,
-    const std::string& keyword);
+    const CsrGraph& component_deps, const std::string& keyword);
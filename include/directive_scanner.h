@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+// Result of scanning one source buffer. Every view points into the scanned
+// buffer, so the buffer must outlive the result.
+struct ScannedDirectives {
+  // Targets of `#include <...>` / `#include "..."` that look like headers
+  std::vector<std::string_view> included_headers;
+  // Per included header: written as `#include <...>`, so the compiler does
+  // not look next to the including file
+  std::vector<bool> angled_includes;
+  // Identifiers following the `class` / `struct` keywords; kFull only
+  std::vector<std::string_view> defined_classes;
+};
+
+// What ScanDirectives extracts
+enum class ScanProfile {
+  // Include directives only, which is all a dependency graph needs. Lexing
+  // stops at the first code outside the preprocessor preamble (leading
+  // directives and comments); the rest of the file is only searched for a
+  // line starting with `#include`, and lexed after all when it has one, so
+  // the result always matches kFull.
+  kIncludesOnly,
+  // Include directives and class names, lexing the whole file
+  kFull,
+};
+
+// Regex-free scanner over a whole file buffer. It jumps between candidate
+// bytes (`#`, comment and literal openers, and, with kFull, the `cl` / `st`
+// prefixes of `class` / `struct`) with a vectorized byte search, and skips
+// comments, string literals (including raw strings) and character literals.
+ScannedDirectives ScanDirectives(std::string_view source,
+                                 ScanProfile profile = ScanProfile::kFull);
+
+// Name of the byte-search kernel picked for this CPU: "avx2", "sse2" or
+// "scalar".
+std::string_view DirectiveScannerKernel();
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+// std::ostream writing to a file descriptor through a fixed-size buffer.
+// Whenever the buffer fills it goes straight to the descriptor, so memory
+// stays bounded however much is written. Does not own the descriptor.
+class FdOutputStream : public std::ostream {
+ public:
+  explicit FdOutputStream(int fd, size_t buffer_size = 64 * 1024);
+  ~FdOutputStream() override;
+
+  FdOutputStream(const FdOutputStream&) = delete;
+  FdOutputStream& operator=(const FdOutputStream&) = delete;
+
+  // Bytes handed to the descriptor so far
+  size_t BytesWritten() const { return buffer_.BytesWritten(); }
+
+ private:
+  class Buffer : public std::streambuf {
+   public:
+    Buffer(int fd, size_t size);
+    size_t BytesWritten() const { return written_; }
+
+   protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* data, std::streamsize count) override;
+    int sync() override;
+
+   private:
+    int fd_;
+    std::vector<char> buffer_;
+    size_t written_ = 0;
+
+    bool Flush();
+    bool WriteAll(const char* data, size_t size);
+  };
+
+  Buffer buffer_;
+};
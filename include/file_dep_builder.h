@@ -0,0 +1,88 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "dep_graph.h"
+#include "file_parser.h"
+#include "header_resolver.h"
+#include "string_arena.h"
+
+class ThreadPool;
+
+// Same as std::filesystem::path::stem() for '/' separated paths, without
+// allocating. File graph nodes are named by it.
+std::string_view GetFileStem(std::string_view path);
+
+// Builds the file level graph of BuildFileDependencies and keeps it current
+// as files change. It owns copies of the parts of the file records the graph
+// reads (names and includes, not defined_classes), and re-resolves only the
+// includes a delta can affect: those of the changed files, and those naming
+// a file that appeared or disappeared.
+class FileDepGraphBuilder {
+ public:
+  // How the last delta changed Graph(). Nodes are numbered in "pre" ids:
+  // the ids before the delta, followed by the nodes the delta introduced.
+  struct Update {
+    size_t old_num_nodes = 0;  // pre ids from here on are new nodes
+    IdCompaction compaction;   // pre ids -> ids of the updated graph
+    std::vector<CsrGraph::Edge> added_edges;    // in pre ids
+    std::vector<CsrGraph::Edge> removed_edges;  // in pre ids
+
+    bool empty() const {
+      return added_edges.empty() && removed_edges.empty() &&
+             compaction.removed.empty() &&
+             compaction.new_size == old_num_nodes;
+    }
+  };
+
+  FileDepGraphBuilder(const std::vector<File>& files,
+                      std::vector<std::string> include_paths,
+                      ThreadPool* pool = nullptr);
+
+  FileDepGraphBuilder(const FileDepGraphBuilder&) = delete;
+  FileDepGraphBuilder& operator=(const FileDepGraphBuilder&) = delete;
+
+  const FileDepGraph& Graph() const { return graph_; }
+  FileDepGraph TakeGraph() && { return std::move(graph_); }
+  // The live files, in the order a full rebuild would see them, without
+  // their defined_classes
+  std::vector<File> Files() const;
+
+  Update ApplyDelta(const FileDelta& delta);
+
+ private:
+  using FileSlot = uint32_t;
+
+  ThreadPool* pool_;
+  StringArena strings_;
+  // One slot per file ever seen; removed files keep their slot with an empty
+  // name so that slot order stays the file order
+  std::vector<File> files_;
+  HeaderResolver resolver_;  // indexes files_
+  // Resolved include targets of each file, one per resolved include
+  std::vector<std::vector<FileSlot>> targets_;
+  // Files including some path whose last component is the key
+  std::unordered_map<std::string_view, std::vector<FileSlot>>
+      includers_by_filename_;
+  std::unordered_map<std::string_view, std::vector<FileSlot>> files_by_stem_;
+  // Resolved includes each node takes part in; a node exists while this is
+  // non-zero
+  std::vector<uint32_t> node_refs_;
+  FileDepGraph graph_;
+
+ private:
+  File CopyFile(const File& file);
+  void IndexFile(FileSlot slot);
+  void UnindexFile(FileSlot slot);
+  std::vector<HeaderResolver::Resolution> Resolve(FileSlot slot) const;
+  // Records slot's resolved includes as node references; with report,
+  // unresolved and ambiguous includes are logged
+  void CommitResolutions(FileSlot slot,
+                         const std::vector<HeaderResolver::Resolution>& found,
+                         NameTable& names, bool report);
+  std::vector<NodeId> StemRow(NodeId node, const NameTable& names) const;
+};
@@ -1,20 +1,130 @@
 #pragma once
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+#include "source_walker.h"
+#include "string_arena.h"
+
+class ParseCache;
+class ThreadPool;
+
+// The strings of a File are views into the StringArena of the FileParser that
+// produced it (or into static storage for hand-written records), so parsed
+// files must not outlive their parser.
 struct File {
-  std::string name;
-  std::vector<std::string> included_headers;
-  std::vector<std::string> defined_classes;
+  std::string_view name;
+  std::vector<std::string_view> included_headers;
+  // Left empty by parsing, which only scans includes; filled on demand by
+  // FileParser::GetDefinedClasses
+  std::vector<std::string_view> defined_classes;
+  // Size of the source, for include cost analysis; zero when unknown
+  uint64_t bytes = 0;
+  uint64_t lines = 0;
 };
 
+// Changed parse results, keyed by File::name. Files in `added` and
+// `modified` replace any file of the same name, so the two lists only differ
+// in intent. The views only need to stay valid during the call.
+struct FileDelta {
+  std::vector<File> added;
+  std::vector<File> modified;
+  std::vector<std::string> removed;
+
+  bool empty() const {
+    return added.empty() && modified.empty() && removed.empty();
+  }
+};
+
+// Slice `index` of `count` near-equal contiguous slices of [0, size)
+inline std::pair<size_t, size_t> SliceBounds(size_t size, size_t index,
+                                             size_t count) {
+  return {size * index / count, size * (index + 1) / count};
+}
+
 class FileParser {
  public:
+  // jobs == 1 parses on the calling thread, jobs == 0 uses one thread per
+  // hardware thread. Results are in directory-walk order either way.
+  explicit FileParser(unsigned jobs = 1);
+  // Parses on a pool shared with other phases; it must outlive the parser
+  explicit FileParser(ThreadPool& pool);
+  ~FileParser();
+
+  // Parses the sources found by a SourceWalker below the directory, in
+  // walk order. What was left out is summarized on stderr.
   void ParseFilesUnder(std::string_view directory);
+  // Like ParseFilesUnder, but parses only slice `index` of `count`
+  // contiguous slices of the walk (see SliceBounds), and returns how many
+  // sources the whole walk found. Processes parsing the other slices of the
+  // same tree can thus be merged back into ParseFilesUnder's result.
+  size_t ParseSliceOf(std::string_view directory, size_t index, size_t count);
+  // Exclude / only globs and .gitignore handling for ParseFilesUnder and
+  // Reparse. Call before the first ParseFilesUnder.
+  void SetWalkOptions(const WalkOptions& options);
+  // Parses the translation units of a compile_commands.json and the files
+  // they include, and nothing else. Each include is resolved the way the
+  // compiler would for every translation unit reaching it: next to the
+  // including file for `#include "..."`, then along the unit's -iquote, -I,
+  // -isystem and -idirafter directories. Files are named relative to their
+  // deepest common directory, and every include of the results names the
+  // file it resolved to, relative to the includer's directory, so later
+  // analysis follows exactly these edges. Includes found on no search
+  // directory (system headers) are dropped. The parse cache is not used.
+  // Returns false, after reporting on stderr, when the database cannot be
+  // read.
+  bool ParseCompileCommands(const std::string& compile_commands_path);
   const std::vector<File>& GetParsedFiles() const;
 
+  // Classes and structs defined by GetParsedFiles()[file_index]. Parsing
+  // stops scanning a file once its includes are known, so the first call
+  // for a file scans it again in full, from disk, and stores the result in
+  // its defined_classes; later calls return that. Not thread-safe.
+  const std::vector<std::string_view>& GetDefinedClasses(size_t file_index);
+
+  // Brings GetParsedFiles() up to date after the given paths changed on
+  // disk, and returns the change. A path may name a file or a directory, and
+  // may no longer exist: every source file at or below it is parsed again,
+  // and parsed files that are gone or no longer pass the filter are dropped.
+  // Paths outside the parsed directories are ignored. New files are
+  // appended, so the order may differ from a fresh directory walk.
+  FileDelta Reparse(const std::vector<std::string>& paths);
+
+  // Reuses results from the parse cache at cache_path for files whose size
+  // and mtime (or, with hash_contents, size and content hash) are unchanged.
+  // Call before the first ParseFilesUnder; SaveCache() writes it back.
+  void EnableCache(std::string cache_path, bool hash_contents = false);
+  bool SaveCache() const;
+  const ParseCache* GetCache() const { return cache_.get(); }  // may be null
+
+  // Number of distinct strings and their total bytes across all arenas
+  size_t GetInternedStringCount() const;
+  size_t GetInternedStringBytes() const;
+
  private:
   std::vector<File> parsed_files_;
-  File ParseFile(std::string_view file_path, std::string_view relative_to_path);
-};
\ No newline at end of file
+  // Absolute path of each parsed file, and the directories given to
+  // ParseFilesUnder, for Reparse
+  std::vector<std::string> parsed_paths_;
+  std::vector<std::string> directories_;
+  SourceWalker walker_;
+  // Per parsed file: defined_classes has been filled in
+  std::vector<bool> classes_scanned_;
+  std::unique_ptr<ThreadPool> owned_pool_;
+  ThreadPool* pool_ = nullptr;  // null when parsing on the calling thread
+  // One arena for the calling thread plus one per worker, so interning needs
+  // no locking
+  std::vector<std::unique_ptr<StringArena>> arenas_;
+  std::unique_ptr<ParseCache> cache_;
+
+  struct ParseResult;
+  void CreateArenas();
+  ParseResult ParseFile(const std::string& file_path,
+                        std::string_view relative_to_path,
+                        StringArena& arena) const;
+  static File ParseContent(std::string_view name, std::string_view content,
+                           StringArena& arena);
+};
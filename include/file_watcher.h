@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Reports changes below a set of directories, through inotify (Linux only).
+// Every directory below the added ones is watched, including directories
+// created later. Changes are collected into debounced batches, so the burst
+// of events of a single editor save arrives as one batch.
+class FileWatcher {
+ public:
+  static constexpr std::chrono::milliseconds kNoTimeout{-1};
+
+  struct Batch {
+    // Absolute paths of the changed files. A directory is listed when it
+    // appeared, disappeared, or when events below it were lost; everything
+    // below it should be considered changed.
+    std::vector<std::string> paths;
+    // When the first event of the batch was read
+    std::chrono::steady_clock::time_point first_change;
+  };
+
+  // A batch is complete once `debounce` passes without a new event, or at
+  // the latest a second after its first event
+  explicit FileWatcher(std::chrono::milliseconds debounce);
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  // Watches directory and every directory below it. Returns false when
+  // inotify is unavailable or directory cannot be watched.
+  bool AddDirectory(std::string_view directory);
+
+  // Blocks until a batch is complete. Returns nullopt when `timeout` passes
+  // without any change, or when reading events fails.
+  std::optional<Batch> WaitForChanges(
+      std::chrono::milliseconds timeout = kNoTimeout);
+
+ private:
+  int fd_;
+  std::chrono::milliseconds debounce_;
+  std::unordered_map<int, std::string> watched_;  // watch descriptor -> dir
+  std::vector<std::string> roots_;
+
+ private:
+  bool WatchTree(const std::string& directory);
+  void UnwatchTree(const std::string& directory);
+  // Returns >0 when events are ready, 0 on timeout and <0 on error
+  int Poll(std::chrono::milliseconds timeout) const;
+  bool ReadEvents(std::set<std::string>& changed);
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dependency_analyzer.h"
+#include "json.h"
+#include "source_walker.h"
+#include "string_arena.h"
+
+// The dependency structure of one revision, in numbers
+struct RevisionMetrics {
+  std::string revision;
+  size_t files = 0;          // source files in the tree
+  size_t changed_files = 0;  // added, modified or removed since the last one
+  size_t parsed_blobs = 0;   // the others came from the blob cache
+  size_t nodes = 0;          // file graph nodes (stems)
+  size_t edges = 0;          // file graph edges
+  size_t components = 0;
+  size_t cyclic_components = 0;  // with more than one member
+  size_t largest_component = 0;  // members
+  int max_depth = 0;
+  size_t simplified_edges = 0;  // component edges after transitive pruning
+  double milliseconds = 0;
+
+  JsonValue ToJson() const;
+};
+
+// Follows the dependency structure of a local git repository across a
+// series of revisions without checking anything out.
+//
+// The first revision's source files are listed with `git ls-tree`; after
+// that only `git diff-tree` against the previous revision is read, so the
+// tree is kept up to date at the cost of what changed. Contents come from
+// one long-running `git cat-file --batch`. Parse results are cached by blob
+// id, so a blob is scanned once however many revisions contain it, and the
+// analysis is updated with DependencyAnalyzer::ApplyDelta, for the files
+// whose includes changed only. The work per revision thus follows the
+// churn, not the size of the repository.
+//
+// Files are named by their path in the repository and filtered like a
+// directory walk with the given options, except that .gitignore does not
+// apply: the tree only has tracked files. A git process that exits early
+// makes writes to it raise SIGPIPE, which callers should ignore.
+class GitHistoryAnalyzer {
+ public:
+  explicit GitHistoryAnalyzer(std::string repository,
+                              const WalkOptions& walk_options = {},
+                              AnalyzerOptions analyzer_options = {});
+  ~GitHistoryAnalyzer();
+
+  // Moves to `revision` (anything git rev-parse accepts) and measures it.
+  // Returns nullopt, with *error set, when git fails, e.g. for an unknown
+  // revision; the state stays at the previous revision.
+  std::optional<RevisionMetrics> Analyze(const std::string& revision,
+                                         std::string* error);
+
+  // Distinct blobs parsed so far
+  size_t CachedBlobs() const { return blobs_.size(); }
+
+ private:
+  struct ParsedBlob {
+    std::vector<std::string_view> included_headers;  // into arena_
+    uint64_t bytes = 0;
+    uint64_t lines = 0;
+  };
+  class BlobReader;
+
+  std::string repository_;
+  SourceWalker walker_;
+  AnalyzerOptions analyzer_options_;
+  StringArena arena_;
+  std::unique_ptr<BlobReader> blob_reader_;
+  std::unordered_map<std::string, ParsedBlob> blobs_;  // by blob id
+  std::map<std::string, std::string> tree_;  // source path -> blob id
+  std::string tree_revision_;                // commit id of tree_
+  std::unique_ptr<DependencyAnalyzer> analyzer_;
+  std::string contents_;  // of the blob being parsed, reused
+
+  const ParsedBlob* Parse(const std::string& blob, std::string* error);
+  File MakeFile(const std::string& path, const ParsedBlob& blob);
+  void Measure(RevisionMetrics& metrics) const;
+};
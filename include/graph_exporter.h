@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dependency_analyzer.h"
+#include "graph_snapshot.h"
+
+enum class ExportFormat { kMermaid, kDot, kJson, kGraphml };
+
+// "mermaid", "dot", "json" or "graphml"
+std::optional<ExportFormat> ParseExportFormat(std::string_view name);
+
+// Names and members of the components an exporter draws
+class ComponentTable {
+ public:
+  virtual ~ComponentTable() = default;
+
+  virtual std::string_view Name(SccIdx component_idx) const = 0;
+  virtual size_t NumMembers(SccIdx component_idx) const = 0;
+  virtual std::string_view Member(SccIdx component_idx, size_t i) const = 0;
+};
+
+// Over the components of a DependencyAnalyzer
+class SccComponentTable : public ComponentTable {
+ public:
+  explicit SccComponentTable(const std::vector<SCCComponent>& components)
+      : components_(components) {}
+
+  std::string_view Name(SccIdx component_idx) const override {
+    return components_[component_idx].name;
+  }
+  size_t NumMembers(SccIdx component_idx) const override {
+    return components_[component_idx].members.size();
+  }
+  std::string_view Member(SccIdx component_idx, size_t i) const override {
+    return components_[component_idx].members[i];
+  }
+
+ private:
+  const std::vector<SCCComponent>& components_;
+};
+
+// Writes a graph of components to a stream as it is handed over: Begin(),
+// Node() for every component, Edge() for every edge, End(). Nothing is
+// buffered beyond the stream's own buffer, and nothing is allocated per edge.
+class GraphExporter {
+ public:
+  GraphExporter(std::ostream& out, const ComponentTable& components)
+      : out_(out), components_(components) {}
+  virtual ~GraphExporter() = default;
+
+  virtual void Begin() {}
+  virtual void Node(SccIdx component_idx) = 0;
+  virtual void Edge(SccIdx from, SccIdx to) = 0;
+  virtual void End() {}
+
+ protected:
+  std::ostream& out_;
+  const ComponentTable& components_;
+};
+
+std::unique_ptr<GraphExporter> MakeGraphExporter(
+    ExportFormat format, std::ostream& out, const ComponentTable& components);
+
+struct ExportStats {
+  size_t nodes = 0;
+  size_t edges = 0;
+};
+
+// Streams the part of component_deps reachable from roots: the components in
+// depth-first order from each root in turn, then the edges between them in
+// the same order. Only the visit order is kept in memory.
+ExportStats ExportGraph(CsrView component_deps,
+                        const std::vector<SccIdx>& roots,
+                        GraphExporter& exporter);
+
+// The simplified graph of the components matching keyword and everything they
+// depend on (the whole graph for an empty keyword)
+ExportStats ExportGraph(const DependencyAnalyzer& analyzer,
+                        std::string_view keyword, ExportFormat format,
+                        std::ostream& out);
+// Same for a mapped snapshot, whose keyword matches are found by a scan
+ExportStats ExportGraph(const GraphSnapshot& snapshot,
+                        std::string_view keyword, ExportFormat format,
+                        std::ostream& out);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dep_graph.h"
+#include "dependency_analyzer.h"
+
+// Read-only view of an analyzed graph, mapped from a snapshot file. Every
+// accessor points straight into the mapping, so opening costs a checksum
+// pass at most and nothing is deserialized.
+//
+// File layout (little-endian; only little-endian hosts build this):
+//   Header: u32 magic 'CDAS', u32 format version, u64 file size,
+//     u64 Fnv1a64 of everything after the header, u32 file count,
+//     u32 component count, then (offset, byte size) of every section
+//   Sections, each 8-byte aligned:
+//     file names: u64 offsets (files + 1) into the name characters, the
+//       characters, and u32 file ids sorted by name for lookups
+//     file graph: u64 CSR offsets, u32 targets
+//     u32 component of every file
+//     component names: u64 offsets (components + 1), characters
+//     component members: u64 offsets, u32 file ids
+//     condensed and simplified component graphs: u64 offsets, u32 targets
+//     u32 topological order, i32 depth of every component
+// Open() rejects a file with the wrong magic or version, a size or section
+// that does not add up, or a checksum mismatch.
+class GraphSnapshot {
+ public:
+  // Bump whenever the layout or the meaning of a section changes
+  static constexpr uint32_t kFormatVersion = 1;
+
+  GraphSnapshot() = default;
+  ~GraphSnapshot();
+
+  GraphSnapshot(const GraphSnapshot&) = delete;
+  GraphSnapshot& operator=(const GraphSnapshot&) = delete;
+
+  // Writes the analyzer's results to a temporary file renamed to path
+  static bool Save(const DependencyAnalyzer& analyzer,
+                   const std::string& path);
+
+  // Maps path, replacing any snapshot opened before. Skipping the checksum
+  // makes opening O(1) but trusts the content of the file.
+  bool Open(const std::string& path, bool verify_checksum = true);
+  bool IsOpen() const { return data_ != nullptr; }
+  size_t SizeBytes() const { return size_; }
+
+  size_t NumFiles() const { return views_.num_files; }
+  std::string_view FileName(NodeId file) const;
+  std::optional<NodeId> FindFile(std::string_view name) const;
+  CsrView FileDeps() const { return views_.file_deps; }
+  SccIdx ComponentOf(NodeId file) const {
+    return views_.file_components[file];
+  }
+
+  size_t NumComponents() const { return views_.num_components; }
+  std::string_view ComponentName(SccIdx component_idx) const;
+  std::span<const NodeId> ComponentMembers(SccIdx component_idx) const {
+    return views_.component_members.Neighbors(component_idx);
+  }
+  // The condensed graph, and the same with transitive edges removed
+  CsrView ComponentDeps() const { return views_.component_deps; }
+  CsrView SimplifiedComponentDeps() const { return views_.simplified_deps; }
+  std::span<const SccIdx> TopologicalOrder() const {
+    return views_.topo_order;
+  }
+  std::span<const int32_t> ComponentDepths() const { return views_.depths; }
+
+  // Components whose name contains keyword, ascending, by a scan of the
+  // names; all of them for an empty keyword
+  std::vector<SccIdx> FindComponents(std::string_view keyword) const;
+
+ private:
+  // Everything below points into the mapping
+  struct Views {
+    size_t num_files = 0;
+    size_t num_components = 0;
+    std::span<const uint64_t> file_name_offsets;
+    std::span<const char> file_name_chars;
+    std::span<const NodeId> files_by_name;
+    CsrView file_deps;
+    std::span<const SccIdx> file_components;
+    std::span<const uint64_t> component_name_offsets;
+    std::span<const char> component_name_chars;
+    CsrView component_members;  // component -> member files, in order
+    CsrView component_deps;
+    CsrView simplified_deps;
+    std::span<const SccIdx> topo_order;
+    std::span<const int32_t> depths;
+  };
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  Views views_;
+
+ private:
+  bool BindViews(bool verify_checksum);
+  void Close();
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "file_parser.h"
+
+// Maps `#include` targets to parsed files. Built once over all files, after
+// which every lookup costs O(include path length):
+//
+//  1. the include relative to the including file's directory,
+//  2. the include under each user supplied search path, in order,
+//  3. the parsed file sharing the longest trailing run of path components
+//     with the include (a trie over reversed path components), e.g.
+//     "net/socket.h" prefers "src/net/socket.h" over "src/os/socket.h".
+//
+// Search paths are relative to the analyzed directories, like File::name.
+// When several files tie in step 3, the first one in `files` order wins and
+// the resolution is flagged as ambiguous.
+//
+// The index follows later changes to `files` through AddFile / RemoveFile;
+// only the entries sharing the file name are touched.
+class HeaderResolver {
+ public:
+  struct Resolution {
+    std::optional<size_t> file_idx;  // index into the files given at build
+    size_t candidate_count = 0;      // > 1 when the match was ambiguous
+  };
+
+  explicit HeaderResolver(const std::vector<File>& files,
+                          std::vector<std::string> include_paths = {});
+
+  Resolution Resolve(const File& includer, std::string_view include) const;
+  // The first indexed file with exactly this name
+  std::optional<size_t> FindFile(std::string_view name) const;
+
+  // files[idx] was appended after every indexed file
+  void AddFile(size_t idx);
+  // Call while files[idx] still holds its name
+  void RemoveFile(size_t idx);
+
+ private:
+  using TrieNodeIdx = uint32_t;
+  static constexpr TrieNodeIdx kRoot = 0;
+
+  struct TrieNode {
+    size_t first_file;  // lowest file index having this path suffix
+    size_t file_count;  // number of files having this path suffix
+  };
+  struct EdgeKey {
+    TrieNodeIdx parent;
+    std::string_view component;
+    bool operator==(const EdgeKey&) const = default;
+  };
+  struct EdgeKeyHash {
+    size_t operator()(const EdgeKey& key) const;
+  };
+
+  const std::vector<File>& files_;
+  std::vector<std::string> include_paths_;
+  std::unordered_map<std::string_view, size_t> path_to_file_;
+  // Indexed files by last path component, ascending
+  std::unordered_map<std::string_view, std::vector<size_t>> files_by_filename_;
+  std::vector<TrieNode> trie_nodes_;
+  std::unordered_map<EdgeKey, TrieNodeIdx, EdgeKeyHash> trie_edges_;
+
+ private:
+  Resolution FindLongestSuffix(std::string_view include) const;
+};
+
+// Last component of a '/' separated path
+std::string_view PathFilename(std::string_view path);
+
+// Lexically normalizes a '/' separated relative path: drops "." components
+// and empty components, and folds "dir/.." pairs. Leading ".." are kept.
+std::string NormalizeRelativePath(std::string_view path);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "dep_graph.h"
+#include "dependency_analyzer.h"
+
+class ThreadPool;
+
+// What a change set reaches: every component and file that depends on a
+// changed file, directly or through any path, plus the changed ones
+// themselves. All id lists are ascending.
+struct ImpactResult {
+  std::vector<NodeId> changed_files;       // the inputs that name a file
+  std::vector<std::string> unknown_files;  // the inputs that do not
+  std::vector<SccIdx> components;
+  std::vector<NodeId> files;
+};
+
+// Answers "what needs rebuilding if these files change" over the condensed
+// graph reversed once up front. A query is a multi-source BFS from the
+// components of the changed files with a packed visited bitset, so its cost
+// is that of the affected part of the graph, however many files changed.
+//
+// The DependencyAnalyzer must not change while this is in use (build a new
+// one after ApplyDelta); queries are read-only and may run concurrently.
+class ImpactAnalyzer {
+ public:
+  explicit ImpactAnalyzer(const DependencyAnalyzer& analyzer,
+                          ThreadPool* pool = nullptr);
+
+  // changed holds file paths or stems; like the file graph, x.h and x.cpp
+  // both name the node x
+  ImpactResult Analyze(std::span<const std::string> changed) const;
+  ImpactResult Analyze(std::span<const NodeId> changed_files) const;
+
+  // The condensed graph reversed: component -> components depending on it
+  const CsrGraph& ComponentDependents() const {
+    return component_dependents_;
+  }
+
+ private:
+  const DependencyAnalyzer& analyzer_;
+  CsrGraph component_dependents_;
+};
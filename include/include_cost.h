@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "dep_graph.h"
+
+class DependencyAnalyzer;
+class ThreadPool;
+
+// Amount of source in a set of files
+struct CodeSize {
+  uint64_t files = 0;
+  uint64_t bytes = 0;
+  uint64_t lines = 0;
+
+  CodeSize& operator+=(const CodeSize& other) {
+    files += other.files;
+    bytes += other.bytes;
+    lines += other.lines;
+    return *this;
+  }
+  bool operator==(const CodeSize&) const = default;
+};
+
+// What one file graph node (stem) costs a build
+struct IncludeCost {
+  CodeSize own;      // the parsed files of the stem
+  CodeSize closure;  // own plus everything it includes, transitively
+  // Nodes including it, directly or transitively
+  uint64_t fan_in = 0;
+
+  // Bytes the compiler reads because of it across a full build: its closure
+  // once per node including it
+  uint64_t BuildBytes() const { return fan_in * closure.bytes; }
+  bool operator==(const IncludeCost&) const = default;
+};
+
+// Costs of every node of the analyzer's file graph, indexed by NodeId. Sizes
+// come from File::bytes and File::lines. Members of a cycle include each
+// other, so they share the closure of their component.
+//
+// Closures are summed per component over the analyzer's ReachabilityIndex,
+// not by a walk per file: a component's closure is its own size plus that of
+// every component in its reachability row, and each row also adds the
+// component's size to the fan-in of everything in it. With a pool, rows are
+// summed in parallel.
+std::vector<IncludeCost> ComputeIncludeCosts(const DependencyAnalyzer& analyzer,
+                                             ThreadPool* pool = nullptr);
+
+// Ranks the included nodes (fan-in above zero) by BuildBytes, highest first,
+// and writes the first `limit` of them as a table
+void WriteIncludeCostReport(const DependencyAnalyzer& analyzer,
+                            const std::vector<IncludeCost>& costs,
+                            size_t limit, std::ostream& out);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// A parsed JSON document. Objects keep their members in document order;
+// lookups are linear, which is fine for the small objects exchanged here.
+struct JsonValue {
+  using Array = std::vector<JsonValue>;
+  using Object = std::vector<std::pair<std::string, JsonValue>>;
+
+  std::variant<std::nullptr_t, bool, double, std::string, Array, Object>
+      value;
+
+  bool IsNull() const { return std::holds_alternative<std::nullptr_t>(value); }
+  // Typed accessors return null when the value has another type
+  const bool* AsBool() const { return std::get_if<bool>(&value); }
+  const double* AsNumber() const { return std::get_if<double>(&value); }
+  const std::string* AsString() const {
+    return std::get_if<std::string>(&value);
+  }
+  const Array* AsArray() const { return std::get_if<Array>(&value); }
+  const Object* AsObject() const { return std::get_if<Object>(&value); }
+  // The member named key of an object (the first one, if repeated)
+  const JsonValue* Find(std::string_view key) const;
+};
+
+// Parses a complete JSON text (RFC 8259). Returns nullopt on malformed
+// input, trailing garbage, or nesting deeper than 256 levels.
+std::optional<JsonValue> ParseJson(std::string_view text);
+
+// Appends the compact serialization of value to out
+void AppendJson(std::string& out, const JsonValue& value);
+// Appends str as a quoted, escaped JSON string to out
+void AppendJsonString(std::string& out, std::string_view str);
+// Appends the UTF-8 encoding of the code point to out
+void AppendUtf8(std::string& out, uint32_t code);
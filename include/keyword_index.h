@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "dep_graph.h"
+
+// Substring index over a set of names keyed by NodeId: a trigram inverted
+// index. A keyword of three or more characters only has to be checked
+// against the names holding all of its trigrams, so lookups no longer scan
+// every name, and long names (SCCs join all their members) are only read
+// when they are likely matches. Shorter keywords fall back to a scan.
+class KeywordIndex {
+ public:
+  KeywordIndex() = default;
+
+  // Indexes id under name, replacing any name it had
+  void Set(NodeId id, std::string_view name);
+  void Erase(NodeId id);
+  // Follows a renumbering: drops the removed ids and moves the moved ones.
+  // Ids from old_size on (new in the renumbering) were never indexed.
+  void Remap(const IdCompaction& compaction, size_t old_size);
+
+  // Ids whose name contains keyword, ascending; every id for an empty
+  // keyword
+  std::vector<NodeId> Find(std::string_view keyword) const;
+
+ private:
+  std::vector<std::string> names_;  // indexed by NodeId
+  std::vector<uint8_t> present_;
+  // Trigram (three bytes packed) -> ids whose name contains it, ascending
+  std::unordered_map<uint32_t, std::vector<NodeId>> postings_;
+
+ private:
+  static std::vector<uint32_t> Trigrams(std::string_view str);
+};
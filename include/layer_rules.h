@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class DependencyAnalyzer;
+
+// Architecture rules over the file graph, read from a text file:
+//
+//   # Layers: a file is in the first layer with a glob covering its path
+//   # as analyzed, like an exclude glob of WalkOptions would: a glob
+//   # without `/` matches a name at any depth (`*.h` is every header), and
+//   # a trailing `/` covers everything below the directory. In no layer
+//   # otherwise.
+//   layer core src/core/
+//   layer service src/service/ src/rpc/**/*.h
+//   layer app src/app/
+//   # A layer with allow rules may only depend on the layers listed (and
+//   # on itself); forbid rules apply either way. `*` is every layer.
+//   allow app -> core service
+//   forbid core -> service app
+//   # No cycle may mix layers, or directories: here the first component
+//   # of the path
+//   no-cycles-between layers
+//   no-cycles-between directories 1
+//
+// Graph nodes are file stems, so x.h and x.cpp are one node: a node is in
+// the first listed layer any of its files is in, and in the directory of its
+// first file.
+struct LayerRules {
+  static constexpr size_t kMaxLayers = 64;  // one bit each
+
+  struct Layer {
+    std::string name;
+    std::vector<std::string> globs;
+  };
+  std::vector<Layer> layers;
+  // Per layer, the layers it must not depend on
+  std::vector<uint64_t> forbidden;
+  bool no_cycles_between_layers = false;
+  size_t no_cycles_between_directories = 0;  // path depth, 0 for none
+
+  // Returns nullopt, with *error naming the offending line, when the text
+  // is malformed
+  static std::optional<LayerRules> Parse(std::string_view text,
+                                         std::string* error);
+  static std::optional<LayerRules> Load(const std::string& path,
+                                        std::string* error);
+};
+
+struct LayerViolation {
+  enum class Kind { kForbiddenDependency, kCycle };
+  Kind kind = Kind::kForbiddenDependency;
+  // The two layers, or for a cycle between directories the two directories
+  std::string from;
+  std::string to;
+  // A path of the file graph showing it, as the first file of every node:
+  // from a node of `from` to the nearest node of `to`, or for a cycle from a
+  // node of `from` to one of `to` and back
+  std::vector<std::string> chain;
+
+  // One line, e.g. "core -> service: src/core/a.cpp -> src/service/b.h"
+  std::string Describe() const;
+};
+
+// Checks the rules against the analyzer's graphs, returning every violation:
+//
+// - A dependency of a layered node counts wherever it ends up through nodes
+//   in no layer, so routing an include through an unlayered helper does not
+//   hide it. The layers reachable that way from every unlayered node are
+//   computed once, as bit masks propagated backwards over the file graph
+//   until they settle; each node then costs one OR per edge and an AND
+//   with its layer's forbidden mask. One violation is reported per node and
+//   forbidden layer, with the shortest chain found by a BFS over unlayered
+//   nodes.
+// - The cycle rules look at the strongly connected components only: one
+//   violation per component whose members span several layers or
+//   directories.
+//
+// Nodes are visited by id and components by index, so the order is stable.
+std::vector<LayerViolation> CheckLayerRules(const DependencyAnalyzer& analyzer,
+                                            const LayerRules& rules);
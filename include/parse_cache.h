@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "file_parser.h"
+#include "string_arena.h"
+
+// What the cache knows about a file on disk
+struct FileStamp {
+  uint64_t size = 0;
+  int64_t mtime = 0;          // filesystem clock ticks
+  uint64_t content_hash = 0;  // Fnv1a64 of the content, if hashing contents
+};
+
+// On-disk cache of parse results keyed by absolute path.
+//
+// An entry is reused when the file's size and mtime are unchanged, or, with
+// content hashing enabled, when its size and content hash are unchanged (e.g.
+// after a checkout that only touched mtimes). Without it no content is
+// hashed, and entries stored then carry a zero hash that matches nothing.
+//
+// File layout (little-endian, integers as LEB128 varints unless noted):
+//   u32 magic 'CDAC', u32 format version
+//   string table: count, then length-prefixed strings
+//   entries: count, then per entry
+//     path (string index), size, zigzag mtime, u64 content hash,
+//     include count + string indices, lines
+//   u64 Fnv1a64 of everything above
+// Anything that does not match (wrong magic or version, truncation, checksum
+// mismatch) makes Load() start from an empty cache, so deleting or corrupting
+// the file is always safe.
+class ParseCache {
+ public:
+  // Bump whenever the scanner's output for the same input changes
+  static constexpr uint32_t kFormatVersion = 3;
+
+  struct Entry {
+    FileStamp stamp;
+    std::vector<std::string_view> included_headers;
+    uint64_t lines = 0;  // the size in bytes is stamp.size
+  };
+
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+  };
+
+  ParseCache(std::string path, bool hash_contents);
+
+  bool Load();
+  // Writes the entries stored since Load(); entries for files that were not
+  // seen in this run are dropped. Written to a temporary file and renamed.
+  bool Save() const;
+
+  bool HashContents() const { return hash_contents_; }
+  const Entry* Find(std::string_view path) const;
+  // Not thread-safe; call from one thread once parsing is done.
+  void Store(std::string_view path, const FileStamp& stamp, const File& file,
+             bool hit);
+
+  const Stats& GetStats() const { return stats_; }
+  size_t Size() const { return entries_.size(); }
+
+ private:
+  std::string path_;
+  bool hash_contents_;
+  StringArena arena_;
+  std::unordered_map<std::string_view, Entry> entries_;
+  std::unordered_map<std::string_view, Entry> stored_;
+  Stats stats_;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <charconv>
+#include <optional>
+#include <string_view>
+#include <system_error>
+
+// The value of a numeric command-line flag: all of `text` as a number that
+// fits in T, without leading sign (for unsigned T) or spaces, or nullopt
+template <typename T>
+std::optional<T> ParseNumber(std::string_view text) {
+  T value{};
+  const char* end = text.data() + text.size();
+  const auto [parsed_end, ec] = std::from_chars(text.data(), end, value);
+  if (text.empty() || ec != std::errc() || parsed_end != end) {
+    return std::nullopt;
+  }
+  return value;
+}
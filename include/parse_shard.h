@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "file_parser.h"
+#include "string_arena.h"
+
+// One process's share of a parse split across processes: slice `index` of
+// `count` of the walk of every analyzed directory (FileParser::ParseSliceOf).
+// Shards are written by workers, possibly on other hosts sharing the
+// filesystem, and merged by one process that runs the analysis.
+//
+// File layout (little-endian, integers as LEB128 varints unless noted):
+//   u32 magic 'CDSH' (not a snapshot's 'CDAS'), u32 format version
+//   shard index, shard count
+//   string table: count, then length-prefixed strings
+//   slices: count, then per slice
+//     directory (string index), walk size, file count, then per file
+//       name (string index), include count + string indices, bytes, lines
+//   u64 Fnv1a64 of everything above
+// Names and includes repeat across files, so the string table keeps shards
+// small; file order is the walk order, so merging needs no sorting.
+struct ParseShard {
+  // Bump whenever the layout or the scanner's output for the same input
+  // changes
+  static constexpr uint32_t kFormatVersion = 1;
+
+  struct Slice {
+    std::string directory;    // as given to the parser
+    size_t walk_size = 0;     // sources the whole walk found
+    std::vector<File> files;  // this shard's slice, in walk order
+  };
+
+  size_t index = 0;
+  size_t count = 1;
+  std::vector<Slice> slices;  // one per directory, in parse order
+
+  // Written to a temporary file and renamed, so a reader never sees half
+  // a shard
+  bool Save(const std::string& path) const;
+  // Replaces the contents; strings are interned into arena, which must
+  // outlive the files. Returns false, with *error set, for a missing,
+  // truncated or corrupt file.
+  bool Load(const std::string& path, StringArena& arena, std::string* error);
+};
+
+// Puts shards 0 .. count-1, in any order, back together into the files a
+// single FileParser::ParseFilesUnder over the same directories would have
+// produced, in the same order. Returns false, with *error set, when a shard
+// is missing or repeated, or when the shards disagree on the directories or
+// on what their walks found (the tree changed while they ran).
+bool MergeParseShards(const std::vector<ParseShard>& shards,
+                      std::vector<File>& files, std::string* error);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Process-wide phase timers and counters, off until Enable().
+//
+// While disabled, a Phase or a Count() costs one relaxed atomic load and a
+// branch, so the instrumentation stays in release builds. While enabled,
+// every finished phase records its thread, start, duration and the
+// process's current and peak RSS at its end; counters are relaxed atomic
+// adds. Phases are meant to be coarse (a parse, a build step), not per file.
+//
+//   Profiler::Enable();
+//   { Profiler::Phase phase("SCCBuilder"); ... }
+//   Profiler::Count(Profiler::kFilesScanned);
+//   Profiler::WriteSummary(std::cerr);
+//   Profiler::WriteChromeTrace(trace_file);  // chrome://tracing, Perfetto
+class Profiler {
+ public:
+  enum Counter : size_t {
+    kFilesScanned,
+    kFilesSkipped,
+    kBytesRead,
+    kIncludesSeen,
+    kIncludesResolved,
+    kIncludesUnresolved,
+    kSccCount,
+    kLargestScc,  // a maximum, not a sum
+    kEdgesPruned,
+    kNumCounters
+  };
+
+  // Times the enclosing scope. name must outlive the profiler (a literal).
+  class Phase {
+   public:
+    explicit Phase(const char* name)
+        : name_(Enabled() ? name : nullptr),
+          begin_(name_ ? std::chrono::steady_clock::now()
+                       : std::chrono::steady_clock::time_point{}) {}
+    ~Phase() {
+      if (name_) {
+        Record(name_, begin_, std::chrono::steady_clock::now());
+      }
+    }
+
+    Phase(const Phase&) = delete;
+    Phase& operator=(const Phase&) = delete;
+
+   private:
+    const char* name_;
+    std::chrono::steady_clock::time_point begin_;
+  };
+
+  static void Enable();
+  static void Disable();
+  static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+  // Drops every recorded phase and counter
+  static void Reset();
+
+  static void Count(Counter counter, uint64_t amount = 1) {
+    if (Enabled()) {
+      counters_[counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+  }
+  static void Max(Counter counter, uint64_t value) {
+    if (Enabled()) {
+      uint64_t seen = counters_[counter].load(std::memory_order_relaxed);
+      while (seen < value && !counters_[counter].compare_exchange_weak(
+                                 seen, value, std::memory_order_relaxed)) {
+      }
+    }
+  }
+  static uint64_t Get(Counter counter) {
+    return counters_[counter].load(std::memory_order_relaxed);
+  }
+  static const char* CounterName(Counter counter);
+
+  // Per phase name: calls, total time and the highest peak RSS seen at its
+  // end; then every counter
+  static void WriteSummary(std::ostream& out);
+  // Chrome trace_event JSON: a complete ("X") event per phase, RSS counter
+  // ("C") events at phase ends, and the counters under "otherData"
+  static void WriteChromeTrace(std::ostream& out);
+
+ private:
+  static inline std::atomic<bool> enabled_{false};
+  static inline std::array<std::atomic<uint64_t>, kNumCounters> counters_{};
+
+  static void Record(const char* name,
+                     std::chrono::steady_clock::time_point begin,
+                     std::chrono::steady_clock::time_point end);
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dep_graph.h"
+#include "json.h"
+
+class DependencyAnalyzer;
+class ImpactAnalyzer;
+class ThreadPool;
+
+// Answers JSON-lines queries over an analyzed graph. Every request is one
+// JSON object; its optional "id" is echoed in the response, which carries
+// either "result" or "error":
+//
+//   {"id": 1, "query": "subgraph", "keyword": "net"}
+//     -> components whose name contains the keyword, everything they depend
+//        on, and the simplified (transitively reduced) edges between them,
+//        in the JSON format of ExportGraph; answers are cached per keyword
+//        (DependencyAnalyzer::GetOrRender)
+//   {"id": 2, "query": "dependencies", "file": "a", "transitive": false}
+//   {"id": 3, "query": "dependents", "file": "a", "transitive": true}
+//     -> file level (stem) dependencies of / dependents on "file", sorted
+//   {"id": 4, "query": "depth", "file": "a"}
+//     -> the component of "file" and its depth
+//   {"id": 5, "query": "impact", "files": ["src/a.h", "b"]}
+//     -> every file and component depending on any of "files" (paths or
+//        stems) through any path, the changed ones included, sorted; inputs
+//        naming no file are listed under "unknown" (ImpactAnalyzer)
+//
+// The analyzer must not change while the engine is in use; answering is
+// read-only, so any number of threads may answer at once.
+class QueryEngine {
+ public:
+  explicit QueryEngine(const DependencyAnalyzer& analyzer,
+                       ThreadPool* pool = nullptr);
+  ~QueryEngine();
+
+  // One request line in, one response line out (without the newline)
+  std::string Answer(std::string_view request) const;
+
+  // Answers every line read_line yields until it returns false. Requests are
+  // answered concurrently on the pool, and responses handed to write in
+  // request order as soon as they and all earlier ones are ready; each call
+  // gets one or more complete lines. Returns the number of requests.
+  size_t Serve(const std::function<bool(std::string&)>& read_line,
+               const std::function<void(std::string_view)>& write,
+               ThreadPool* pool) const;
+
+ private:
+  const DependencyAnalyzer& analyzer_;
+  CsrGraph file_dependents_;  // the file graph reversed
+  std::unique_ptr<ImpactAnalyzer> impact_;
+
+ private:
+  JsonValue FileNeighbors(const CsrGraph& graph, NodeId file,
+                          bool transitive) const;
+  JsonValue Depth(NodeId file) const;
+  JsonValue Impact(const std::vector<std::string>& files) const;
+};
+
+// Serves queries on a Unix domain socket at path, one thread per
+// connection, answering on the pool. Returns only when the socket cannot be
+// set up or accepting fails, after ending and joining every connection. A
+// stale socket at path is replaced; any other file there is an error.
+bool ServeUnixSocket(const QueryEngine& engine, const std::string& path,
+                     ThreadPool* pool);
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "dep_graph.h"
+
+class ThreadPool;
+
+// Transitive closure of a DAG, one row per node holding every node reachable
+// from it (the node itself excluded).
+//
+// Rows are built in dependencies-first order by OR-ing the rows of the direct
+// dependencies into a packed scratch bitset, then stored in whichever form is
+// smaller: a sorted id list for sparse rows or a packed bitset for dense
+// ones. Dense rows are merged a 64-bit word at a time.
+//
+// When the DAG changes, Remap follows its renumbering and UpdateRow
+// recomputes single rows; replaced rows are reclaimed once they make up half
+// of the pools.
+class ReachabilityIndex {
+ public:
+  class Accumulator;
+  // Called once per node with the union of its dependencies' rows, before the
+  // dependencies themselves are added
+  using MergeObserver = std::function<void(NodeId, const Accumulator&)>;
+
+  // order must list every node of dag after all of its dependencies
+  ReachabilityIndex(const CsrGraph& dag, std::span<const NodeId> order,
+                    const MergeObserver& on_merged = {});
+  // Builds the rows of each level (see ComputeHeightLevels) in parallel. The
+  // observer may then run concurrently for nodes of the same level.
+  ReachabilityIndex(const CsrGraph& dag,
+                    const std::vector<std::vector<NodeId>>& levels,
+                    ThreadPool* pool, const MergeObserver& on_merged = {});
+
+  bool Reaches(NodeId from, NodeId to) const;
+  size_t Count(NodeId node) const { return rows_[node].count; }
+  // Calls fn(id) for every node reachable from node, in ascending id order
+  template <typename Fn>
+  void ForEach(NodeId node, Fn&& fn) const;
+
+  size_t NumNodes() const { return rows_.size(); }
+  size_t DenseRowCount() const { return dense_rows_; }
+
+  // Applies compaction to the row ids and to the ids inside the rows, then
+  // grows to num_nodes with empty rows for the nodes added after it. Only the
+  // rows of `reaching` (old ids: every node reaching a removed or moved one)
+  // are rewritten.
+  void Remap(const IdCompaction& compaction, size_t num_nodes,
+             std::span<const NodeId> reaching);
+  // Recomputes node's row from the current rows of its dependencies in dag,
+  // calling on_merged as the constructors do. Returns whether it changed.
+  bool UpdateRow(const CsrGraph& dag, NodeId node, Accumulator& acc,
+                 const MergeObserver& on_merged = {});
+  // A scratch accumulator wide enough for every row
+  Accumulator MakeAccumulator() const {
+    return Accumulator(words_per_row_ * 64);
+  }
+  size_t MemoryBytes() const {
+    return sparse_pool_.size() * sizeof(NodeId) +
+           dense_pool_.size() * sizeof(uint64_t) + rows_.size() * sizeof(Row);
+  }
+
+  // Packed scratch bitset that only clears the words it touched
+  class Accumulator {
+   public:
+    explicit Accumulator(size_t num_nodes);
+    void Set(NodeId id);
+    bool Test(NodeId id) const {
+      return (words_[id / 64] >> (id % 64)) & 1;
+    }
+    void OrRow(const ReachabilityIndex& index, NodeId node);
+    void Clear();
+
+   private:
+    friend class ReachabilityIndex;
+    std::vector<uint64_t> words_;
+    std::vector<uint32_t> touched_words_;
+    bool all_touched_ = false;
+  };
+
+ private:
+  struct Row {
+    uint64_t begin = 0;  // offset into sparse_pool_ or dense_pool_
+    uint32_t count = 0;  // number of reachable nodes
+    bool dense = false;
+  };
+
+  // A finished row that is not yet in the pools
+  struct PendingRow {
+    uint32_t count = 0;
+    bool dense = false;
+    std::vector<NodeId> ids;      // when sparse
+    std::vector<uint64_t> words;  // when dense
+  };
+
+  size_t words_per_row_;
+  std::vector<Row> rows_;
+  std::vector<NodeId> sparse_pool_;
+  std::vector<uint64_t> dense_pool_;
+  size_t dense_rows_ = 0;
+  // Pool entries still referenced by a row
+  size_t live_sparse_ = 0;
+  size_t live_dense_ = 0;
+
+ private:
+  void MergeNode(const CsrGraph& dag, NodeId node, Accumulator& acc,
+                 const MergeObserver& on_merged) const;
+  PendingRow ExtractRow(Accumulator& acc) const;
+  void StoreRow(NodeId node, PendingRow&& row);
+  void ReleaseRow(NodeId node);
+  bool RowEquals(NodeId node, const PendingRow& row) const;
+  void CompactPoolsIfSparse();
+  void CompactPools();
+};
+
+// Removes every edge u -> v for which v is also reachable from u through
+// another dependency of u. order is as for ReachabilityIndex.
+CsrGraph TransitiveReduction(const CsrGraph& dag,
+                             std::span<const NodeId> order);
+// Same result, with each level reduced in parallel
+CsrGraph TransitiveReduction(const CsrGraph& dag,
+                             const std::vector<std::vector<NodeId>>& levels,
+                             ThreadPool* pool);
+
+template <typename Fn>
+void ReachabilityIndex::ForEach(NodeId node, Fn&& fn) const {
+  const Row& row = rows_[node];
+  if (!row.dense) {
+    for (uint32_t i = 0; i < row.count; ++i) {
+      fn(sparse_pool_[row.begin + i]);
+    }
+    return;
+  }
+  for (size_t w = 0; w < words_per_row_; ++w) {
+    uint64_t word = dense_pool_[row.begin + w];
+    while (word != 0) {
+      fn(static_cast<NodeId>(w * 64 + __builtin_ctzll(word)));
+      word &= word - 1;
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Least-recently-used cache of rendered graphs, bounded by the bytes of its
+// keys and renderings. Keys name everything the rendering depends on besides
+// the graph itself (format, keyword, ...); the owner clears the cache when
+// the graph changes. Thread safe.
+class RenderCache {
+ public:
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+
+    double HitRate() const {
+      return hits + misses == 0 ? 0.0
+                                : static_cast<double>(hits) / (hits + misses);
+    }
+  };
+
+  explicit RenderCache(size_t capacity_bytes) : capacity_(capacity_bytes) {}
+
+  // The rendering cached under key, or render()'s result, which is cached
+  // unless it alone exceeds the capacity. render runs without the lock held,
+  // so concurrent misses on one key may render it more than once.
+  std::shared_ptr<const std::string> GetOrRender(
+      const std::string& key, const std::function<std::string()>& render);
+  void Clear();
+  Stats GetStats() const;
+
+ private:
+  struct Entry {
+    std::string key;
+    std::shared_ptr<const std::string> value;
+  };
+
+  const size_t capacity_;
+  mutable std::mutex mutex_;
+  std::list<Entry> entries_;  // most recently used first
+  std::unordered_map<std::string_view, std::list<Entry>::iterator> by_key_;
+  size_t bytes_ = 0;
+  Stats stats_;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ThreadPool;
+
+// Which files below an analyzed directory are sources.
+//
+// Globs follow .gitignore syntax: `*` and `?` do not match `/`, `**` does,
+// `[a-z]` / `[!a-z]` are character classes, and a trailing `/` only matches
+// directories. A glob without a `/` (other than a trailing one) matches the
+// name of a file or directory at any depth; otherwise it matches its path
+// relative to the analyzed directory, or for .gitignore rules to the
+// directory holding the .gitignore.
+struct WalkOptions {
+  // Files and directories to leave out; a matching directory is not entered
+  std::vector<std::string> exclude;
+  // When not empty, only files matching one of these are kept
+  std::vector<std::string> only;
+  // Honor the .gitignore files found at and below the analyzed directory
+  // (including `!` rules re-including files); `.git` is never entered
+  bool gitignore = true;
+};
+
+// What a walk left out. Nothing is reported per file; callers summarize.
+struct WalkStats {
+  size_t not_sources = 0;     // other extensions, test and mock files
+  size_t excluded_files = 0;  // by the globs or a .gitignore
+  size_t pruned_directories = 0;
+
+  WalkStats& operator+=(const WalkStats& other) {
+    not_sources += other.not_sources;
+    excluded_files += other.excluded_files;
+    pruned_directories += other.pruned_directories;
+    return *this;
+  }
+};
+
+struct WalkResult {
+  // Absolute paths, ordered as a depth-first walk visiting the entries of
+  // every directory by name, whatever the thread count
+  std::vector<std::string> files;
+  WalkStats stats;
+};
+
+// .c .cpp .cu .h .hpp .hu in any case, without a regex
+bool HasSourceExtension(std::string_view name);
+
+// Whether `path` matches the glob, as described above for WalkOptions, but
+// always against the whole of `path`
+bool MatchGlob(std::string_view glob, std::string_view path);
+
+// Recursive directory walk that decides on every directory before entering
+// it, so excluded and ignored trees (build output, .git, third-party code)
+// cost one directory entry each. With a pool, directories are read in
+// parallel; a walk only waits for its own directories, and one started
+// from a task of the pool runs on the calling thread.
+class SourceWalker {
+ public:
+  explicit SourceWalker(const WalkOptions& options = {});
+
+  WalkResult Walk(const std::filesystem::path& root,
+                  ThreadPool* pool = nullptr) const;
+  // Only the sources at or below `start`, which may be a file or a
+  // directory and may no longer exist, filtered as a walk of `root` would:
+  // the .gitignore files of the directories in between apply too
+  WalkResult Walk(const std::filesystem::path& root,
+                  const std::filesystem::path& start,
+                  ThreadPool* pool = nullptr) const;
+  // Whether a walk would keep the file at `rel_path` (relative to the root,
+  // `/`-separated) given its path alone: the directories on the way and the
+  // file itself are checked against the globs, but no .gitignore is read
+  bool Selects(std::string_view rel_path) const;
+  // Whether `glob`, as an exclude glob, would leave out the file at
+  // `rel_path`: it matches the file or a directory on the way to it, so a
+  // glob without `/` matches a name at any depth and one with a trailing
+  // `/` everything below the directory
+  static bool GlobCovers(std::string_view glob, std::string_view rel_path);
+
+ private:
+  // One glob, parsed
+  struct Rule {
+    std::string glob;
+    bool negated = false;         // `!`: re-includes (.gitignore only)
+    bool directory_only = false;  // trailing `/`
+    bool anchored = false;        // matched against the relative path
+
+    static Rule Parse(std::string_view line);
+    bool Matches(std::string_view rel, std::string_view name,
+                 bool is_directory) const;
+  };
+  struct IgnoreLevel;
+  struct Directory;
+  class WalkTasks;
+
+  std::vector<Rule> exclude_;
+  std::vector<Rule> only_;
+  bool gitignore_;
+
+  std::shared_ptr<const IgnoreLevel> LoadIgnoreFile(
+      const std::filesystem::path& directory, std::string_view rel,
+      std::shared_ptr<const IgnoreLevel> parent) const;
+  bool IsExcluded(const IgnoreLevel* level, std::string_view rel,
+                  std::string_view name, bool is_directory) const;
+  // Whether a regular file passes every filter, counting it in stats if not
+  bool KeepFile(const IgnoreLevel* level, std::string_view rel,
+                std::string_view name, WalkStats& stats) const;
+  // With tasks, subdirectories are walked as tasks of its pool
+  void WalkDirectory(std::filesystem::path path, std::string rel,
+                     std::shared_ptr<const IgnoreLevel> level, Directory& out,
+                     WalkTasks* tasks) const;
+};
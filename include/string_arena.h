@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_set>
+
+// Interns strings into one monotonic buffer. Every distinct string is stored
+// once and the returned views stay valid for the lifetime of the arena, so
+// callers can keep std::string_view instead of owning std::string copies.
+// Not thread-safe: use one arena per thread.
+class StringArena {
+ public:
+  StringArena();
+
+  StringArena(const StringArena&) = delete;
+  StringArena& operator=(const StringArena&) = delete;
+
+  std::string_view Intern(std::string_view str);
+
+  size_t Size() const { return interned_.size(); }  // distinct strings
+  size_t BytesUsed() const { return bytes_used_; }  // string payload only
+
+ private:
+  std::pmr::monotonic_buffer_resource resource_;
+  std::pmr::unordered_set<std::string_view> interned_;
+  size_t bytes_used_ = 0;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A child process, optionally with a pipe to its stdin and one from its
+// stdout. stderr is always shared with ours, so the child's diagnostics
+// reach the user. Writing to a child that exited raises SIGPIPE, which
+// callers that may outlive their children should ignore.
+class Subprocess {
+ public:
+  Subprocess() = default;
+  Subprocess(const Subprocess&) = delete;
+  Subprocess& operator=(const Subprocess&) = delete;
+  ~Subprocess() { Finish(); }
+
+  // Runs argv[0], looked up on PATH unless it contains a `/`. Without
+  // pipes the child shares our stdin and stdout.
+  bool Start(const std::vector<std::string>& argv, bool pipes = true);
+
+  bool Write(std::string_view data);
+  // Tells the child its input is complete
+  void CloseInput();
+
+  // Appends up to and including the next `delimiter`; false when the output
+  // ends first
+  bool ReadUntil(char delimiter, std::string& out);
+  // Appends exactly `size` bytes; false when the output ends first
+  bool Read(size_t size, std::string& out);
+  void ReadAll(std::string& out);
+
+  // Closes the pipes, waits for the child and returns whether it exited
+  // with status 0
+  bool Finish();
+
+ private:
+  pid_t pid_ = -1;
+  int in_ = -1;
+  int out_ = -1;
+  std::vector<char> buffer_ = std::vector<char>(size_t{1} << 16);
+  size_t begin_ = 0;
+  size_t end_ = 0;
+
+  bool Fill();
+};
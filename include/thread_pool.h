@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool.
+//
+// Every worker owns a deque of tasks. Tasks submitted from outside the pool
+// are distributed round-robin over the worker deques; a worker pops from the
+// back of its own deque and, when that runs dry, steals from the front of the
+// other workers' deques. Each task receives the index of the worker running
+// it so callers can keep per-thread buffers without any locking.
+class ThreadPool {
+ public:
+  using Task = std::function<void(unsigned worker_idx)>;
+
+  // num_threads == 0 means "one per hardware thread".
+  explicit ThreadPool(unsigned num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void Submit(Task task);
+  // Blocks until every task submitted so far has finished running.
+  void Wait();
+  unsigned Size() const { return static_cast<unsigned>(workers_.size()); }
+  // Whether the calling thread is one of this pool's workers, i.e. runs a
+  // task, which must not block on other tasks of the pool
+  bool IsWorkerThread() const;
+
+  static unsigned ResolveThreadCount(unsigned requested);
+
+ private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> next_queue_{0};
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable all_done_;
+  size_t queued_ = 0;   // submitted but not yet picked up
+  size_t pending_ = 0;  // submitted but not yet finished
+  bool stop_ = false;
+
+ private:
+  void WorkerLoop(unsigned worker_idx);
+  bool TryPopLocal(unsigned worker_idx, Task& task);
+  bool TrySteal(unsigned worker_idx, Task& task);
+};
+
+
+// Runs fn(i, worker_idx) for every i in [0, count) on the pool and blocks
+// until all calls returned. Indices are handed out in contiguous chunks. With
+// a null pool the loop runs inline on the calling thread with worker_idx 0,
+// so callers can size per-thread scratch as max(1, pool->Size()).
+// Must not be called from inside a pool task.
+void ParallelFor(ThreadPool* pool, size_t count,
+                 const std::function<void(size_t, unsigned)>& fn);
@@ -0,0 +1,97 @@
+#include "binary_io.h"
+
+uint64_t Fnv1a64(std::string_view data, uint64_t seed) {
+  uint64_t hash = seed;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+void BinaryWriter::WriteU32(uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    buffer_.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+void BinaryWriter::WriteU64(uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    buffer_.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+void BinaryWriter::WriteVarint(uint64_t value) {
+  while (value >= 0x80) {
+    buffer_.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  buffer_.push_back(static_cast<char>(value));
+}
+
+void BinaryWriter::WriteSignedVarint(int64_t value) {
+  WriteVarint((static_cast<uint64_t>(value) << 1) ^
+              static_cast<uint64_t>(value >> 63));
+}
+
+void BinaryWriter::WriteString(std::string_view str) {
+  WriteVarint(str.size());
+  buffer_.append(str);
+}
+
+void BinaryWriter::WriteBytes(std::string_view bytes) { buffer_.append(bytes); }
+
+uint32_t BinaryReader::ReadU32() {
+  const std::string_view bytes = ReadBytes(4);
+  uint32_t value = 0;
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    value |= static_cast<uint32_t>(static_cast<unsigned char>(bytes[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+uint64_t BinaryReader::ReadU64() {
+  const std::string_view bytes = ReadBytes(8);
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+uint64_t BinaryReader::ReadVarint() {
+  uint64_t value = 0;
+  for (int shift = 0; ok_ && shift < 64; shift += 7) {
+    if (pos_ >= data_.size()) {
+      break;
+    }
+    const auto byte = static_cast<unsigned char>(data_[pos_++]);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  ok_ = false;
+  return 0;
+}
+
+int64_t BinaryReader::ReadSignedVarint() {
+  const uint64_t raw = ReadVarint();
+  return static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+}
+
+std::string_view BinaryReader::ReadString() {
+  return ReadBytes(static_cast<size_t>(ReadVarint()));
+}
+
+std::string_view BinaryReader::ReadBytes(size_t size) {
+  if (!ok_ || size > data_.size() - pos_) {
+    ok_ = false;
+    return {};
+  }
+  const std::string_view bytes = data_.substr(pos_, size);
+  pos_ += size;
+  return bytes;
+}
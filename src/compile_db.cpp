@@ -0,0 +1,471 @@
+#include "compile_db.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#include "json.h"
+#include "profiler.h"
+
+namespace {
+
+using ByteSet = std::array<bool, 256>;
+
+constexpr ByteSet MakeByteSet(std::string_view bytes) {
+  ByteSet set{};
+  for (const char c : bytes) {
+    set[static_cast<unsigned char>(c)] = true;
+  }
+  return set;
+}
+
+// Bytes that end a run of plain string content
+constexpr ByteSet kStringStops = [] {
+  ByteSet set = MakeByteSet("\"\\");
+  for (int c = 0; c < 0x20; ++c) {
+    set[c] = true;  // control characters must be escaped
+  }
+  return set;
+}();
+
+// Pull reader over a file descriptor for the subset of JSON a compilation
+// database uses. The file is read through one fixed buffer; strings are
+// decoded into caller-owned buffers a run of plain bytes at a time, and
+// values that are not needed are skipped without being materialized.
+class JsonStreamReader {
+ public:
+  static constexpr int kEnd = -1;
+
+  JsonStreamReader(int fd, size_t buffer_size)
+      : fd_(fd), buffer_(buffer_size) {}
+
+  // Whether a read failed, as opposed to reaching the end of the file
+  bool ReadFailed() const { return read_failed_; }
+
+  // The next non-whitespace byte, left unread; kEnd at the end
+  int Peek() {
+    while (pos_ < end_ || Refill()) {
+      const char c = *pos_;
+      if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        return static_cast<unsigned char>(c);
+      }
+      ++pos_;
+    }
+    return kEnd;
+  }
+
+  bool Consume(char expected) {
+    if (Peek() != static_cast<unsigned char>(expected)) {
+      return false;
+    }
+    ++pos_;
+    return true;
+  }
+
+  // Reads a string into out, replacing its contents
+  bool ReadString(std::string& out) {
+    out.clear();
+    if (!Consume('"')) {
+      return false;
+    }
+    while (true) {
+      if (pos_ == end_ && !Refill()) {
+        return false;
+      }
+      const char* run = pos_;
+      while (run < end_ && !kStringStops[static_cast<unsigned char>(*run)]) {
+        ++run;
+      }
+      out.append(pos_, run);
+      pos_ = run;
+      if (pos_ == end_) {
+        continue;
+      }
+      const char c = *pos_++;
+      if (c == '"') {
+        return true;
+      }
+      if (c != '\\') {
+        return false;  // a control character
+      }
+      switch (Get()) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+          uint32_t code;
+          if (!ReadHex4(code)) {
+            return false;
+          }
+          if (code >= 0xD800 && code < 0xDC00) {
+            uint32_t low;
+            if (Get() != '\\' || Get() != 'u' ||
+                !ReadHex4(low) || low < 0xDC00 || low >= 0xE000) {
+              return false;
+            }
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          } else if (code >= 0xDC00 && code < 0xE000) {
+            return false;
+          }
+          AppendUtf8(out, code);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+  }
+
+  // Reads an array of strings into out, reusing its elements' buffers
+  bool ReadStringArray(std::vector<std::string>& out) {
+    size_t count = 0;
+    if (!Consume('[')) {
+      return false;
+    }
+    if (!Consume(']')) {
+      do {
+        if (count == out.size()) {
+          out.emplace_back();
+        }
+        if (!ReadString(out[count++])) {
+          return false;
+        }
+      } while (Consume(','));
+      if (!Consume(']')) {
+        return false;
+      }
+    }
+    out.resize(count);
+    return true;
+  }
+
+  bool SkipValue(int depth = 0) {
+    if (depth > kMaxDepth) {
+      return false;
+    }
+    switch (Peek()) {
+      case '"':
+        return ReadString(scratch_);
+      case '[':
+        ++pos_;
+        if (Consume(']')) {
+          return true;
+        }
+        do {
+          if (!SkipValue(depth + 1)) {
+            return false;
+          }
+        } while (Consume(','));
+        return Consume(']');
+      case '{':
+        ++pos_;
+        if (Consume('}')) {
+          return true;
+        }
+        do {
+          if (!ReadString(scratch_) || !Consume(':') ||
+              !SkipValue(depth + 1)) {
+            return false;
+          }
+        } while (Consume(','));
+        return Consume('}');
+      default: {
+        // A number or a literal: a run of the bytes they are made of
+        size_t length = 0;
+        while ((pos_ < end_ || Refill()) &&
+               std::string_view("+-.0123456789Eaeflnrstu").find(*pos_) !=
+                   std::string_view::npos) {
+          ++pos_;
+          ++length;
+        }
+        return length > 0;
+      }
+    }
+  }
+
+ private:
+  static constexpr int kMaxDepth = 256;
+
+  bool ReadHex4(uint32_t& code) {
+    code = 0;
+    for (int i = 0; i < 4; ++i) {
+      const int c = Get();
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        code |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        code |= c - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  int Get() {
+    if (pos_ == end_ && !Refill()) {
+      return kEnd;
+    }
+    return static_cast<unsigned char>(*pos_++);
+  }
+
+  bool Refill() {
+    while (!read_failed_) {
+      const ssize_t length = ::read(fd_, buffer_.data(), buffer_.size());
+      if (length < 0 && errno == EINTR) {
+        continue;
+      }
+      if (length <= 0) {
+        read_failed_ = length < 0;
+        return false;
+      }
+      pos_ = buffer_.data();
+      end_ = pos_ + length;
+      return true;
+    }
+    return false;
+  }
+
+  int fd_;
+  std::vector<char> buffer_;
+  const char* pos_ = nullptr;
+  const char* end_ = nullptr;
+  bool read_failed_ = false;
+  std::string scratch_;
+};
+
+std::string AbsoluteNormal(std::string_view path, std::string_view directory) {
+  std::filesystem::path result(path);
+  if (result.is_relative()) {
+    result = std::filesystem::absolute(std::filesystem::path(directory) /
+                                       result);
+  }
+  result = result.lexically_normal();
+  if (!result.has_filename() && result.has_relative_path()) {
+    result = result.parent_path();
+  }
+  return result.string();
+}
+
+// The entries of a compilation database, reported as they are read
+bool ReadEntries(JsonStreamReader& reader, const std::string& path,
+                 const std::function<void(const CompileCommand&)>& on_command,
+                 std::string* error) {
+  size_t entries = 0;
+  auto fail = [&](std::string_view what) {
+    *error = path + ": " + std::string(what) + " in entry " +
+             std::to_string(entries + 1);
+    return false;
+  };
+
+  // Reused across entries, so their buffers are allocated once
+  std::string key;
+  std::string directory;
+  std::string file_name;
+  std::string command;
+  std::vector<std::string> arguments;
+  CompileCommand entry;
+  if (!reader.Consume('[')) {
+    return fail("expected a JSON array");
+  }
+  if (reader.Consume(']')) {
+    return true;
+  }
+  do {
+    directory.clear();
+    file_name.clear();
+    command.clear();
+    bool has_arguments = false;
+    if (!reader.Consume('{')) {
+      return fail("expected an object");
+    }
+    if (!reader.Consume('}')) {
+      do {
+        if (!reader.ReadString(key) || !reader.Consume(':')) {
+          return fail("malformed member");
+        }
+        bool ok;
+        if (key == "directory") {
+          ok = reader.ReadString(directory);
+        } else if (key == "file") {
+          ok = reader.ReadString(file_name);
+        } else if (key == "command") {
+          ok = reader.ReadString(command);
+        } else if (key == "arguments") {
+          ok = reader.ReadStringArray(arguments);
+          has_arguments = true;
+        } else {
+          ok = reader.SkipValue();
+        }
+        if (!ok) {
+          return fail("malformed \"" + key + "\"");
+        }
+      } while (reader.Consume(','));
+      if (!reader.Consume('}')) {
+        return fail("expected '}'");
+      }
+    }
+    if (file_name.empty()) {
+      return fail("missing \"file\"");
+    }
+    if (!has_arguments) {
+      SplitCommandLine(command, arguments);
+    }
+    entry.file = AbsoluteNormal(file_name, directory);
+    entry.search_path = ExtractIncludeSearchPath(arguments, directory);
+    on_command(entry);
+    ++entries;
+  } while (reader.Consume(','));
+  if (!reader.Consume(']')) {
+    return fail("expected ']'");
+  }
+  if (reader.Peek() != JsonStreamReader::kEnd) {
+    *error = path + ": trailing data after the array";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::vector<std::string> SplitCommandLine(std::string_view command) {
+  std::vector<std::string> arguments;
+  SplitCommandLine(command, arguments);
+  return arguments;
+}
+
+void SplitCommandLine(std::string_view command,
+                      std::vector<std::string>& arguments) {
+  size_t count = 0;
+  bool in_argument = false;
+  auto current = [&]() -> std::string& {
+    if (!in_argument) {
+      if (count == arguments.size()) {
+        arguments.emplace_back();
+      }
+      arguments[count++].clear();
+      in_argument = true;
+    }
+    return arguments[count - 1];
+  };
+  // Runs of bytes that mean nothing to the shell are copied as a whole
+  static constexpr ByteSet kUnquotedStops = MakeByteSet(" \t\n\r'\"\\");
+  static constexpr ByteSet kSingleQuotedStops = MakeByteSet("'");
+  static constexpr ByteSet kDoubleQuotedStops = MakeByteSet("\"\\");
+  char quote = 0;  // the open quote, if any
+  size_t i = 0;
+  while (i < command.size()) {
+    const ByteSet& stops = quote == '\'' ? kSingleQuotedStops
+                           : quote == '"' ? kDoubleQuotedStops
+                                          : kUnquotedStops;
+    size_t run_end = i;
+    while (run_end < command.size() &&
+           !stops[static_cast<unsigned char>(command[run_end])]) {
+      ++run_end;
+    }
+    if (run_end > i) {
+      current().append(command.substr(i, run_end - i));
+      i = run_end;
+      continue;
+    }
+    const char c = command[i++];
+    if (c == quote) {
+      quote = 0;
+    } else if (c == '\\') {
+      const bool escapes =
+          i < command.size() &&
+          (quote == 0 || std::string_view("\"\\$`").find(command[i]) !=
+                             std::string_view::npos);
+      if (escapes) {
+        current() += command[i++];
+      } else {
+        current() += c;
+      }
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+      current();  // "" is an empty argument
+    } else {
+      in_argument = false;  // whitespace
+    }
+  }
+  arguments.resize(count);
+}
+
+IncludeSearchPath ExtractIncludeSearchPath(
+    const std::vector<std::string>& arguments, std::string_view directory) {
+  // -I, -isystem and -idirafter directories are searched in that order,
+  // whatever the order of the flags
+  std::vector<std::string> quote_dirs;
+  std::vector<std::string> user_dirs;
+  std::vector<std::string> system_dirs;
+  std::vector<std::string> after_dirs;
+  const std::pair<std::string_view, std::vector<std::string>*> kFlags[] = {
+      {"-iquote", &quote_dirs},
+      {"-isystem", &system_dirs},
+      {"-idirafter", &after_dirs},
+      {"-I", &user_dirs},
+  };
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    const std::string_view arg = arguments[i];
+    if (arg.size() < 2 || arg[0] != '-' || (arg[1] != 'I' && arg[1] != 'i')) {
+      continue;  // the common case: not a search path flag
+    }
+    for (const auto& [flag, dirs] : kFlags) {
+      if (!arg.starts_with(flag)) {
+        continue;
+      }
+      std::string_view value = arg.substr(flag.size());
+      if (value.empty() && i + 1 < arguments.size()) {
+        value = arguments[++i];
+      }
+      if (!value.empty()) {
+        dirs->push_back(AbsoluteNormal(value, directory));
+      }
+      break;
+    }
+  }
+
+  IncludeSearchPath search_path;
+  search_path.quote_dirs = std::move(quote_dirs);
+  search_path.dirs = std::move(user_dirs);
+  for (auto* later : {&system_dirs, &after_dirs}) {
+    search_path.dirs.insert(search_path.dirs.end(),
+                            std::make_move_iterator(later->begin()),
+                            std::make_move_iterator(later->end()));
+  }
+  return search_path;
+}
+
+bool ReadCompileCommands(
+    const std::string& path,
+    const std::function<void(const CompileCommand&)>& on_command,
+    std::string* error) {
+  Profiler::Phase phase("ReadCompileCommands");
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    *error = "cannot read " + path;
+    return false;
+  }
+  JsonStreamReader reader(fd, size_t{1} << 20);
+  bool ok = ReadEntries(reader, path, on_command, error);
+  close(fd);
+  if (reader.ReadFailed()) {
+    *error = "failed to read " + path;
+    ok = false;
+  }
+  return ok;
+}
@@ -0,0 +1,382 @@
+#include "dep_graph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include "thread_pool.h"
+
+NodeId IdCompaction::Map(NodeId id) const {
+  if (std::binary_search(removed.begin(), removed.end(), id)) {
+    return kRemoved;
+  }
+  if (id < new_size) {
+    return id;
+  }
+  const auto it = std::lower_bound(
+      moves.begin(), moves.end(), std::make_pair(id, NodeId{0}));
+  return it != moves.end() && it->first == id ? it->second : kRemoved;
+}
+
+NodeId IdCompaction::Origin(NodeId id) const {
+  // Holes are filled in ascending order, so moves are sorted by new id too
+  const auto it = std::lower_bound(
+      moves.begin(), moves.end(), id,
+      [](const auto& move, NodeId value) { return move.second < value; });
+  return it != moves.end() && it->second == id ? it->first : id;
+}
+
+IdCompaction PlanIdCompaction(size_t size, std::vector<NodeId> removed) {
+  std::sort(removed.begin(), removed.end());
+  removed.erase(std::unique(removed.begin(), removed.end()), removed.end());
+
+  IdCompaction compaction;
+  compaction.new_size = size - removed.size();
+  // Holes below new_size are paired, in order, with the survivors above it
+  auto hole = removed.begin();
+  auto removed_above = std::lower_bound(
+      removed.begin(), removed.end(), static_cast<NodeId>(compaction.new_size));
+  for (NodeId id = compaction.new_size; id < size; ++id) {
+    if (removed_above != removed.end() && *removed_above == id) {
+      ++removed_above;
+      continue;
+    }
+    compaction.moves.emplace_back(id, *hole++);
+  }
+  compaction.removed = std::move(removed);
+  return compaction;
+}
+
+NameTable::NameTable() : arena_(std::make_unique<StringArena>()) {}
+
+NodeId NameTable::Intern(std::string_view name) {
+  auto it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  const auto id = static_cast<NodeId>(names_.size());
+  names_.push_back(arena_->Intern(name));
+  ids_.emplace(names_.back(), id);
+  return id;
+}
+
+std::optional<NodeId> NameTable::Find(std::string_view name) const {
+  auto it = ids_.find(name);
+  if (it == ids_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+void NameTable::Compact(const IdCompaction& compaction) {
+  // Removed names stay in the arena; only the lookups forget them
+  for (const NodeId id : compaction.removed) {
+    ids_.erase(names_[id]);
+  }
+  for (const auto& [from, to] : compaction.moves) {
+    names_[to] = names_[from];
+    ids_[names_[to]] = to;
+  }
+  names_.resize(compaction.new_size);
+}
+
+CsrGraph CsrGraph::FromEdges(size_t num_nodes, std::vector<Edge> edges) {
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  CsrGraph graph;
+  graph.offsets_.assign(num_nodes + 1, 0);
+  graph.targets_.reserve(edges.size());
+  for (const auto& [from, to] : edges) {
+    graph.offsets_[from + 1]++;
+    graph.targets_.push_back(to);
+  }
+  for (size_t i = 0; i < num_nodes; ++i) {
+    graph.offsets_[i + 1] += graph.offsets_[i];
+  }
+  return graph;
+}
+
+CsrGraph CsrGraph::FromRows(
+    size_t num_nodes,
+    const std::function<void(NodeId, std::vector<NodeId>&)>& fill_row) {
+  CsrGraph graph;
+  graph.offsets_.reserve(num_nodes + 1);
+  graph.offsets_.push_back(0);
+  std::vector<NodeId> row;
+  for (NodeId node = 0; node < num_nodes; ++node) {
+    row.clear();
+    fill_row(node, row);
+    std::sort(row.begin(), row.end());
+    row.erase(std::unique(row.begin(), row.end()), row.end());
+    graph.targets_.insert(graph.targets_.end(), row.begin(), row.end());
+    graph.offsets_.push_back(graph.targets_.size());
+  }
+  return graph;
+}
+
+bool CsrGraph::HasEdge(NodeId from, NodeId to) const {
+  const auto neighbors = Neighbors(from);
+  return std::binary_search(neighbors.begin(), neighbors.end(), to);
+}
+
+CsrGraph CsrGraph::Reversed(ThreadPool* pool) const {
+  const size_t num_nodes = NumNodes();
+  CsrGraph reversed;
+  reversed.offsets_.assign(num_nodes + 1, 0);
+  reversed.targets_.resize(targets_.size());
+
+  ParallelFor(pool, num_nodes, [&](size_t from, unsigned) {
+    for (const NodeId to : Neighbors(static_cast<NodeId>(from))) {
+      std::atomic_ref<uint64_t>(reversed.offsets_[to + 1])
+          .fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  for (size_t i = 0; i < num_nodes; ++i) {
+    reversed.offsets_[i + 1] += reversed.offsets_[i];
+  }
+
+  std::vector<uint64_t> cursor(reversed.offsets_.begin(),
+                               reversed.offsets_.end() - 1);
+  if (pool == nullptr) {
+    // Walking sources in ascending order keeps every reversed row sorted
+    for (NodeId from = 0; from < num_nodes; ++from) {
+      for (const NodeId to : Neighbors(from)) {
+        reversed.targets_[cursor[to]++] = from;
+      }
+    }
+    return reversed;
+  }
+
+  // Concurrent fills land in arbitrary order within a row; sort them after
+  ParallelFor(pool, num_nodes, [&](size_t from, unsigned) {
+    for (const NodeId to : Neighbors(static_cast<NodeId>(from))) {
+      const uint64_t slot = std::atomic_ref<uint64_t>(cursor[to]).fetch_add(
+          1, std::memory_order_relaxed);
+      reversed.targets_[slot] = static_cast<NodeId>(from);
+    }
+  });
+  ParallelFor(pool, num_nodes, [&](size_t node, unsigned) {
+    std::sort(reversed.targets_.begin() + reversed.offsets_[node],
+              reversed.targets_.begin() + reversed.offsets_[node + 1]);
+  });
+  return reversed;
+}
+
+void CsrGraph::Patch(
+    const IdCompaction& compaction,
+    const std::unordered_map<NodeId, std::vector<NodeId>>& rows) {
+  const size_t old_size = NumNodes();
+  const size_t new_size = compaction.new_size;
+  // Ids not keeping their own row: replaced rows, moved-into slots and ids
+  // past the old size. Their rows are set aside before anything moves.
+  std::vector<NodeId> special;
+  special.reserve(rows.size() + compaction.moves.size());
+  for (const auto& [node, row] : rows) {
+    special.push_back(node);
+  }
+  for (const auto& [from, to] : compaction.moves) {
+    special.push_back(to);
+  }
+  for (size_t node = old_size; node < new_size; ++node) {
+    special.push_back(static_cast<NodeId>(node));
+  }
+  std::sort(special.begin(), special.end());
+  special.erase(std::unique(special.begin(), special.end()), special.end());
+  special.erase(std::lower_bound(special.begin(), special.end(), new_size),
+                special.end());
+  std::vector<NodeId> special_targets;
+  std::vector<size_t> special_ends;
+  special_ends.reserve(special.size());
+  for (const NodeId node : special) {
+    if (const auto it = rows.find(node); it != rows.end()) {
+      special_targets.insert(special_targets.end(), it->second.begin(),
+                             it->second.end());
+    } else if (const NodeId origin = compaction.Origin(node);
+               origin < old_size) {
+      const auto neighbors = Neighbors(origin);
+      special_targets.insert(special_targets.end(), neighbors.begin(),
+                             neighbors.end());
+    }
+    special_ends.push_back(special_targets.size());
+  }
+
+  // Lay out the runs of untouched rows between them
+  struct Run {
+    NodeId begin, end;          // ids
+    uint64_t old_begin, old_end;  // positions in targets_
+    uint64_t new_begin;
+  };
+  std::vector<Run> runs;
+  runs.reserve(special.size() + 1);
+  uint64_t size = 0;
+  NodeId node = 0;
+  const NodeId kept_end = static_cast<NodeId>(std::min(old_size, new_size));
+  for (size_t i = 0; i <= special.size(); ++i) {
+    const NodeId run_end = i < special.size()
+                               ? std::min(special[i], kept_end)
+                               : kept_end;
+    if (node < run_end) {
+      runs.push_back({node, run_end, offsets_[node], offsets_[run_end], size});
+      size += offsets_[run_end] - offsets_[node];
+    }
+    if (i < special.size()) {
+      size += special_ends[i] - (i == 0 ? 0 : special_ends[i - 1]);
+      node = special[i] + 1;
+    }
+  }
+
+  // A run moving left never lands on the source of a run before it that
+  // still has to move, and the other way round: shift the left-moving runs
+  // first to last, then the right-moving ones last to first
+  if (size > targets_.size()) {
+    targets_.resize(size);
+  }
+  for (const Run& run : runs) {
+    if (run.new_begin < run.old_begin) {
+      std::copy(targets_.begin() + run.old_begin,
+                targets_.begin() + run.old_end,
+                targets_.begin() + run.new_begin);
+    }
+  }
+  for (auto run = runs.rbegin(); run != runs.rend(); ++run) {
+    if (run->new_begin > run->old_begin) {
+      std::copy_backward(
+          targets_.begin() + run->old_begin, targets_.begin() + run->old_end,
+          targets_.begin() + run->new_begin + (run->old_end - run->old_begin));
+    }
+  }
+  targets_.resize(size);
+  offsets_.resize(new_size + 1);
+  for (const Run& run : runs) {
+    if (run.new_begin != run.old_begin) {
+      for (NodeId row = run.begin + 1; row <= run.end; ++row) {
+        offsets_[row] = offsets_[row] - run.old_begin + run.new_begin;
+      }
+    }
+  }
+  offsets_[0] = 0;
+  for (size_t i = 0; i < special.size(); ++i) {
+    const size_t row_begin = i == 0 ? 0 : special_ends[i - 1];
+    const uint64_t begin = offsets_[special[i]];
+    std::copy(special_targets.begin() + row_begin,
+              special_targets.begin() + special_ends[i],
+              targets_.begin() + begin);
+    offsets_[special[i] + 1] = begin + special_ends[i] - row_begin;
+  }
+}
+
+void PatchReverse(CsrGraph& reversed, const CsrGraph& graph,
+                  const IdCompaction& compaction,
+                  const std::unordered_map<NodeId, std::vector<NodeId>>& rows) {
+  const size_t old_size = graph.NumNodes();
+  // Nodes whose row was replaced or moved: their reverse edges are re-added
+  std::unordered_set<NodeId> touched;
+  for (const auto& [node, row] : rows) {
+    touched.insert(node);
+  }
+  for (const auto& [from, to] : compaction.moves) {
+    touched.insert(to);
+  }
+
+  std::unordered_map<NodeId, std::vector<NodeId>> added;
+  std::unordered_map<NodeId, std::vector<NodeId>> reversed_rows;
+  const auto rebuild_old = [&](NodeId old_target) {
+    const NodeId target = compaction.Map(old_target);
+    if (target != IdCompaction::kRemoved) {
+      reversed_rows.try_emplace(target);
+    }
+  };
+  for (const NodeId node : touched) {
+    const NodeId origin = compaction.Origin(node);
+    std::span<const NodeId> old_row;
+    if (origin < old_size) {
+      old_row = graph.Neighbors(origin);
+      for (const NodeId old_target : old_row) {
+        rebuild_old(old_target);
+      }
+    }
+    const auto it = rows.find(node);
+    const std::span<const NodeId> new_row =
+        it != rows.end() ? std::span<const NodeId>(it->second) : old_row;
+    for (const NodeId target : new_row) {
+      added[target].push_back(node);
+      reversed_rows.try_emplace(target);
+    }
+  }
+  for (const NodeId removed : compaction.removed) {
+    if (removed < old_size) {
+      for (const NodeId old_target : graph.Neighbors(removed)) {
+        rebuild_old(old_target);
+      }
+    }
+  }
+
+  for (auto& [target, row] : reversed_rows) {
+    if (const NodeId origin = compaction.Origin(target);
+        origin < reversed.NumNodes()) {
+      for (const NodeId old_dependent : reversed.Neighbors(origin)) {
+        const NodeId dependent = compaction.Map(old_dependent);
+        if (dependent != IdCompaction::kRemoved &&
+            !touched.contains(dependent)) {
+          row.push_back(dependent);
+        }
+      }
+    }
+    if (const auto it = added.find(target); it != added.end()) {
+      row.insert(row.end(), it->second.begin(), it->second.end());
+    }
+    std::sort(row.begin(), row.end());
+    row.erase(std::unique(row.begin(), row.end()), row.end());
+  }
+  reversed.Patch(compaction, reversed_rows);
+}
+
+std::vector<std::vector<NodeId>> ComputeHeightLevels(const CsrGraph& dag,
+                                                     ThreadPool* pool) {
+  const size_t num_nodes = dag.NumNodes();
+  const CsrGraph dependents = dag.Reversed(pool);
+
+  // pending[n]: dependencies of n whose level is not known yet
+  std::vector<uint32_t> pending(num_nodes);
+  std::vector<NodeId> frontier;
+  for (NodeId node = 0; node < num_nodes; ++node) {
+    pending[node] = static_cast<uint32_t>(dag.Neighbors(node).size());
+    if (pending[node] == 0) {
+      frontier.push_back(node);
+    }
+  }
+
+  std::vector<std::vector<NodeId>> levels;
+  std::vector<std::vector<NodeId>> next_per_thread(
+      pool ? std::max(1u, pool->Size()) : 1);
+  while (!frontier.empty()) {
+    // A node joins the next level once its last dependency got a level
+    ParallelFor(pool, frontier.size(), [&](size_t i, unsigned worker_idx) {
+      for (const NodeId dependent : dependents.Neighbors(frontier[i])) {
+        if (std::atomic_ref<uint32_t>(pending[dependent])
+                .fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          next_per_thread[worker_idx].push_back(dependent);
+        }
+      }
+    });
+    levels.push_back(std::move(frontier));
+    frontier.clear();
+    for (auto& next : next_per_thread) {
+      frontier.insert(frontier.end(), next.begin(), next.end());
+      next.clear();
+    }
+    std::sort(frontier.begin(), frontier.end());
+  }
+  return levels;
+}
+
+std::span<const NodeId> FileDepGraph::at(std::string_view name) const {
+  const auto id = names_.Find(name);
+  if (!id) {
+    throw std::out_of_range("unknown file: " + std::string(name));
+  }
+  return deps_.Neighbors(*id);
+}
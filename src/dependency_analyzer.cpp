@@ -2,148 +2,197 @@
 
 #include <algorithm>
 #include <cassert>
-#include <filesystem>
 #include <functional>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <optional>
-#include <regex>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <string_view>
 
-std::string GetFileNameFromPath(const std::string& path) {
-  std::regex file_regex(R"([^/]+$)");
-  std::smatch match;
+#include "graph_exporter.h"
+#include "profiler.h"
+#include "reachability.h"
+#include "thread_pool.h"
 
-  if (std::regex_search(path, match, file_regex)) {
-    return match.str(0);  // Return the matched file name
-  }
+FileDepGraph BuildFileDependencies(
+    const std::vector<File>& files,
+    const std::vector<std::string>& include_paths, ThreadPool* pool) {
+  return FileDepGraphBuilder(files, include_paths, pool).TakeGraph();
+}
+
+// -----------------------------------------------------------------------------
 
-  return "";  // Return an empty string if no match is found
+SCCBuilder::SCCBuilder(const FileDepGraph& file_deps) : file_deps_(file_deps) {
+  Profiler::Phase phase("SCCBuilder");
+  BuildSCC();
+  BuildSCCNames();  // Build SCC names once the SCCs are detected
+  BuildSCCDependencies();
 }
 
-StrDepMap BuildFileDependencies(const std::vector<File>& files) {
-  // with this, src_path/x.cpp and include_path/x.h will be considered
-  // as the same file component.
-  auto get_file_stem = [](const std::string& path) {
-    return std::filesystem::path(path).stem().string();
+// Scratch space of the iterative Tarjan walk, allocated once per build. A
+// walk over every node indexes it by NodeId; a walk over a few nodes keeps
+// one slot per node, so its cost does not grow with the graph.
+struct SCCBuilder::TarjanState {
+  static constexpr uint32_t kUnvisited = std::numeric_limits<uint32_t>::max();
+  // Nodes outside the walked subgraph: treated as visited and off the stack
+  static constexpr uint32_t kExcluded = kUnvisited - 1;
+
+  // One frame per node on the DFS path: the node, its slot and the position
+  // in the CSR targets array of the next edge to explore
+  struct Frame {
+    NodeId node;
+    uint32_t slot;
+    uint64_t next_edge;
   };
 
-  StrDepMap file_deps;
-  for (const auto& file : files) {
-    for (const auto& header_path : file.included_headers) {
-      // When dealing with included files, only check files that are under the
-      // user specified directory. (e.g. those included by the files input)
-      const auto header = GetFileNameFromPath(header_path);
-      auto it = std::find_if(
-          files.begin(), files.end(),
-          [&header](const File& f) { return f.name.ends_with(header); });
-      if (it != files.end()) {
-        const auto src_stem = get_file_stem(file.name);
-        const auto tgt_stem = get_file_stem(it->name);
-        if (file_deps.find(src_stem) == file_deps.end()) {
-          file_deps[src_stem] = {};
-        }
-        if (file_deps.find(tgt_stem) == file_deps.end()) {
-          file_deps[tgt_stem] = {};
-        }
-        if (src_stem != tgt_stem) {
-          file_deps[src_stem].insert(tgt_stem);
-        }
-      } else {
-        std::cerr << "Skip included file: " << header << " for " << file.name
-                  << " as it's not under user specified directory."
-                  << std::endl;
-      }
+  // Walks every node
+  explicit TarjanState(size_t num_nodes)
+      : index(num_nodes, kUnvisited), lowlink(num_nodes, 0),
+        on_stack(num_nodes, false) {
+    stack.reserve(num_nodes);
+    call_stack.reserve(num_nodes);
+  }
+  // Walks the subgraph induced by `nodes`
+  explicit TarjanState(std::span<const NodeId> nodes)
+      : TarjanState(nodes.size()) {
+    slots.reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      slots.emplace(nodes[i], static_cast<uint32_t>(i));
     }
   }
-  return file_deps;
-}
 
-// -----------------------------------------------------------------------------
+  // Where node lives in the arrays, or kExcluded
+  uint32_t Slot(NodeId node) const {
+    if (slots.empty()) {
+      return node;
+    }
+    const auto it = slots.find(node);
+    return it == slots.end() ? kExcluded : it->second;
+  }
 
-SCCBuilder::SCCBuilder(const StrDepMap& file_deps) : file_deps_(file_deps) {
-  BuildSCC();
-  BuildSCCNames();  // Build SCC names once the SCCs are detected
-  BuildSCCDependencies();
-}
+  std::unordered_map<NodeId, uint32_t> slots;  // empty when walking all
+  std::vector<uint32_t> index;
+  std::vector<uint32_t> lowlink;
+  std::vector<bool> on_stack;
+  std::vector<NodeId> stack;
+  std::vector<Frame> call_stack;
+  uint32_t index_counter = 0;
+};
 
 void SCCBuilder::BuildSCC() {
-  std::map<std::string, int> index;
-  std::map<std::string, int> lowlink;
-  std::map<std::string, bool> on_stack;
-  std::vector<std::string> stack;
-  int index_counter = 0;
+  const size_t num_nodes = file_deps_.Graph().NumNodes();
+  TarjanState state(num_nodes);
 
-  for (const auto& [node, _] : file_deps_) {
-    if (index.find(node) == index.end()) {
-      TarjanSCC(node, stack, index, lowlink, on_stack, index_counter);
+  for (NodeId node = 0; node < num_nodes; ++node) {
+    if (state.index[node] == TarjanState::kUnvisited) {
+      TarjanSCC(node, state, scc_components_);
     }
   }
 }
 
-void SCCBuilder::TarjanSCC(const std::string& node,
-                           std::vector<std::string>& stack,
-                           std::map<std::string, int>& index,
-                           std::map<std::string, int>& lowlink,
-                           std::map<std::string, bool>& on_stack,
-                           int& index_counter) {
-  index[node] = index_counter;
-  lowlink[node] = index_counter;
-  index_counter++;
-  stack.push_back(node);
-  on_stack[node] = true;
-
-  for (const auto& neighbor : file_deps_.at(node)) {
-    if (index.find(neighbor) == index.end()) {
-      TarjanSCC(neighbor, stack, index, lowlink, on_stack, index_counter);
-      lowlink[node] = std::min(lowlink[node], lowlink[neighbor]);
-    } else if (on_stack[neighbor]) {
-      lowlink[node] = std::min(lowlink[node], index[neighbor]);
-    }
-  }
-
-  if (lowlink[node] == index[node]) {
-    std::vector<std::string> component;
-    std::string w;
-    do {
-      w = stack.back();
-      stack.pop_back();
-      on_stack[w] = false;
-      component.push_back(w);
-    } while (w != node);
-    scc_components_.emplace_back("", component);  // Add SCC without name yet
+void SCCBuilder::TarjanSCC(NodeId root, TarjanState& state,
+                           std::vector<SCCComponent>& out) const {
+  // Tarjan's algorithm with the recursion unrolled onto state.call_stack, so
+  // deep include chains cannot overflow the native stack. Components come out
+  // in the same order as with the recursive formulation.
+  const auto& offsets = file_deps_.Graph().Offsets();
+  const auto& targets = file_deps_.Graph().Targets();
+
+  auto visit = [&state, &offsets](NodeId node, uint32_t slot) {
+    state.index[slot] = state.index_counter;
+    state.lowlink[slot] = state.index_counter;
+    state.index_counter++;
+    state.stack.push_back(node);
+    state.on_stack[slot] = true;
+    state.call_stack.push_back({node, slot, offsets[node]});
+  };
+
+  visit(root, state.Slot(root));
+  while (!state.call_stack.empty()) {
+    auto& frame = state.call_stack.back();
+    const NodeId node = frame.node;
+    const uint32_t slot = frame.slot;
+
+    if (frame.next_edge < offsets[node + 1]) {
+      const NodeId neighbor = targets[frame.next_edge++];
+      const uint32_t neighbor_slot = state.Slot(neighbor);
+      if (neighbor_slot == TarjanState::kExcluded) {
+        continue;
+      }
+      if (state.index[neighbor_slot] == TarjanState::kUnvisited) {
+        // "recurse"; frame is invalidated from here on
+        visit(neighbor, neighbor_slot);
+      } else if (state.on_stack[neighbor_slot]) {
+        state.lowlink[slot] =
+            std::min(state.lowlink[slot], state.index[neighbor_slot]);
+      }
+      continue;
+    }
+
+    // All edges explored: node is done, "return" to the parent
+    if (state.lowlink[slot] == state.index[slot]) {
+      std::vector<NodeId> component;
+      NodeId w;
+      do {
+        w = state.stack.back();
+        state.stack.pop_back();
+        state.on_stack[state.Slot(w)] = false;
+        component.push_back(w);
+      } while (w != node);
+      // Add SCC without names yet
+      out.emplace_back("", std::vector<std::string>{});
+      out.back().member_ids = std::move(component);
+    }
+    state.call_stack.pop_back();
+    if (!state.call_stack.empty()) {
+      const uint32_t parent = state.call_stack.back().slot;
+      state.lowlink[parent] =
+          std::min(state.lowlink[parent], state.lowlink[slot]);
+    }
   }
 }
 
 void SCCBuilder::BuildSCCNames() {
-  assert(!scc_components_.empty());
+  file_to_component_.assign(file_deps_.Names().Size(), 0);
 
   for (size_t i = 0; i < scc_components_.size(); ++i) {
-    std::string concatenated_name;
-
-    // For each SCC component, concatenate the member names
-    for (const auto& file : scc_components_[i].members) {
-      file_to_component_[file] = i;     // Map file to its component index
-      concatenated_name += file + "|";  // Append file name with separator
+    for (const auto file : scc_components_[i].member_ids) {
+      file_to_component_[file] = i;  // Map file to its component index
     }
+    NameComponent(scc_components_[i]);
+  }
+}
 
-    // Remove trailing '|'
-    if (!concatenated_name.empty()) {
-      concatenated_name.pop_back();
-    }
+void SCCBuilder::NameComponent(SCCComponent& component) const {
+  const auto& names = file_deps_.Names();
+  std::string concatenated_name;
+
+  // For each SCC component, concatenate the member names
+  component.members.clear();
+  component.members.reserve(component.member_ids.size());
+  for (const auto file : component.member_ids) {
+    component.members.emplace_back(names.Name(file));
+    concatenated_name += component.members.back();
+    concatenated_name += '|';  // Append file name with separator
+  }
 
-    // Assign concatenated name to the SCC component
-    scc_components_[i].name = concatenated_name;
+  // Remove trailing '|'
+  if (!concatenated_name.empty()) {
+    concatenated_name.pop_back();
   }
+
+  // Assign concatenated name to the SCC component
+  component.name = std::move(concatenated_name);
 }
 
 std::optional<SccIdx> SCCBuilder::GetComponentIndex(
-    const std::string& file) const {
-  auto it = file_to_component_.find(file);
-  if (it != file_to_component_.end()) {
-    return it->second;
+    std::string_view file) const {
+  if (auto id = file_deps_.Names().Find(file)) {
+    return file_to_component_[*id];
   }
   return std::nullopt;
 }
@@ -163,142 +212,663 @@ std::string SCCBuilder::ToDescription() const {
 }
 
 void SCCBuilder::BuildSCCDependencies() {
-  for (const auto& [file, dependencies] : file_deps_) {
-    SccIdx component_idx = file_to_component_[file];  // Component of the file
+  const auto& graph = file_deps_.Graph();
+  std::vector<CsrGraph::Edge> edges;
+  for (NodeId file = 0; file < graph.NumNodes(); ++file) {
+    const SccIdx component_idx = file_to_component_[file];
 
-    for (const auto& dep : dependencies) {
-      SccIdx dep_component_idx =
-          file_to_component_[dep];  // Component of the dependency
+    for (const auto dep : graph.Neighbors(file)) {
+      const SccIdx dep_component_idx = file_to_component_[dep];
 
       // Add a dependency between different components
       if (component_idx != dep_component_idx) {
-        component_deps_[component_idx].insert(dep_component_idx);
+        edges.emplace_back(component_idx, dep_component_idx);
       }
     }
   }
+  component_deps_ =
+      CsrGraph::FromEdges(scc_components_.size(), std::move(edges));
+  component_dependents_ = component_deps_.Reversed();
 }
 
-// -----------------------------------------------------------------------------
-
-DependencyAnalyzer::DependencyAnalyzer(const std::vector<File>& files)
-    : max_depth_{0},
-      file_deps_{BuildFileDependencies(files)},
-      scc_{file_deps_},
-      components_vec_{scc_.GetSCCComponents()},
-      simplified_component_deps_{scc_.GetSCCDeps()} {
-  PruneTransitiveDependencies();
-  TopologicalSortSCCDependencies();
-  BuildMinDepthRelation();  // for better ordering of the output
-}
+SCCBuilder::Update SCCBuilder::ApplyFileUpdate(
+    const FileDepGraphBuilder::Update& file_update,
+    std::vector<SccIdx> affected) {
+  constexpr SccIdx kNoComponent = std::numeric_limits<SccIdx>::max();
+  const auto& graph = file_deps_.Graph();
+  const IdCompaction& file_ids = file_update.compaction;
+  const size_t old_count = scc_components_.size();
+  Update update;
+  update.old_num_components = old_count;
+
+  std::sort(affected.begin(), affected.end());
+  affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+  auto is_affected = [&](SccIdx component_idx) {
+    return std::binary_search(affected.begin(), affected.end(),
+                              component_idx);
+  };
 
-void DependencyAnalyzer::PruneTransitiveDependencies() {
-  for (auto& [node, dependencies] : simplified_component_deps_) {
-    std::unordered_set<SccIdx> transitive_dependencies;
+  // Carry the memberships over to the new file ids; new files have none yet
+  file_to_component_.resize(file_ids.new_size + file_ids.removed.size(),
+                            kNoComponent);
+  for (const auto& [from, to] : file_ids.moves) {
+    const SccIdx component_idx = file_to_component_[from];
+    file_to_component_[to] = component_idx;
+    if (component_idx != kNoComponent && !is_affected(component_idx)) {
+      auto& member_ids = scc_components_[component_idx].member_ids;
+      std::replace(member_ids.begin(), member_ids.end(), from, to);
+    }
+  }
+  file_to_component_.resize(file_ids.new_size);
+
+  // Partition the files of the affected components and the new files again
+  std::vector<NodeId> nodes;
+  for (const SccIdx component_idx : affected) {
+    for (const NodeId file : scc_components_[component_idx].member_ids) {
+      if (const NodeId mapped = file_ids.Map(file);
+          mapped != IdCompaction::kRemoved) {
+        nodes.push_back(mapped);
+      }
+    }
+  }
+  for (NodeId file = file_update.old_num_nodes;
+       file < file_ids.new_size + file_ids.removed.size(); ++file) {
+    if (const NodeId mapped = file_ids.Map(file);
+        mapped != IdCompaction::kRemoved) {
+      nodes.push_back(mapped);
+    }
+  }
+  std::sort(nodes.begin(), nodes.end());
+  std::vector<SCCComponent> rebuilt;
+  if (!nodes.empty()) {
+    TarjanState state(nodes);
+    for (const NodeId node : nodes) {
+      if (state.index[state.Slot(node)] == TarjanState::kUnvisited) {
+        TarjanSCC(node, state, rebuilt);
+      }
+    }
+  }
 
-    // Collect all transitive dependencies for the current node
-    for (const auto& direct_dep : dependencies) {
-      CollectTransitiveDependencies(direct_dep, transitive_dependencies);
+  // A rebuilt component with unchanged members returns to its old id; the
+  // others take the remaining affected ids, then fresh ones
+  std::vector<SccIdx> placement(rebuilt.size(), kNoComponent);
+  std::unordered_set<SccIdx> taken;
+  std::vector<bool> same_members(rebuilt.size(), false);
+  for (size_t i = 0; i < rebuilt.size(); ++i) {
+    const auto& member_ids = rebuilt[i].member_ids;
+    const SccIdx old = file_to_component_[member_ids.front()];
+    if (old != kNoComponent && is_affected(old) && !taken.contains(old) &&
+        scc_components_[old].member_ids.size() == member_ids.size() &&
+        std::all_of(member_ids.begin(), member_ids.end(), [&](NodeId file) {
+          return file_to_component_[file] == old;
+        })) {
+      placement[i] = old;
+      taken.insert(old);
+      same_members[i] = true;
+    }
+  }
+  auto free_slot = affected.begin();
+  SccIdx next_new = old_count;
+  for (auto& slot : placement) {
+    if (slot != kNoComponent) {
+      continue;
+    }
+    while (free_slot != affected.end() && taken.contains(*free_slot)) {
+      ++free_slot;
+    }
+    if (free_slot != affected.end()) {
+      slot = *free_slot;
+      taken.insert(slot);
+    } else {
+      slot = next_new++;
     }
+  }
+  std::vector<SccIdx> unused;
+  for (const SccIdx component_idx : affected) {
+    if (!taken.contains(component_idx)) {
+      unused.push_back(component_idx);
+    }
+  }
+  update.compaction = PlanIdCompaction(next_new, std::move(unused));
+  const IdCompaction& ids = update.compaction;
+
+  // The condensed graphs are patched last; until then they are the old ones
+  const CsrGraph& old_deps = component_deps_;
+  const CsrGraph& old_dependents = component_dependents_;
+
+  // The components reaching a removed or moved one still name it in their
+  // reachability rows
+  {
+    std::vector<SccIdx> frontier = ids.removed;
+    for (const auto& [from, to] : ids.moves) {
+      frontier.push_back(from);
+    }
+    std::unordered_set<SccIdx> seen;
+    while (!frontier.empty()) {
+      const SccIdx component_idx = frontier.back();
+      frontier.pop_back();
+      if (component_idx >= old_count) {
+        continue;
+      }
+      for (const SccIdx dependent : old_dependents.Neighbors(component_idx)) {
+        if (seen.insert(dependent).second) {
+          update.renumbered_dependents.push_back(dependent);
+          frontier.push_back(dependent);
+        }
+      }
+    }
+    std::sort(update.renumbered_dependents.begin(),
+              update.renumbered_dependents.end());
+  }
 
-    // Remove direct dependencies that are also reachable transitively
-    for (auto it = dependencies.begin(); it != dependencies.end();) {
-      if (transitive_dependencies.find(*it) != transitive_dependencies.end()) {
-        it = dependencies.erase(it);  // Remove transitive dependency
-      } else {
-        ++it;
+  // Move everything to the final ids
+  scc_components_.resize(next_new, SCCComponent("", {}));
+  for (size_t i = 0; i < rebuilt.size(); ++i) {
+    for (const NodeId file : rebuilt[i].member_ids) {
+      file_to_component_[file] = placement[i];
+    }
+    scc_components_[placement[i]] = std::move(rebuilt[i]);
+    NameComponent(scc_components_[placement[i]]);
+  }
+  for (const auto& [from, to] : ids.moves) {
+    scc_components_[to] = std::move(scc_components_[from]);
+    for (const NodeId file : scc_components_[to].member_ids) {
+      file_to_component_[file] = to;
+    }
+  }
+  scc_components_.resize(ids.new_size, SCCComponent("", {}));
+
+  // Rows to rebuild (new ids, with whether the members are new): components
+  // with new members, with a file whose edges changed, or depending on an
+  // affected component
+  std::unordered_map<SccIdx, bool> recomputed;
+  for (size_t i = 0; i < rebuilt.size(); ++i) {
+    recomputed[ids.Map(placement[i])] = !same_members[i];
+  }
+  for (const auto* edges :
+       {&file_update.added_edges, &file_update.removed_edges}) {
+    for (const auto& [from, to] : *edges) {
+      if (const NodeId file = file_ids.Map(from);
+          file != IdCompaction::kRemoved) {
+        recomputed.try_emplace(file_to_component_[file], false);
+      }
+    }
+  }
+  for (const SccIdx component_idx : affected) {
+    for (const SccIdx dependent : old_dependents.Neighbors(component_idx)) {
+      if (const SccIdx mapped = ids.Map(dependent);
+          mapped != IdCompaction::kRemoved) {
+        recomputed.try_emplace(mapped, false);
       }
     }
   }
+  auto mapped_old_row = [&](SccIdx origin) {
+    std::vector<SccIdx> row;
+    if (origin < old_count) {
+      for (const SccIdx dep : old_deps.Neighbors(origin)) {
+        row.push_back(ids.Map(dep));  // kRemoved kept so the rows differ
+      }
+    }
+    std::sort(row.begin(), row.end());
+    return row;
+  };
+  std::unordered_map<SccIdx, std::vector<SccIdx>> rows;
+  for (const auto& [component_idx, new_members] : recomputed) {
+    std::vector<SccIdx>& row = rows[component_idx];
+    for (const NodeId file : scc_components_[component_idx].member_ids) {
+      for (const NodeId dep : graph.Neighbors(file)) {
+        if (file_to_component_[dep] != component_idx) {
+          row.push_back(file_to_component_[dep]);
+        }
+      }
+    }
+    std::sort(row.begin(), row.end());
+    row.erase(std::unique(row.begin(), row.end()), row.end());
+    if (new_members ||
+        row != mapped_old_row(ids.Origin(component_idx))) {
+      update.changed.push_back(component_idx);
+    }
+  }
+  std::sort(update.changed.begin(), update.changed.end());
+  // The other dependents of moved components only need their rows renamed
+  for (const auto& [from, to] : ids.moves) {
+    if (from >= old_count) {
+      continue;
+    }
+    for (const SccIdx dependent : old_dependents.Neighbors(from)) {
+      if (const SccIdx mapped = ids.Map(dependent);
+          mapped != IdCompaction::kRemoved && !rows.contains(mapped)) {
+        rows.emplace(mapped, mapped_old_row(dependent));
+      }
+    }
+  }
+  PatchReverse(component_dependents_, component_deps_, ids, rows);
+  component_deps_.Patch(ids, rows);
+  return update;
 }
 
-void DependencyAnalyzer::CollectTransitiveDependencies(
-    SccIdx component_idx, std::unordered_set<SccIdx>& reachable_indices) {
-  // If the component has no dependencies, return
-  const auto& original_deps = scc_.GetSCCDeps();
-  if (original_deps.find(component_idx) == original_deps.end()) {
-    return;
+// -----------------------------------------------------------------------------
+
+namespace {
+
+// The dependencies of component_idx not reachable through another one, given
+// the union of its dependencies' reachability rows
+std::vector<SccIdx> KeptDependencies(
+    const CsrGraph& deps, SccIdx component_idx,
+    const ReachabilityIndex::Accumulator& acc) {
+  std::vector<SccIdx> kept;
+  for (const SccIdx dep : deps.Neighbors(component_idx)) {
+    if (!acc.Test(dep)) {
+      kept.push_back(dep);
+    }
+  }
+  return kept;
+}
+
+std::unique_ptr<ThreadPool> MakeAnalyzerPool(const AnalyzerOptions& options) {
+  if (options.pool != nullptr ||
+      ThreadPool::ResolveThreadCount(options.jobs) <= 1) {
+    return nullptr;
   }
+  return std::make_unique<ThreadPool>(options.jobs);
+}
+
+}  // namespace
 
-  // Recursively visit each neighbor (dependency)
-  for (auto neighbor : original_deps.at(component_idx)) {
-    if (reachable_indices.find(neighbor) == reachable_indices.end()) {
-      reachable_indices.insert(neighbor);
-      CollectTransitiveDependencies(neighbor, reachable_indices);
+DependencyAnalyzer::DependencyAnalyzer(const std::vector<File>& files,
+                                       const AnalyzerOptions& options)
+    : owned_pool_{MakeAnalyzerPool(options)},
+      pool_{options.pool ? options.pool : owned_pool_.get()},
+      max_depth_{0},
+      file_graph_{std::make_unique<FileDepGraphBuilder>(
+          files, options.include_paths, pool_)},
+      scc_{file_graph_->Graph()},
+      components_vec_{scc_.GetSCCComponents()},
+      render_cache_{std::make_unique<RenderCache>(options.render_cache_bytes)} {
+  // Depth levels come first: the edge pruning below processes one level at a
+  // time
+  {
+    Profiler::Phase phase("DepthLevels");
+    BuildMinDepthRelation();
+  }
+  {
+    Profiler::Phase phase("PruneTransitiveDependencies");
+    PruneTransitiveDependencies();
+  }
+  {
+    Profiler::Phase phase("TopologicalSort");
+    TopologicalSortSCCDependencies();
+  }
+  {
+    Profiler::Phase phase("KeywordIndex");
+    for (SccIdx i = 0; i < components_vec_.size(); ++i) {
+      keyword_index_.Set(i, components_vec_[i].name);
     }
   }
+  if (Profiler::Enabled()) {
+    Profiler::Count(Profiler::kSccCount, components_vec_.size());
+    for (const auto& component : components_vec_) {
+      Profiler::Max(Profiler::kLargestScc, component.member_ids.size());
+    }
+    Profiler::Count(Profiler::kEdgesPruned,
+                    scc_.GetSCCDeps().NumEdges() -
+                        simplified_component_deps_.NumEdges());
+  }
+}
+
+DependencyAnalyzer::~DependencyAnalyzer() = default;
+
+void DependencyAnalyzer::PruneTransitiveDependencies() {
+  // Components of one depth only depend on shallower ones, so each depth
+  // level is reduced in parallel. The reachability rows are kept for
+  // ApplyDelta.
+  const auto& deps = scc_.GetSCCDeps();
+  std::vector<std::vector<SccIdx>> kept(deps.NumNodes());
+  reachability_ = std::make_unique<ReachabilityIndex>(
+      deps, depth_to_component_idx_map_, pool_,
+      [&](SccIdx component_idx, const ReachabilityIndex::Accumulator& acc) {
+        kept[component_idx] = KeptDependencies(deps, component_idx, acc);
+      });
+  simplified_component_deps_ = CsrGraph::FromRows(
+      deps.NumNodes(), [&](SccIdx component_idx, std::vector<SccIdx>& row) {
+        row = std::move(kept[component_idx]);
+      });
 }
 
 void DependencyAnalyzer::TopologicalSortSCCDependencies() {
-  if (!topoplogical_sorted_sccs_.empty()) {
-    return;
+  // A component only depends on shallower ones, so listing the depth levels
+  // from the deepest down puts every component before its dependencies
+  topoplogical_sorted_sccs_.clear();
+  topoplogical_sorted_sccs_.reserve(components_vec_.size());
+  for (auto level = depth_to_component_idx_map_.rbegin();
+       level != depth_to_component_idx_map_.rend(); ++level) {
+    topoplogical_sorted_sccs_.insert(topoplogical_sorted_sccs_.end(),
+                                     level->begin(), level->end());
   }
+}
 
-  // If no dependencies exist, just add all components to the sorted list
-  if (simplified_component_deps_.empty()) {
-    for (size_t i = 0; i < scc_.GetSCCComponents().size(); ++i) {
-      topoplogical_sorted_sccs_.push_back(i);  // Add each component index
+void DependencyAnalyzer::BuildMinDepthRelation() {
+  //  the minimum depth of each node in a graph, where the depth of a node is
+  //  defined as the longest path from that node to any node with no
+  //  dependencies (a leaf node).
+  //  Pruning transitive edges never changes the longest path (a pruned edge
+  //  always has a longer detour), so the depths are computed on the full
+  //  condensed graph, level by level.
+  depth_to_component_idx_map_ = ComputeHeightLevels(scc_.GetSCCDeps(), pool_);
+  depth_map_.assign(components_vec_.size(), 0);
+  for (size_t depth = 0; depth < depth_to_component_idx_map_.size(); ++depth) {
+    for (const auto component_idx : depth_to_component_idx_map_[depth]) {
+      depth_map_[component_idx] = static_cast<int>(depth);
     }
+  }
+  max_depth_ = std::max(
+      0, static_cast<int>(depth_to_component_idx_map_.size()) - 1);
+}
+
+void DependencyAnalyzer::ApplyDelta(const FileDelta& delta) {
+  Profiler::Phase phase("ApplyDelta");
+  const auto file_update = file_graph_->ApplyDelta(delta);
+  if (file_update.empty()) {
     return;
   }
+  const auto update =
+      scc_.ApplyFileUpdate(file_update, FindAffectedComponents(file_update));
+  UpdateComponentRelations(update);
+  keyword_index_.Remap(update.compaction, update.old_num_components);
+  for (const SccIdx component_idx : update.changed) {
+    keyword_index_.Set(component_idx, components_vec_[component_idx].name);
+  }
+  render_cache_->Clear();
+}
+
+std::vector<SccIdx> DependencyAnalyzer::FindAffectedComponents(
+    const FileDepGraphBuilder::Update& file_update) const {
+  const size_t old_count = components_vec_.size();
+  // New files get placeholder ids after the components
+  auto component_of = [&](NodeId file) -> SccIdx {
+    return file < file_update.old_num_nodes
+               ? scc_.GetComponentOf(file)
+               : static_cast<SccIdx>(old_count + file -
+                                     file_update.old_num_nodes);
+  };
 
-  std::set<SccIdx> visited;
-  // no need to only traverse from node without deps
-  // as Dfs will ensure those nodes are visited first
-  for (const auto& [node, _] : simplified_component_deps_) {
-    if (visited.find(node) == visited.end()) {
-      Dfs(node, visited);
+  std::vector<SccIdx> affected;
+  // Components losing files or inner edges may split
+  for (const NodeId file : file_update.compaction.removed) {
+    affected.push_back(component_of(file));
+  }
+  for (const auto& [from, to] : file_update.removed_edges) {
+    if (component_of(from) == component_of(to)) {
+      affected.push_back(component_of(from));
     }
   }
 
-  std::reverse(topoplogical_sorted_sccs_.begin(),
-               topoplogical_sorted_sccs_.end());
-}
-
-void DependencyAnalyzer::Dfs(SccIdx component_idx, std::set<SccIdx>& visited) {
-  visited.insert(component_idx);
+  // Components may merge along a cycle through an added edge. Heights
+  // strictly decrease along the old edges, so such a cycle never visits a
+  // component lower than the lowest old component an added edge starts from.
+  std::unordered_map<SccIdx, std::vector<SccIdx>> added;
+  int min_height = std::numeric_limits<int>::max();
+  for (const auto& [from, to] : file_update.added_edges) {
+    if (component_of(from) != component_of(to)) {
+      added[component_of(from)].push_back(component_of(to));
+      if (component_of(from) < old_count) {
+        min_height = std::min(min_height, depth_map_[component_of(from)]);
+      }
+    }
+  }
+  if (added.empty()) {
+    return affected;
+  }
+  auto can_be_on_cycle = [&](SccIdx component_idx) {
+    return component_idx >= old_count ||
+           depth_map_[component_idx] >= min_height;
+  };
 
-  if (simplified_component_deps_.find(component_idx) !=
-      simplified_component_deps_.end()) {
-    for (const auto& neighbor : simplified_component_deps_.at(component_idx)) {
-      if (visited.find(neighbor) == visited.end()) {
-        Dfs(neighbor, visited);
+  // Forward from the added edges' targets, then back from their sources
+  // within what was reached
+  const auto& old_deps = scc_.GetSCCDeps();
+  std::unordered_map<SccIdx, std::vector<SccIdx>> reached_from;
+  std::vector<SccIdx> stack;
+  auto reach = [&](SccIdx from, SccIdx to) {
+    if (!can_be_on_cycle(to)) {
+      return;
+    }
+    auto [it, inserted] = reached_from.try_emplace(to);
+    if (from != to) {
+      it->second.push_back(from);
+    }
+    if (inserted) {
+      stack.push_back(to);
+    }
+  };
+  for (const auto& [from, targets] : added) {
+    for (const SccIdx to : targets) {
+      reach(to, to);
+    }
+  }
+  while (!stack.empty()) {
+    const SccIdx component_idx = stack.back();
+    stack.pop_back();
+    if (component_idx < old_count) {
+      for (const SccIdx dep : old_deps.Neighbors(component_idx)) {
+        reach(component_idx, dep);
+      }
+    }
+    if (auto it = added.find(component_idx); it != added.end()) {
+      for (const SccIdx dep : it->second) {
+        reach(component_idx, dep);
       }
     }
   }
 
-  topoplogical_sorted_sccs_.emplace_back(component_idx);
+  std::unordered_set<SccIdx> on_cycle;
+  for (const auto& [from, targets] : added) {
+    if (reached_from.contains(from) && on_cycle.insert(from).second) {
+      stack.push_back(from);
+    }
+  }
+  while (!stack.empty()) {
+    const SccIdx component_idx = stack.back();
+    stack.pop_back();
+    for (const SccIdx dependent : reached_from[component_idx]) {
+      if (on_cycle.insert(dependent).second) {
+        stack.push_back(dependent);
+      }
+    }
+  }
+  for (const SccIdx component_idx : on_cycle) {
+    if (component_idx < old_count) {
+      affected.push_back(component_idx);
+    }
+  }
+  return affected;
 }
 
-void DependencyAnalyzer::BuildMinDepthRelation() {
-  //  the minimum depth of each node in a graph, where the depth of a node is
-  //  defined as the longest path from that node to any node with no
-  //  dependencies (a leaf node).
-  assert(!topoplogical_sorted_sccs_.empty());
-
-  for (auto it = topoplogical_sorted_sccs_.rbegin();
-       it != topoplogical_sorted_sccs_.rend(); ++it) {
-    const auto& component_idx = *it;
-    int max_dependency_depth = 0;
-
-    if (simplified_component_deps_.find(component_idx) !=
-        simplified_component_deps_.end()) {
-      for (const auto& neighbor :
-           simplified_component_deps_.at(component_idx)) {
-        max_dependency_depth =
-            std::max(max_dependency_depth, depth_map_[neighbor] + 1);
+void DependencyAnalyzer::UpdateComponentRelations(
+    const SCCBuilder::Update& update) {
+  const auto& deps = scc_.GetSCCDeps();
+  const auto& dependents = scc_.GetSCCDependents();
+  const size_t num_components = deps.NumNodes();
+  const IdCompaction& ids = update.compaction;
+
+  // The depth buckets follow every component that is renumbered or changes
+  // depth, remembering the old size of each bucket they touch
+  auto& levels = depth_to_component_idx_map_;
+  std::map<int, size_t> old_level_sizes;
+  auto touch_level = [&](int depth) {
+    if (static_cast<size_t>(depth) >= levels.size()) {
+      levels.resize(depth + 1);
+    }
+    old_level_sizes.try_emplace(depth, levels[depth].size());
+    return &levels[depth];
+  };
+  auto leave_level = [&](SccIdx component_idx, int depth) {
+    auto& level = *touch_level(depth);
+    level.erase(std::lower_bound(level.begin(), level.end(), component_idx));
+  };
+  auto join_level = [&](SccIdx component_idx, int depth) {
+    auto& level = *touch_level(depth);
+    level.insert(std::lower_bound(level.begin(), level.end(), component_idx),
+                 component_idx);
+  };
+
+  // Follow the renumbering; added components start at depth 0 and empty rows
+  for (const SccIdx component_idx : ids.removed) {
+    leave_level(component_idx, depth_map_[component_idx]);
+  }
+  for (const auto& [from, to] : ids.moves) {
+    leave_level(from, depth_map_[from]);
+  }
+  depth_map_.resize(ids.new_size + ids.removed.size(), 0);
+  for (const auto& [from, to] : ids.moves) {
+    depth_map_[to] = depth_map_[from];
+    join_level(to, depth_map_[to]);
+  }
+  depth_map_.resize(num_components);
+  for (SccIdx component_idx = update.old_num_components;
+       component_idx < num_components; ++component_idx) {
+    join_level(component_idx, 0);
+  }
+  reachability_->Remap(ids, num_components, update.renumbered_dependents);
+
+  // Only the changed components and what depends on them can get new rows
+  std::unordered_set<SccIdx> in_region(update.changed.begin(),
+                                       update.changed.end());
+  std::vector<SccIdx> region(update.changed.begin(), update.changed.end());
+  for (size_t i = 0; i < region.size(); ++i) {
+    for (const SccIdx dependent : dependents.Neighbors(region[i])) {
+      if (in_region.insert(dependent).second) {
+        region.push_back(dependent);
       }
     }
+  }
 
-    depth_map_[component_idx] = max_dependency_depth;
-    depth_to_component_idx_map_[max_dependency_depth].push_back(component_idx);
-    max_depth_ = std::max(max_depth_, max_dependency_depth);
+  // Visit the region dependencies first, recomputing a component when it
+  // changed itself or one of its dependencies got a new height or row
+  const std::unordered_set<SccIdx> seed(update.changed.begin(),
+                                        update.changed.end());
+  std::unordered_map<SccIdx, uint32_t> pending;
+  std::vector<SccIdx> ready;
+  for (const SccIdx component_idx : region) {
+    const auto component_deps = deps.Neighbors(component_idx);
+    const auto count = std::count_if(
+        component_deps.begin(), component_deps.end(),
+        [&](SccIdx dep) { return in_region.contains(dep); });
+    if (count == 0) {
+      ready.push_back(component_idx);
+    } else {
+      pending[component_idx] = static_cast<uint32_t>(count);
+    }
   }
+  std::unordered_set<SccIdx> propagate;
+  std::unordered_map<SccIdx, std::vector<SccIdx>> kept;
+  auto acc = reachability_->MakeAccumulator();
+  while (!ready.empty()) {
+    const SccIdx component_idx = ready.back();
+    ready.pop_back();
+    for (const SccIdx dependent : dependents.Neighbors(component_idx)) {
+      if (in_region.contains(dependent) && --pending[dependent] == 0) {
+        ready.push_back(dependent);
+      }
+    }
+
+    const auto component_deps = deps.Neighbors(component_idx);
+    if (!seed.contains(component_idx) &&
+        std::none_of(component_deps.begin(), component_deps.end(),
+                     [&](SccIdx dep) { return propagate.contains(dep); })) {
+      continue;
+    }
+    int depth = 0;
+    for (const SccIdx dep : component_deps) {
+      depth = std::max(depth, depth_map_[dep] + 1);
+    }
+    const bool row_changed = reachability_->UpdateRow(
+        deps, component_idx, acc,
+        [&](SccIdx node, const ReachabilityIndex::Accumulator& merged) {
+          kept[node] = KeptDependencies(deps, node, merged);
+        });
+    if (depth != depth_map_[component_idx]) {
+      leave_level(component_idx, depth_map_[component_idx]);
+      join_level(component_idx, depth);
+      depth_map_[component_idx] = depth;
+      propagate.insert(component_idx);
+    } else if (row_changed) {
+      propagate.insert(component_idx);
+    }
+  }
+
+  if (!old_level_sizes.empty()) {
+    // The order lists the buckets from the deepest down: relist the touched
+    // ones and those between them, and shift the shallower tail as a block
+    const int deepest = old_level_sizes.rbegin()->first;
+    const int shallowest = old_level_sizes.begin()->first;
+    auto& order = topoplogical_sorted_sccs_;
+    size_t begin = 0;
+    for (size_t depth = deepest + 1; depth < levels.size(); ++depth) {
+      begin += levels[depth].size();
+    }
+    size_t old_span = 0;
+    size_t new_span = 0;
+    for (int depth = shallowest; depth <= deepest; ++depth) {
+      const auto it = old_level_sizes.find(depth);
+      old_span += it != old_level_sizes.end() ? it->second
+                                              : levels[depth].size();
+      new_span += levels[depth].size();
+    }
+    const size_t old_end = begin + old_span;
+    if (new_span > old_span) {
+      order.resize(order.size() + new_span - old_span);
+      std::move_backward(order.begin() + old_end,
+                         order.end() - (new_span - old_span), order.end());
+    } else if (new_span < old_span) {
+      std::move(order.begin() + old_end, order.end(),
+                order.begin() + begin + new_span);
+      order.resize(order.size() - (old_span - new_span));
+    }
+    auto out = order.begin() + begin;
+    for (int depth = deepest; depth >= shallowest; --depth) {
+      out = std::copy(levels[depth].begin(), levels[depth].end(), out);
+    }
+  }
+  while (!levels.empty() && levels.back().empty()) {
+    levels.pop_back();
+  }
+  max_depth_ = std::max(0, static_cast<int>(levels.size()) - 1);
+
+  // Patch the recomputed rows, and rename those naming a moved component
+  for (const auto& [from, to] : ids.moves) {
+    for (const SccIdx dependent : dependents.Neighbors(to)) {
+      if (kept.contains(dependent)) {
+        continue;
+      }
+      std::vector<SccIdx>& row = kept[dependent];
+      for (const SccIdx dep :
+           simplified_component_deps_.Neighbors(ids.Origin(dependent))) {
+        row.push_back(ids.Map(dep));
+      }
+      std::sort(row.begin(), row.end());
+    }
+  }
+  simplified_component_deps_.Patch(ids, kept);
 }
 
 std::string DependencyAnalyzer::GenerateMermaidGraph(
     const std::string& keyword) const {
-  return GenerateMermaidGraphWithKeyword(components_vec_,
-                                         simplified_component_deps_, keyword);
+  return *GetOrRender("mermaid\n" + keyword, [&] {
+    std::ostringstream mermaid;
+    ExportGraph(*this, keyword, ExportFormat::kMermaid, mermaid);
+    return mermaid.str();
+  });
+}
+
+std::vector<SccIdx> DependencyAnalyzer::FindComponents(
+    std::string_view keyword) const {
+  return keyword_index_.Find(keyword);
+}
+
+std::shared_ptr<const std::string> DependencyAnalyzer::GetOrRender(
+    const std::string& key, const std::function<std::string()>& render) const {
+  return render_cache_->GetOrRender(key, render);
 }
 
 void DependencyAnalyzer::Summary() {
@@ -310,7 +880,7 @@ void DependencyAnalyzer::Summary() {
   std::cout << "Max Graph Depth: " << max_depth_ + 1 << "\n";
   std::cout << "\nTopological Sort of Files(less deps on top):\n\n";
 
-  for (size_t depth = 0; depth <= max_depth_; ++depth) {
+  for (size_t depth = 0; depth < depth_to_component_idx_map_.size(); ++depth) {
     for (const auto& component_idx : depth_to_component_idx_map_[depth]) {
       std::cout << "[" << depth << "]: " << components_vec_[component_idx].name
                 << "\n";
@@ -318,10 +888,12 @@ void DependencyAnalyzer::Summary() {
   }
 
   std::cout << "\nFile Dependencies:\n\n";
-  for (const auto& [file, deps] : file_deps_) {
-    std::cout << file << " depends on:\n";
-    for (const auto& dep : deps) {
-      std::cout << "  " << dep << "\n";
+  const auto& names = GetFileDependencies().Names();
+  const auto& graph = GetFileDependencies().Graph();
+  for (NodeId file = 0; file < graph.NumNodes(); ++file) {
+    std::cout << names.Name(file) << " depends on:\n";
+    for (const auto dep : graph.Neighbors(file)) {
+      std::cout << "  " << names.Name(dep) << "\n";
     }
   }
   std::cout << "```\n";
@@ -329,64 +901,20 @@ void DependencyAnalyzer::Summary() {
 
 std::string GenerateMermaidGraphWithKeyword(
     const std::vector<SCCComponent>& components_vec,
-    const std::unordered_map<int, std::set<int>>& component_deps,
-    const std::string& keyword) {
+    const CsrGraph& component_deps, const std::string& keyword) {
   // When keyword is empty, it basically generates the whole graph
   // otherwise, it should only prints out partial graph that is related to the
   // keyword
-  std::stringstream mermaid;
-  std::cout << "```mermaid\n";
-  mermaid << "graph LR\n";
-
-  // Helper function to get the name of a component
-  auto get_name = [&](int component_idx) {
-    if (components_vec[component_idx].members.size() > 1) {
-      return "SCC_" + std::to_string(component_idx);
-    } else {
-      return components_vec[component_idx].name;
-    }
-  };
-
-  // Track visited nodes to avoid duplicate entries
-  std::unordered_set<int> visited;
-
-  std::function<void(int)> draw_subgraph = [&](int component_idx) {
-    if (visited.find(component_idx) != visited.end()) {
-      return;  // Skip already processed nodes
-    }
-    visited.insert(component_idx);
-
-    // Draw the current component
-    if (components_vec[component_idx].members.size() > 1) {
-      mermaid << "    " << get_name(component_idx) << "_contains[\""
-              << get_name(component_idx) << " contains:<br/><br/>";
-      for (const auto& file : components_vec[component_idx].members) {
-        mermaid << file << "<br/>";
-      }
-      mermaid << "\"]\n";
-    }
-
-    mermaid << "    " << get_name(component_idx) << "\n";
-
-    // Draw edges to dependent components
-    if (component_deps.find(component_idx) != component_deps.end()) {
-      for (const auto& to_component : component_deps.at(component_idx)) {
-        if (component_idx != to_component) {
-          mermaid << "    " << get_name(component_idx) << " --> "
-                  << get_name(to_component) << "\n";
-          draw_subgraph(to_component);  // Recursively draw dependencies
-        }
-      }
-    }
-  };
-
-  // Find the components that match the keyword and start drawing from there
-  for (size_t i = 0; i < components_vec.size(); ++i) {
+  std::vector<SccIdx> roots;
+  for (SccIdx i = 0; i < components_vec.size(); ++i) {
     if (components_vec[i].name.find(keyword) != std::string::npos) {
-      draw_subgraph(i);  // Draw subgraph rooted at this component
+      roots.push_back(i);
     }
   }
-
-  mermaid << "```\n";
+  std::ostringstream mermaid;
+  const SccComponentTable components(components_vec);
+  const auto exporter =
+      MakeGraphExporter(ExportFormat::kMermaid, mermaid, components);
+  ExportGraph(component_deps, roots, *exporter);
   return mermaid.str();
 }
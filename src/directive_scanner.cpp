@@ -0,0 +1,433 @@
+#include "directive_scanner.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DIRECTIVE_SCANNER_X86 1
+#endif
+
+namespace {
+
+// Bytes that can start something the scanner cares about. `c` and `s` are
+// only candidates when followed by `l` / `t`, which keeps ordinary
+// identifiers from stopping the vectorized search every few bytes. Without
+// keywords (ScanProfile::kIncludesOnly) they are not candidates at all.
+template <bool kKeywords>
+constexpr std::array<bool, 256> kCandidateBytes = [] {
+  std::array<bool, 256> table{};
+  for (unsigned char c : std::string_view(kKeywords ? "#/\"'cs" : "#/\"'")) {
+    table[c] = true;
+  }
+  return table;
+}();
+
+bool IsIdentifierChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// A quote inside a numeric literal is a digit separator (1'000, 0xFF'FF).
+bool IsDigitSeparator(const char* begin, const char* quote) {
+  const char* p = quote;
+  while (p > begin && (IsIdentifierChar(p[-1]) || p[-1] == '\'')) {
+    --p;
+  }
+  return p != quote && IsDigit(*p);
+}
+
+bool IsHorizontalSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+bool IsSpace(char c) { return IsHorizontalSpace(c) || c == '\n'; }
+
+template <bool kKeywords>
+bool IsCandidateAt(const char* p, const char* end) {
+  const unsigned char c = static_cast<unsigned char>(*p);
+  if (!kCandidateBytes<kKeywords>[c]) {
+    return false;
+  }
+  if (c == 'c' || c == 's') {
+    return p + 1 < end && p[1] == (c == 'c' ? 'l' : 't');
+  }
+  return true;
+}
+
+template <bool kKeywords>
+const char* FindCandidateScalar(const char* p, const char* end) {
+  while (p < end && !IsCandidateAt<kKeywords>(p, end)) {
+    ++p;
+  }
+  return p;
+}
+
+#ifdef DIRECTIVE_SCANNER_X86
+
+template <bool kKeywords>
+const char* FindCandidateSse2(const char* p, const char* end) {
+  const __m128i hash = _mm_set1_epi8('#');
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i dquote = _mm_set1_epi8('"');
+  const __m128i squote = _mm_set1_epi8('\'');
+  const __m128i c = _mm_set1_epi8('c');
+  const __m128i l = _mm_set1_epi8('l');
+  const __m128i s = _mm_set1_epi8('s');
+  const __m128i t = _mm_set1_epi8('t');
+
+  // Two overlapping loads so that `cl` / `st` pairs can be tested in-register;
+  // hence the extra byte of slack at the end.
+  for (; p + 17 <= end; p += 16) {
+    const __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i next =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(cur, hash), _mm_cmpeq_epi8(cur, slash)),
+        _mm_or_si128(_mm_cmpeq_epi8(cur, dquote), _mm_cmpeq_epi8(cur, squote)));
+    if constexpr (kKeywords) {
+      hit = _mm_or_si128(hit, _mm_and_si128(_mm_cmpeq_epi8(cur, c),
+                                            _mm_cmpeq_epi8(next, l)));
+      hit = _mm_or_si128(hit, _mm_and_si128(_mm_cmpeq_epi8(cur, s),
+                                            _mm_cmpeq_epi8(next, t)));
+    }
+    const int mask = _mm_movemask_epi8(hit);
+    if (mask != 0) {
+      return p + __builtin_ctz(static_cast<unsigned>(mask));
+    }
+  }
+  return FindCandidateScalar<kKeywords>(p, end);
+}
+
+template <bool kKeywords>
+__attribute__((target("avx2"))) const char* FindCandidateAvx2(
+    const char* p, const char* end) {
+  const __m256i hash = _mm256_set1_epi8('#');
+  const __m256i slash = _mm256_set1_epi8('/');
+  const __m256i dquote = _mm256_set1_epi8('"');
+  const __m256i squote = _mm256_set1_epi8('\'');
+  const __m256i c = _mm256_set1_epi8('c');
+  const __m256i l = _mm256_set1_epi8('l');
+  const __m256i s = _mm256_set1_epi8('s');
+  const __m256i t = _mm256_set1_epi8('t');
+
+  for (; p + 33 <= end; p += 32) {
+    const __m256i cur =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i next =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+    __m256i hit = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(cur, hash),
+                        _mm256_cmpeq_epi8(cur, slash)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(cur, dquote),
+                        _mm256_cmpeq_epi8(cur, squote)));
+    if constexpr (kKeywords) {
+      hit = _mm256_or_si256(hit,
+                            _mm256_and_si256(_mm256_cmpeq_epi8(cur, c),
+                                             _mm256_cmpeq_epi8(next, l)));
+      hit = _mm256_or_si256(hit,
+                            _mm256_and_si256(_mm256_cmpeq_epi8(cur, s),
+                                             _mm256_cmpeq_epi8(next, t)));
+    }
+    const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return FindCandidateSse2<kKeywords>(p, end);
+}
+
+#endif  // DIRECTIVE_SCANNER_X86
+
+using FindCandidateFn = const char* (*)(const char*, const char*);
+
+struct Kernel {
+  FindCandidateFn find;
+  FindCandidateFn find_without_keywords;
+  std::string_view name;
+};
+
+Kernel SelectKernel() {
+#ifdef DIRECTIVE_SCANNER_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return {FindCandidateAvx2<true>, FindCandidateAvx2<false>, "avx2"};
+  }
+  return {FindCandidateSse2<true>, FindCandidateSse2<false>, "sse2"};
+#else
+  return {FindCandidateScalar<true>, FindCandidateScalar<false>, "scalar"};
+#endif
+}
+
+const Kernel& GetKernel() {
+  static const Kernel kernel = SelectKernel();
+  return kernel;
+}
+
+// Returns the position right after the closing quote (or at the end of the
+// line for unterminated literals).
+const char* SkipQuoted(const char* p, const char* end, char quote) {
+  for (++p; p < end; ++p) {
+    if (*p == '\\') {
+      ++p;  // skip the escaped character, including escaped newlines
+    } else if (*p == quote) {
+      return p + 1;
+    } else if (*p == '\n') {
+      return p;
+    }
+  }
+  return end;
+}
+
+// p points at the opening quote of R"delim( ... )delim".
+const char* SkipRawString(const char* p, const char* end) {
+  const char* open_paren = p + 1;
+  while (open_paren < end && *open_paren != '(' && *open_paren != '\n') {
+    ++open_paren;
+  }
+  if (open_paren >= end || *open_paren != '(') {
+    return SkipQuoted(p, end, '"');  // not a raw string after all
+  }
+  const std::string_view delimiter(p + 1, open_paren - p - 1);
+  for (const char* q = open_paren + 1; q < end; ++q) {
+    q = static_cast<const char*>(std::memchr(q, ')', end - q));
+    if (q == nullptr) {
+      return end;
+    }
+    const char* after = q + 1 + delimiter.size();
+    if (after < end && std::string_view(q + 1, delimiter.size()) == delimiter &&
+        *after == '"') {
+      return after + 1;
+    }
+  }
+  return end;
+}
+
+const char* SkipLineComment(const char* p, const char* end) {
+  const void* newline = std::memchr(p, '\n', end - p);
+  return newline ? static_cast<const char*>(newline) : end;
+}
+
+const char* SkipBlockComment(const char* p, const char* end) {
+  for (p += 2; p + 1 < end; ++p) {
+    p = static_cast<const char*>(std::memchr(p, '*', end - p - 1));
+    if (p == nullptr) {
+      return end;
+    }
+    if (p[1] == '/') {
+      return p + 2;
+    }
+  }
+  return end;
+}
+
+bool IsRawStringPrefix(const char* begin, const char* quote) {
+  // R"...", and the encoding-prefixed LR / uR / UR / u8R variants.
+  if (quote == begin || quote[-1] != 'R') {
+    return false;
+  }
+  const char* prefix_begin = quote - 1;
+  while (prefix_begin > begin && IsIdentifierChar(prefix_begin[-1])) {
+    --prefix_begin;
+  }
+  const std::string_view prefix(prefix_begin, quote - prefix_begin);
+  return prefix == "R" || prefix == "LR" || prefix == "uR" || prefix == "UR" ||
+         prefix == "u8R";
+}
+
+bool IsAtLineStart(const char* begin, const char* p) {
+  while (p > begin && IsHorizontalSpace(p[-1])) {
+    --p;
+  }
+  return p == begin || p[-1] == '\n';
+}
+
+bool LooksLikeHeader(std::string_view header) {
+  // ".h" also covers ".hpp" and ".hu"
+  return header.find(".h") != std::string_view::npos;
+}
+
+// p points at a `#` that starts a line. Records the include target if this is
+// an include directive and returns where scanning should resume.
+const char* ScanDirective(const char* p, const char* end,
+                          ScannedDirectives& result) {
+  ++p;
+  while (p < end && IsHorizontalSpace(*p)) {
+    ++p;
+  }
+  constexpr std::string_view kInclude = "include";
+  if (static_cast<size_t>(end - p) < kInclude.size() ||
+      std::string_view(p, kInclude.size()) != kInclude) {
+    return p;
+  }
+  p += kInclude.size();
+  while (p < end && IsHorizontalSpace(*p)) {
+    ++p;
+  }
+  if (p >= end || (*p != '<' && *p != '"')) {
+    return p;
+  }
+  const char close = *p == '<' ? '>' : '"';
+  const char* target_begin = ++p;
+  while (p < end && *p != close && *p != '\n') {
+    ++p;
+  }
+  if (p >= end || *p != close) {
+    return p;
+  }
+  const std::string_view header(target_begin, p - target_begin);
+  if (!header.empty() && LooksLikeHeader(header)) {
+    result.included_headers.push_back(header);
+    result.angled_includes.push_back(close == '>');
+  }
+  return p + 1;
+}
+
+// p points at a `c` / `s` that is not preceded by an identifier character.
+const char* ScanClassKeyword(const char* p, const char* end,
+                             ScannedDirectives& result) {
+  const std::string_view keyword = *p == 'c' ? "class" : "struct";
+  if (static_cast<size_t>(end - p) <= keyword.size() ||
+      std::string_view(p, keyword.size()) != keyword ||
+      !IsSpace(p[keyword.size()])) {
+    return p + 1;
+  }
+  p += keyword.size();
+  while (p < end && IsSpace(*p)) {
+    ++p;
+  }
+  const char* name_begin = p;
+  while (p < end && IsIdentifierChar(*p)) {
+    ++p;
+  }
+  if (p != name_begin) {
+    result.defined_classes.emplace_back(name_begin, p - name_begin);
+  }
+  return p;
+}
+
+// End of the logical line p is on: the first newline that is not escaped by
+// a backslash
+const char* EndOfLogicalLine(const char* p, const char* end) {
+  while (true) {
+    const void* found = std::memchr(p, '\n', end - p);
+    if (found == nullptr) {
+      return end;
+    }
+    const char* newline = static_cast<const char*>(found);
+    const char* last = newline;
+    if (last > p && last[-1] == '\r') {
+      --last;
+    }
+    if (last == p || last[-1] != '\\') {
+      return newline;
+    }
+    p = newline + 1;
+  }
+}
+
+// Whether [p, end) has a `#` starting a line followed by `include`: a
+// superset of the include directives the lexer would find there
+bool MayHaveIncludeDirective(const char* begin, const char* p,
+                             const char* end) {
+  constexpr std::string_view kInclude = "include";
+  while ((p = static_cast<const char*>(std::memchr(p, '#', end - p)))) {
+    const bool at_line_start = IsAtLineStart(begin, p);
+    ++p;
+    if (!at_line_start) {
+      continue;
+    }
+    while (p < end && IsHorizontalSpace(*p)) {
+      ++p;
+    }
+    if (static_cast<size_t>(end - p) >= kInclude.size() &&
+        std::string_view(p, kInclude.size()) == kInclude) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Lexes [p, end) and records what it finds; class names only when
+// find_candidate stops at keywords. With stop_at_code, lexing ends before
+// the first token that is neither whitespace, a comment nor part of a
+// directive line, and the position to resume from is returned; it is always
+// outside comments and literals. Otherwise returns end.
+const char* Scan(const char* begin, const char* p, const char* end,
+                 FindCandidateFn find_candidate, bool stop_at_code,
+                 ScannedDirectives& result) {
+  const char* directive_end = begin;  // end of the last directive's line
+  for (const char* from = p; (p = find_candidate(from, end)) < end; from = p) {
+    if (stop_at_code && p >= directive_end) {
+      const char* gap = std::max(from, directive_end);
+      while (gap < p && IsSpace(*gap)) {
+        ++gap;
+      }
+      const bool comment =
+          *p == '/' && p + 1 < end && (p[1] == '/' || p[1] == '*');
+      const bool directive = *p == '#' && IsAtLineStart(begin, p);
+      if (gap != p || !(comment || directive)) {
+        return from;
+      }
+    }
+    switch (*p) {
+      case '/':
+        if (p + 1 < end && p[1] == '/') {
+          p = SkipLineComment(p, end);
+        } else if (p + 1 < end && p[1] == '*') {
+          p = SkipBlockComment(p, end);
+        } else {
+          ++p;
+        }
+        break;
+      case '"':
+        p = IsRawStringPrefix(begin, p) ? SkipRawString(p, end)
+                                        : SkipQuoted(p, end, '"');
+        break;
+      case '\'':
+        p = IsDigitSeparator(begin, p) ? p + 1 : SkipQuoted(p, end, '\'');
+        break;
+      case '#':
+        if (IsAtLineStart(begin, p)) {
+          p = ScanDirective(p, end, result);
+          directive_end = EndOfLogicalLine(p, end);
+        } else {
+          ++p;
+        }
+        break;
+      default:  // 'c' or 's'
+        p = (p > begin && IsIdentifierChar(p[-1]))
+                ? p + 1
+                : ScanClassKeyword(p, end, result);
+        break;
+    }
+  }
+  return end;
+}
+
+}  // namespace
+
+std::string_view DirectiveScannerKernel() { return GetKernel().name; }
+
+ScannedDirectives ScanDirectives(std::string_view source,
+                                 ScanProfile profile) {
+  ScannedDirectives result;
+  const char* const begin = source.data();
+  const char* const end = begin + source.size();
+  if (profile == ScanProfile::kFull) {
+    Scan(begin, begin, end, GetKernel().find, false, result);
+    return result;
+  }
+
+  const FindCandidateFn find_candidate = GetKernel().find_without_keywords;
+  const char* const rest =
+      Scan(begin, begin, end, find_candidate, true, result);
+  // Includes after the first code are rare, but the rest is only skipped
+  // when it has nothing that could be one
+  if (MayHaveIncludeDirective(begin, rest, end)) {
+    Scan(begin, rest, end, find_candidate, false, result);
+  }
+  return result;
+}
@@ -0,0 +1,72 @@
+#include "fd_stream.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+
+FdOutputStream::Buffer::Buffer(int fd, size_t size)
+    : fd_(fd), buffer_(size > 0 ? size : 1) {
+  setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+bool FdOutputStream::Buffer::WriteAll(const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t count = ::write(fd_, data, size);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    data += count;
+    size -= static_cast<size_t>(count);
+    written_ += static_cast<size_t>(count);
+  }
+  return true;
+}
+
+bool FdOutputStream::Buffer::Flush() {
+  const bool ok = WriteAll(pbase(), static_cast<size_t>(pptr() - pbase()));
+  setp(buffer_.data(), buffer_.data() + buffer_.size());
+  return ok;
+}
+
+FdOutputStream::Buffer::int_type FdOutputStream::Buffer::overflow(int_type c) {
+  if (!Flush()) {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize FdOutputStream::Buffer::xsputn(const char* data,
+                                               std::streamsize count) {
+  const auto size = static_cast<size_t>(count);
+  if (size <= static_cast<size_t>(epptr() - pptr())) {
+    traits_type::copy(pptr(), data, size);
+    pbump(static_cast<int>(size));
+    return count;
+  }
+  if (!Flush()) {
+    return 0;
+  }
+  if (size < buffer_.size()) {
+    traits_type::copy(pptr(), data, size);
+    pbump(static_cast<int>(size));
+    return count;
+  }
+  // Larger than the whole buffer: pass it through rather than chunking it
+  return WriteAll(data, size) ? count : 0;
+}
+
+int FdOutputStream::Buffer::sync() { return Flush() ? 0 : -1; }
+
+FdOutputStream::FdOutputStream(int fd, size_t buffer_size)
+    : std::ostream(nullptr), buffer_(fd, buffer_size) {
+  rdbuf(&buffer_);
+}
+
+FdOutputStream::~FdOutputStream() { flush(); }
@@ -0,0 +1,365 @@
+#include "file_dep_builder.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <unordered_set>
+
+#include "profiler.h"
+#include "thread_pool.h"
+
+std::string_view GetFileStem(std::string_view path) {
+  const std::string_view filename = PathFilename(path);
+  if (filename == "." || filename == "..") {
+    return filename;
+  }
+  const size_t dot = filename.rfind('.');
+  if (dot == std::string_view::npos || dot == 0) {
+    return filename;
+  }
+  return filename.substr(0, dot);
+}
+
+FileDepGraphBuilder::FileDepGraphBuilder(const std::vector<File>& files,
+                                         std::vector<std::string> include_paths,
+                                         ThreadPool* pool)
+    : pool_(pool),
+      files_([&] {
+        std::vector<File> copies;
+        copies.reserve(files.size());
+        for (const auto& file : files) {
+          copies.push_back(CopyFile(file));
+        }
+        return copies;
+      }()),
+      resolver_(files_, std::move(include_paths)),
+      targets_(files_.size()) {
+  Profiler::Phase phase("BuildFileDependencies");
+  includers_by_filename_.reserve(files_.size());
+  files_by_stem_.reserve(files_.size());
+  for (FileSlot slot = 0; slot < files_.size(); ++slot) {
+    IndexFile(slot);
+  }
+
+  // When dealing with included files, only check files that are under the
+  // user specified directory. (e.g. those included by the files input)
+  // Resolving is independent per file; interning and reporting then happen
+  // in file order so ids and messages do not depend on the thread count.
+  std::vector<std::vector<HeaderResolver::Resolution>> resolutions(
+      files_.size());
+  ParallelFor(pool_, files_.size(), [&](size_t slot, unsigned) {
+    resolutions[slot] = Resolve(static_cast<FileSlot>(slot));
+  });
+
+  // Nodes are file stems: with this, src_path/x.cpp and include_path/x.h
+  // will be considered as the same file component.
+  NameTable names;
+  for (FileSlot slot = 0; slot < files_.size(); ++slot) {
+    CommitResolutions(slot, resolutions[slot], names, /*report=*/true);
+  }
+  graph_.deps_ = CsrGraph::FromRows(
+      names.Size(), [&](NodeId node, std::vector<NodeId>& row) {
+        row = StemRow(node, names);
+      });
+  graph_.names_ = std::move(names);
+}
+
+std::vector<File> FileDepGraphBuilder::Files() const {
+  std::vector<File> live;
+  for (const auto& file : files_) {
+    if (!file.name.empty()) {
+      live.push_back(file);
+    }
+  }
+  return live;
+}
+
+File FileDepGraphBuilder::CopyFile(const File& file) {
+  File copy;
+  copy.name = strings_.Intern(file.name);
+  copy.bytes = file.bytes;
+  copy.lines = file.lines;
+  copy.included_headers.reserve(file.included_headers.size());
+  for (const auto header : file.included_headers) {
+    copy.included_headers.push_back(strings_.Intern(header));
+  }
+  return copy;
+}
+
+void FileDepGraphBuilder::IndexFile(FileSlot slot) {
+  const File& file = files_[slot];
+  for (const auto header : file.included_headers) {
+    auto& includers = includers_by_filename_[PathFilename(header)];
+    if (includers.empty() || includers.back() != slot) {
+      includers.push_back(slot);
+    }
+  }
+  files_by_stem_[GetFileStem(file.name)].push_back(slot);
+}
+
+void FileDepGraphBuilder::UnindexFile(FileSlot slot) {
+  auto unlist = [slot](auto& index, std::string_view key) {
+    auto it = index.find(key);
+    if (it != index.end() && std::erase(it->second, slot) > 0 &&
+        it->second.empty()) {
+      index.erase(it);
+    }
+  };
+  const File& file = files_[slot];
+  for (const auto header : file.included_headers) {
+    unlist(includers_by_filename_, PathFilename(header));
+  }
+  unlist(files_by_stem_, GetFileStem(file.name));
+}
+
+std::vector<HeaderResolver::Resolution> FileDepGraphBuilder::Resolve(
+    FileSlot slot) const {
+  const File& file = files_[slot];
+  std::vector<HeaderResolver::Resolution> found;
+  found.reserve(file.included_headers.size());
+  for (const auto header : file.included_headers) {
+    found.push_back(resolver_.Resolve(file, header));
+  }
+  return found;
+}
+
+void FileDepGraphBuilder::CommitResolutions(
+    FileSlot slot, const std::vector<HeaderResolver::Resolution>& found,
+    NameTable& names, bool report) {
+  const File& file = files_[slot];
+  Profiler::Count(Profiler::kIncludesSeen, found.size());
+  for (size_t i = 0; i < found.size(); ++i) {
+    const auto& header_path = file.included_headers[i];
+    if (!found[i].file_idx) {
+      Profiler::Count(Profiler::kIncludesUnresolved);
+      if (report) {
+        std::cerr << "Skip included file: " << header_path << " for "
+                  << file.name << " as it's not under user specified directory."
+                  << std::endl;
+      }
+      continue;
+    }
+    const File& target = files_[*found[i].file_idx];
+    if (report && found[i].candidate_count > 1) {
+      std::cerr << "Ambiguous included file: " << header_path << " for "
+                << file.name << " matches " << found[i].candidate_count
+                << " files, using " << target.name << std::endl;
+    }
+    Profiler::Count(Profiler::kIncludesResolved);
+    const NodeId src = names.Intern(GetFileStem(file.name));
+    const NodeId tgt = names.Intern(GetFileStem(target.name));
+    node_refs_.resize(names.Size(), 0);
+    ++node_refs_[src];
+    ++node_refs_[tgt];
+    targets_[slot].push_back(static_cast<FileSlot>(*found[i].file_idx));
+  }
+}
+
+std::vector<NodeId> FileDepGraphBuilder::StemRow(
+    NodeId node, const NameTable& names) const {
+  std::vector<NodeId> row;
+  auto it = files_by_stem_.find(names.Name(node));
+  if (it == files_by_stem_.end()) {
+    return row;
+  }
+  for (const FileSlot slot : it->second) {
+    for (const FileSlot target : targets_[slot]) {
+      const NodeId dep = *names.Find(GetFileStem(files_[target].name));
+      if (dep != node) {
+        row.push_back(dep);
+      }
+    }
+  }
+  std::sort(row.begin(), row.end());
+  row.erase(std::unique(row.begin(), row.end()), row.end());
+  return row;
+}
+
+FileDepGraphBuilder::Update FileDepGraphBuilder::ApplyDelta(
+    const FileDelta& delta) {
+  NameTable& names = graph_.names_;
+  Update update;
+  update.old_num_nodes = names.Size();
+
+  // Files whose includes get resolved again, and nodes whose rows may change
+  std::vector<FileSlot> requeued;
+  std::unordered_set<FileSlot> requeued_set;
+  std::unordered_set<FileSlot> reported;
+  std::unordered_set<NodeId> dirty;
+  std::vector<NodeId> released;  // nodes that lost references
+
+  auto requeue = [&](FileSlot slot) {
+    if (!requeued_set.insert(slot).second) {
+      return;
+    }
+    requeued.push_back(slot);
+    if (targets_[slot].empty()) {
+      return;
+    }
+    const NodeId src = *names.Find(GetFileStem(files_[slot].name));
+    dirty.insert(src);
+    released.push_back(src);
+    for (const FileSlot target : targets_[slot]) {
+      const NodeId tgt = *names.Find(GetFileStem(files_[target].name));
+      --node_refs_[src];
+      --node_refs_[tgt];
+      released.push_back(tgt);
+    }
+    targets_[slot].clear();
+  };
+  // Includes naming `name` may resolve differently once it comes or goes
+  auto requeue_includers_of = [&](std::string_view name) {
+    auto it = includers_by_filename_.find(PathFilename(name));
+    if (it != includers_by_filename_.end()) {
+      for (const FileSlot slot : it->second) {
+        requeue(slot);
+      }
+    }
+  };
+
+  for (const auto& name : delta.removed) {
+    const auto idx = resolver_.FindFile(name);
+    if (!idx) {
+      continue;
+    }
+    const auto slot = static_cast<FileSlot>(*idx);
+    requeue(slot);
+    requeue_includers_of(name);
+    UnindexFile(slot);
+    resolver_.RemoveFile(slot);
+    files_[slot] = File{};
+  }
+
+  auto upsert = [&](const File& file) {
+    File copy = CopyFile(file);
+    FileSlot slot;
+    if (const auto idx = resolver_.FindFile(copy.name)) {
+      slot = static_cast<FileSlot>(*idx);
+      requeue(slot);
+      UnindexFile(slot);
+      files_[slot] = std::move(copy);
+      IndexFile(slot);
+    } else {
+      slot = static_cast<FileSlot>(files_.size());
+      files_.push_back(std::move(copy));
+      targets_.emplace_back();
+      IndexFile(slot);
+      resolver_.AddFile(slot);
+      requeue(slot);
+      requeue_includers_of(files_[slot].name);
+    }
+    reported.insert(slot);
+  };
+  for (const auto& file : delta.added) {
+    upsert(file);
+  }
+  for (const auto& file : delta.modified) {
+    upsert(file);
+  }
+
+  // Resolve against the final file set, then intern in file order as the
+  // full build does
+  std::erase_if(requeued,
+                [&](FileSlot slot) { return files_[slot].name.empty(); });
+  std::sort(requeued.begin(), requeued.end());
+  std::vector<std::vector<HeaderResolver::Resolution>> resolutions(
+      requeued.size());
+  ParallelFor(pool_, requeued.size(), [&](size_t i, unsigned) {
+    resolutions[i] = Resolve(requeued[i]);
+  });
+  for (size_t i = 0; i < requeued.size(); ++i) {
+    const FileSlot slot = requeued[i];
+    CommitResolutions(slot, resolutions[i], names, reported.contains(slot));
+    if (!targets_[slot].empty()) {
+      dirty.insert(*names.Find(GetFileStem(files_[slot].name)));
+    }
+  }
+
+  std::vector<NodeId> removed_nodes;
+  for (const NodeId node : released) {
+    if (node_refs_[node] == 0) {
+      removed_nodes.push_back(node);
+      dirty.insert(node);
+    }
+  }
+
+  // Diff the rebuilt rows against the current ones
+  std::unordered_map<NodeId, std::vector<NodeId>> new_rows;
+  for (const NodeId node : dirty) {
+    std::vector<NodeId> row = StemRow(node, names);
+    std::span<const NodeId> old_row;
+    if (node < update.old_num_nodes) {
+      old_row = graph_.deps_.Neighbors(node);
+    }
+    std::vector<NodeId> gone, came;
+    std::set_difference(old_row.begin(), old_row.end(), row.begin(),
+                        row.end(), std::back_inserter(gone));
+    std::set_difference(row.begin(), row.end(), old_row.begin(),
+                        old_row.end(), std::back_inserter(came));
+    for (const NodeId dep : gone) {
+      update.removed_edges.emplace_back(node, dep);
+    }
+    for (const NodeId dep : came) {
+      update.added_edges.emplace_back(node, dep);
+    }
+    new_rows.emplace(node, std::move(row));
+  }
+  std::sort(update.removed_edges.begin(), update.removed_edges.end());
+  std::sort(update.added_edges.begin(), update.added_edges.end());
+
+  update.compaction = PlanIdCompaction(names.Size(), std::move(removed_nodes));
+  const IdCompaction& compaction = update.compaction;
+  // Patch only the rebuilt rows and those naming a renumbered node
+  std::unordered_map<NodeId, std::vector<NodeId>> rows;
+  auto add_mapped_row = [&](NodeId node, std::span<const NodeId> deps) {
+    const NodeId new_id = compaction.Map(node);
+    if (new_id == IdCompaction::kRemoved || rows.contains(new_id)) {
+      return;
+    }
+    std::vector<NodeId>& row = rows[new_id];
+    for (const NodeId dep : deps) {
+      row.push_back(compaction.Map(dep));
+    }
+    std::sort(row.begin(), row.end());
+  };
+  for (const auto& [node, row] : new_rows) {
+    add_mapped_row(node, row);
+  }
+  for (const auto& [from, to] : compaction.moves) {
+    // Nodes added by this delta are only named by rebuilt rows
+    if (from >= update.old_num_nodes) {
+      continue;
+    }
+    // Whoever depends on `from` includes a file of it by its filename
+    const std::string_view stem = names.Name(from);
+    const auto files = files_by_stem_.find(stem);
+    if (files == files_by_stem_.end()) {
+      continue;
+    }
+    for (const FileSlot file : files->second) {
+      const auto includers =
+          includers_by_filename_.find(PathFilename(files_[file].name));
+      if (includers == includers_by_filename_.end()) {
+        continue;
+      }
+      for (const FileSlot includer : includers->second) {
+        const bool depends = std::any_of(
+            targets_[includer].begin(), targets_[includer].end(),
+            [&](FileSlot target) {
+              return GetFileStem(files_[target].name) == stem;
+            });
+        if (depends) {
+          const NodeId node = *names.Find(GetFileStem(files_[includer].name));
+          add_mapped_row(node, graph_.deps_.Neighbors(node));
+        }
+      }
+    }
+  }
+  graph_.deps_.Patch(compaction, rows);
+  names.Compact(compaction);
+  for (const auto& [from, to] : compaction.moves) {
+    node_refs_[to] = node_refs_[from];
+  }
+  node_refs_.resize(compaction.new_size);
+  return update;
+}
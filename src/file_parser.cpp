@@ -1,63 +1,526 @@
 #include "file_parser.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <regex>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "binary_io.h"
+#include "compile_db.h"
+#include "directive_scanner.h"
+#include "parse_cache.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+namespace {
+
+std::string ReadFileContent(std::string_view file_path) {
+  std::ifstream in_file(std::string(file_path), std::ios::binary);
+  std::string content;
+  in_file.seekg(0, std::ios::end);
+  const std::streamoff size = in_file.tellg();
+  if (size > 0) {
+    content.resize(static_cast<size_t>(size));
+    in_file.seekg(0, std::ios::beg);
+    in_file.read(content.data(), size);
+    content.resize(static_cast<size_t>(in_file.gcount()));
+  }
+  return content;
+}
+
+// A last line without a newline still counts
+uint64_t CountLines(std::string_view content) {
+  return std::count(content.begin(), content.end(), '\n') +
+         (!content.empty() && content.back() != '\n');
+}
+
+// Absolute and lexically normal, without a trailing separator, so that paths
+// from the directory walk and from a file watcher compare equal
+std::string NormalizedAbsolute(const std::filesystem::path& path) {
+  std::filesystem::path normal =
+      std::filesystem::absolute(path).lexically_normal();
+  if (!normal.has_filename() && normal.has_relative_path()) {
+    normal = normal.parent_path();
+  }
+  return normal.string();
+}
+
+bool IsAtOrBelow(std::string_view path, std::string_view directory) {
+  return path.starts_with(directory) &&
+         (path.size() == directory.size() || directory.ends_with('/') ||
+          path[directory.size()] == '/');
+}
+
+}  // namespace
+
+struct FileParser::ParseResult {
+  size_t sequence;
+  File file;
+  FileStamp stamp;
+  bool cache_hit = false;
+};
+
+FileParser::FileParser(unsigned jobs) {
+  if (ThreadPool::ResolveThreadCount(jobs) > 1) {
+    owned_pool_ = std::make_unique<ThreadPool>(jobs);
+    pool_ = owned_pool_.get();
+  }
+  CreateArenas();
+}
+
+FileParser::FileParser(ThreadPool& pool) : pool_(&pool) { CreateArenas(); }
+
+void FileParser::CreateArenas() {
+  const unsigned arena_count = 1 + (pool_ ? pool_->Size() : 0);
+  for (unsigned i = 0; i < arena_count; ++i) {
+    arenas_.push_back(std::make_unique<StringArena>());
+  }
+}
+
+FileParser::~FileParser() = default;
 
 const std::vector<File>& FileParser::GetParsedFiles() const {
   return parsed_files_;
 }
 
+const std::vector<std::string_view>& FileParser::GetDefinedClasses(
+    size_t file_index) {
+  classes_scanned_.resize(parsed_files_.size(), false);
+  File& file = parsed_files_[file_index];
+  if (!classes_scanned_[file_index]) {
+    classes_scanned_[file_index] = true;
+    const std::string content = ReadFileContent(parsed_paths_[file_index]);
+    const ScannedDirectives directives =
+        ScanDirectives(content, ScanProfile::kFull);
+    file.defined_classes.clear();
+    for (const auto class_name : directives.defined_classes) {
+      file.defined_classes.push_back(arenas_[0]->Intern(class_name));
+    }
+  }
+  return file.defined_classes;
+}
+
+void FileParser::SetWalkOptions(const WalkOptions& options) {
+  walker_ = SourceWalker(options);
+}
+
+void FileParser::EnableCache(std::string cache_path, bool hash_contents) {
+  cache_ = std::make_unique<ParseCache>(std::move(cache_path), hash_contents);
+  cache_->Load();
+}
+
+bool FileParser::SaveCache() const { return cache_ && cache_->Save(); }
+
+size_t FileParser::GetInternedStringCount() const {
+  size_t count = 0;
+  for (const auto& arena : arenas_) {
+    count += arena->Size();
+  }
+  return count;
+}
+
+size_t FileParser::GetInternedStringBytes() const {
+  size_t bytes = 0;
+  for (const auto& arena : arenas_) {
+    bytes += arena->BytesUsed();
+  }
+  return bytes;
+}
+
 void FileParser::ParseFilesUnder(std::string_view directory) {
-  std::filesystem::path base_path = std::filesystem::absolute(directory);
-  for (const auto& entry :
-       std::filesystem::recursive_directory_iterator(base_path)) {
-    if (entry.is_regular_file() &&
-        (std::regex_match(entry.path().extension().string(),
-                          std::regex(".c|.cpp|.cu|.h|.hpp|.hu",
-                                     std::regex_constants::icase)) &&
-         !std::regex_search(
-             entry.path().filename().string(),
-             std::regex("test|mock", std::regex_constants::icase)))) {
-      // The file is already inside the provided directory, so we can add it
-      parsed_files_.emplace_back(ParseFile(entry.path().string(), directory));
-    } else {
-      std::cerr << "Skipping " << entry.path().filename().string() << '\n';
-    }
-  }
-}
-
-File FileParser::ParseFile(std::string_view file_path,
-                           std::string_view relative_to_path) {
-  File file;
-  file.name = std::filesystem::relative(file_path, relative_to_path).string();
-
-  std::ifstream in_file(file_path.data());
-  std::string line;
-  std::regex include_regex(R"(^\s*#include\s*[<"](.+)[>"])");
-  std::regex class_regex(R"(class\s+(\w+)|struct\s+(\w+))");
-
-  while (std::getline(in_file, line)) {
-    std::smatch match;
-    if (std::regex_search(line, match, include_regex)) {
-      std::string header = match[1].str();
-      bool has_extension = header.find(".h") != std::string::npos ||
-                           header.find(".hpp") != std::string::npos ||
-                           header.find(".hu") != std::string::npos;
-      if (has_extension) {
-        file.included_headers.push_back(header);
+  ParseSliceOf(directory, 0, 1);
+}
+
+size_t FileParser::ParseSliceOf(std::string_view directory, size_t index,
+                                size_t count) {
+  Profiler::Phase phase("ParseFilesUnder");
+  const std::string relative_to(directory);
+  directories_.push_back(relative_to);
+
+  const WalkResult walk = walker_.Walk(directory, pool_);
+  const WalkStats& skipped = walk.stats;
+  Profiler::Count(Profiler::kFilesScanned, walk.files.size());
+  Profiler::Count(Profiler::kFilesSkipped,
+                  skipped.not_sources + skipped.excluded_files);
+  const size_t left_out = skipped.not_sources + skipped.excluded_files +
+                          skipped.pruned_directories;
+  // Every slice sees the same walk; one report is enough
+  if (index == 0 && left_out > 0) {
+    std::cerr << "Skipped " << skipped.not_sources
+              << " files that are not sources, " << skipped.excluded_files
+              << " excluded or ignored files and "
+              << skipped.pruned_directories << " directories below "
+              << directory << '\n';
+  }
+
+  // Results land at the index of their file in the walk, so the parallel
+  // output is identical to the serial one
+  const auto [begin, end] = SliceBounds(walk.files.size(), index, count);
+  std::vector<ParseResult> results(end - begin);
+  ParallelFor(pool_, results.size(), [&](size_t i, unsigned worker_idx) {
+    StringArena& arena = *arenas_[pool_ ? worker_idx + 1 : 0];
+    results[i] = ParseFile(walk.files[begin + i], relative_to, arena);
+  });
+
+  parsed_files_.reserve(parsed_files_.size() + results.size());
+  parsed_paths_.reserve(parsed_paths_.size() + results.size());
+  for (size_t i = 0; i < results.size(); ++i) {
+    const std::string& path = walk.files[begin + i];
+    parsed_paths_.push_back(NormalizedAbsolute(path));
+    if (cache_) {
+      cache_->Store(path, results[i].stamp, results[i].file,
+                    results[i].cache_hit);
+    }
+    parsed_files_.push_back(std::move(results[i].file));
+  }
+  return walk.files.size();
+}
+
+FileDelta FileParser::Reparse(const std::vector<std::string>& paths) {
+  std::vector<std::string> roots;
+  for (const auto& directory : directories_) {
+    roots.push_back(NormalizedAbsolute(directory));
+  }
+
+  // Source files currently at or below the changed paths, by the parsed
+  // directory they are below (a file below several parsed directories was
+  // parsed once for each), and the parsed files they may replace
+  std::set<std::pair<std::string, size_t>> present;
+  std::vector<bool> covered(parsed_files_.size(), false);
+  for (const auto& changed : paths) {
+    const std::string path = NormalizedAbsolute(changed);
+    for (size_t d = 0; d < roots.size(); ++d) {
+      if (!IsAtOrBelow(path, roots[d])) {
+        continue;
+      }
+      // The directory may be changing under us; take what the walk sees
+      for (auto& file : walker_.Walk(roots[d], path, pool_).files) {
+        present.emplace(NormalizedAbsolute(file), d);
+      }
+    }
+    for (size_t i = 0; i < parsed_paths_.size(); ++i) {
+      if (IsAtOrBelow(parsed_paths_[i], path)) {
+        covered[i] = true;
+      }
+    }
+  }
+
+  struct Target {
+    std::string path;
+    size_t directory;
+  };
+  std::vector<Target> targets;
+  for (const auto& [path, directory] : present) {
+    targets.push_back({path, directory});
+  }
+  std::vector<ParseResult> results(targets.size());
+  ParallelFor(pool_, targets.size(), [&](size_t i, unsigned worker_idx) {
+    StringArena& arena = *arenas_[pool_ ? worker_idx + 1 : 0];
+    results[i] =
+        ParseFile(targets[i].path, directories_[targets[i].directory], arena);
+  });
+
+  std::unordered_map<std::string_view, size_t> covered_by_name;
+  for (size_t i = 0; i < parsed_files_.size(); ++i) {
+    if (covered[i]) {
+      covered_by_name.emplace(parsed_files_[i].name, i);
+    }
+  }
+  FileDelta delta;
+  for (size_t i = 0; i < targets.size(); ++i) {
+    File& file = results[i].file;
+    auto it = covered_by_name.find(file.name);
+    if (it == covered_by_name.end()) {
+      delta.added.push_back(file);
+      parsed_files_.push_back(std::move(file));
+      parsed_paths_.push_back(targets[i].path);
+      continue;
+    }
+    covered[it->second] = false;  // still there
+    delta.modified.push_back(file);
+    parsed_files_[it->second] = std::move(file);
+    if (it->second < classes_scanned_.size()) {
+      classes_scanned_[it->second] = false;
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < parsed_files_.size(); ++i) {
+    if (i < covered.size() && covered[i]) {
+      delta.removed.emplace_back(parsed_files_[i].name);
+      continue;
+    }
+    if (kept != i) {
+      parsed_files_[kept] = std::move(parsed_files_[i]);
+      parsed_paths_[kept] = std::move(parsed_paths_[i]);
+      if (i < classes_scanned_.size()) {
+        classes_scanned_[kept] = classes_scanned_[i];
+      }
+    }
+    ++kept;
+  }
+  parsed_files_.resize(kept);
+  parsed_paths_.resize(kept);
+  classes_scanned_.resize(std::min(classes_scanned_.size(), kept));
+  return delta;
+}
+
+bool FileParser::ParseCompileCommands(
+    const std::string& compile_commands_path) {
+  Profiler::Phase phase("ParseCompileCommands");
+  // Every file reachable from a translation unit, in discovery order
+  struct Source {
+    std::string path;  // absolute
+    bool parsed = false;
+    std::vector<std::string_view> includes;
+    std::vector<bool> angled_includes;
+    uint64_t bytes = 0;
+    uint64_t lines = 0;
+    std::vector<uint32_t> targets;  // resolved includes, first seen first
+  };
+  std::vector<Source> sources;
+  std::unordered_map<std::string, uint32_t> source_ids;
+  auto source_id = [&](const std::string& path) {
+    auto [it, inserted] =
+        source_ids.try_emplace(path, static_cast<uint32_t>(sources.size()));
+    if (inserted) {
+      sources.emplace_back().path = path;
+    }
+    return it->second;
+  };
+
+  // Translation units share a handful of distinct search paths, and a file
+  // is walked once per search path reaching it
+  std::vector<IncludeSearchPath> search_paths;
+  std::unordered_map<std::string, uint32_t> search_path_ids;
+  using Visit = std::pair<uint32_t, uint32_t>;  // source, search path
+  std::vector<Visit> frontier;
+  std::unordered_set<uint64_t> visited;
+  auto first_visit = [&](Visit visit) {
+    return visited.insert(uint64_t{visit.first} << 32 | visit.second).second;
+  };
+  std::string key;
+  std::string error;
+  size_t units = 0;
+  const bool read = ReadCompileCommands(
+      compile_commands_path,
+      [&](const CompileCommand& command) {
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(command.file, ec)) {
+          std::cerr << "Skipping missing " << command.file << '\n';
+          return;
+        }
+        key.clear();
+        for (const auto* dirs : {&command.search_path.quote_dirs,
+                                 &command.search_path.dirs}) {
+          for (const auto& dir : *dirs) {
+            key += dir;
+            key += '\0';
+          }
+          key += '\n';
+        }
+        auto [it, inserted] = search_path_ids.try_emplace(
+            key, static_cast<uint32_t>(search_paths.size()));
+        if (inserted) {
+          search_paths.push_back(command.search_path);
+        }
+        const Visit visit{source_id(command.file), it->second};
+        if (first_visit(visit)) {
+          frontier.push_back(visit);
+          ++units;
+        }
+      },
+      &error);
+  if (!read) {
+    std::cerr << "Failed to read compile commands: " << error << std::endl;
+    return false;
+  }
+
+  // Resolutions by search path, includer directory (for quoted includes)
+  // and include, and whether each candidate path exists
+  std::unordered_map<std::string, int64_t> resolved;
+  std::unordered_map<std::string, bool> exists;
+  auto existing = [&](const std::string& dir, std::string_view include) {
+    std::string candidate =
+        (std::filesystem::path(dir) / include).lexically_normal().string();
+    auto [it, inserted] = exists.try_emplace(candidate, false);
+    if (inserted) {
+      std::error_code ec;
+      it->second = std::filesystem::is_regular_file(candidate, ec);
+    }
+    return it->second ? std::optional<std::string>(std::move(candidate))
+                      : std::nullopt;
+  };
+  size_t unresolved = 0;
+  while (!frontier.empty()) {
+    std::vector<uint32_t> to_parse;
+    for (const auto& [id, search_path] : frontier) {
+      if (!sources[id].parsed) {
+        sources[id].parsed = true;
+        to_parse.push_back(id);
       }
     }
-    if (std::regex_search(line, match, class_regex)) {
-      if (match[1].matched) {  // matched class
-        file.defined_classes.push_back(match[1]);
+    ParallelFor(pool_, to_parse.size(), [&](size_t i, unsigned worker_idx) {
+      Source& source = sources[to_parse[i]];
+      StringArena& arena = *arenas_[pool_ ? worker_idx + 1 : 0];
+      const std::string content = ReadFileContent(source.path);
+      Profiler::Count(Profiler::kFilesScanned);
+      Profiler::Count(Profiler::kBytesRead, content.size());
+      const ScannedDirectives directives =
+          ScanDirectives(content, ScanProfile::kIncludesOnly);
+      for (const auto header : directives.included_headers) {
+        source.includes.push_back(arena.Intern(header));
       }
-      if (match[2].matched) {  // matched struct
-        file.defined_classes.push_back(match[2]);
+      source.angled_includes = directives.angled_includes;
+      source.bytes = content.size();
+      source.lines = CountLines(content);
+    });
+
+    std::vector<Visit> next;
+    for (const auto& [id, search_path_id] : frontier) {
+      const IncludeSearchPath& search_path = search_paths[search_path_id];
+      const std::string directory =
+          std::filesystem::path(sources[id].path).parent_path().string();
+      for (size_t i = 0; i < sources[id].includes.size(); ++i) {
+        const std::string_view include = sources[id].includes[i];
+        const bool angled = sources[id].angled_includes[i];
+        key = std::to_string(search_path_id);
+        key += '\0';
+        key += angled ? std::string_view() : std::string_view(directory);
+        key += '\0';
+        key += include;
+        auto [it, inserted] = resolved.try_emplace(key, -1);
+        if (inserted) {
+          std::optional<std::string> found;
+          if (!angled) {
+            found = existing(directory, include);
+            for (size_t d = 0; !found && d < search_path.quote_dirs.size();
+                 ++d) {
+              found = existing(search_path.quote_dirs[d], include);
+            }
+          }
+          for (size_t d = 0; !found && d < search_path.dirs.size(); ++d) {
+            found = existing(search_path.dirs[d], include);
+          }
+          if (found) {
+            it->second = source_id(*found);
+          }
+        }
+        if (it->second < 0) {
+          ++unresolved;
+          continue;
+        }
+        const auto target = static_cast<uint32_t>(it->second);
+        auto& targets = sources[id].targets;
+        if (std::find(targets.begin(), targets.end(), target) ==
+            targets.end()) {
+          targets.push_back(target);
+        }
+        if (first_visit({target, search_path_id})) {
+          next.push_back({target, search_path_id});
+        }
       }
     }
+    frontier = std::move(next);
+  }
+
+  if (sources.empty()) {
+    return true;
+  }
+  // Names relative to the deepest directory holding every file
+  std::string root =
+      std::filesystem::path(sources.front().path).parent_path().string();
+  for (const Source& source : sources) {
+    while (!IsAtOrBelow(source.path, root)) {
+      root = std::filesystem::path(root).parent_path().string();
+    }
+  }
+  const size_t prefix = root.size() + (root.ends_with('/') ? 0 : 1);
+  StringArena& arena = *arenas_[0];
+  parsed_files_.reserve(parsed_files_.size() + sources.size());
+  for (const Source& source : sources) {
+    File file;
+    file.name = arena.Intern(std::string_view(source.path).substr(prefix));
+    const std::filesystem::path directory =
+        std::filesystem::path(source.path).parent_path();
+    for (const uint32_t target : source.targets) {
+      file.included_headers.push_back(arena.Intern(
+          std::filesystem::path(sources[target].path)
+              .lexically_relative(directory)
+              .string()));
+    }
+    file.bytes = source.bytes;
+    file.lines = source.lines;
+    parsed_files_.push_back(std::move(file));
+    parsed_paths_.push_back(source.path);
+  }
+  directories_.push_back(root);
+  std::cerr << "Parsed " << sources.size() << " files reachable from "
+            << units << " translation unit(s) with " << search_paths.size()
+            << " distinct search path(s); " << unresolved
+            << " includes were not found on their search path" << std::endl;
+  return true;
+}
+
+FileParser::ParseResult FileParser::ParseFile(const std::string& file_path,
+                                              std::string_view relative_to_path,
+                                              StringArena& arena) const {
+  ParseResult result{};
+  const std::string_view name = arena.Intern(
+      std::filesystem::relative(file_path, relative_to_path).string());
+
+  const ParseCache::Entry* cached = nullptr;
+  if (cache_) {
+    std::error_code ec;
+    result.stamp.size = std::filesystem::file_size(file_path, ec);
+    result.stamp.mtime = std::filesystem::last_write_time(file_path, ec)
+                             .time_since_epoch()
+                             .count();
+    cached = cache_->Find(file_path);
+  }
+  auto reuse = [&](const ParseCache::Entry& entry) {
+    result.stamp.content_hash = entry.stamp.content_hash;
+    result.file = {name, entry.included_headers, {}, entry.stamp.size,
+                   entry.lines};
+    result.cache_hit = true;
+    return result;
+  };
+  if (cached && cached->stamp.size == result.stamp.size &&
+      cached->stamp.mtime == result.stamp.mtime) {
+    return reuse(*cached);
+  }
+
+  const std::string content = ReadFileContent(file_path);
+  Profiler::Count(Profiler::kBytesRead, content.size());
+  // A full pass over the content, so only when the cache compares hashes
+  if (cache_ && cache_->HashContents()) {
+    result.stamp.content_hash = Fnv1a64(content);
+    if (cached && cached->stamp.size == content.size() &&
+        cached->stamp.content_hash == result.stamp.content_hash) {
+      return reuse(*cached);
+    }
   }
+  result.file = ParseContent(name, content, arena);
+  return result;
+}
+
+File FileParser::ParseContent(std::string_view name, std::string_view content,
+                              StringArena& arena) {
+  File file;
+  file.name = name;
+  file.bytes = content.size();
+  file.lines = CountLines(content);
 
+  const ScannedDirectives directives =
+      ScanDirectives(content, ScanProfile::kIncludesOnly);
+  file.included_headers.reserve(directives.included_headers.size());
+  for (const auto header : directives.included_headers) {
+    file.included_headers.push_back(arena.Intern(header));
+  }
   return file;
-}
\ No newline at end of file
+}
@@ -0,0 +1,180 @@
+#include "file_watcher.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+
+namespace {
+
+constexpr uint32_t kWatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+                                IN_ONLYDIR | IN_EXCL_UNLINK;
+constexpr std::chrono::seconds kMaxBatchDelay{1};
+
+std::string NormalizedAbsolute(std::string_view directory) {
+  std::filesystem::path normal =
+      std::filesystem::absolute(directory).lexically_normal();
+  if (!normal.has_filename() && normal.has_relative_path()) {
+    normal = normal.parent_path();
+  }
+  return normal.string();
+}
+
+}  // namespace
+
+FileWatcher::FileWatcher(std::chrono::milliseconds debounce)
+    : fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), debounce_(debounce) {}
+
+FileWatcher::~FileWatcher() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool FileWatcher::AddDirectory(std::string_view directory) {
+  if (fd_ < 0) {
+    return false;
+  }
+  const std::string root = NormalizedAbsolute(directory);
+  if (!WatchTree(root)) {
+    return false;
+  }
+  roots_.push_back(root);
+  return true;
+}
+
+bool FileWatcher::WatchTree(const std::string& directory) {
+  const int wd = inotify_add_watch(fd_, directory.c_str(), kWatchMask);
+  if (wd < 0) {
+    return false;
+  }
+  watched_[wd] = directory;
+  // Subdirectories may come and go during the walk; whatever is missed shows
+  // up as an event on the parent
+  std::error_code ec;
+  for (auto it = std::filesystem::recursive_directory_iterator(
+           directory,
+           std::filesystem::directory_options::skip_permission_denied, ec);
+       !ec && it != std::filesystem::recursive_directory_iterator();
+       it.increment(ec)) {
+    if (it->is_directory(ec) && !it->is_symlink(ec)) {
+      const std::string path = it->path().string();
+      const int sub_wd = inotify_add_watch(fd_, path.c_str(), kWatchMask);
+      if (sub_wd >= 0) {
+        watched_[sub_wd] = path;
+      }
+    }
+  }
+  return true;
+}
+
+void FileWatcher::UnwatchTree(const std::string& directory) {
+  for (auto it = watched_.begin(); it != watched_.end();) {
+    const std::string& path = it->second;
+    if (path.starts_with(directory) &&
+        (path.size() == directory.size() || path[directory.size()] == '/')) {
+      inotify_rm_watch(fd_, it->first);
+      it = watched_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+int FileWatcher::Poll(std::chrono::milliseconds timeout) const {
+  pollfd entry{fd_, POLLIN, 0};
+  while (true) {
+    const int ready = poll(&entry, 1, static_cast<int>(timeout.count()));
+    if (ready >= 0 || errno != EINTR) {
+      return ready;
+    }
+  }
+}
+
+bool FileWatcher::ReadEvents(std::set<std::string>& changed) {
+  alignas(inotify_event) char buffer[16 * 1024];
+  while (true) {
+    const ssize_t length = read(fd_, buffer, sizeof(buffer));
+    if (length < 0) {
+      return errno == EAGAIN || errno == EINTR;
+    }
+    for (ssize_t offset = 0; offset < length;) {
+      const auto* event = reinterpret_cast<const inotify_event*>(
+          buffer + offset);
+      offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Events were dropped, so anything may have changed
+        changed.insert(roots_.begin(), roots_.end());
+        continue;
+      }
+      auto dir = watched_.find(event->wd);
+      if (dir == watched_.end()) {
+        continue;
+      }
+      if (event->mask & IN_IGNORED) {
+        watched_.erase(dir);
+        continue;
+      }
+      if (event->mask & IN_DELETE_SELF) {
+        changed.insert(dir->second);
+        continue;
+      }
+      if (event->len == 0) {
+        continue;
+      }
+      const std::string path = dir->second + '/' + event->name;
+      if (event->mask & IN_ISDIR) {
+        // A moved directory keeps its watches under the old path
+        if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
+          UnwatchTree(path);
+        } else {
+          WatchTree(path);
+        }
+        changed.insert(path);
+      } else if (!(event->mask & IN_CREATE)) {
+        // A created file is reported once it is closed after writing
+        changed.insert(path);
+      }
+    }
+  }
+}
+
+std::optional<FileWatcher::Batch> FileWatcher::WaitForChanges(
+    std::chrono::milliseconds timeout) {
+  using Clock = std::chrono::steady_clock;
+  const bool bounded = timeout != kNoTimeout;
+  const auto deadline = Clock::now() + timeout;
+
+  std::set<std::string> changed;
+  Batch batch;
+  // Events that change nothing of interest (e.g. a created file not yet
+  // written) do not start a batch
+  while (changed.empty()) {
+    auto wait = timeout;
+    if (bounded) {
+      wait = std::max(std::chrono::milliseconds(0),
+                      std::chrono::duration_cast<std::chrono::milliseconds>(
+                          deadline - Clock::now()));
+    }
+    if (Poll(wait) <= 0) {
+      return std::nullopt;
+    }
+    batch.first_change = Clock::now();
+    if (!ReadEvents(changed)) {
+      return std::nullopt;
+    }
+  }
+  while (Clock::now() - batch.first_change < kMaxBatchDelay &&
+         Poll(debounce_) > 0) {
+    if (!ReadEvents(changed)) {
+      break;
+    }
+  }
+  batch.paths.assign(changed.begin(), changed.end());
+  return batch;
+}
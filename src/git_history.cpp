@@ -0,0 +1,315 @@
+#include "git_history.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#include "directive_scanner.h"
+#include "subprocess.h"
+
+namespace {
+
+std::vector<std::string> GitCommand(const std::string& repository,
+                                    std::vector<std::string> args) {
+  args.insert(args.begin(), {"git", "-C", repository});
+  return args;
+}
+
+// Runs a git command to completion, returning its output
+bool RunGit(const std::string& repository, std::vector<std::string> args,
+            std::string& output, std::string* error) {
+  const std::string name = args.front();
+  Subprocess git;
+  if (!git.Start(GitCommand(repository, std::move(args)))) {
+    *error = "cannot run git: " + std::string(strerror(errno));
+    return false;
+  }
+  git.CloseInput();
+  git.ReadAll(output);
+  if (!git.Finish()) {
+    *error = "git " + name + " failed in " + repository;
+    return false;
+  }
+  return true;
+}
+
+// Regular files, executable or not; not symlinks or submodules
+bool IsRegularFileMode(std::string_view mode) {
+  return mode == "100644" || mode == "100755";
+}
+
+// The space-separated fields of a diff-tree header, without its leading `:`
+std::vector<std::string_view> SplitFields(std::string_view header) {
+  std::vector<std::string_view> fields;
+  if (header.starts_with(':')) {
+    header.remove_prefix(1);
+  }
+  for (size_t begin = 0; begin <= header.size();) {
+    const size_t end = std::min(header.find(' ', begin), header.size());
+    fields.push_back(header.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return fields;
+}
+
+uint64_t CountLines(std::string_view content) {
+  return std::count(content.begin(), content.end(), '\n') +
+         (!content.empty() && content.back() != '\n');
+}
+
+double Milliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}  // namespace
+
+// Request / response over one `git cat-file --batch`: we write an object id,
+// it answers `<id> <type> <size>\n<contents>\n` or `<id> missing\n`
+class GitHistoryAnalyzer::BlobReader {
+ public:
+  explicit BlobReader(const std::string& repository)
+      : repository_(repository) {}
+
+  bool Read(const std::string& blob, std::string& contents,
+            std::string* error) {
+    if (!started_) {
+      started_ = true;
+      running_ =
+          git_.Start(GitCommand(repository_, {"cat-file", "--batch"}));
+    }
+    header_.clear();
+    if (!running_ || !git_.Write(blob + "\n") ||
+        !git_.ReadUntil('\n', header_)) {
+      running_ = false;
+      *error = "git cat-file failed in " + repository_;
+      return false;
+    }
+    header_.pop_back();
+    const size_t space = header_.rfind(' ');
+    const std::string_view type_and_id =
+        std::string_view(header_).substr(0, space);
+    if (space == std::string::npos || !type_and_id.ends_with(" blob")) {
+      // A missing object has no contents; anything else would be followed
+      // by contents we did not ask for
+      running_ = header_.ends_with(" missing");
+      *error = "git object " + blob + " is not a blob";
+      return false;
+    }
+    const size_t size = std::stoull(header_.substr(space + 1));
+    contents.clear();
+    std::string newline;
+    if (!git_.Read(size, contents) || !git_.Read(1, newline)) {
+      running_ = false;
+      *error = "git cat-file stopped while reading " + blob;
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  std::string repository_;
+  Subprocess git_;
+  bool started_ = false;
+  bool running_ = false;
+  std::string header_;
+};
+
+JsonValue RevisionMetrics::ToJson() const {
+  auto number = [](auto value) {
+    return JsonValue{static_cast<double>(value)};
+  };
+  return JsonValue{JsonValue::Object{
+      {"revision", JsonValue{revision}},
+      {"files", number(files)},
+      {"changed_files", number(changed_files)},
+      {"parsed_blobs", number(parsed_blobs)},
+      {"nodes", number(nodes)},
+      {"edges", number(edges)},
+      {"components", number(components)},
+      {"cyclic_components", number(cyclic_components)},
+      {"largest_component", number(largest_component)},
+      {"max_depth", number(max_depth)},
+      {"simplified_edges", number(simplified_edges)},
+      {"milliseconds", number(milliseconds)}}};
+}
+
+GitHistoryAnalyzer::GitHistoryAnalyzer(std::string repository,
+                                       const WalkOptions& walk_options,
+                                       AnalyzerOptions analyzer_options)
+    : repository_(std::move(repository)),
+      walker_(walk_options),
+      analyzer_options_(std::move(analyzer_options)),
+      blob_reader_(std::make_unique<BlobReader>(repository_)) {}
+
+GitHistoryAnalyzer::~GitHistoryAnalyzer() = default;
+
+std::optional<RevisionMetrics> GitHistoryAnalyzer::Analyze(
+    const std::string& revision, std::string* error) {
+  const auto start = std::chrono::steady_clock::now();
+  std::string commit;
+  if (!RunGit(repository_,
+              {"rev-parse", "--verify", "--quiet", revision + "^{commit}"},
+              commit, error)) {
+    *error = "unknown revision " + revision;
+    return std::nullopt;
+  }
+  while (!commit.empty() && commit.back() == '\n') {
+    commit.pop_back();
+  }
+
+  // The source paths that changed, with their new blob, or an empty one
+  // when removed. Nothing is applied before every blob is parsed, so a
+  // failure leaves the previous revision in place.
+  std::vector<std::pair<std::string, std::string>> changes;
+  std::string listing;
+  if (!analyzer_) {
+    if (!RunGit(repository_, {"ls-tree", "-r", "-z", "--full-tree", commit},
+                listing, error)) {
+      return std::nullopt;
+    }
+    // <mode> SP <type> SP <blob> TAB <path> NUL
+    for (size_t begin = 0, end; begin < listing.size(); begin = end + 1) {
+      end = std::min(listing.find('\0', begin), listing.size());
+      const std::string_view entry(listing.data() + begin, end - begin);
+      const size_t tab = entry.find('\t');
+      if (tab == std::string_view::npos) {
+        continue;
+      }
+      const std::string_view path = entry.substr(tab + 1);
+      const std::string_view mode = entry.substr(0, entry.find(' '));
+      const size_t blob = entry.rfind(' ', tab) + 1;
+      if (IsRegularFileMode(mode) && walker_.Selects(path)) {
+        changes.emplace_back(path, entry.substr(blob, tab - blob));
+      }
+    }
+  } else if (commit != tree_revision_) {
+    if (!RunGit(repository_,
+                {"diff-tree", "-r", "-z", "--no-renames", "--no-commit-id",
+                 tree_revision_, commit},
+                listing, error)) {
+      return std::nullopt;
+    }
+    // :<old mode> SP <new mode> SP <old blob> SP <new blob> SP <status> NUL
+    // <path> NUL
+    for (size_t begin = 0; begin < listing.size();) {
+      const size_t header_end = listing.find('\0', begin);
+      if (header_end == std::string::npos) {
+        break;
+      }
+      const size_t path_end =
+          std::min(listing.find('\0', header_end + 1), listing.size());
+      const std::string_view header(listing.data() + begin,
+                                    header_end - begin);
+      const std::string_view path(listing.data() + header_end + 1,
+                                  path_end - header_end - 1);
+      begin = path_end + 1;
+      const std::vector<std::string_view> fields = SplitFields(header);
+      if (fields.size() != 5 || !walker_.Selects(path)) {
+        continue;
+      }
+      if (IsRegularFileMode(fields[1])) {
+        changes.emplace_back(path, fields[3]);
+      } else if (tree_.count(std::string(path))) {
+        changes.emplace_back(path, "");  // removed, or no longer a file
+      }
+    }
+  }
+
+  RevisionMetrics metrics;
+  for (const auto& [path, blob] : changes) {
+    if (!blob.empty() && !blobs_.count(blob)) {
+      if (!Parse(blob, error)) {
+        return std::nullopt;
+      }
+      ++metrics.parsed_blobs;
+    }
+  }
+
+  if (!analyzer_) {
+    std::vector<File> files;
+    files.reserve(changes.size());
+    for (auto& [path, blob] : changes) {
+      files.push_back(MakeFile(path, blobs_.at(blob)));
+      tree_.emplace(std::move(path), std::move(blob));
+    }
+    metrics.changed_files = files.size();
+    analyzer_ = std::make_unique<DependencyAnalyzer>(files, analyzer_options_);
+  } else {
+    FileDelta delta;
+    for (auto& [path, blob] : changes) {
+      const auto old = tree_.find(path);
+      if (blob.empty()) {
+        delta.removed.push_back(path);
+        tree_.erase(old);
+      } else if (old == tree_.end()) {
+        delta.added.push_back(MakeFile(path, blobs_.at(blob)));
+        tree_.emplace(path, blob);
+      } else {
+        // Edits that leave the includes alone do not touch the graph
+        const ParsedBlob& parsed = blobs_.at(blob);
+        if (parsed.included_headers !=
+            blobs_.at(old->second).included_headers) {
+          delta.modified.push_back(MakeFile(path, parsed));
+        }
+        old->second = blob;
+      }
+    }
+    metrics.changed_files = changes.size();
+    if (!delta.empty()) {
+      analyzer_->ApplyDelta(delta);
+    }
+  }
+  tree_revision_ = commit;
+
+  Measure(metrics);
+  metrics.revision = revision;
+  metrics.milliseconds = Milliseconds(std::chrono::steady_clock::now() - start);
+  return metrics;
+}
+
+const GitHistoryAnalyzer::ParsedBlob* GitHistoryAnalyzer::Parse(
+    const std::string& blob, std::string* error) {
+  if (!blob_reader_->Read(blob, contents_, error)) {
+    return nullptr;
+  }
+  ParsedBlob parsed;
+  parsed.bytes = contents_.size();
+  parsed.lines = CountLines(contents_);
+  const ScannedDirectives directives =
+      ScanDirectives(contents_, ScanProfile::kIncludesOnly);
+  parsed.included_headers.reserve(directives.included_headers.size());
+  for (const auto header : directives.included_headers) {
+    parsed.included_headers.push_back(arena_.Intern(header));
+  }
+  return &blobs_.emplace(blob, std::move(parsed)).first->second;
+}
+
+File GitHistoryAnalyzer::MakeFile(const std::string& path,
+                                  const ParsedBlob& blob) {
+  File file;
+  file.name = arena_.Intern(path);
+  file.included_headers = blob.included_headers;
+  file.bytes = blob.bytes;
+  file.lines = blob.lines;
+  return file;
+}
+
+void GitHistoryAnalyzer::Measure(RevisionMetrics& metrics) const {
+  metrics.files = tree_.size();
+  const FileDepGraph& graph = analyzer_->GetFileDependencies();
+  metrics.nodes = graph.size();
+  metrics.edges = graph.Graph().NumEdges();
+  const auto& components = analyzer_->GetStronglyConnectedComponents();
+  metrics.components = components.size();
+  for (const auto& component : components) {
+    const size_t members = component.member_ids.size();
+    metrics.cyclic_components += members > 1;
+    metrics.largest_component = std::max(metrics.largest_component, members);
+  }
+  for (const int depth : analyzer_->GetComponentDepths()) {
+    metrics.max_depth = std::max(metrics.max_depth, depth);
+  }
+  metrics.simplified_edges = analyzer_->GetSimplifiedComponentDeps().NumEdges();
+}
@@ -0,0 +1,340 @@
+#include "graph_exporter.h"
+
+#include <string_view>
+#include <utility>
+
+#include "profiler.h"
+
+namespace {
+
+// Writes str with the characters `escape` maps to a replacement replaced,
+// passing the runs in between through unchanged
+template <class EscapeFn>
+void WriteEscaped(std::ostream& out, std::string_view str, EscapeFn escape) {
+  size_t run_start = 0;
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (const char* replacement = escape(str[i])) {
+      out.write(str.data() + run_start, i - run_start);
+      out << replacement;
+      run_start = i + 1;
+    }
+  }
+  out.write(str.data() + run_start, str.size() - run_start);
+}
+
+void WriteJsonString(std::ostream& out, std::string_view str) {
+  static constexpr const char* kControl[] = {
+      "\\u0000", "\\u0001", "\\u0002", "\\u0003", "\\u0004", "\\u0005",
+      "\\u0006", "\\u0007", "\\b",     "\\t",     "\\n",     "\\u000b",
+      "\\f",     "\\r",     "\\u000e", "\\u000f", "\\u0010", "\\u0011",
+      "\\u0012", "\\u0013", "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+      "\\u0018", "\\u0019", "\\u001a", "\\u001b", "\\u001c", "\\u001d",
+      "\\u001e", "\\u001f"};
+  out << '"';
+  WriteEscaped(out, str, [](char c) -> const char* {
+    if (c == '"') {
+      return "\\\"";
+    }
+    if (c == '\\') {
+      return "\\\\";
+    }
+    if (static_cast<unsigned char>(c) < 0x20) {
+      return kControl[static_cast<unsigned char>(c)];
+    }
+    return nullptr;
+  });
+  out << '"';
+}
+
+// Inside a double-quoted DOT string
+void WriteDotEscaped(std::ostream& out, std::string_view str) {
+  WriteEscaped(out, str, [](char c) -> const char* {
+    switch (c) {
+      case '"':
+        return "\\\"";
+      case '\\':
+        return "\\\\";
+      case '\n':
+        return "\\n";
+      default:
+        return nullptr;
+    }
+  });
+}
+
+void WriteXmlEscaped(std::ostream& out, std::string_view str) {
+  WriteEscaped(out, str, [](char c) -> const char* {
+    switch (c) {
+      case '&':
+        return "&amp;";
+      case '<':
+        return "&lt;";
+      case '>':
+        return "&gt;";
+      case '"':
+        return "&quot;";
+      default:
+        return nullptr;
+    }
+  });
+}
+
+class MermaidExporter : public GraphExporter {
+ public:
+  using GraphExporter::GraphExporter;
+
+  void Begin() override { out_ << "```mermaid\ngraph LR\n"; }
+
+  void Node(SccIdx component_idx) override {
+    const size_t num_members = components_.NumMembers(component_idx);
+    if (num_members > 1) {
+      out_ << "    ";
+      WriteLabel(component_idx);
+      out_ << "_contains[\"";
+      WriteLabel(component_idx);
+      out_ << " contains:<br/><br/>";
+      for (size_t i = 0; i < num_members; ++i) {
+        out_ << components_.Member(component_idx, i) << "<br/>";
+      }
+      out_ << "\"]\n";
+    }
+    out_ << "    ";
+    WriteLabel(component_idx);
+    out_ << '\n';
+  }
+
+  void Edge(SccIdx from, SccIdx to) override {
+    out_ << "    ";
+    WriteLabel(from);
+    out_ << " --> ";
+    WriteLabel(to);
+    out_ << '\n';
+  }
+
+  void End() override { out_ << "```\n"; }
+
+ private:
+  // A component is drawn under its name, or SCC_<index> for a real SCC
+  void WriteLabel(SccIdx component_idx) {
+    if (components_.NumMembers(component_idx) > 1) {
+      out_ << "SCC_" << component_idx;
+    } else {
+      out_ << components_.Name(component_idx);
+    }
+  }
+};
+
+class DotExporter : public GraphExporter {
+ public:
+  using GraphExporter::GraphExporter;
+
+  void Begin() override { out_ << "digraph dependencies {\n  rankdir=LR;\n"; }
+
+  void Node(SccIdx component_idx) override {
+    const size_t num_members = components_.NumMembers(component_idx);
+    out_ << "  n" << component_idx << " [label=\"";
+    if (num_members > 1) {
+      out_ << "SCC_" << component_idx;
+      for (size_t i = 0; i < num_members; ++i) {
+        out_ << "\\n";
+        WriteDotEscaped(out_, components_.Member(component_idx, i));
+      }
+      out_ << "\", shape=box];\n";
+    } else {
+      WriteDotEscaped(out_, components_.Name(component_idx));
+      out_ << "\"];\n";
+    }
+  }
+
+  void Edge(SccIdx from, SccIdx to) override {
+    out_ << "  n" << from << " -> n" << to << ";\n";
+  }
+
+  void End() override { out_ << "}\n"; }
+};
+
+// {"components": [{"id", "name", "members"}...], "edges": [[from, to]...]}
+class JsonExporter : public GraphExporter {
+ public:
+  using GraphExporter::GraphExporter;
+
+  void Begin() override { out_ << "{\"components\":["; }
+
+  void Node(SccIdx component_idx) override {
+    out_ << (nodes_++ ? ",{\"id\":" : "{\"id\":") << component_idx
+         << ",\"name\":";
+    WriteJsonString(out_, components_.Name(component_idx));
+    out_ << ",\"members\":[";
+    const size_t num_members = components_.NumMembers(component_idx);
+    for (size_t i = 0; i < num_members; ++i) {
+      if (i > 0) {
+        out_ << ',';
+      }
+      WriteJsonString(out_, components_.Member(component_idx, i));
+    }
+    out_ << "]}";
+  }
+
+  void Edge(SccIdx from, SccIdx to) override {
+    out_ << (edges_++ ? ",[" : "],\"edges\":[[") << from << ',' << to << ']';
+  }
+
+  void End() override { out_ << (edges_ ? "]}" : "],\"edges\":[]}"); }
+
+ private:
+  size_t nodes_ = 0;
+  size_t edges_ = 0;
+};
+
+class GraphmlExporter : public GraphExporter {
+ public:
+  using GraphExporter::GraphExporter;
+
+  void Begin() override {
+    out_ << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+            "  <key id=\"name\" for=\"node\" attr.name=\"name\" "
+            "attr.type=\"string\"/>\n"
+            "  <key id=\"members\" for=\"node\" attr.name=\"members\" "
+            "attr.type=\"int\"/>\n"
+            "  <graph id=\"dependencies\" edgedefault=\"directed\">\n";
+  }
+
+  void Node(SccIdx component_idx) override {
+    out_ << "    <node id=\"n" << component_idx << "\"><data key=\"name\">";
+    WriteXmlEscaped(out_, components_.Name(component_idx));
+    out_ << "</data><data key=\"members\">"
+         << components_.NumMembers(component_idx)
+         << "</data></node>\n";
+  }
+
+  void Edge(SccIdx from, SccIdx to) override {
+    out_ << "    <edge source=\"n" << from << "\" target=\"n" << to
+         << "\"/>\n";
+  }
+
+  void End() override { out_ << "  </graph>\n</graphml>\n"; }
+};
+
+// Members are stored as file ids in a snapshot
+class SnapshotComponentTable : public ComponentTable {
+ public:
+  explicit SnapshotComponentTable(const GraphSnapshot& snapshot)
+      : snapshot_(snapshot) {}
+
+  std::string_view Name(SccIdx component_idx) const override {
+    return snapshot_.ComponentName(component_idx);
+  }
+  size_t NumMembers(SccIdx component_idx) const override {
+    return snapshot_.ComponentMembers(component_idx).size();
+  }
+  std::string_view Member(SccIdx component_idx, size_t i) const override {
+    return snapshot_.FileName(snapshot_.ComponentMembers(component_idx)[i]);
+  }
+
+ private:
+  const GraphSnapshot& snapshot_;
+};
+
+}  // namespace
+
+std::optional<ExportFormat> ParseExportFormat(std::string_view name) {
+  if (name == "mermaid") {
+    return ExportFormat::kMermaid;
+  }
+  if (name == "dot") {
+    return ExportFormat::kDot;
+  }
+  if (name == "json") {
+    return ExportFormat::kJson;
+  }
+  if (name == "graphml") {
+    return ExportFormat::kGraphml;
+  }
+  return std::nullopt;
+}
+
+std::unique_ptr<GraphExporter> MakeGraphExporter(
+    ExportFormat format, std::ostream& out, const ComponentTable& components) {
+  switch (format) {
+    case ExportFormat::kMermaid:
+      return std::make_unique<MermaidExporter>(out, components);
+    case ExportFormat::kDot:
+      return std::make_unique<DotExporter>(out, components);
+    case ExportFormat::kJson:
+      return std::make_unique<JsonExporter>(out, components);
+    case ExportFormat::kGraphml:
+      return std::make_unique<GraphmlExporter>(out, components);
+  }
+  return nullptr;
+}
+
+ExportStats ExportGraph(CsrView component_deps,
+                        const std::vector<SccIdx>& roots,
+                        GraphExporter& exporter) {
+  Profiler::Phase phase("ExportGraph");
+  // Depth-first preorder with an explicit stack of (component, next
+  // dependency), so deep chains cannot overflow the call stack
+  std::vector<bool> visited(component_deps.NumNodes(), false);
+  std::vector<SccIdx> order;
+  std::vector<std::pair<SccIdx, size_t>> stack;
+  for (const SccIdx root : roots) {
+    if (visited[root]) {
+      continue;
+    }
+    visited[root] = true;
+    order.push_back(root);
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+      const auto [component_idx, next] = stack.back();
+      const auto deps = component_deps.Neighbors(component_idx);
+      if (next == deps.size()) {
+        stack.pop_back();
+        continue;
+      }
+      ++stack.back().second;
+      const SccIdx dep = deps[next];
+      if (!visited[dep]) {
+        visited[dep] = true;
+        order.push_back(dep);
+        stack.emplace_back(dep, 0);
+      }
+    }
+  }
+
+  ExportStats stats;
+  exporter.Begin();
+  for (const SccIdx component_idx : order) {
+    exporter.Node(component_idx);
+  }
+  stats.nodes = order.size();
+  for (const SccIdx component_idx : order) {
+    for (const SccIdx dep : component_deps.Neighbors(component_idx)) {
+      if (dep != component_idx) {
+        exporter.Edge(component_idx, dep);
+        ++stats.edges;
+      }
+    }
+  }
+  exporter.End();
+  return stats;
+}
+
+ExportStats ExportGraph(const DependencyAnalyzer& analyzer,
+                        std::string_view keyword, ExportFormat format,
+                        std::ostream& out) {
+  const SccComponentTable components(
+      analyzer.GetStronglyConnectedComponents());
+  const auto exporter = MakeGraphExporter(format, out, components);
+  return ExportGraph(analyzer.GetSimplifiedComponentDeps(),
+                     analyzer.FindComponents(keyword), *exporter);
+}
+
+ExportStats ExportGraph(const GraphSnapshot& snapshot,
+                        std::string_view keyword, ExportFormat format,
+                        std::ostream& out) {
+  const SnapshotComponentTable components(snapshot);
+  const auto exporter = MakeGraphExporter(format, out, components);
+  return ExportGraph(snapshot.SimplifiedComponentDeps(),
+                     snapshot.FindComponents(keyword), *exporter);
+}
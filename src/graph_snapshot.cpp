@@ -0,0 +1,341 @@
+#include "graph_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+#include "binary_io.h"
+
+namespace {
+
+static_assert(std::endian::native == std::endian::little,
+              "snapshots are mapped as little-endian arrays");
+
+constexpr uint32_t kMagic = 0x53414443;  // "CDAS"
+
+enum Section : size_t {
+  kFileNameOffsets,
+  kFileNameChars,
+  kFilesByName,
+  kFileDepOffsets,
+  kFileDepTargets,
+  kFileComponents,
+  kComponentNameOffsets,
+  kComponentNameChars,
+  kMemberOffsets,
+  kMembers,
+  kComponentDepOffsets,
+  kComponentDepTargets,
+  kSimplifiedDepOffsets,
+  kSimplifiedDepTargets,
+  kTopologicalOrder,
+  kDepths,
+  kNumSections
+};
+
+struct SectionRef {
+  uint64_t offset = 0;
+  uint64_t size = 0;  // bytes
+};
+
+struct Header {
+  uint32_t magic = kMagic;
+  uint32_t version = GraphSnapshot::kFormatVersion;
+  uint64_t file_size = 0;
+  uint64_t checksum = 0;
+  uint32_t num_files = 0;
+  uint32_t num_components = 0;
+  SectionRef sections[kNumSections];
+};
+static_assert(sizeof(Header) % 8 == 0);
+
+// Lays sections out after a header that is filled in last
+class SnapshotWriter {
+ public:
+  SnapshotWriter() : buffer_(sizeof(Header), '\0') {}
+
+  template <typename T>
+  void Add(Section section, std::span<const T> values) {
+    buffer_.resize((buffer_.size() + 7) & ~size_t{7}, '\0');
+    header_.sections[section] = {buffer_.size(), values.size_bytes()};
+    buffer_.append(reinterpret_cast<const char*>(values.data()),
+                   values.size_bytes());
+  }
+
+  // name(i) for i in [0, count): u64 offsets, then the characters
+  template <typename NameFn>
+  void AddNames(Section offsets_section, Section chars_section, size_t count,
+                NameFn name) {
+    std::vector<uint64_t> offsets{0};
+    offsets.reserve(count + 1);
+    std::string chars;
+    for (size_t i = 0; i < count; ++i) {
+      chars += name(i);
+      offsets.push_back(chars.size());
+    }
+    Add<uint64_t>(offsets_section, offsets);
+    Add<char>(chars_section, chars);
+  }
+
+  void AddGraph(Section offsets_section, Section targets_section,
+                CsrView graph) {
+    Add(offsets_section, graph.Offsets());
+    Add(targets_section, graph.Targets());
+  }
+
+  std::string Finish(size_t num_files, size_t num_components) {
+    header_.file_size = buffer_.size();
+    header_.num_files = static_cast<uint32_t>(num_files);
+    header_.num_components = static_cast<uint32_t>(num_components);
+    header_.checksum =
+        Fnv1a64(std::string_view(buffer_).substr(sizeof(Header)));
+    std::memcpy(buffer_.data(), &header_, sizeof(Header));
+    return std::move(buffer_);
+  }
+
+ private:
+  Header header_;
+  std::string buffer_;
+};
+
+// Checks sections against the bounds of the mapping. Like BinaryReader, a
+// bad section puts the reader into a failed state (Ok() == false) and yields
+// empty views, so callers can check once at the end.
+class SectionReader {
+ public:
+  SectionReader(std::string_view data, const Header& header)
+      : data_(data), header_(header) {}
+
+  // The section as an array of count Ts (any count for std::nullopt)
+  template <typename T>
+  std::span<const T> Array(Section section,
+                           std::optional<size_t> count = std::nullopt) {
+    const SectionRef& ref = header_.sections[section];
+    if (ref.offset < sizeof(Header) || ref.offset % alignof(T) != 0 ||
+        ref.offset > data_.size() || ref.size > data_.size() - ref.offset ||
+        ref.size % sizeof(T) != 0 ||
+        (count && ref.size / sizeof(T) != *count)) {
+      ok_ = false;
+      return {};
+    }
+    return {reinterpret_cast<const T*>(data_.data() + ref.offset),
+            ref.size / sizeof(T)};
+  }
+
+  CsrView Graph(Section offsets_section, Section targets_section,
+                size_t num_nodes) {
+    const auto offsets = Array<uint64_t>(offsets_section, num_nodes + 1);
+    const auto targets = Array<NodeId>(targets_section);
+    if (!ok_ || offsets.front() != 0 || offsets.back() != targets.size()) {
+      ok_ = false;
+      return {};
+    }
+    return {offsets, targets};
+  }
+
+  // Offsets must end at the end of the characters
+  std::span<const char> Chars(std::span<const uint64_t> offsets,
+                              Section chars_section) {
+    const auto chars = Array<char>(chars_section);
+    if (!ok_ || offsets.front() != 0 || offsets.back() != chars.size()) {
+      ok_ = false;
+      return {};
+    }
+    return chars;
+  }
+
+  bool Ok() const { return ok_; }
+
+ private:
+  std::string_view data_;
+  const Header& header_;
+  bool ok_ = true;
+};
+
+}  // namespace
+
+GraphSnapshot::~GraphSnapshot() { Close(); }
+
+bool GraphSnapshot::Save(const DependencyAnalyzer& analyzer,
+                         const std::string& path) {
+  const NameTable& names = analyzer.GetFileDependencies().Names();
+  const auto& components = analyzer.GetStronglyConnectedComponents();
+  const size_t num_files = names.Size();
+  const size_t num_components = components.size();
+  SnapshotWriter writer;
+
+  writer.AddNames(kFileNameOffsets, kFileNameChars, num_files,
+                  [&](size_t file) { return names.Name(file); });
+  std::vector<NodeId> files_by_name(num_files);
+  std::iota(files_by_name.begin(), files_by_name.end(), NodeId{0});
+  std::sort(files_by_name.begin(), files_by_name.end(),
+            [&](NodeId a, NodeId b) { return names.Name(a) < names.Name(b); });
+  writer.Add<NodeId>(kFilesByName, files_by_name);
+  writer.AddGraph(kFileDepOffsets, kFileDepTargets,
+                  analyzer.GetFileDependencies().Graph());
+  std::vector<SccIdx> file_components(num_files);
+  for (NodeId file = 0; file < num_files; ++file) {
+    file_components[file] = analyzer.GetComponentOf(file);
+  }
+  writer.Add<SccIdx>(kFileComponents, file_components);
+
+  writer.AddNames(kComponentNameOffsets, kComponentNameChars, num_components,
+                  [&](size_t i) -> std::string_view {
+                    return components[i].name;
+                  });
+  // Kept in member order, so unlike the graphs the rows are not sorted
+  std::vector<uint64_t> member_offsets{0};
+  std::vector<NodeId> members;
+  for (const auto& component : components) {
+    members.insert(members.end(), component.member_ids.begin(),
+                   component.member_ids.end());
+    member_offsets.push_back(members.size());
+  }
+  writer.AddGraph(kMemberOffsets, kMembers, CsrView(member_offsets, members));
+  writer.AddGraph(kComponentDepOffsets, kComponentDepTargets,
+                  analyzer.GetComponentDeps());
+  writer.AddGraph(kSimplifiedDepOffsets, kSimplifiedDepTargets,
+                  analyzer.GetSimplifiedComponentDeps());
+  writer.Add<SccIdx>(kTopologicalOrder, analyzer.GetTopologicalSortedSCCs());
+  const std::vector<int32_t> depths(analyzer.GetComponentDepths().begin(),
+                                    analyzer.GetComponentDepths().end());
+  writer.Add<int32_t>(kDepths, depths);
+
+  const std::string data = writer.Finish(num_files, num_components);
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!file) {
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+  return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool GraphSnapshot::Open(const std::string& path, bool verify_checksum) {
+  Close();
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st {};
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    close(fd);
+    return false;
+  }
+  const auto size = static_cast<size_t>(st.st_size);
+  void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // the mapping keeps the file
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<const char*>(mapped);
+  size_ = size;
+  if (!BindViews(verify_checksum)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool GraphSnapshot::BindViews(bool verify_checksum) {
+  Header header;
+  std::memcpy(&header, data_, sizeof(Header));
+  if (header.magic != kMagic || header.version != kFormatVersion ||
+      header.file_size != size_) {
+    return false;
+  }
+  const std::string_view data(data_, size_);
+  if (verify_checksum &&
+      Fnv1a64(data.substr(sizeof(Header))) != header.checksum) {
+    return false;
+  }
+
+  SectionReader reader(data, header);
+  Views views;
+  views.num_files = header.num_files;
+  views.num_components = header.num_components;
+  views.file_name_offsets =
+      reader.Array<uint64_t>(kFileNameOffsets, views.num_files + 1);
+  views.file_name_chars = reader.Chars(views.file_name_offsets, kFileNameChars);
+  views.files_by_name = reader.Array<NodeId>(kFilesByName, views.num_files);
+  views.file_deps =
+      reader.Graph(kFileDepOffsets, kFileDepTargets, views.num_files);
+  views.file_components =
+      reader.Array<SccIdx>(kFileComponents, views.num_files);
+  views.component_name_offsets =
+      reader.Array<uint64_t>(kComponentNameOffsets, views.num_components + 1);
+  views.component_name_chars =
+      reader.Chars(views.component_name_offsets, kComponentNameChars);
+  views.component_members =
+      reader.Graph(kMemberOffsets, kMembers, views.num_components);
+  views.component_deps = reader.Graph(kComponentDepOffsets,
+                                      kComponentDepTargets,
+                                      views.num_components);
+  views.simplified_deps = reader.Graph(kSimplifiedDepOffsets,
+                                       kSimplifiedDepTargets,
+                                       views.num_components);
+  views.topo_order =
+      reader.Array<SccIdx>(kTopologicalOrder, views.num_components);
+  views.depths = reader.Array<int32_t>(kDepths, views.num_components);
+  if (!reader.Ok()) {
+    return false;
+  }
+  views_ = views;
+  return true;
+}
+
+void GraphSnapshot::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  views_ = {};
+}
+
+std::string_view GraphSnapshot::FileName(NodeId file) const {
+  const auto begin = views_.file_name_offsets[file];
+  return {views_.file_name_chars.data() + begin,
+          views_.file_name_offsets[file + 1] - begin};
+}
+
+std::optional<NodeId> GraphSnapshot::FindFile(std::string_view name) const {
+  const auto it = std::lower_bound(
+      views_.files_by_name.begin(), views_.files_by_name.end(), name,
+      [&](NodeId file, std::string_view value) {
+        return FileName(file) < value;
+      });
+  if (it == views_.files_by_name.end() || FileName(*it) != name) {
+    return std::nullopt;
+  }
+  return *it;
+}
+
+std::string_view GraphSnapshot::ComponentName(SccIdx component_idx) const {
+  const auto begin = views_.component_name_offsets[component_idx];
+  return {views_.component_name_chars.data() + begin,
+          views_.component_name_offsets[component_idx + 1] - begin};
+}
+
+std::vector<SccIdx> GraphSnapshot::FindComponents(
+    std::string_view keyword) const {
+  std::vector<SccIdx> found;
+  for (SccIdx i = 0; i < views_.num_components; ++i) {
+    if (ComponentName(i).find(keyword) != std::string_view::npos) {
+      found.push_back(i);
+    }
+  }
+  return found;
+}
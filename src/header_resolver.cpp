@@ -0,0 +1,210 @@
+#include "header_resolver.h"
+
+#include <algorithm>
+
+namespace {
+
+// Splits a '/' separated path into its non-empty components
+std::vector<std::string_view> SplitPath(std::string_view path) {
+  std::vector<std::string_view> components;
+  size_t begin = 0;
+  while (begin <= path.size()) {
+    size_t end = path.find('/', begin);
+    if (end == std::string_view::npos) {
+      end = path.size();
+    }
+    if (end > begin) {
+      components.push_back(path.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+  return components;
+}
+
+std::string_view DirectoryOf(std::string_view path) {
+  const size_t slash = path.rfind('/');
+  return slash == std::string_view::npos ? std::string_view{}
+                                         : path.substr(0, slash);
+}
+
+std::string JoinPath(std::string_view dir, std::string_view path) {
+  if (dir.empty()) {
+    return std::string(path);
+  }
+  std::string joined;
+  joined.reserve(dir.size() + 1 + path.size());
+  joined.append(dir).append(1, '/').append(path);
+  return joined;
+}
+
+// Whether a and b end with the same `depth` path components
+bool SharesSuffix(std::string_view a, std::string_view b, size_t depth) {
+  const auto a_components = SplitPath(a);
+  const auto b_components = SplitPath(b);
+  if (a_components.size() < depth || b_components.size() < depth) {
+    return false;
+  }
+  return std::equal(a_components.end() - depth, a_components.end(),
+                    b_components.end() - depth);
+}
+
+}  // namespace
+
+std::string_view PathFilename(std::string_view path) {
+  const size_t slash = path.rfind('/');
+  return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+std::string NormalizeRelativePath(std::string_view path) {
+  std::vector<std::string_view> kept;
+  for (const auto component : SplitPath(path)) {
+    if (component == ".") {
+      continue;
+    }
+    if (component == ".." && !kept.empty() && kept.back() != "..") {
+      kept.pop_back();
+      continue;
+    }
+    kept.push_back(component);
+  }
+  std::string normalized;
+  for (const auto component : kept) {
+    if (!normalized.empty()) {
+      normalized.push_back('/');
+    }
+    normalized.append(component);
+  }
+  return normalized;
+}
+
+size_t HeaderResolver::EdgeKeyHash::operator()(const EdgeKey& key) const {
+  return std::hash<std::string_view>{}(key.component) ^
+         (static_cast<size_t>(key.parent) * 0x9e3779b97f4a7c15ULL);
+}
+
+HeaderResolver::HeaderResolver(const std::vector<File>& files,
+                               std::vector<std::string> include_paths)
+    : files_(files), include_paths_(std::move(include_paths)) {
+  for (auto& include_path : include_paths_) {
+    include_path = NormalizeRelativePath(include_path);
+  }
+
+  trie_nodes_.push_back({0, 0});  // root, the empty suffix
+  // Sized up front: rehashing tables of a million entries costs more than
+  // filling them
+  path_to_file_.reserve(files.size());
+  files_by_filename_.reserve(files.size());
+  trie_edges_.reserve(files.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    AddFile(i);
+  }
+}
+
+void HeaderResolver::AddFile(size_t idx) {
+  const std::string_view name = files_[idx].name;
+  path_to_file_.emplace(name, idx);  // keeps the first on duplicates
+  files_by_filename_[PathFilename(name)].push_back(idx);
+
+  const auto components = SplitPath(name);
+  TrieNodeIdx node = kRoot;
+  for (auto it = components.rbegin(); it != components.rend(); ++it) {
+    auto [edge, inserted] = trie_edges_.try_emplace(
+        EdgeKey{node, *it}, static_cast<TrieNodeIdx>(trie_nodes_.size()));
+    if (inserted) {
+      trie_nodes_.push_back({idx, 0});
+    }
+    node = edge->second;
+    if (trie_nodes_[node].file_count++ == 0) {
+      trie_nodes_[node].first_file = idx;  // all earlier files were removed
+    }
+  }
+}
+
+void HeaderResolver::RemoveFile(size_t idx) {
+  const std::string_view name = files_[idx].name;
+  auto& same_filename = files_by_filename_[PathFilename(name)];
+  std::erase(same_filename, idx);
+
+  // Every file sharing a path suffix with this one also shares its file name,
+  // so replacements are looked up among those only
+  auto first_sharing = [&](size_t depth) -> size_t {
+    for (const size_t other : same_filename) {
+      if (SharesSuffix(files_[other].name, name, depth)) {
+        return other;
+      }
+    }
+    return 0;
+  };
+
+  if (auto it = path_to_file_.find(name);
+      it != path_to_file_.end() && it->second == idx) {
+    path_to_file_.erase(it);
+    for (const size_t other : same_filename) {
+      if (files_[other].name == name) {
+        path_to_file_.emplace(files_[other].name, other);
+        break;
+      }
+    }
+  }
+
+  const auto components = SplitPath(name);
+  TrieNodeIdx node = kRoot;
+  size_t depth = 0;
+  for (auto it = components.rbegin(); it != components.rend(); ++it) {
+    node = trie_edges_.at(EdgeKey{node, *it});
+    ++depth;
+    TrieNode& trie_node = trie_nodes_[node];
+    // Emptied nodes stay in the trie with a zero count
+    if (--trie_node.file_count > 0 && trie_node.first_file == idx) {
+      trie_node.first_file = first_sharing(depth);
+    }
+  }
+  if (same_filename.empty()) {
+    files_by_filename_.erase(PathFilename(name));
+  }
+}
+
+std::optional<size_t> HeaderResolver::FindFile(std::string_view path) const {
+  auto it = path_to_file_.find(path);
+  if (it == path_to_file_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+HeaderResolver::Resolution HeaderResolver::FindLongestSuffix(
+    std::string_view include) const {
+  const auto components = SplitPath(include);
+  TrieNodeIdx node = kRoot;
+  for (auto it = components.rbegin(); it != components.rend(); ++it) {
+    if (*it == "." || *it == "..") {
+      break;  // nothing above this point can match a parsed file name
+    }
+    auto edge = trie_edges_.find(EdgeKey{node, *it});
+    if (edge == trie_edges_.end() ||
+        trie_nodes_[edge->second].file_count == 0) {
+      break;
+    }
+    node = edge->second;
+  }
+  if (node == kRoot) {
+    return {};  // not even the file name matched
+  }
+  return {trie_nodes_[node].first_file, trie_nodes_[node].file_count};
+}
+
+HeaderResolver::Resolution HeaderResolver::Resolve(
+    const File& includer, std::string_view include) const {
+  const std::string relative =
+      NormalizeRelativePath(JoinPath(DirectoryOf(includer.name), include));
+  if (auto idx = FindFile(relative)) {
+    return {idx, 1};
+  }
+  for (const auto& include_path : include_paths_) {
+    if (auto idx = FindFile(
+            NormalizeRelativePath(JoinPath(include_path, include)))) {
+      return {idx, 1};
+    }
+  }
+  return FindLongestSuffix(include);
+}
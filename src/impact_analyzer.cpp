@@ -0,0 +1,67 @@
+#include "impact_analyzer.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "file_dep_builder.h"
+
+ImpactAnalyzer::ImpactAnalyzer(const DependencyAnalyzer& analyzer,
+                               ThreadPool* pool)
+    : analyzer_(analyzer),
+      component_dependents_(analyzer.GetComponentDeps().Reversed(pool)) {}
+
+ImpactResult ImpactAnalyzer::Analyze(
+    std::span<const std::string> changed) const {
+  const NameTable& names = analyzer_.GetFileDependencies().Names();
+  std::vector<NodeId> files;
+  std::vector<std::string> unknown;
+  for (const auto& path : changed) {
+    if (const auto file = names.Find(GetFileStem(path))) {
+      files.push_back(*file);
+    } else {
+      unknown.push_back(path);
+    }
+  }
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end()), files.end());
+  ImpactResult result = Analyze(files);
+  result.unknown_files = std::move(unknown);
+  return result;
+}
+
+ImpactResult ImpactAnalyzer::Analyze(
+    std::span<const NodeId> changed_files) const {
+  ImpactResult result;
+  result.changed_files.assign(changed_files.begin(), changed_files.end());
+
+  // Every component enters the queue once, when it is first reached; the
+  // queue then holds exactly the affected components
+  std::vector<uint64_t> visited((component_dependents_.NumNodes() + 63) / 64);
+  auto visit = [&](SccIdx component_idx) {
+    uint64_t& word = visited[component_idx / 64];
+    const uint64_t bit = uint64_t{1} << (component_idx % 64);
+    if (word & bit) {
+      return;
+    }
+    word |= bit;
+    result.components.push_back(component_idx);
+  };
+  for (const NodeId file : changed_files) {
+    visit(analyzer_.GetComponentOf(file));
+  }
+  for (size_t next = 0; next < result.components.size(); ++next) {
+    for (const SccIdx dependent :
+         component_dependents_.Neighbors(result.components[next])) {
+      visit(dependent);
+    }
+  }
+  std::sort(result.components.begin(), result.components.end());
+
+  const auto& components = analyzer_.GetStronglyConnectedComponents();
+  for (const SccIdx component_idx : result.components) {
+    const auto& members = components[component_idx].member_ids;
+    result.files.insert(result.files.end(), members.begin(), members.end());
+  }
+  std::sort(result.files.begin(), result.files.end());
+  return result;
+}
@@ -0,0 +1,110 @@
+#include "include_cost.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <string_view>
+
+#include "dependency_analyzer.h"
+#include "file_dep_builder.h"
+#include "profiler.h"
+#include "reachability.h"
+#include "thread_pool.h"
+
+std::vector<IncludeCost> ComputeIncludeCosts(const DependencyAnalyzer& analyzer,
+                                             ThreadPool* pool) {
+  Profiler::Phase phase("IncludeCosts");
+  const NameTable& names = analyzer.GetFileDependencies().Names();
+  const auto& components = analyzer.GetStronglyConnectedComponents();
+  const ReachabilityIndex& reachability = analyzer.GetComponentReachability();
+
+  std::vector<IncludeCost> costs(names.Size());
+  for (const File& file : analyzer.GetFiles()) {
+    // Files without any resolved include edge are not graph nodes
+    if (const auto node = names.Find(GetFileStem(file.name))) {
+      costs[*node].own += CodeSize{1, file.bytes, file.lines};
+    }
+  }
+  std::vector<CodeSize> component_sizes(components.size());
+  for (SccIdx i = 0; i < components.size(); ++i) {
+    for (const NodeId member : components[i].member_ids) {
+      component_sizes[i] += costs[member].own;
+    }
+  }
+
+  // Per worker fan-in counts, summed once all rows are done, so the
+  // components everything reaches are not contended
+  std::vector<CodeSize> closures(components.size());
+  std::vector<std::vector<uint64_t>> fan_in_per_thread(
+      pool ? std::max(1u, pool->Size()) : 1);
+  ParallelFor(pool, components.size(), [&](size_t i, unsigned worker_idx) {
+    auto& fan_in = fan_in_per_thread[worker_idx];
+    if (fan_in.empty()) {
+      fan_in.resize(components.size(), 0);
+    }
+    const uint64_t includers = components[i].member_ids.size();
+    CodeSize closure = component_sizes[i];
+    reachability.ForEach(static_cast<SccIdx>(i), [&](SccIdx reached) {
+      closure += component_sizes[reached];
+      fan_in[reached] += includers;
+    });
+    closures[i] = closure;
+  });
+
+  std::vector<uint64_t> component_fan_in(components.size(), 0);
+  for (const auto& fan_in : fan_in_per_thread) {
+    for (size_t i = 0; i < fan_in.size(); ++i) {
+      component_fan_in[i] += fan_in[i];
+    }
+  }
+  for (SccIdx i = 0; i < components.size(); ++i) {
+    const auto& members = components[i].member_ids;
+    for (const NodeId member : members) {
+      costs[member].closure = closures[i];
+      // The other members of a cycle include it too
+      costs[member].fan_in = component_fan_in[i] + members.size() - 1;
+    }
+  }
+  return costs;
+}
+
+void WriteIncludeCostReport(const DependencyAnalyzer& analyzer,
+                            const std::vector<IncludeCost>& costs,
+                            size_t limit, std::ostream& out) {
+  std::vector<NodeId> ranked;
+  for (NodeId node = 0; node < costs.size(); ++node) {
+    if (costs[node].fan_in > 0) {
+      ranked.push_back(node);
+    }
+  }
+  const size_t shown = std::min(limit, ranked.size());
+  std::partial_sort(ranked.begin(), ranked.begin() + shown, ranked.end(),
+                    [&](NodeId a, NodeId b) {
+                      const uint64_t a_bytes = costs[a].BuildBytes();
+                      const uint64_t b_bytes = costs[b].BuildBytes();
+                      return a_bytes != b_bytes ? a_bytes > b_bytes : a < b;
+                    });
+
+  const NameTable& names = analyzer.GetFileDependencies().Names();
+  size_t name_width = 4;
+  for (size_t i = 0; i < shown; ++i) {
+    name_width = std::max(name_width, names.Name(ranked[i]).size());
+  }
+  const auto flags = out.flags();
+  out << std::right << std::setw(5) << "Rank" << "  " << std::left
+      << std::setw(static_cast<int>(name_width)) << "File" << std::right
+      << std::setw(10) << "Fan-in" << std::setw(10) << "Files"
+      << std::setw(14) << "Closure KiB" << std::setw(14) << "Lines"
+      << std::setw(14) << "Build MiB" << '\n';
+  out << std::fixed << std::setprecision(1);
+  for (size_t i = 0; i < shown; ++i) {
+    const IncludeCost& cost = costs[ranked[i]];
+    out << std::setw(5) << i + 1 << "  " << std::left
+        << std::setw(static_cast<int>(name_width)) << names.Name(ranked[i])
+        << std::right << std::setw(10) << cost.fan_in << std::setw(10)
+        << cost.closure.files << std::setw(14)
+        << static_cast<double>(cost.closure.bytes) / 1024 << std::setw(14)
+        << cost.closure.lines << std::setw(14)
+        << static_cast<double>(cost.BuildBytes()) / (1024 * 1024) << '\n';
+  }
+  out.flags(flags);
+}
@@ -0,0 +1,349 @@
+#include "json.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+namespace {
+
+constexpr int kMaxDepth = 256;
+
+class JsonParser {
+ public:
+  explicit JsonParser(std::string_view text) : text_(text) {}
+
+  std::optional<JsonValue> ParseDocument() {
+    JsonValue value;
+    if (!ParseValue(value, 0)) {
+      return std::nullopt;
+    }
+    SkipWhitespace();
+    if (pos_ != text_.size()) {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+ private:
+  std::string_view text_;
+  size_t pos_ = 0;
+
+  void SkipWhitespace() {
+    while (pos_ < text_.size() &&
+           (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' ||
+            text_[pos_] == '\r')) {
+      ++pos_;
+    }
+  }
+
+  bool Consume(char c) {
+    SkipWhitespace();
+    if (pos_ < text_.size() && text_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  bool ConsumeLiteral(std::string_view literal) {
+    if (text_.substr(pos_, literal.size()) != literal) {
+      return false;
+    }
+    pos_ += literal.size();
+    return true;
+  }
+
+  bool ParseValue(JsonValue& out, int depth) {
+    if (depth > kMaxDepth) {
+      return false;
+    }
+    SkipWhitespace();
+    if (pos_ == text_.size()) {
+      return false;
+    }
+    switch (text_[pos_]) {
+      case '{':
+        return ParseObject(out, depth);
+      case '[':
+        return ParseArray(out, depth);
+      case '"': {
+        std::string str;
+        if (!ParseString(str)) {
+          return false;
+        }
+        out.value = std::move(str);
+        return true;
+      }
+      case 't':
+        out.value = true;
+        return ConsumeLiteral("true");
+      case 'f':
+        out.value = false;
+        return ConsumeLiteral("false");
+      case 'n':
+        out.value = nullptr;
+        return ConsumeLiteral("null");
+      default:
+        return ParseNumber(out);
+    }
+  }
+
+  bool ParseObject(JsonValue& out, int depth) {
+    ++pos_;  // '{'
+    JsonValue::Object object;
+    if (!Consume('}')) {
+      do {
+        SkipWhitespace();
+        std::string key;
+        if (pos_ == text_.size() || text_[pos_] != '"' || !ParseString(key) ||
+            !Consume(':')) {
+          return false;
+        }
+        JsonValue member;
+        if (!ParseValue(member, depth + 1)) {
+          return false;
+        }
+        object.emplace_back(std::move(key), std::move(member));
+      } while (Consume(','));
+      if (!Consume('}')) {
+        return false;
+      }
+    }
+    out.value = std::move(object);
+    return true;
+  }
+
+  bool ParseArray(JsonValue& out, int depth) {
+    ++pos_;  // '['
+    JsonValue::Array array;
+    if (!Consume(']')) {
+      do {
+        JsonValue element;
+        if (!ParseValue(element, depth + 1)) {
+          return false;
+        }
+        array.push_back(std::move(element));
+      } while (Consume(','));
+      if (!Consume(']')) {
+        return false;
+      }
+    }
+    out.value = std::move(array);
+    return true;
+  }
+
+  bool ParseNumber(JsonValue& out) {
+    // from_chars accepts a superset of the JSON grammar (e.g. leading zeros
+    // and "inf"), so the grammar is checked first
+    const size_t start = pos_;
+    auto digits = [&] {
+      const size_t from = pos_;
+      while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') {
+        ++pos_;
+      }
+      return pos_ - from;
+    };
+    if (pos_ < text_.size() && text_[pos_] == '-') {
+      ++pos_;
+    }
+    const size_t int_start = pos_;
+    const size_t int_digits = digits();
+    if (int_digits == 0 || (int_digits > 1 && text_[int_start] == '0')) {
+      return false;
+    }
+    if (pos_ < text_.size() && text_[pos_] == '.') {
+      ++pos_;
+      if (digits() == 0) {
+        return false;
+      }
+    }
+    if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+      ++pos_;
+      if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-')) {
+        ++pos_;
+      }
+      if (digits() == 0) {
+        return false;
+      }
+    }
+    double number = 0;
+    const auto [end, ec] =
+        std::from_chars(text_.data() + start, text_.data() + pos_, number);
+    if (ec != std::errc() || end != text_.data() + pos_) {
+      return false;
+    }
+    out.value = number;
+    return true;
+  }
+
+  bool ParseHex4(uint32_t& code) {
+    if (pos_ + 4 > text_.size()) {
+      return false;
+    }
+    code = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = text_[pos_++];
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        code |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        code |= c - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool ParseString(std::string& out) {
+    ++pos_;  // '"'
+    while (pos_ < text_.size()) {
+      const char c = text_[pos_++];
+      if (c == '"') {
+        return true;
+      }
+      if (static_cast<unsigned char>(c) < 0x20) {
+        return false;
+      }
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (pos_ == text_.size()) {
+        return false;
+      }
+      switch (text_[pos_++]) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+          uint32_t code;
+          if (!ParseHex4(code)) {
+            return false;
+          }
+          if (code >= 0xD800 && code < 0xDC00) {
+            // A high surrogate must be followed by an escaped low one
+            uint32_t low;
+            if (!ConsumeLiteral("\\u") || !ParseHex4(low) || low < 0xDC00 ||
+                low >= 0xE000) {
+              return false;
+            }
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          } else if (code >= 0xDC00 && code < 0xE000) {
+            return false;
+          }
+          AppendUtf8(out, code);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+};
+
+}  // namespace
+
+void AppendUtf8(std::string& out, uint32_t code) {
+  if (code < 0x80) {
+    out += static_cast<char>(code);
+  } else if (code < 0x800) {
+    out += static_cast<char>(0xC0 | (code >> 6));
+    out += static_cast<char>(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    out += static_cast<char>(0xE0 | (code >> 12));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (code >> 18));
+    out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code & 0x3F));
+  }
+}
+
+const JsonValue* JsonValue::Find(std::string_view key) const {
+  if (const Object* object = AsObject()) {
+    for (const auto& [name, member] : *object) {
+      if (name == key) {
+        return &member;
+      }
+    }
+  }
+  return nullptr;
+}
+
+std::optional<JsonValue> ParseJson(std::string_view text) {
+  return JsonParser(text).ParseDocument();
+}
+
+void AppendJsonString(std::string& out, std::string_view str) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  out += '"';
+  for (const char c : str) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          out += "\\u00";
+          out += kHex[(c >> 4) & 0xF];
+          out += kHex[c & 0xF];
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+void AppendJson(std::string& out, const JsonValue& value) {
+  if (value.IsNull()) {
+    out += "null";
+  } else if (const bool* flag = value.AsBool()) {
+    out += *flag ? "true" : "false";
+  } else if (const double* number = value.AsNumber()) {
+    if (!std::isfinite(*number)) {
+      out += "null";  // not representable in JSON
+      return;
+    }
+    char buffer[32];
+    const auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer),
+                                         *number);
+    out.append(buffer, end);
+  } else if (const std::string* str = value.AsString()) {
+    AppendJsonString(out, *str);
+  } else if (const JsonValue::Array* array = value.AsArray()) {
+    out += '[';
+    for (size_t i = 0; i < array->size(); ++i) {
+      if (i > 0) {
+        out += ',';
+      }
+      AppendJson(out, (*array)[i]);
+    }
+    out += ']';
+  } else if (const JsonValue::Object* object = value.AsObject()) {
+    out += '{';
+    for (size_t i = 0; i < object->size(); ++i) {
+      if (i > 0) {
+        out += ',';
+      }
+      AppendJsonString(out, (*object)[i].first);
+      out += ':';
+      AppendJson(out, (*object)[i].second);
+    }
+    out += '}';
+  }
+}
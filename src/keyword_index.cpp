@@ -0,0 +1,112 @@
+#include "keyword_index.h"
+
+#include <algorithm>
+
+std::vector<uint32_t> KeywordIndex::Trigrams(std::string_view str) {
+  std::vector<uint32_t> trigrams;
+  if (str.size() < 3) {
+    return trigrams;
+  }
+  trigrams.reserve(str.size() - 2);
+  for (size_t i = 0; i + 3 <= str.size(); ++i) {
+    trigrams.push_back(static_cast<uint32_t>(static_cast<uint8_t>(str[i])) |
+                       static_cast<uint32_t>(static_cast<uint8_t>(str[i + 1]))
+                           << 8 |
+                       static_cast<uint32_t>(static_cast<uint8_t>(str[i + 2]))
+                           << 16);
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  return trigrams;
+}
+
+void KeywordIndex::Set(NodeId id, std::string_view name) {
+  if (id < names_.size() && present_[id] && names_[id] == name) {
+    return;
+  }
+  Erase(id);
+  if (id >= names_.size()) {
+    names_.resize(id + 1);
+    present_.resize(id + 1, false);
+  }
+  names_[id] = name;
+  present_[id] = true;
+  for (const uint32_t trigram : Trigrams(name)) {
+    auto& ids = postings_[trigram];
+    // Building in id order only appends
+    if (ids.empty() || ids.back() < id) {
+      ids.push_back(id);
+    } else {
+      ids.insert(std::lower_bound(ids.begin(), ids.end(), id), id);
+    }
+  }
+}
+
+void KeywordIndex::Erase(NodeId id) {
+  if (id >= names_.size() || !present_[id]) {
+    return;
+  }
+  for (const uint32_t trigram : Trigrams(names_[id])) {
+    auto it = postings_.find(trigram);
+    auto& ids = it->second;
+    ids.erase(std::lower_bound(ids.begin(), ids.end(), id));
+    if (ids.empty()) {
+      postings_.erase(it);
+    }
+  }
+  names_[id].clear();
+  present_[id] = false;
+}
+
+void KeywordIndex::Remap(const IdCompaction& compaction, size_t old_size) {
+  for (const NodeId id : compaction.removed) {
+    if (id < old_size) {
+      Erase(id);
+    }
+  }
+  for (const auto& [from, to] : compaction.moves) {
+    if (from < old_size && from < names_.size() && present_[from]) {
+      const std::string name = names_[from];
+      Erase(from);
+      Set(to, name);
+    }
+  }
+  names_.resize(std::min(names_.size(), compaction.new_size));
+  present_.resize(names_.size());
+}
+
+std::vector<NodeId> KeywordIndex::Find(std::string_view keyword) const {
+  std::vector<NodeId> found;
+  if (keyword.size() < 3) {
+    for (NodeId id = 0; id < names_.size(); ++id) {
+      if (present_[id] && names_[id].find(keyword) != std::string::npos) {
+        found.push_back(id);
+      }
+    }
+    return found;
+  }
+
+  // Walk the rarest trigram's ids, skipping those missing from another
+  // trigram's list before reading the name itself
+  std::vector<const std::vector<NodeId>*> lists;
+  for (const uint32_t trigram : Trigrams(keyword)) {
+    auto it = postings_.find(trigram);
+    if (it == postings_.end()) {
+      return found;
+    }
+    lists.push_back(&it->second);
+  }
+  std::sort(lists.begin(), lists.end(),
+            [](const auto* a, const auto* b) { return a->size() < b->size(); });
+  for (const NodeId id : *lists.front()) {
+    const bool in_all =
+        std::all_of(lists.begin() + 1, lists.end(), [id](const auto* ids) {
+          return std::binary_search(ids->begin(), ids->end(), id);
+        });
+    if (in_all && names_[id].find(keyword) != std::string::npos) {
+      found.push_back(id);
+    }
+  }
+  return found;
+}
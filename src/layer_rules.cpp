@@ -0,0 +1,376 @@
+#include "layer_rules.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+#include "dependency_analyzer.h"
+#include "file_dep_builder.h"
+#include "profiler.h"
+#include "source_walker.h"
+
+namespace {
+
+constexpr uint8_t kNoLayer = 0xff;
+
+std::vector<std::string_view> SplitWords(std::string_view line) {
+  std::vector<std::string_view> words;
+  size_t i = 0;
+  while (i < line.size()) {
+    while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) {
+      ++i;
+    }
+    const size_t begin = i;
+    while (i < line.size() && line[i] != ' ' && line[i] != '\t') {
+      ++i;
+    }
+    if (i > begin) {
+      words.push_back(line.substr(begin, i - begin));
+    }
+  }
+  return words;
+}
+
+// The first `depth` directories of the path, or all of them when it is not
+// that deep; "." for a file at the top
+std::string_view DirectoryPrefix(std::string_view path, size_t depth) {
+  size_t end = std::string_view::npos;
+  size_t pos = 0;
+  for (size_t i = 0; i < depth; ++i) {
+    const size_t slash = path.find('/', pos);
+    if (slash == std::string_view::npos) {
+      break;
+    }
+    end = slash;
+    pos = slash + 1;
+  }
+  return end == std::string_view::npos ? "." : path.substr(0, end);
+}
+
+// Shortest path from `from` to the first node is_target accepts, through
+// nodes may_enter accepts; empty when there is none
+template <typename IsTarget, typename MayEnter>
+std::vector<NodeId> ShortestPath(const CsrGraph& graph, NodeId from,
+                                 const IsTarget& is_target,
+                                 const MayEnter& may_enter) {
+  std::unordered_map<NodeId, NodeId> parent{{from, from}};
+  std::vector<NodeId> frontier{from};
+  for (size_t next = 0; next < frontier.size(); ++next) {
+    for (const NodeId neighbor : graph.Neighbors(frontier[next])) {
+      if (parent.count(neighbor)) {
+        continue;
+      }
+      parent.emplace(neighbor, frontier[next]);
+      if (is_target(neighbor)) {
+        std::vector<NodeId> path{neighbor};
+        while (path.back() != from) {
+          path.push_back(parent.at(path.back()));
+        }
+        std::reverse(path.begin(), path.end());
+        return path;
+      }
+      if (may_enter(neighbor)) {
+        frontier.push_back(neighbor);
+      }
+    }
+  }
+  return {};
+}
+
+}  // namespace
+
+std::optional<LayerRules> LayerRules::Parse(std::string_view text,
+                                            std::string* error) {
+  LayerRules rules;
+  std::unordered_map<std::string_view, size_t> layer_ids;
+  // Edge rules are resolved once every layer is known, so they may come
+  // first
+  struct EdgeRule {
+    size_t line;
+    bool allow;
+    std::vector<std::string_view> words;
+  };
+  std::vector<EdgeRule> edge_rules;
+
+  size_t line_number = 0;
+  auto fail = [&](size_t line, const std::string& message) {
+    *error = "line " + std::to_string(line) + ": " + message;
+    return std::nullopt;
+  };
+  while (!text.empty()) {
+    ++line_number;
+    const size_t newline = std::min(text.find('\n'), text.size());
+    std::vector<std::string_view> words = SplitWords(text.substr(0, newline));
+    text.remove_prefix(std::min(newline + 1, text.size()));
+    if (!words.empty() && words.back().ends_with('\r')) {
+      words.back().remove_suffix(1);
+    }
+    if (words.empty() || words[0].starts_with('#')) {
+      continue;
+    }
+    const std::string_view directive = words[0];
+    if (directive == "layer") {
+      if (words.size() < 3 || words[1] == "*" || words[1] == "->") {
+        return fail(line_number, "expected: layer NAME GLOB...");
+      }
+      if (rules.layers.size() == kMaxLayers) {
+        return fail(line_number, "more than 64 layers");
+      }
+      if (!layer_ids.emplace(words[1], rules.layers.size()).second) {
+        return fail(line_number,
+                    "layer " + std::string(words[1]) + " defined twice");
+      }
+      Layer& layer = rules.layers.emplace_back();
+      layer.name = words[1];
+      layer.globs.assign(words.begin() + 2, words.end());
+    } else if (directive == "allow" || directive == "forbid") {
+      if (words.size() < 4 || words[2] != "->") {
+        return fail(line_number, "expected: " + std::string(directive) +
+                                     " LAYER -> LAYER...");
+      }
+      edge_rules.push_back({line_number, directive == "allow", words});
+    } else if (directive == "no-cycles-between") {
+      if (words.size() == 2 && words[1] == "layers") {
+        rules.no_cycles_between_layers = true;
+      } else if (words.size() == 3 && words[1] == "directories" &&
+                 std::all_of(words[2].begin(), words[2].end(),
+                             [](char c) { return c >= '0' && c <= '9'; }) &&
+                 std::stoul(std::string(words[2])) > 0) {
+        rules.no_cycles_between_directories =
+            std::stoul(std::string(words[2]));
+      } else {
+        return fail(line_number,
+                    "expected: no-cycles-between layers | directories DEPTH");
+      }
+    } else {
+      return fail(line_number, "unknown rule " + std::string(directive));
+    }
+  }
+
+  const uint64_t all_layers = rules.layers.size() == kMaxLayers
+                                  ? ~uint64_t{0}
+                                  : (uint64_t{1} << rules.layers.size()) - 1;
+  std::vector<uint64_t> allowed(rules.layers.size(), 0);
+  std::vector<bool> has_allow(rules.layers.size(), false);
+  rules.forbidden.assign(rules.layers.size(), 0);
+  for (const EdgeRule& rule : edge_rules) {
+    auto mask_of = [&](std::string_view name) -> std::optional<uint64_t> {
+      if (name == "*") {
+        return all_layers;
+      }
+      const auto it = layer_ids.find(name);
+      if (it == layer_ids.end()) {
+        return std::nullopt;
+      }
+      return uint64_t{1} << it->second;
+    };
+    uint64_t targets = 0;
+    for (size_t i = 3; i < rule.words.size(); ++i) {
+      const std::optional<uint64_t> mask = mask_of(rule.words[i]);
+      if (!mask) {
+        return fail(rule.line,
+                    "unknown layer " + std::string(rule.words[i]));
+      }
+      targets |= *mask;
+    }
+    const std::optional<uint64_t> sources = mask_of(rule.words[1]);
+    if (!sources) {
+      return fail(rule.line, "unknown layer " + std::string(rule.words[1]));
+    }
+    for (size_t layer = 0; layer < rules.layers.size(); ++layer) {
+      if (*sources >> layer & 1) {
+        (rule.allow ? allowed[layer] : rules.forbidden[layer]) |= targets;
+        has_allow[layer] = has_allow[layer] || rule.allow;
+      }
+    }
+  }
+  for (size_t layer = 0; layer < rules.layers.size(); ++layer) {
+    if (has_allow[layer]) {
+      rules.forbidden[layer] |= all_layers & ~allowed[layer];
+    }
+    // A layer may always depend on itself
+    rules.forbidden[layer] &= ~(uint64_t{1} << layer);
+  }
+  return rules;
+}
+
+std::optional<LayerRules> LayerRules::Load(const std::string& path,
+                                           std::string* error) {
+  std::ifstream in(path);
+  if (!in) {
+    *error = "cannot read " + path;
+    return std::nullopt;
+  }
+  const std::string text((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  std::optional<LayerRules> rules = Parse(text, error);
+  if (!rules) {
+    *error = path + ": " + *error;
+  }
+  return rules;
+}
+
+std::string LayerViolation::Describe() const {
+  std::string line = kind == Kind::kCycle
+                         ? "cycle between " + from + " and " + to + ": "
+                         : from + " -> " + to + ": ";
+  for (size_t i = 0; i < chain.size(); ++i) {
+    line += (i ? " -> " : "") + chain[i];
+  }
+  return line;
+}
+
+std::vector<LayerViolation> CheckLayerRules(const DependencyAnalyzer& analyzer,
+                                            const LayerRules& rules) {
+  Profiler::Phase phase("CheckLayerRules");
+  const FileDepGraph& file_graph = analyzer.GetFileDependencies();
+  const NameTable& names = file_graph.Names();
+  const CsrGraph& graph = file_graph.Graph();
+  const size_t num_nodes = names.Size();
+
+  // Every node's layer and first file. Only the layers listed before the
+  // one a node already has can still change it.
+  const std::vector<File> files = analyzer.GetFiles();
+  std::vector<uint8_t> layer(num_nodes, kNoLayer);
+  std::vector<std::string_view> first_file(num_nodes);
+  for (const File& file : files) {
+    const auto node = names.Find(GetFileStem(file.name));
+    if (!node) {
+      continue;  // no include edges
+    }
+    if (first_file[*node].empty()) {
+      first_file[*node] = file.name;
+    }
+    const size_t candidates =
+        std::min<size_t>(layer[*node], rules.layers.size());
+    for (size_t l = 0; l < candidates; ++l) {
+      const auto& globs = rules.layers[l].globs;
+      if (std::any_of(globs.begin(), globs.end(), [&](const auto& glob) {
+            return SourceWalker::GlobCovers(glob, file.name);
+          })) {
+        layer[*node] = static_cast<uint8_t>(l);
+        break;
+      }
+    }
+  }
+  auto chain_of = [&](const std::vector<NodeId>& path) {
+    std::vector<std::string> chain;
+    for (const NodeId node : path) {
+      chain.emplace_back(first_file[node]);
+    }
+    return chain;
+  };
+
+  std::vector<LayerViolation> violations;
+  const bool any_forbidden =
+      std::any_of(rules.forbidden.begin(), rules.forbidden.end(),
+                  [](uint64_t mask) { return mask != 0; });
+  if (any_forbidden) {
+    // The layers each unlayered node leads to through unlayered nodes. A
+    // node is queued again only when it gains a layer, so at most
+    // kMaxLayers times.
+    std::vector<uint64_t> exits(num_nodes, 0);
+    std::vector<NodeId> queue;
+    for (NodeId node = 0; node < num_nodes; ++node) {
+      if (layer[node] != kNoLayer) {
+        continue;
+      }
+      for (const NodeId dep : graph.Neighbors(node)) {
+        if (layer[dep] != kNoLayer) {
+          exits[node] |= uint64_t{1} << layer[dep];
+        }
+      }
+      if (exits[node]) {
+        queue.push_back(node);
+      }
+    }
+    const CsrGraph includers = graph.Reversed();
+    while (!queue.empty()) {
+      const NodeId node = queue.back();
+      queue.pop_back();
+      for (const NodeId includer : includers.Neighbors(node)) {
+        if (layer[includer] == kNoLayer && (exits[node] & ~exits[includer])) {
+          exits[includer] |= exits[node];
+          queue.push_back(includer);
+        }
+      }
+    }
+
+    for (NodeId node = 0; node < num_nodes; ++node) {
+      if (layer[node] == kNoLayer || !rules.forbidden[layer[node]]) {
+        continue;
+      }
+      uint64_t reached = 0;
+      for (const NodeId dep : graph.Neighbors(node)) {
+        reached |= layer[dep] != kNoLayer ? uint64_t{1} << layer[dep]
+                                          : exits[dep];
+      }
+      for (uint64_t bad = reached & rules.forbidden[layer[node]]; bad;
+           bad &= bad - 1) {
+        const size_t target = std::countr_zero(bad);
+        const std::vector<NodeId> path = ShortestPath(
+            graph, node, [&](NodeId v) { return layer[v] == target; },
+            [&](NodeId v) {
+              return layer[v] == kNoLayer && (exits[v] >> target & 1);
+            });
+        violations.push_back({LayerViolation::Kind::kForbiddenDependency,
+                              rules.layers[layer[node]].name,
+                              rules.layers[target].name, chain_of(path)});
+      }
+    }
+  }
+
+  // Cycles: a path from a member to one of another layer or directory and
+  // back, both within the component
+  const auto& components = analyzer.GetStronglyConnectedComponents();
+  auto report_cycle = [&](SccIdx component, NodeId from, NodeId to,
+                          std::string from_name, std::string to_name) {
+    auto within = [&](NodeId v) {
+      return analyzer.GetComponentOf(v) == component;
+    };
+    std::vector<NodeId> path = ShortestPath(
+        graph, from, [&](NodeId v) { return v == to; }, within);
+    const std::vector<NodeId> back = ShortestPath(
+        graph, to, [&](NodeId v) { return v == from; }, within);
+    path.insert(path.end(), back.begin() + 1, back.end());
+    violations.push_back({LayerViolation::Kind::kCycle, std::move(from_name),
+                          std::move(to_name), chain_of(path)});
+  };
+  const size_t depth = rules.no_cycles_between_directories;
+  for (SccIdx c = 0; c < components.size(); ++c) {
+    const auto& members = components[c].member_ids;
+    if (members.size() < 2) {
+      continue;
+    }
+    if (rules.no_cycles_between_layers) {
+      const auto first = std::find_if(
+          members.begin(), members.end(),
+          [&](NodeId v) { return layer[v] != kNoLayer; });
+      const auto other =
+          first == members.end()
+              ? first
+              : std::find_if(first + 1, members.end(), [&](NodeId v) {
+                  return layer[v] != kNoLayer && layer[v] != layer[*first];
+                });
+      if (other != members.end()) {
+        report_cycle(c, *first, *other, rules.layers[layer[*first]].name,
+                     rules.layers[layer[*other]].name);
+      }
+    }
+    if (depth > 0) {
+      const std::string_view directory =
+          DirectoryPrefix(first_file[members[0]], depth);
+      const auto other =
+          std::find_if(members.begin() + 1, members.end(), [&](NodeId v) {
+            return DirectoryPrefix(first_file[v], depth) != directory;
+          });
+      if (other != members.end()) {
+        report_cycle(c, members[0], *other, std::string(directory),
+                     std::string(DirectoryPrefix(first_file[*other], depth)));
+      }
+    }
+  }
+  return violations;
+}
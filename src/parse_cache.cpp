@@ -0,0 +1,157 @@
+#include "parse_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include "binary_io.h"
+
+namespace {
+
+constexpr uint32_t kMagic = 0x43414443;  // "CDAC"
+
+}  // namespace
+
+ParseCache::ParseCache(std::string path, bool hash_contents)
+    : path_(std::move(path)), hash_contents_(hash_contents) {}
+
+const ParseCache::Entry* ParseCache::Find(std::string_view path) const {
+  auto it = entries_.find(path);
+  return it != entries_.end() ? &it->second : nullptr;
+}
+
+void ParseCache::Store(std::string_view path, const FileStamp& stamp,
+                       const File& file, bool hit) {
+  hit ? ++stats_.hits : ++stats_.misses;
+
+  const std::string_view key = arena_.Intern(path);
+  Entry& entry = stored_[key];
+  entry.stamp = stamp;
+  entry.lines = file.lines;
+  if (hit) {
+    // Cached records already point into arena_
+    entry.included_headers = file.included_headers;
+    return;
+  }
+  entry.included_headers.clear();
+  for (const auto header : file.included_headers) {
+    entry.included_headers.push_back(arena_.Intern(header));
+  }
+}
+
+bool ParseCache::Load() {
+  entries_.clear();
+
+  std::ifstream in(path_, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  const std::string data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  if (data.size() < sizeof(uint64_t)) {
+    return false;
+  }
+
+  const std::string_view body(data.data(), data.size() - sizeof(uint64_t));
+  BinaryReader trailer(std::string_view(data).substr(body.size()));
+  if (trailer.ReadU64() != Fnv1a64(body)) {
+    return false;
+  }
+
+  BinaryReader reader(body);
+  if (reader.ReadU32() != kMagic || reader.ReadU32() != kFormatVersion) {
+    return false;
+  }
+
+  std::vector<std::string_view> strings(reader.ReadVarint());
+  for (auto& str : strings) {
+    str = arena_.Intern(reader.ReadString());
+  }
+  bool indices_valid = true;
+  auto read_string = [&]() -> std::string_view {
+    const uint64_t idx = reader.ReadVarint();
+    if (idx >= strings.size()) {
+      indices_valid = false;
+      return {};
+    }
+    return strings[idx];
+  };
+
+  std::unordered_map<std::string_view, Entry> entries;
+  const uint64_t entry_count = reader.ReadVarint();
+  for (uint64_t i = 0; i < entry_count && reader.Ok() && indices_valid; ++i) {
+    const std::string_view path = read_string();
+    Entry entry;
+    entry.stamp.size = reader.ReadVarint();
+    entry.stamp.mtime = reader.ReadSignedVarint();
+    entry.stamp.content_hash = reader.ReadU64();
+    const uint64_t include_count = reader.ReadVarint();
+    for (uint64_t j = 0; j < include_count && reader.Ok(); ++j) {
+      entry.included_headers.push_back(read_string());
+    }
+    entry.lines = reader.ReadVarint();
+    entries.emplace(path, std::move(entry));
+  }
+
+  if (!reader.Ok() || !indices_valid || reader.Remaining() != 0) {
+    return false;
+  }
+  entries_ = std::move(entries);
+  return true;
+}
+
+bool ParseCache::Save() const {
+  // Sort by path so the same tree always produces the same file
+  std::vector<std::pair<std::string_view, const Entry*>> entries;
+  entries.reserve(stored_.size());
+  for (const auto& [path, entry] : stored_) {
+    entries.emplace_back(path, &entry);
+  }
+  std::sort(entries.begin(), entries.end());
+
+  std::vector<std::string_view> strings;
+  std::unordered_map<std::string_view, uint64_t> string_idx;
+  auto index_of = [&](std::string_view str) {
+    auto [it, inserted] = string_idx.emplace(str, strings.size());
+    if (inserted) {
+      strings.push_back(str);
+    }
+    return it->second;
+  };
+
+  BinaryWriter records;
+  records.WriteVarint(entries.size());
+  for (const auto& [path, entry] : entries) {
+    records.WriteVarint(index_of(path));
+    records.WriteVarint(entry->stamp.size);
+    records.WriteSignedVarint(entry->stamp.mtime);
+    records.WriteU64(entry->stamp.content_hash);
+    records.WriteVarint(entry->included_headers.size());
+    for (const auto header : entry->included_headers) {
+      records.WriteVarint(index_of(header));
+    }
+    records.WriteVarint(entry->lines);
+  }
+
+  BinaryWriter out;
+  out.WriteU32(kMagic);
+  out.WriteU32(kFormatVersion);
+  out.WriteVarint(strings.size());
+  for (const auto str : strings) {
+    out.WriteString(str);
+  }
+  out.WriteBytes(records.Buffer());
+  out.WriteU64(Fnv1a64(out.Buffer()));
+
+  const std::string tmp_path = path_ + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(out.Buffer().data(),
+               static_cast<std::streamsize>(out.Buffer().size()));
+    if (!file) {
+      return false;
+    }
+  }
+  return std::rename(tmp_path.c_str(), path_.c_str()) == 0;
+}
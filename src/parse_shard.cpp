@@ -0,0 +1,199 @@
+#include "parse_shard.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <unordered_map>
+
+#include "binary_io.h"
+
+namespace {
+
+constexpr uint32_t kMagic = 0x48534443;  // "CDSH"
+
+}  // namespace
+
+bool ParseShard::Save(const std::string& path) const {
+  std::vector<std::string_view> strings;
+  std::unordered_map<std::string_view, uint64_t> string_idx;
+  auto index_of = [&](std::string_view str) {
+    auto [it, inserted] = string_idx.emplace(str, strings.size());
+    if (inserted) {
+      strings.push_back(str);
+    }
+    return it->second;
+  };
+
+  BinaryWriter records;
+  records.WriteVarint(slices.size());
+  for (const Slice& slice : slices) {
+    records.WriteVarint(index_of(slice.directory));
+    records.WriteVarint(slice.walk_size);
+    records.WriteVarint(slice.files.size());
+    for (const File& file : slice.files) {
+      records.WriteVarint(index_of(file.name));
+      records.WriteVarint(file.included_headers.size());
+      for (const auto header : file.included_headers) {
+        records.WriteVarint(index_of(header));
+      }
+      records.WriteVarint(file.bytes);
+      records.WriteVarint(file.lines);
+    }
+  }
+
+  BinaryWriter out;
+  out.WriteU32(kMagic);
+  out.WriteU32(kFormatVersion);
+  out.WriteVarint(index);
+  out.WriteVarint(count);
+  out.WriteVarint(strings.size());
+  for (const auto str : strings) {
+    out.WriteString(str);
+  }
+  out.WriteBytes(records.Buffer());
+  out.WriteU64(Fnv1a64(out.Buffer()));
+
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(out.Buffer().data(),
+               static_cast<std::streamsize>(out.Buffer().size()));
+    if (!file) {
+      return false;
+    }
+  }
+  return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool ParseShard::Load(const std::string& path, StringArena& arena,
+                      std::string* error) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    *error = "cannot open shard " + path;
+    return false;
+  }
+  const std::string data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  *error = "corrupt shard " + path;
+  if (data.size() < sizeof(uint64_t)) {
+    return false;
+  }
+  const std::string_view body(data.data(), data.size() - sizeof(uint64_t));
+  BinaryReader trailer(std::string_view(data).substr(body.size()));
+  if (trailer.ReadU64() != Fnv1a64(body)) {
+    return false;
+  }
+
+  BinaryReader reader(body);
+  if (reader.ReadU32() != kMagic || reader.ReadU32() != kFormatVersion) {
+    *error = "not a shard of this format version: " + path;
+    return false;
+  }
+  index = reader.ReadVarint();
+  count = reader.ReadVarint();
+
+  std::vector<std::string_view> strings(reader.ReadVarint());
+  for (auto& str : strings) {
+    str = arena.Intern(reader.ReadString());
+  }
+  bool indices_valid = true;
+  auto read_string = [&]() -> std::string_view {
+    const uint64_t idx = reader.ReadVarint();
+    if (idx >= strings.size()) {
+      indices_valid = false;
+      return {};
+    }
+    return strings[idx];
+  };
+
+  slices.clear();
+  const uint64_t slice_count = reader.ReadVarint();
+  for (uint64_t i = 0; i < slice_count && reader.Ok() && indices_valid; ++i) {
+    Slice& slice = slices.emplace_back();
+    slice.directory = read_string();
+    slice.walk_size = reader.ReadVarint();
+    const uint64_t file_count = reader.ReadVarint();
+    for (uint64_t j = 0; j < file_count && reader.Ok() && indices_valid;
+         ++j) {
+      File& file = slice.files.emplace_back();
+      file.name = read_string();
+      const uint64_t include_count = reader.ReadVarint();
+      for (uint64_t k = 0; k < include_count && reader.Ok(); ++k) {
+        file.included_headers.push_back(read_string());
+      }
+      file.bytes = reader.ReadVarint();
+      file.lines = reader.ReadVarint();
+    }
+  }
+
+  if (!reader.Ok() || !indices_valid || reader.Remaining() != 0 ||
+      count == 0 || index >= count) {
+    slices.clear();
+    return false;
+  }
+  error->clear();
+  return true;
+}
+
+bool MergeParseShards(const std::vector<ParseShard>& shards,
+                      std::vector<File>& files, std::string* error) {
+  if (shards.empty()) {
+    *error = "no shards to merge";
+    return false;
+  }
+  const size_t count = shards.front().count;
+  std::vector<const ParseShard*> by_index(count, nullptr);
+  for (const ParseShard& shard : shards) {
+    if (shard.count != count || shard.index >= count) {
+      *error = "shards of different splits: " + std::to_string(shard.index) +
+               " of " + std::to_string(shard.count) + " next to " +
+               std::to_string(count);
+      return false;
+    }
+    if (by_index[shard.index]) {
+      *error = "shard " + std::to_string(shard.index) + " given twice";
+      return false;
+    }
+    by_index[shard.index] = &shard;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (!by_index[i]) {
+      *error = "shard " + std::to_string(i) + " of " + std::to_string(count) +
+               " is missing";
+      return false;
+    }
+  }
+
+  // Every shard walked every directory; their walks must agree, or the
+  // slices would overlap or leave gaps
+  const std::vector<ParseShard::Slice>& first = by_index[0]->slices;
+  for (const ParseShard* shard : by_index) {
+    if (shard->slices.size() != first.size()) {
+      *error = "shards parsed different directories";
+      return false;
+    }
+    for (size_t d = 0; d < first.size(); ++d) {
+      const ParseShard::Slice& slice = shard->slices[d];
+      const auto [begin, end] =
+          SliceBounds(slice.walk_size, shard->index, count);
+      if (slice.directory != first[d].directory ||
+          slice.walk_size != first[d].walk_size ||
+          slice.files.size() != end - begin) {
+        *error = "shards disagree on " + first[d].directory +
+                 "; did it change while they ran?";
+        return false;
+      }
+    }
+  }
+
+  files.clear();
+  for (size_t d = 0; d < first.size(); ++d) {
+    files.reserve(files.size() + first[d].walk_size);
+    for (const ParseShard* shard : by_index) {
+      const auto& slice_files = shard->slices[d].files;
+      files.insert(files.end(), slice_files.begin(), slice_files.end());
+    }
+  }
+  return true;
+}
@@ -0,0 +1,207 @@
+#include "profiler.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+
+namespace {
+
+struct PhaseEvent {
+  const char* name;
+  uint32_t thread;
+  int64_t begin_us;  // since the origin
+  int64_t duration_us;
+  uint64_t rss_bytes;
+  uint64_t peak_rss_bytes;
+};
+
+struct Trace {
+  std::mutex mutex;
+  std::chrono::steady_clock::time_point origin =
+      std::chrono::steady_clock::now();
+  std::vector<PhaseEvent> events;
+};
+
+Trace& GetTrace() {
+  static Trace trace;
+  return trace;
+}
+
+// Small, stable per-thread ids for the trace viewer
+uint32_t ThreadId() {
+  static std::atomic<uint32_t> next_id{1};
+  thread_local const uint32_t id =
+      next_id.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+uint64_t CurrentRssBytes() {
+  FILE* statm = std::fopen("/proc/self/statm", "r");
+  if (!statm) {
+    return 0;
+  }
+  unsigned long size_pages = 0;
+  unsigned long resident_pages = 0;
+  const int read = std::fscanf(statm, "%lu %lu", &size_pages, &resident_pages);
+  std::fclose(statm);
+  return read == 2 ? resident_pages * static_cast<uint64_t>(getpagesize())
+                   : 0;
+}
+
+uint64_t PeakRssBytes() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+double ToMiB(uint64_t bytes) {
+  return static_cast<double>(bytes) / (1024 * 1024);
+}
+
+}  // namespace
+
+void Profiler::Enable() {
+  GetTrace();  // fixes the origin before the first phase
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::Disable() { enabled_.store(false, std::memory_order_relaxed); }
+
+void Profiler::Reset() {
+  Trace& trace = GetTrace();
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  trace.events.clear();
+  trace.origin = std::chrono::steady_clock::now();
+  for (auto& counter : counters_) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+}
+
+const char* Profiler::CounterName(Counter counter) {
+  switch (counter) {
+    case kFilesScanned:
+      return "files scanned";
+    case kFilesSkipped:
+      return "files skipped";
+    case kBytesRead:
+      return "bytes read";
+    case kIncludesSeen:
+      return "includes seen";
+    case kIncludesResolved:
+      return "includes resolved";
+    case kIncludesUnresolved:
+      return "includes unresolved";
+    case kSccCount:
+      return "SCCs";
+    case kLargestScc:
+      return "largest SCC";
+    case kEdgesPruned:
+      return "edges pruned";
+    case kNumCounters:
+      break;
+  }
+  return "";
+}
+
+void Profiler::Record(const char* name,
+                      std::chrono::steady_clock::time_point begin,
+                      std::chrono::steady_clock::time_point end) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  PhaseEvent event{name, ThreadId(), 0,
+                   duration_cast<microseconds>(end - begin).count(),
+                   CurrentRssBytes(), PeakRssBytes()};
+  Trace& trace = GetTrace();
+  std::lock_guard<std::mutex> lock(trace.mutex);
+  event.begin_us = duration_cast<microseconds>(begin - trace.origin).count();
+  trace.events.push_back(event);
+}
+
+void Profiler::WriteSummary(std::ostream& out) {
+  struct PhaseTotals {
+    std::string_view name;
+    size_t calls = 0;
+    int64_t total_us = 0;
+    uint64_t peak_rss_bytes = 0;
+  };
+  std::vector<PhaseTotals> phases;  // in order of first appearance
+  {
+    Trace& trace = GetTrace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    for (const PhaseEvent& event : trace.events) {
+      auto it = std::find_if(phases.begin(), phases.end(), [&](auto& phase) {
+        return phase.name == event.name;
+      });
+      if (it == phases.end()) {
+        it = phases.insert(phases.end(), PhaseTotals{event.name});
+      }
+      ++it->calls;
+      it->total_us += event.duration_us;
+      it->peak_rss_bytes = std::max(it->peak_rss_bytes, event.peak_rss_bytes);
+    }
+  }
+
+  const auto flags = out.flags();
+  out << std::left << std::setw(32) << "Phase" << std::right << std::setw(8)
+      << "Calls" << std::setw(12) << "Total ms" << std::setw(16)
+      << "Peak RSS MiB" << '\n';
+  out << std::fixed;
+  for (const PhaseTotals& phase : phases) {
+    out << std::left << std::setw(32) << phase.name << std::right
+        << std::setw(8) << phase.calls << std::setw(12) << std::setprecision(2)
+        << phase.total_us / 1000.0 << std::setw(16) << std::setprecision(1)
+        << ToMiB(phase.peak_rss_bytes) << '\n';
+  }
+  out << '\n' << std::left << std::setw(32) << "Counter" << std::right
+      << std::setw(20) << "Value" << '\n';
+  for (size_t i = 0; i < kNumCounters; ++i) {
+    const auto counter = static_cast<Counter>(i);
+    out << std::left << std::setw(32) << CounterName(counter) << std::right
+        << std::setw(20) << Get(counter) << '\n';
+  }
+  out.flags(flags);
+}
+
+void Profiler::WriteChromeTrace(std::ostream& out) {
+  std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  {
+    Trace& trace = GetTrace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    bool first = true;
+    for (const PhaseEvent& event : trace.events) {
+      json += first ? "{\"name\":" : ",{\"name\":";
+      first = false;
+      AppendJsonString(json, event.name);
+      json += ",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":1,\"tid\":" +
+              std::to_string(event.thread) +
+              ",\"ts\":" + std::to_string(event.begin_us) +
+              ",\"dur\":" + std::to_string(event.duration_us) + '}';
+      json += ",{\"name\":\"memory\",\"ph\":\"C\",\"pid\":1,\"ts\":" +
+              std::to_string(event.begin_us + event.duration_us) +
+              ",\"args\":{\"rss_mib\":" +
+              std::to_string(ToMiB(event.rss_bytes)) +
+              ",\"peak_rss_mib\":" +
+              std::to_string(ToMiB(event.peak_rss_bytes)) + "}}";
+    }
+  }
+  json += "],\"otherData\":{";
+  for (size_t i = 0; i < kNumCounters; ++i) {
+    const auto counter = static_cast<Counter>(i);
+    if (i > 0) {
+      json += ',';
+    }
+    AppendJsonString(json, CounterName(counter));
+    json += ':' + std::to_string(Get(counter));
+  }
+  json += "}}\n";
+  out << json;
+}
@@ -0,0 +1,411 @@
+#include "query_engine.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "dependency_analyzer.h"
+#include "graph_exporter.h"
+#include "impact_analyzer.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Requests read ahead of the oldest unanswered one; bounds the memory a
+// fast writer can make a slow reader hold
+constexpr size_t kMaxInFlight = 4096;
+
+JsonValue MakeString(std::string_view str) {
+  return JsonValue{std::string(str)};
+}
+
+JsonValue MakeNumber(size_t number) {
+  return JsonValue{static_cast<double>(number)};
+}
+
+std::string ErrorResponse(const JsonValue* id, std::string_view message) {
+  std::string response = "{\"id\":";
+  AppendJson(response, id ? *id : JsonValue{});
+  response += ",\"error\":";
+  AppendJsonString(response, message);
+  response += '}';
+  return response;
+}
+
+// Hands responses to write in sequence order, batching every run of
+// consecutive ready responses into one call
+class ResponseSequencer {
+ public:
+  explicit ResponseSequencer(
+      const std::function<void(std::string_view)>& write)
+      : write_(write) {}
+
+  void Complete(size_t sequence, std::string response) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.emplace(sequence, std::move(response));
+    std::string batch;
+    while (!ready_.empty() && ready_.begin()->first == next_) {
+      batch += ready_.begin()->second;
+      batch += '\n';
+      ready_.erase(ready_.begin());
+      ++next_;
+    }
+    if (!batch.empty()) {
+      // Writing under the lock keeps the batches in order
+      write_(batch);
+      drained_.notify_all();
+    }
+  }
+
+  // Blocks until fewer than `limit` of the first `issued` responses are
+  // still missing
+  void WaitBelow(size_t issued, size_t limit) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_.wait(lock, [&] { return issued - next_ < limit; });
+  }
+
+ private:
+  const std::function<void(std::string_view)>& write_;
+  std::mutex mutex_;
+  std::condition_variable drained_;
+  std::map<size_t, std::string> ready_;
+  size_t next_ = 0;
+};
+
+// Line reader over a socket, buffering whatever recv returns
+class SocketLineReader {
+ public:
+  explicit SocketLineReader(int fd) : fd_(fd) {}
+
+  bool ReadLine(std::string& line) {
+    while (true) {
+      const size_t newline = buffer_.find('\n', scanned_);
+      if (newline != std::string::npos) {
+        line.assign(buffer_, 0, newline);
+        buffer_.erase(0, newline + 1);
+        scanned_ = 0;
+        return true;
+      }
+      scanned_ = buffer_.size();
+      char chunk[64 * 1024];
+      const ssize_t length = recv(fd_, chunk, sizeof(chunk), 0);
+      if (length < 0 && errno == EINTR) {
+        continue;
+      }
+      if (length <= 0) {
+        // A last line without a newline still counts
+        if (buffer_.empty()) {
+          return false;
+        }
+        line = std::move(buffer_);
+        buffer_.clear();
+        scanned_ = 0;
+        return true;
+      }
+      buffer_.append(chunk, static_cast<size_t>(length));
+    }
+  }
+
+ private:
+  int fd_;
+  std::string buffer_;
+  size_t scanned_ = 0;  // buffer_ has no newline before this
+};
+
+void WriteAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t written = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return;  // the client went away; its remaining responses are dropped
+    }
+    data.remove_prefix(static_cast<size_t>(written));
+  }
+}
+
+}  // namespace
+
+QueryEngine::QueryEngine(const DependencyAnalyzer& analyzer, ThreadPool* pool)
+    : analyzer_(analyzer),
+      file_dependents_(analyzer.GetFileDependencies().Graph().Reversed(pool)),
+      impact_(std::make_unique<ImpactAnalyzer>(analyzer, pool)) {}
+
+QueryEngine::~QueryEngine() = default;
+
+std::string QueryEngine::Answer(std::string_view request) const {
+  const auto parsed = ParseJson(request);
+  if (!parsed || !parsed->AsObject()) {
+    return ErrorResponse(nullptr, "request is not a JSON object");
+  }
+  const JsonValue* id = parsed->Find("id");
+  const JsonValue* query = parsed->Find("query");
+  if (!query || !query->AsString()) {
+    return ErrorResponse(id, "missing \"query\"");
+  }
+  const std::string& kind = *query->AsString();
+
+  JsonValue result;
+  std::shared_ptr<const std::string> rendered;  // result, already serialized
+  if (kind == "subgraph") {
+    const JsonValue* keyword = parsed->Find("keyword");
+    if (keyword && !keyword->AsString()) {
+      return ErrorResponse(id, "\"keyword\" must be a string");
+    }
+    const std::string_view text = keyword ? *keyword->AsString() : "";
+    rendered = analyzer_.GetOrRender("json\n" + std::string(text), [&] {
+      std::ostringstream json;
+      ExportGraph(analyzer_, text, ExportFormat::kJson, json);
+      return json.str();
+    });
+  } else if (kind == "dependencies" || kind == "dependents" ||
+             kind == "depth") {
+    const JsonValue* file = parsed->Find("file");
+    if (!file || !file->AsString()) {
+      return ErrorResponse(id, "missing \"file\"");
+    }
+    const auto node =
+        analyzer_.GetFileDependencies().Names().Find(*file->AsString());
+    if (!node) {
+      return ErrorResponse(id, "unknown file: " + *file->AsString());
+    }
+    const JsonValue* transitive = parsed->Find("transitive");
+    const bool all =
+        transitive && transitive->AsBool() && *transitive->AsBool();
+    if (kind == "dependencies") {
+      result = FileNeighbors(analyzer_.GetFileDependencies().Graph(), *node,
+                             all);
+    } else if (kind == "dependents") {
+      result = FileNeighbors(file_dependents_, *node, all);
+    } else {
+      result = Depth(*node);
+    }
+  } else if (kind == "impact") {
+    const JsonValue* files = parsed->Find("files");
+    if (!files || !files->AsArray()) {
+      return ErrorResponse(id, "missing \"files\"");
+    }
+    std::vector<std::string> changed;
+    for (const auto& file : *files->AsArray()) {
+      if (!file.AsString()) {
+        return ErrorResponse(id, "\"files\" must hold strings");
+      }
+      changed.push_back(*file.AsString());
+    }
+    result = Impact(changed);
+  } else {
+    return ErrorResponse(id, "unknown query: " + kind);
+  }
+
+  std::string response = "{\"id\":";
+  AppendJson(response, id ? *id : JsonValue{});
+  response += ",\"result\":";
+  if (rendered) {
+    response += *rendered;
+  } else {
+    AppendJson(response, result);
+  }
+  response += '}';
+  return response;
+}
+
+JsonValue QueryEngine::FileNeighbors(const CsrGraph& graph, NodeId file,
+                                     bool transitive) const {
+  const NameTable& names = analyzer_.GetFileDependencies().Names();
+  std::vector<std::string_view> found;
+  if (!transitive) {
+    for (const NodeId neighbor : graph.Neighbors(file)) {
+      found.push_back(names.Name(neighbor));
+    }
+  } else {
+    std::vector<bool> visited(graph.NumNodes(), false);
+    std::vector<NodeId> stack{file};
+    visited[file] = true;
+    while (!stack.empty()) {
+      const NodeId node = stack.back();
+      stack.pop_back();
+      for (const NodeId neighbor : graph.Neighbors(node)) {
+        if (!visited[neighbor]) {
+          visited[neighbor] = true;
+          found.push_back(names.Name(neighbor));
+          stack.push_back(neighbor);
+        }
+      }
+    }
+  }
+  std::sort(found.begin(), found.end());
+
+  JsonValue::Array files;
+  for (const auto name : found) {
+    files.push_back(MakeString(name));
+  }
+  return JsonValue{JsonValue::Object{{"file", MakeString(names.Name(file))},
+                                     {"files", JsonValue{std::move(files)}}}};
+}
+
+JsonValue QueryEngine::Depth(NodeId file) const {
+  const SccIdx component_idx = analyzer_.GetComponentOf(file);
+  const auto& component =
+      analyzer_.GetStronglyConnectedComponents()[component_idx];
+  return JsonValue{JsonValue::Object{
+      {"file",
+       MakeString(analyzer_.GetFileDependencies().Names().Name(file))},
+      {"component", MakeString(component.name)},
+      {"depth",
+       MakeNumber(static_cast<size_t>(
+           analyzer_.GetComponentDepths()[component_idx]))}}};
+}
+
+JsonValue QueryEngine::Impact(const std::vector<std::string>& files) const {
+  const ImpactResult impact = impact_->Analyze(files);
+  const NameTable& names = analyzer_.GetFileDependencies().Names();
+  const auto& components = analyzer_.GetStronglyConnectedComponents();
+  auto sorted_names = [](std::vector<std::string_view> found) {
+    std::sort(found.begin(), found.end());
+    JsonValue::Array list;
+    for (const auto name : found) {
+      list.push_back(MakeString(name));
+    }
+    return JsonValue{std::move(list)};
+  };
+  std::vector<std::string_view> affected_files;
+  for (const NodeId file : impact.files) {
+    affected_files.push_back(names.Name(file));
+  }
+  std::vector<std::string_view> affected_components;
+  for (const SccIdx component_idx : impact.components) {
+    affected_components.push_back(components[component_idx].name);
+  }
+  JsonValue::Array unknown_list;
+  for (const auto& file : impact.unknown_files) {
+    unknown_list.push_back(MakeString(file));
+  }
+  return JsonValue{JsonValue::Object{
+      {"files", sorted_names(std::move(affected_files))},
+      {"components", sorted_names(std::move(affected_components))},
+      {"unknown", JsonValue{std::move(unknown_list)}}}};
+}
+
+size_t QueryEngine::Serve(const std::function<bool(std::string&)>& read_line,
+                          const std::function<void(std::string_view)>& write,
+                          ThreadPool* pool) const {
+  ResponseSequencer sequencer(write);
+  size_t issued = 0;
+  std::string line;
+  while (read_line(line)) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;  // blank lines are not requests
+    }
+    const size_t sequence = issued++;
+    if (pool == nullptr || pool->Size() <= 1) {
+      sequencer.Complete(sequence, Answer(line));
+      continue;
+    }
+    sequencer.WaitBelow(sequence, kMaxInFlight);
+    pool->Submit([this, &sequencer, sequence,
+                  request = std::move(line)](unsigned) {
+      sequencer.Complete(sequence, Answer(request));
+    });
+    line = std::string();
+  }
+  sequencer.WaitBelow(issued, 1);
+  return issued;
+}
+
+bool ServeUnixSocket(const QueryEngine& engine, const std::string& path,
+                     ThreadPool* pool) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path too long: " << path << std::endl;
+    return false;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0) {
+    std::cerr << "Failed to create socket: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  // Only a stale socket from an earlier run is replaced, never a file
+  struct stat existing;
+  if (lstat(path.c_str(), &existing) == 0) {
+    if (!S_ISSOCK(existing.st_mode)) {
+      std::cerr << "Not replacing " << path << ": not a socket" << std::endl;
+      close(listener);
+      return false;
+    }
+    unlink(path.c_str());
+  }
+  if (bind(listener, reinterpret_cast<const sockaddr*>(&address),
+           sizeof(address)) < 0 ||
+      listen(listener, SOMAXCONN) < 0) {
+    std::cerr << "Failed to listen on " << path << ": " << std::strerror(errno)
+              << std::endl;
+    close(listener);
+    return false;
+  }
+
+  // Connections in flight; they use engine, so all of them are joined
+  // before returning. Finished ones are reaped on every accept.
+  struct Client {
+    int fd;
+    std::atomic<bool> done{false};
+    std::thread thread;
+  };
+  std::list<Client> clients;
+  auto reap = [&clients](bool all) {
+    for (auto it = clients.begin(); it != clients.end();) {
+      if (!all && !it->done) {
+        ++it;
+        continue;
+      }
+      if (all) {
+        shutdown(it->fd, SHUT_RDWR);  // ends the client's read loop
+      }
+      it->thread.join();
+      close(it->fd);
+      it = clients.erase(it);
+    }
+  };
+
+  while (true) {
+    const int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      std::cerr << "Failed to accept on " << path << ": "
+                << std::strerror(errno) << std::endl;
+      close(listener);
+      reap(/*all=*/true);
+      return false;
+    }
+    reap(/*all=*/false);
+    Client& entry = clients.emplace_back();
+    entry.fd = client;
+    entry.thread = std::thread([&engine, pool, &entry] {
+      SocketLineReader reader(entry.fd);
+      engine.Serve(
+          [&](std::string& line) { return reader.ReadLine(line); },
+          [&](std::string_view data) { WriteAll(entry.fd, data); }, pool);
+      entry.done = true;
+    });
+  }
+}
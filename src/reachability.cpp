@@ -0,0 +1,335 @@
+#include "reachability.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "thread_pool.h"
+
+ReachabilityIndex::Accumulator::Accumulator(size_t num_nodes)
+    : words_((num_nodes + 63) / 64, 0) {}
+
+void ReachabilityIndex::Accumulator::Set(NodeId id) {
+  uint64_t& word = words_[id / 64];
+  if (word == 0 && !all_touched_) {
+    touched_words_.push_back(id / 64);
+  }
+  word |= uint64_t{1} << (id % 64);
+}
+
+void ReachabilityIndex::Accumulator::OrRow(const ReachabilityIndex& index,
+                                           NodeId node) {
+  const Row& row = index.rows_[node];
+  if (!row.dense) {
+    for (uint32_t i = 0; i < row.count; ++i) {
+      Set(index.sparse_pool_[row.begin + i]);
+    }
+    return;
+  }
+  // Word-level OR; the compiler vectorizes this loop
+  const uint64_t* src = index.dense_pool_.data() + row.begin;
+  uint64_t* dst = words_.data();
+  for (size_t w = 0; w < words_.size(); ++w) {
+    dst[w] |= src[w];
+  }
+  all_touched_ = true;
+}
+
+void ReachabilityIndex::Accumulator::Clear() {
+  if (all_touched_) {
+    std::fill(words_.begin(), words_.end(), 0);
+  } else {
+    for (const auto w : touched_words_) {
+      words_[w] = 0;
+    }
+  }
+  touched_words_.clear();
+  all_touched_ = false;
+}
+
+ReachabilityIndex::ReachabilityIndex(const CsrGraph& dag,
+                                     std::span<const NodeId> order,
+                                     const MergeObserver& on_merged)
+    : words_per_row_((dag.NumNodes() + 63) / 64), rows_(dag.NumNodes()) {
+  Accumulator acc(dag.NumNodes());
+  for (const NodeId node : order) {
+    MergeNode(dag, node, acc, on_merged);
+    StoreRow(node, ExtractRow(acc));
+    acc.Clear();
+  }
+}
+
+ReachabilityIndex::ReachabilityIndex(
+    const CsrGraph& dag, const std::vector<std::vector<NodeId>>& levels,
+    ThreadPool* pool, const MergeObserver& on_merged)
+    : words_per_row_((dag.NumNodes() + 63) / 64), rows_(dag.NumNodes()) {
+  std::vector<Accumulator> accs(pool ? std::max(1u, pool->Size()) : 1,
+                                Accumulator(dag.NumNodes()));
+  std::vector<PendingRow> pending;
+  for (const auto& level : levels) {
+    // Rows of one level only read rows of lower levels, which are already in
+    // the pools; they are appended once the whole level is done.
+    pending.resize(level.size());
+    ParallelFor(pool, level.size(), [&](size_t i, unsigned worker_idx) {
+      Accumulator& acc = accs[worker_idx];
+      MergeNode(dag, level[i], acc, on_merged);
+      pending[i] = ExtractRow(acc);
+      acc.Clear();
+    });
+    for (size_t i = 0; i < level.size(); ++i) {
+      StoreRow(level[i], std::move(pending[i]));
+    }
+  }
+}
+
+void ReachabilityIndex::MergeNode(const CsrGraph& dag, NodeId node,
+                                  Accumulator& acc,
+                                  const MergeObserver& on_merged) const {
+  const auto deps = dag.Neighbors(node);
+  for (const NodeId dep : deps) {
+    acc.OrRow(*this, dep);
+  }
+  if (on_merged) {
+    on_merged(node, acc);
+  }
+  for (const NodeId dep : deps) {
+    acc.Set(dep);
+  }
+}
+
+ReachabilityIndex::PendingRow ReachabilityIndex::ExtractRow(
+    Accumulator& acc) const {
+  if (!acc.all_touched_) {
+    // Only the touched words can be non-zero
+    std::sort(acc.touched_words_.begin(), acc.touched_words_.end());
+  }
+  auto for_each_word = [&](auto&& fn) {
+    if (acc.all_touched_) {
+      for (size_t w = 0; w < acc.words_.size(); ++w) {
+        fn(w, acc.words_[w]);
+      }
+    } else {
+      for (const auto w : acc.touched_words_) {
+        fn(w, acc.words_[w]);
+      }
+    }
+  };
+
+  PendingRow row;
+  size_t count = 0;
+  for_each_word([&](size_t, uint64_t word) { count += std::popcount(word); });
+  row.count = static_cast<uint32_t>(count);
+
+  // A sparse row costs 32 bits per member, a dense one 1 bit per node
+  if (count * 32 < words_per_row_ * 64) {
+    row.ids.reserve(count);
+    for_each_word([&](size_t w, uint64_t word) {
+      while (word != 0) {
+        row.ids.push_back(static_cast<NodeId>(w * 64 + std::countr_zero(word)));
+        word &= word - 1;
+      }
+    });
+  } else {
+    row.dense = true;
+    row.words = acc.words_;
+  }
+  return row;
+}
+
+void ReachabilityIndex::StoreRow(NodeId node, PendingRow&& pending) {
+  Row& row = rows_[node];
+  row.count = pending.count;
+  row.dense = pending.dense;
+  if (pending.dense) {
+    row.begin = dense_pool_.size();
+    dense_pool_.insert(dense_pool_.end(), pending.words.begin(),
+                       pending.words.end());
+    live_dense_ += words_per_row_;
+    ++dense_rows_;
+  } else {
+    row.begin = sparse_pool_.size();
+    sparse_pool_.insert(sparse_pool_.end(), pending.ids.begin(),
+                        pending.ids.end());
+    live_sparse_ += row.count;
+  }
+}
+
+void ReachabilityIndex::ReleaseRow(NodeId node) {
+  Row& row = rows_[node];
+  if (row.dense) {
+    live_dense_ -= words_per_row_;
+    --dense_rows_;
+  } else {
+    live_sparse_ -= row.count;
+  }
+  row = Row{};
+}
+
+bool ReachabilityIndex::RowEquals(NodeId node,
+                                  const PendingRow& pending) const {
+  if (rows_[node].count != pending.count) {
+    return false;
+  }
+  // Same size, so equal exactly when every pending member is in the row
+  if (pending.dense) {
+    for (size_t w = 0; w < pending.words.size(); ++w) {
+      uint64_t word = pending.words[w];
+      while (word != 0) {
+        const auto member =
+            static_cast<NodeId>(w * 64 + std::countr_zero(word));
+        if (!Reaches(node, member)) {
+          return false;
+        }
+        word &= word - 1;
+      }
+    }
+    return true;
+  }
+  return std::all_of(pending.ids.begin(), pending.ids.end(),
+                     [&](NodeId id) { return Reaches(node, id); });
+}
+
+bool ReachabilityIndex::UpdateRow(const CsrGraph& dag, NodeId node,
+                                  Accumulator& acc,
+                                  const MergeObserver& on_merged) {
+  MergeNode(dag, node, acc, on_merged);
+  PendingRow pending = ExtractRow(acc);
+  acc.Clear();
+  if (RowEquals(node, pending)) {
+    return false;
+  }
+  ReleaseRow(node);
+  StoreRow(node, std::move(pending));
+  CompactPoolsIfSparse();
+  return true;
+}
+
+void ReachabilityIndex::Remap(const IdCompaction& compaction,
+                              size_t num_nodes,
+                              std::span<const NodeId> reaching) {
+  const size_t words = std::max(words_per_row_, (num_nodes + 63) / 64);
+  if (words != words_per_row_) {
+    // Widen every dense row; this only happens when the graph outgrows the
+    // last 64-bit word
+    std::vector<uint64_t> widened;
+    widened.reserve(dense_rows_ * words);
+    for (Row& row : rows_) {
+      if (row.dense) {
+        const uint64_t begin = widened.size();
+        widened.insert(widened.end(), dense_pool_.begin() + row.begin,
+                       dense_pool_.begin() + row.begin + words_per_row_);
+        widened.resize(begin + words, 0);
+        row.begin = begin;
+      }
+    }
+    dense_pool_ = std::move(widened);
+    live_dense_ = dense_pool_.size();
+    words_per_row_ = words;
+  }
+
+  if (!compaction.removed.empty() || !compaction.moves.empty()) {
+    // Rows reaching none of the renumbered ids stay as they are
+    Accumulator acc = MakeAccumulator();
+    for (const NodeId node : reaching) {
+      if (node >= rows_.size()) {
+        continue;
+      }
+      ForEach(node, [&](NodeId id) {
+        const NodeId mapped = compaction.Map(id);
+        if (mapped != IdCompaction::kRemoved) {
+          acc.Set(mapped);
+        }
+      });
+      PendingRow pending = ExtractRow(acc);
+      acc.Clear();
+      ReleaseRow(node);
+      StoreRow(node, std::move(pending));
+    }
+    for (const NodeId id : compaction.removed) {
+      ReleaseRow(id);
+    }
+    for (const auto& [from, to] : compaction.moves) {
+      rows_[to] = rows_[from];
+    }
+  }
+  rows_.resize(compaction.new_size);
+  rows_.resize(num_nodes);
+  CompactPoolsIfSparse();
+}
+
+void ReachabilityIndex::CompactPoolsIfSparse() {
+  if (sparse_pool_.size() > 2 * live_sparse_ + 1024 ||
+      dense_pool_.size() > 2 * live_dense_ + 1024) {
+    CompactPools();
+  }
+}
+
+void ReachabilityIndex::CompactPools() {
+  std::vector<NodeId> sparse;
+  std::vector<uint64_t> dense;
+  sparse.reserve(live_sparse_);
+  dense.reserve(live_dense_);
+  for (Row& row : rows_) {
+    if (row.dense) {
+      const uint64_t begin = dense.size();
+      dense.insert(dense.end(), dense_pool_.begin() + row.begin,
+                   dense_pool_.begin() + row.begin + words_per_row_);
+      row.begin = begin;
+    } else {
+      const uint64_t begin = sparse.size();
+      sparse.insert(sparse.end(), sparse_pool_.begin() + row.begin,
+                    sparse_pool_.begin() + row.begin + row.count);
+      row.begin = begin;
+    }
+  }
+  sparse_pool_ = std::move(sparse);
+  dense_pool_ = std::move(dense);
+}
+
+bool ReachabilityIndex::Reaches(NodeId from, NodeId to) const {
+  const Row& row = rows_[from];
+  if (row.dense) {
+    return (dense_pool_[row.begin + to / 64] >> (to % 64)) & 1;
+  }
+  const auto begin = sparse_pool_.begin() + row.begin;
+  return std::binary_search(begin, begin + row.count, to);
+}
+
+CsrGraph TransitiveReduction(const CsrGraph& dag,
+                             std::span<const NodeId> order) {
+  // An edge u -> v is redundant exactly when v is reachable from another
+  // dependency of u, i.e. when v is in the union of the dependencies' rows.
+  std::vector<CsrGraph::Edge> kept_edges;
+  const ReachabilityIndex index(
+      dag, order, [&](NodeId node, const ReachabilityIndex::Accumulator& acc) {
+        for (const NodeId dep : dag.Neighbors(node)) {
+          if (!acc.Test(dep)) {
+            kept_edges.emplace_back(node, dep);
+          }
+        }
+      });
+  return CsrGraph::FromEdges(dag.NumNodes(), std::move(kept_edges));
+}
+
+CsrGraph TransitiveReduction(const CsrGraph& dag,
+                             const std::vector<std::vector<NodeId>>& levels,
+                             ThreadPool* pool) {
+  // Each node writes only its own slot, so the observer needs no locking
+  std::vector<std::vector<NodeId>> kept(dag.NumNodes());
+  const ReachabilityIndex index(
+      dag, levels, pool,
+      [&](NodeId node, const ReachabilityIndex::Accumulator& acc) {
+        for (const NodeId dep : dag.Neighbors(node)) {
+          if (!acc.Test(dep)) {
+            kept[node].push_back(dep);
+          }
+        }
+      });
+
+  std::vector<CsrGraph::Edge> kept_edges;
+  for (NodeId node = 0; node < kept.size(); ++node) {
+    for (const NodeId dep : kept[node]) {
+      kept_edges.emplace_back(node, dep);
+    }
+  }
+  return CsrGraph::FromEdges(dag.NumNodes(), std::move(kept_edges));
+}
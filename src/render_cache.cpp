@@ -0,0 +1,47 @@
+#include "render_cache.h"
+
+std::shared_ptr<const std::string> RenderCache::GetOrRender(
+    const std::string& key, const std::function<std::string()>& render) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = by_key_.find(key); it != by_key_.end()) {
+      ++stats_.hits;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return it->second->value;
+    }
+    ++stats_.misses;
+  }
+
+  auto value = std::make_shared<const std::string>(render());
+  const size_t bytes = key.size() + value->size();
+  if (bytes > capacity_) {
+    return value;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (by_key_.contains(key)) {
+    return value;  // another thread rendered it meanwhile
+  }
+  entries_.push_front({key, value});
+  by_key_.emplace(entries_.front().key, entries_.begin());
+  bytes_ += bytes;
+  while (bytes_ > capacity_) {
+    const Entry& oldest = entries_.back();
+    bytes_ -= oldest.key.size() + oldest.value->size();
+    by_key_.erase(oldest.key);
+    entries_.pop_back();
+  }
+  return value;
+}
+
+void RenderCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  by_key_.clear();
+  entries_.clear();
+  bytes_ = 0;
+}
+
+RenderCache::Stats RenderCache::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
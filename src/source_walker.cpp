@@ -0,0 +1,473 @@
+#include "source_walker.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+#include "thread_pool.h"
+
+namespace {
+
+char ToLower(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+bool ContainsIgnoringCase(std::string_view text, std::string_view lowercase) {
+  for (size_t i = 0; i + lowercase.size() <= text.size(); ++i) {
+    size_t j = 0;
+    while (j < lowercase.size() && ToLower(text[i + j]) == lowercase[j]) {
+      ++j;
+    }
+    if (j == lowercase.size()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsTestOrMock(std::string_view name) {
+  return ContainsIgnoringCase(name, "test") ||
+         ContainsIgnoringCase(name, "mock");
+}
+
+// Position after the `]` closing the class opened at glob[begin], or npos
+size_t FindClassEnd(std::string_view glob, size_t begin) {
+  size_t i = begin + 1;
+  if (i < glob.size() && (glob[i] == '!' || glob[i] == '^')) {
+    ++i;
+  }
+  if (i < glob.size() && glob[i] == ']') {
+    ++i;  // a leading `]` is literal
+  }
+  const size_t close = glob.find(']', i);
+  return close == std::string_view::npos ? close : close + 1;
+}
+
+bool MatchClass(std::string_view glob_class, char c) {
+  size_t i = 1;
+  const bool negated = glob_class[i] == '!' || glob_class[i] == '^';
+  if (negated) {
+    ++i;
+  }
+  bool matched = false;
+  for (const size_t end = glob_class.size() - 1; i < end; ++i) {
+    if (i + 2 < end && glob_class[i + 1] == '-') {
+      matched |= glob_class[i] <= c && c <= glob_class[i + 2];
+      i += 2;
+    } else {
+      matched |= glob_class[i] == c;
+    }
+  }
+  return matched != negated;
+}
+
+}  // namespace
+
+bool HasSourceExtension(std::string_view name) {
+  const size_t dot = name.rfind('.');
+  // A leading dot starts a hidden name, not an extension (".h")
+  if (dot == std::string_view::npos || dot == 0 || name.size() - dot > 4) {
+    return false;
+  }
+  char ext[3] = {};
+  const size_t length = name.size() - dot - 1;
+  for (size_t i = 0; i < length; ++i) {
+    ext[i] = ToLower(name[dot + 1 + i]);
+  }
+  const bool c_or_h = ext[0] == 'c' || ext[0] == 'h';
+  switch (length) {
+    case 1:  // .c .h
+      return c_or_h;
+    case 2:  // .cu .hu
+      return c_or_h && ext[1] == 'u';
+    case 3:  // .cpp .hpp
+      return c_or_h && ext[1] == 'p' && ext[2] == 'p';
+    default:
+      return false;
+  }
+}
+
+bool MatchGlob(std::string_view glob, std::string_view path) {
+  size_t g = 0;
+  size_t p = 0;
+  while (g < glob.size()) {
+    if (glob[g] == '*') {
+      if (g + 1 < glob.size() && glob[g + 1] == '*') {
+        std::string_view rest = glob.substr(g + 2);
+        // `**/` matches any number of whole directories, none included
+        const bool directories = rest.starts_with('/');
+        if (directories) {
+          rest.remove_prefix(1);
+        }
+        for (size_t k = p; k <= path.size(); ++k) {
+          if ((!directories || k == p || path[k - 1] == '/') &&
+              MatchGlob(rest, path.substr(k))) {
+            return true;
+          }
+        }
+        return false;
+      }
+      for (size_t k = p;; ++k) {
+        if (MatchGlob(glob.substr(g + 1), path.substr(k))) {
+          return true;
+        }
+        if (k == path.size() || path[k] == '/') {
+          return false;
+        }
+      }
+    }
+    if (p == path.size()) {
+      return false;
+    }
+    if (glob[g] == '?') {
+      if (path[p] == '/') {
+        return false;
+      }
+    } else if (glob[g] == '[' &&
+               FindClassEnd(glob, g) != std::string_view::npos) {
+      const size_t end = FindClassEnd(glob, g);
+      if (path[p] == '/' || !MatchClass(glob.substr(g, end - g), path[p])) {
+        return false;
+      }
+      g = end;
+      ++p;
+      continue;
+    } else {
+      if (glob[g] == '\\' && g + 1 < glob.size()) {
+        ++g;
+      }
+      if (glob[g] != path[p]) {
+        return false;
+      }
+    }
+    ++g;
+    ++p;
+  }
+  return p == path.size();
+}
+
+SourceWalker::Rule SourceWalker::Rule::Parse(std::string_view line) {
+  Rule rule;
+  if (line.ends_with('\r')) {
+    line.remove_suffix(1);
+  }
+  while (line.ends_with(' ') &&
+         !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+    line.remove_suffix(1);
+  }
+  if (line.empty() || line.starts_with('#')) {
+    return rule;  // no glob: nothing to match
+  }
+  if (line.starts_with('!')) {
+    rule.negated = true;
+    line.remove_prefix(1);
+  } else if (line.starts_with("\\!") || line.starts_with("\\#")) {
+    line.remove_prefix(1);
+  }
+  if (line.ends_with('/')) {
+    rule.directory_only = true;
+    line.remove_suffix(1);
+  }
+  rule.anchored = line.find('/') != std::string_view::npos;
+  if (line.starts_with('/')) {
+    line.remove_prefix(1);
+  }
+  rule.glob = line;
+  return rule;
+}
+
+bool SourceWalker::Rule::Matches(std::string_view rel, std::string_view name,
+                                 bool is_directory) const {
+  if (directory_only && !is_directory) {
+    return false;
+  }
+  return MatchGlob(glob, anchored ? rel : name);
+}
+
+// The rules of one .gitignore, on top of those of the directories above it
+struct SourceWalker::IgnoreLevel {
+  std::shared_ptr<const IgnoreLevel> parent;
+  // Length of the relative path of its directory, plus the separator
+  size_t prefix = 0;
+  std::vector<Rule> rules;
+};
+
+// Result of walking one directory: its kept files and entered
+// subdirectories by name, each subdirectory filled by its own task
+struct SourceWalker::Directory {
+  struct Entry {
+    std::string file;  // empty for a subdirectory
+    std::unique_ptr<Directory> subdirectory;
+  };
+  std::vector<Entry> entries;
+  WalkStats stats;
+
+  void AppendTo(WalkResult& result) const {
+    result.stats += stats;
+    for (const Entry& entry : entries) {
+      if (entry.subdirectory) {
+        entry.subdirectory->AppendTo(result);
+      } else {
+        result.files.push_back(entry.file);
+      }
+    }
+  }
+};
+
+// The directories of one walk still being read on the pool. Waiting on these
+// rather than on the pool leaves other users' tasks out of it.
+class SourceWalker::WalkTasks {
+ public:
+  explicit WalkTasks(ThreadPool& pool) : pool_(pool) {}
+
+  void Submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++outstanding_;
+    }
+    pool_.Submit([this, task = std::move(task)](unsigned) {
+      task();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--outstanding_ == 0) {
+        done_.notify_all();
+      }
+    });
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return outstanding_ == 0; });
+  }
+
+ private:
+  ThreadPool& pool_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  size_t outstanding_ = 0;
+};
+
+SourceWalker::SourceWalker(const WalkOptions& options)
+    : gitignore_(options.gitignore) {
+  for (const auto& [globs, rules] :
+       {std::pair(&options.exclude, &exclude_),
+        std::pair(&options.only, &only_)}) {
+    for (const auto& glob : *globs) {
+      Rule rule = Rule::Parse(glob);
+      if (!rule.glob.empty()) {
+        rules->push_back(std::move(rule));
+      }
+    }
+  }
+}
+
+std::shared_ptr<const SourceWalker::IgnoreLevel> SourceWalker::LoadIgnoreFile(
+    const std::filesystem::path& directory, std::string_view rel,
+    std::shared_ptr<const IgnoreLevel> parent) const {
+  std::ifstream in(directory / ".gitignore");
+  if (!in) {
+    return parent;
+  }
+  auto level = std::make_shared<IgnoreLevel>();
+  level->prefix = rel.empty() ? 0 : rel.size() + 1;
+  std::string line;
+  while (std::getline(in, line)) {
+    Rule rule = Rule::Parse(line);
+    if (!rule.glob.empty()) {
+      level->rules.push_back(std::move(rule));
+    }
+  }
+  if (level->rules.empty()) {
+    return parent;
+  }
+  level->parent = std::move(parent);
+  return level;
+}
+
+bool SourceWalker::IsExcluded(const IgnoreLevel* level, std::string_view rel,
+                              std::string_view name, bool is_directory) const {
+  // The last matching rule decides, and deeper .gitignore files override
+  // the ones above them
+  for (auto rule = exclude_.rbegin(); rule != exclude_.rend(); ++rule) {
+    if (rule->Matches(rel, name, is_directory)) {
+      return !rule->negated;
+    }
+  }
+  for (; level; level = level->parent.get()) {
+    const std::string_view local = rel.substr(level->prefix);
+    for (auto rule = level->rules.rbegin(); rule != level->rules.rend();
+         ++rule) {
+      if (rule->Matches(local, name, is_directory)) {
+        return !rule->negated;
+      }
+    }
+  }
+  return false;
+}
+
+bool SourceWalker::KeepFile(const IgnoreLevel* level, std::string_view rel,
+                            std::string_view name, WalkStats& stats) const {
+  if (!HasSourceExtension(name) || IsTestOrMock(name)) {
+    ++stats.not_sources;
+    return false;
+  }
+  const bool selected =
+      only_.empty() ||
+      std::any_of(only_.begin(), only_.end(), [&](const Rule& rule) {
+        return rule.Matches(rel, name, false);
+      });
+  if (!selected || IsExcluded(level, rel, name, false)) {
+    ++stats.excluded_files;
+    return false;
+  }
+  return true;
+}
+
+void SourceWalker::WalkDirectory(std::filesystem::path path, std::string rel,
+                                 std::shared_ptr<const IgnoreLevel> level,
+                                 Directory& out, WalkTasks* tasks) const {
+  std::error_code ec;
+  std::vector<std::pair<std::string, std::filesystem::directory_entry>>
+      entries;
+  bool has_gitignore = false;
+  for (std::filesystem::directory_iterator
+           it(path, std::filesystem::directory_options::skip_permission_denied,
+              ec),
+       end;
+       !ec && it != end; it.increment(ec)) {
+    std::string name = it->path().filename().string();
+    has_gitignore |= name == ".gitignore";
+    entries.emplace_back(std::move(name), *it);
+  }
+  if (gitignore_ && has_gitignore) {
+    level = LoadIgnoreFile(path, rel, std::move(level));
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  for (const auto& [name, entry] : entries) {
+    std::string child_rel = rel.empty() ? name : rel + '/' + name;
+    if (entry.is_directory(ec) && !entry.is_symlink(ec)) {
+      if (name == ".git" || IsExcluded(level.get(), child_rel, name, true)) {
+        ++out.stats.pruned_directories;
+        continue;
+      }
+      Directory& child = *out.entries
+                              .emplace_back(Directory::Entry{
+                                  {}, std::make_unique<Directory>()})
+                              .subdirectory;
+      if (!tasks) {
+        WalkDirectory(entry.path(), std::move(child_rel), level, child,
+                      nullptr);
+        continue;
+      }
+      tasks->Submit([this, child_path = entry.path(),
+                     child_rel = std::move(child_rel), level, &child,
+                     tasks] {
+        WalkDirectory(child_path, child_rel, level, child, tasks);
+      });
+    } else if (entry.is_regular_file(ec)) {
+      if (KeepFile(level.get(), child_rel, name, out.stats)) {
+        out.entries.push_back({entry.path().string(), nullptr});
+      }
+    } else {
+      ++out.stats.not_sources;
+    }
+  }
+}
+
+bool SourceWalker::Selects(std::string_view rel_path) const {
+  for (size_t slash = rel_path.find('/'); slash != std::string_view::npos;
+       slash = rel_path.find('/', slash + 1)) {
+    const std::string_view directory = rel_path.substr(0, slash);
+    const std::string_view name =
+        directory.substr(directory.rfind('/') + 1);  // npos + 1 == 0
+    if (name == ".git" || IsExcluded(nullptr, directory, name, true)) {
+      return false;
+    }
+  }
+  WalkStats unused;
+  return KeepFile(nullptr, rel_path, rel_path.substr(rel_path.rfind('/') + 1),
+                  unused);
+}
+
+bool SourceWalker::GlobCovers(std::string_view glob,
+                              std::string_view rel_path) {
+  const Rule rule = Rule::Parse(glob);
+  if (rule.glob.empty() || rule.negated) {
+    return false;
+  }
+  for (size_t end = rel_path.find('/');; end = rel_path.find('/', end + 1)) {
+    const bool is_directory = end != std::string_view::npos;
+    const std::string_view path = rel_path.substr(0, end);
+    if (rule.Matches(path, path.substr(path.rfind('/') + 1), is_directory)) {
+      return true;
+    }
+    if (!is_directory) {
+      return false;
+    }
+  }
+}
+
+WalkResult SourceWalker::Walk(const std::filesystem::path& root,
+                              ThreadPool* pool) const {
+  return Walk(root, root, pool);
+}
+
+WalkResult SourceWalker::Walk(const std::filesystem::path& root,
+                              const std::filesystem::path& start,
+                              ThreadPool* pool) const {
+  const std::filesystem::path base =
+      std::filesystem::absolute(root).lexically_normal();
+  const std::string rel_path = std::filesystem::absolute(start)
+                                   .lexically_normal()
+                                   .lexically_relative(base)
+                                   .generic_string();
+  WalkResult result;
+  if (rel_path.empty() || rel_path == ".." || rel_path.starts_with("../")) {
+    return result;  // not below root
+  }
+
+  // Walk down to start, applying the rules on the way
+  std::shared_ptr<const IgnoreLevel> level;
+  std::filesystem::path path = base;
+  std::string rel;
+  for (size_t begin = 0; rel_path != "." && begin != std::string::npos;) {
+    if (gitignore_) {
+      level = LoadIgnoreFile(path, rel, std::move(level));
+    }
+    const size_t slash = rel_path.find('/', begin);
+    const std::string name = rel_path.substr(begin, slash - begin);
+    path /= name;
+    rel = rel.empty() ? name : rel + '/' + name;
+    begin = slash == std::string::npos ? slash : slash + 1;
+
+    std::error_code ec;
+    if (!std::filesystem::is_directory(
+            std::filesystem::symlink_status(path, ec))) {
+      // Only the last component can be a file
+      if (begin == std::string::npos &&
+          std::filesystem::is_regular_file(path, ec) &&
+          KeepFile(level.get(), rel, name, result.stats)) {
+        result.files.push_back(path.string());
+      }
+      return result;
+    }
+    if (name == ".git" || IsExcluded(level.get(), rel, name, true)) {
+      ++result.stats.pruned_directories;
+      return result;
+    }
+  }
+
+  // A task waiting for other tasks could hold the last free worker
+  Directory top;
+  if (pool && !pool->IsWorkerThread()) {
+    WalkTasks tasks(*pool);
+    WalkDirectory(path, rel, level, top, &tasks);
+    tasks.Wait();
+  } else {
+    WalkDirectory(path, rel, level, top, nullptr);
+  }
+  top.AppendTo(result);
+  return result;
+}
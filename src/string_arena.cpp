@@ -0,0 +1,22 @@
+#include "string_arena.h"
+
+#include <cstring>
+
+namespace {
+constexpr size_t kInitialBlockSize = 64 * 1024;
+}  // namespace
+
+StringArena::StringArena()
+    : resource_(kInitialBlockSize), interned_(&resource_) {}
+
+std::string_view StringArena::Intern(std::string_view str) {
+  auto it = interned_.find(str);
+  if (it != interned_.end()) {
+    return *it;
+  }
+  char* data = static_cast<char*>(resource_.allocate(str.size() + 1, 1));
+  std::memcpy(data, str.data(), str.size());
+  data[str.size()] = '\0';  // keeps views usable as C strings when needed
+  bytes_used_ += str.size();
+  return *interned_.emplace(data, str.size()).first;
+}
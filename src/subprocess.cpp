@@ -0,0 +1,146 @@
+#include "subprocess.h"
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+extern char** environ;
+
+bool Subprocess::Start(const std::vector<std::string>& argv, bool pipes) {
+  int to_child[2] = {-1, -1};
+  int from_child[2] = {-1, -1};
+  if (pipes && pipe2(to_child, O_CLOEXEC) != 0) {
+    return false;
+  }
+  if (pipes && pipe2(from_child, O_CLOEXEC) != 0) {
+    close(to_child[0]);
+    close(to_child[1]);
+    return false;
+  }
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if (pipes) {
+    posix_spawn_file_actions_adddup2(&actions, to_child[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, from_child[1], STDOUT_FILENO);
+  }
+  std::vector<char*> args;
+  for (const auto& arg : argv) {
+    args.push_back(const_cast<char*>(arg.c_str()));
+  }
+  args.push_back(nullptr);
+  const int rc =
+      posix_spawnp(&pid_, args[0], &actions, nullptr, args.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (pipes) {
+    close(to_child[0]);
+    close(from_child[1]);
+  }
+  if (rc != 0) {
+    if (pipes) {
+      close(to_child[1]);
+      close(from_child[0]);
+    }
+    pid_ = -1;
+    errno = rc;
+    return false;
+  }
+  in_ = to_child[1];
+  out_ = from_child[0];
+  return true;
+}
+
+bool Subprocess::Write(std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t n = write(in_, data.data(), data.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+void Subprocess::CloseInput() {
+  if (in_ >= 0) {
+    close(in_);
+    in_ = -1;
+  }
+}
+
+bool Subprocess::ReadUntil(char delimiter, std::string& out) {
+  for (;;) {
+    const char* begin = buffer_.data() + begin_;
+    const char* found =
+        static_cast<const char*>(memchr(begin, delimiter, end_ - begin_));
+    if (found) {
+      out.append(begin, found + 1);
+      begin_ += found + 1 - begin;
+      return true;
+    }
+    out.append(begin, end_ - begin_);
+    if (!Fill()) {
+      return false;
+    }
+  }
+}
+
+bool Subprocess::Read(size_t size, std::string& out) {
+  for (;;) {
+    const size_t n = std::min(size, end_ - begin_);
+    out.append(buffer_.data() + begin_, n);
+    begin_ += n;
+    size -= n;
+    if (size == 0) {
+      return true;
+    }
+    if (!Fill()) {
+      return false;
+    }
+  }
+}
+
+void Subprocess::ReadAll(std::string& out) {
+  do {
+    out.append(buffer_.data() + begin_, end_ - begin_);
+    begin_ = end_;
+  } while (Fill());
+}
+
+bool Subprocess::Finish() {
+  CloseInput();
+  if (out_ >= 0) {
+    close(out_);
+    out_ = -1;
+  }
+  if (pid_ < 0) {
+    return false;
+  }
+  int status = 0;
+  while (waitpid(pid_, &status, 0) < 0 && errno == EINTR) {
+  }
+  pid_ = -1;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool Subprocess::Fill() {
+  if (out_ < 0) {
+    return false;
+  }
+  for (;;) {
+    const ssize_t n = read(out_, buffer_.data(), buffer_.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    begin_ = 0;
+    end_ = n > 0 ? n : 0;
+    return n > 0;
+  }
+}
@@ -0,0 +1,145 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <latch>
+
+namespace {
+
+thread_local const ThreadPool* current_pool = nullptr;
+
+}  // namespace
+
+unsigned ThreadPool::ResolveThreadCount(unsigned requested) {
+  if (requested != 0) {
+    return requested;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+ThreadPool::ThreadPool(unsigned num_threads) {
+  const unsigned count = ResolveThreadCount(num_threads);
+  queues_.reserve(count);
+  for (unsigned i = 0; i < count; ++i) {
+    queues_.push_back(std::make_unique<WorkQueue>());
+  }
+  workers_.reserve(count);
+  for (unsigned i = 0; i < count; ++i) {
+    workers_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_available_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Submit(Task task) {
+  const size_t target = next_queue_.fetch_add(1) % queues_.size();
+  {
+    std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+    queues_[target]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++queued_;
+    ++pending_;
+  }
+  work_available_.notify_one();
+}
+
+bool ThreadPool::IsWorkerThread() const { return current_pool == this; }
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  all_done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool ThreadPool::TryPopLocal(unsigned worker_idx, Task& task) {
+  auto& queue = *queues_[worker_idx];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty()) {
+    return false;
+  }
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::TrySteal(unsigned worker_idx, Task& task) {
+  const size_t count = queues_.size();
+  for (size_t offset = 1; offset < count; ++offset) {
+    auto& victim = *queues_[(worker_idx + offset) % count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(unsigned worker_idx) {
+  current_pool = this;
+  while (true) {
+    {
+      // Sleep until there is something to pick up (or we are shutting down).
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_available_.wait(lock, [this] { return stop_ || queued_ > 0; });
+      if (queued_ == 0) {
+        return;  // stop_ requested and nothing left to run
+      }
+    }
+
+    Task task;
+    if (!TryPopLocal(worker_idx, task) && !TrySteal(worker_idx, task)) {
+      // Another worker took it between the wake-up and the pop.
+      std::this_thread::yield();
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --queued_;
+    }
+
+    task(worker_idx);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0) {
+      all_done_.notify_all();
+    }
+  }
+}
+
+void ParallelFor(ThreadPool* pool, size_t count,
+                 const std::function<void(size_t, unsigned)>& fn) {
+  if (pool == nullptr || pool->Size() <= 1 || count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i, 0);
+    }
+    return;
+  }
+
+  // A few chunks per worker keeps stealing effective without paying the
+  // scheduling cost per index
+  const size_t num_chunks = std::min<size_t>(count, pool->Size() * 4);
+  const size_t chunk_size = (count + num_chunks - 1) / num_chunks;
+  std::latch done(static_cast<std::ptrdiff_t>(num_chunks));
+  for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+    const size_t begin = chunk * chunk_size;
+    const size_t end = std::min(count, begin + chunk_size);
+    pool->Submit([&fn, &done, begin, end](unsigned worker_idx) {
+      for (size_t i = begin; i < end; ++i) {
+        fn(i, worker_idx);
+      }
+      done.count_down();
+    });
+  }
+  done.wait();
+}
@@ -1,12 +1,45 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <numeric>
 #include <optional>
+#include <random>
 #include <regex>
+#include <set>
+#include <sstream>
 
+#include "compile_db.h"
+#include "dep_graph.h"
 #include "dependency_analyzer.h"
+#include "directive_scanner.h"
+#include "fd_stream.h"
+#include "file_dep_builder.h"
 #include "file_parser.h"
+#include "file_watcher.h"
+#include "git_history.h"
+#include "graph_exporter.h"
+#include "graph_snapshot.h"
+#include "header_resolver.h"
+#include "impact_analyzer.h"
+#include "include_cost.h"
+#include "json.h"
+#include "keyword_index.h"
+#include "layer_rules.h"
+#include "parse_cache.h"
+#include "parse_shard.h"
+#include "profiler.h"
+#include "query_engine.h"
+#include "reachability.h"
+#include "render_cache.h"
+#include "source_walker.h"
+#include "string_arena.h"
+#include "thread_pool.h"
 
 class FileParserTest : public ::testing::Test {
  protected:
@@ -58,23 +91,734 @@ TEST_F(FileParserTest, ParsesFileCorrectly) {
   ASSERT_EQ(files.size(), 3);
 
   auto get_file = [&files](const std::string& expected_name) {
-    for (const auto& file : files) {
-      if (file.name == expected_name) {
-        return std::optional<File>(file);
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (files[i].name == expected_name) {
+        return std::optional<size_t>(i);
       }
     }
-    return std::optional<File>{};
+    return std::optional<size_t>{};
   };
 
   auto lib_cpp_file = get_file("lib.cpp");
-  EXPECT_TRUE(lib_cpp_file);
-  EXPECT_EQ(lib_cpp_file.value().included_headers.size(), 1);
-  EXPECT_EQ(lib_cpp_file.value().included_headers[0], "dep.h");
-  EXPECT_EQ(lib_cpp_file.value().defined_classes.size(), 4);
-  EXPECT_EQ(lib_cpp_file.value().defined_classes[0], "LibType1");
-  EXPECT_EQ(lib_cpp_file.value().defined_classes[1], "LibType2");
-  EXPECT_EQ(lib_cpp_file.value().defined_classes[2], "LibType3");
-  EXPECT_EQ(lib_cpp_file.value().defined_classes[3], "LibType4");
+  ASSERT_TRUE(lib_cpp_file);
+  const File& lib_cpp = files[*lib_cpp_file];
+  EXPECT_EQ(lib_cpp.included_headers.size(), 1);
+  EXPECT_EQ(lib_cpp.included_headers[0], "dep.h");
+  // Classes are only scanned when asked for
+  EXPECT_TRUE(lib_cpp.defined_classes.empty());
+  const auto& classes = parser.GetDefinedClasses(*lib_cpp_file);
+  ASSERT_EQ(classes.size(), 4);
+  EXPECT_EQ(classes[0], "LibType1");
+  EXPECT_EQ(classes[1], "LibType2");
+  EXPECT_EQ(classes[2], "LibType3");
+  EXPECT_EQ(classes[3], "LibType4");
+  EXPECT_EQ(&parser.GetDefinedClasses(*lib_cpp_file), &classes);
+  EXPECT_EQ(lib_cpp.defined_classes, classes);
+}
+
+TEST_F(FileParserTest, ParallelParseMatchesSerialOrder) {
+  std::filesystem::create_directory(temp_dir_ / "sub");
+  for (int i = 0; i < 64; ++i) {
+    const std::string idx = std::to_string(i);
+    CreateTestFile((i % 2 ? "sub/f" : "f") + idx + ".h",
+                   "#include \"f" + std::to_string((i + 1) % 64) +
+                       ".h\"\nstruct S" + idx + " {};\n");
+  }
+
+  FileParser serial_parser(1);
+  serial_parser.ParseFilesUnder(temp_dir_.string());
+  FileParser parallel_parser(4);
+  parallel_parser.ParseFilesUnder(temp_dir_.string());
+
+  const auto& serial = serial_parser.GetParsedFiles();
+  const auto& parallel = parallel_parser.GetParsedFiles();
+  ASSERT_EQ(serial.size(), 64);
+  ASSERT_EQ(parallel.size(), serial.size());
+  for (size_t i = 0; i < serial.size(); ++i) {
+    EXPECT_EQ(parallel[i].name, serial[i].name);
+    EXPECT_EQ(parallel[i].included_headers, serial[i].included_headers);
+    EXPECT_EQ(parallel_parser.GetDefinedClasses(i),
+              serial_parser.GetDefinedClasses(i));
+  }
+}
+
+TEST_F(FileParserTest, ShardedParseMatchesSingleProcess) {
+  std::filesystem::create_directories(temp_dir_ / "big/sub");
+  std::filesystem::create_directory(temp_dir_ / "small");
+  for (int i = 0; i < 10; ++i) {
+    const std::string idx = std::to_string(i);
+    CreateTestFile((i % 2 ? "big/sub/f" : "big/f") + idx + ".h",
+                   "#include \"f" + std::to_string((i + 1) % 10) + ".h\"\n");
+  }
+  CreateTestFile("small/only.cpp", "#include \"f0.h\"\n\n");
+  const std::vector<std::string> directories = {
+      (temp_dir_ / "big").string(), (temp_dir_ / "small").string()};
+
+  FileParser single;
+  for (const auto& directory : directories) {
+    single.ParseFilesUnder(directory);
+  }
+
+  // What every worker process would write; "small" leaves two slices empty
+  constexpr size_t kShards = 3;
+  StringArena arena;
+  std::vector<ParseShard> shards(kShards);
+  for (size_t i = kShards; i-- > 0;) {
+    FileParser parser;
+    ParseShard shard;
+    shard.index = i;
+    shard.count = kShards;
+    for (const auto& directory : directories) {
+      const size_t before = parser.GetParsedFiles().size();
+      ParseShard::Slice& slice = shard.slices.emplace_back();
+      slice.directory = directory;
+      slice.walk_size = parser.ParseSliceOf(directory, i, kShards);
+      slice.files.assign(parser.GetParsedFiles().begin() + before,
+                         parser.GetParsedFiles().end());
+    }
+    const std::string path =
+        (temp_dir_ / ("shard" + std::to_string(i))).string();
+    ASSERT_TRUE(shard.Save(path));
+    std::string error;
+    ASSERT_TRUE(shards[kShards - 1 - i].Load(path, arena, &error)) << error;
+  }
+
+  std::vector<File> merged;
+  std::string error;
+  ASSERT_TRUE(MergeParseShards(shards, merged, &error)) << error;
+  const auto& expected = single.GetParsedFiles();
+  ASSERT_EQ(merged.size(), expected.size());
+  for (size_t i = 0; i < merged.size(); ++i) {
+    EXPECT_EQ(merged[i].name, expected[i].name);
+    EXPECT_EQ(merged[i].included_headers, expected[i].included_headers);
+    EXPECT_EQ(merged[i].bytes, expected[i].bytes);
+    EXPECT_EQ(merged[i].lines, expected[i].lines);
+  }
+
+  // A missing shard, or walks that saw different trees, do not merge
+  std::vector<ParseShard> incomplete(shards.begin(), shards.end() - 1);
+  EXPECT_FALSE(MergeParseShards(incomplete, merged, &error));
+  shards[1].slices[0].walk_size += 1;
+  EXPECT_FALSE(MergeParseShards(shards, merged, &error));
+
+  CreateTestFile("shard0", "not a shard");
+  EXPECT_FALSE(shards[0].Load((temp_dir_ / "shard0").string(), arena,
+                              &error));
+}
+
+TEST_F(FileParserTest, ParseCacheReusesUnchangedFiles) {
+  CreateTestFile("a.h", "#include \"b.h\"\nstruct A {};\n");
+  CreateTestFile("b.h", "struct B {};\n");
+  const std::string cache_path =
+      (std::filesystem::temp_directory_path() / "cpp_deps_parse_cache.bin")
+          .string();
+  std::filesystem::remove(cache_path);
+
+  auto parse = [&](bool hash_contents) {
+    auto parser = std::make_unique<FileParser>();
+    parser->EnableCache(cache_path, hash_contents);
+    parser->ParseFilesUnder(temp_dir_.string());
+    EXPECT_TRUE(parser->SaveCache());
+    return parser;
+  };
+
+  auto cold = parse(false);
+  EXPECT_EQ(cold->GetCache()->GetStats().hits, 0);
+  EXPECT_EQ(cold->GetCache()->GetStats().misses, 2);
+
+  auto warm = parse(false);
+  EXPECT_EQ(warm->GetCache()->GetStats().hits, 2);
+  EXPECT_EQ(warm->GetCache()->GetStats().misses, 0);
+  ASSERT_EQ(warm->GetParsedFiles().size(), 2);
+  for (const auto& file : warm->GetParsedFiles()) {
+    if (file.name == "a.h") {
+      ASSERT_EQ(file.included_headers.size(), 1);
+      EXPECT_EQ(file.included_headers[0], "b.h");
+    }
+  }
+
+  // A content change is picked up; hashes are only stored when hashing
+  CreateTestFile("b.h", "#include \"a.h\"\nstruct B {};\n");
+  auto changed = parse(true);
+  EXPECT_EQ(changed->GetCache()->GetStats().hits, 1);
+  EXPECT_EQ(changed->GetCache()->GetStats().misses, 1);
+
+  // Only the mtime changed: a miss by stamp, a hit by content hash
+  const auto b_path = temp_dir_ / "b.h";
+  std::filesystem::last_write_time(
+      b_path, std::filesystem::last_write_time(b_path) + std::chrono::hours(1));
+  auto touched = parse(true);
+  EXPECT_EQ(touched->GetCache()->GetStats().hits, 2);
+
+  // A corrupted cache is ignored rather than trusted
+  {
+    std::fstream cache_file(cache_path, std::ios::in | std::ios::out |
+                                            std::ios::binary);
+    cache_file.seekp(12);
+    cache_file.put('\x7f');
+  }
+  auto corrupted = parse(false);
+  EXPECT_EQ(corrupted->GetCache()->GetStats().hits, 0);
+  EXPECT_EQ(corrupted->GetCache()->GetStats().misses, 2);
+
+  std::filesystem::remove(cache_path);
+}
+
+TEST_F(FileParserTest, ReparseTracksChangedPaths) {
+  std::filesystem::create_directory(temp_dir_ / "sub");
+  CreateTestFile("a.h", "#include \"b.h\"\n");
+  CreateTestFile("b.h", "struct B {};\n");
+  CreateTestFile("sub/c.h", "struct C {};\n");
+  CreateTestFile("sub/d.h", "struct D {};\n");
+
+  FileParser parser;
+  parser.ParseFilesUnder(temp_dir_.string());
+  ASSERT_EQ(parser.GetParsedFiles().size(), 4);
+
+  CreateTestFile("a.h", "#include \"c.h\"\n");
+  std::filesystem::remove(temp_dir_ / "b.h");
+  CreateTestFile("e_test.h", "struct Skipped {};\n");
+  std::filesystem::remove(temp_dir_ / "sub/c.h");
+  CreateTestFile("sub/f.h", "struct F {};\n");
+  // A directory stands for everything below it
+  const FileDelta delta = parser.Reparse(
+      {(temp_dir_ / "a.h").string(), (temp_dir_ / "b.h").string(),
+       (temp_dir_ / "e_test.h").string(), (temp_dir_ / "sub").string(),
+       "/not/under/any/parsed/directory.h"});
+
+  ASSERT_EQ(delta.modified.size(), 2);
+  EXPECT_EQ(delta.modified[0].name, "a.h");
+  ASSERT_EQ(delta.modified[0].included_headers.size(), 1);
+  EXPECT_EQ(delta.modified[0].included_headers[0], "c.h");
+  EXPECT_EQ(delta.modified[1].name, "sub/d.h");
+  ASSERT_EQ(delta.added.size(), 1);
+  EXPECT_EQ(delta.added[0].name, "sub/f.h");
+  EXPECT_EQ(std::set<std::string>(delta.removed.begin(), delta.removed.end()),
+            (std::set<std::string>{"b.h", "sub/c.h"}));
+
+  std::set<std::string_view> names;
+  for (const auto& file : parser.GetParsedFiles()) {
+    names.insert(file.name);
+  }
+  EXPECT_EQ(names, (std::set<std::string_view>{"a.h", "sub/d.h", "sub/f.h"}));
+}
+
+TEST_F(FileParserTest, FollowsCompileCommandsSearchPaths) {
+  for (const char* dir : {"src", "include", "gen"}) {
+    std::filesystem::create_directory(temp_dir_ / dir);
+  }
+  // Quoted includes look next to the includer first, angled ones do not;
+  // -iquote only serves quoted includes
+  CreateTestFile("src/a.cpp",
+                 "#include \"util.h\"\n#include <lib.h>\n#include \"gen.h\"\n"
+                 "#include <vector>\n#include <missing.h>\nstruct A {};\n");
+  CreateTestFile("src/util.h", "struct Util {};\n");
+  CreateTestFile("src/lib.h", "struct Decoy {};\n");
+  CreateTestFile("src/unused.cpp", "#include \"util.h\"\n");
+  CreateTestFile("include/util.h", "struct Decoy {};\n");
+  CreateTestFile("include/lib.h", "#include \"detail.h\"\n");
+  CreateTestFile("include/detail.h", "struct Detail {};\n");
+  CreateTestFile("gen/gen.h", "#include <lib.h>\n");
+  const std::string root = temp_dir_.string();
+  CreateTestFile("compile_commands.json", R"([
+    {"directory": ")" + root + R"(/src", "file": "a.cpp", "output": "a.o",
+     "command": "c++ -I ../include -iquote'../gen' -DX=\"1 2\" -c a.cpp"},
+    {"directory": ")" + root + R"(", "file": "src/missing.cpp",
+     "arguments": ["c++", "-c", "src/missing.cpp"]}
+  ])");
+
+  FileParser parser(2);
+  ASSERT_TRUE(parser.ParseCompileCommands(
+      (temp_dir_ / "compile_commands.json").string()));
+  std::map<std::string, std::vector<std::string_view>> includes;
+  for (const File& file : parser.GetParsedFiles()) {
+    includes[std::string(file.name)] = file.included_headers;
+  }
+  using Includes = std::vector<std::string_view>;
+  EXPECT_EQ(includes, (std::map<std::string, Includes>{
+                          {"src/a.cpp",
+                           {"util.h", "../include/lib.h", "../gen/gen.h"}},
+                          {"src/util.h", {}},
+                          {"include/lib.h", {"detail.h"}},
+                          {"include/detail.h", {}},
+                          {"gen/gen.h", {"../include/lib.h"}}}));
+
+  const DependencyAnalyzer analyzer(parser.GetParsedFiles());
+  const auto& graph = analyzer.GetFileDependencies();
+  EXPECT_EQ(graph.at("a").size(), 3);
+  EXPECT_EQ(graph.at("gen").size(), 1);
+
+  EXPECT_EQ(SplitCommandLine(R"(cc -I"a b" 'c d'\ e "f\"g" h\\i)"),
+            (std::vector<std::string>{"cc", "-Ia b", "c d e", "f\"g",
+                                      "h\\i"}));
+  const IncludeSearchPath search_path = ExtractIncludeSearchPath(
+      {"cc", "-isystem", "sys", "-Ia", "-idirafter/late", "-I", "/b"}, "/w");
+  EXPECT_EQ(search_path.dirs,
+            (std::vector<std::string>{"/w/a", "/b", "/w/sys", "/late"}));
+
+  CreateTestFile("broken.json", R"([{"file": "a.cpp"}, {"file": ])");
+  FileParser broken;
+  EXPECT_FALSE(broken.ParseCompileCommands((temp_dir_ / "broken.json")
+                                               .string()));
+}
+
+TEST_F(FileParserTest, WalkerPrunesExcludedAndIgnoredTrees) {
+  for (const char* dir : {"src/gen", "build/obj", "third_party/lib", "docs",
+                          ".git"}) {
+    std::filesystem::create_directories(temp_dir_ / dir);
+  }
+  for (const char* file :
+       {"src/a.cpp", "src/a.H", "src/b.hpp", "src/a_test.cpp", "src/gen/g.h",
+        "src/gen/keep.h", "build/obj/o.h", "third_party/lib/l.h",
+        "docs/readme.md", ".git/x.h", "top.cu"}) {
+    CreateTestFile(file, "");
+  }
+  CreateTestFile(".gitignore", "# build output\nbuild/\n");
+  CreateTestFile("src/.gitignore", "/gen/*\n!/gen/keep.h\n");
+
+  WalkOptions options;
+  options.exclude = {"third_party/"};
+  auto relative = [&](const WalkResult& result) {
+    std::vector<std::string> files;
+    for (const auto& file : result.files) {
+      files.push_back(
+          std::filesystem::path(file).lexically_relative(temp_dir_).string());
+    }
+    return files;
+  };
+  ThreadPool pool(4);
+  const SourceWalker walker(options);
+  const WalkResult walk = walker.Walk(temp_dir_, &pool);
+  EXPECT_EQ(relative(walk), (std::vector<std::string>{
+                                "src/a.H", "src/a.cpp", "src/b.hpp",
+                                "src/gen/keep.h", "top.cu"}));
+  EXPECT_EQ(walk.stats.not_sources, 4);  // test file, readme, .gitignores
+  EXPECT_EQ(walk.stats.excluded_files, 1);
+  EXPECT_EQ(walk.stats.pruned_directories, 3);  // .git, build, third_party
+  EXPECT_EQ(relative(walker.Walk(temp_dir_, &pool)), relative(walk));
+  // From a task of a one-worker pool, which would otherwise wait on itself
+  ThreadPool single(1);
+  WalkResult nested;
+  single.Submit([&](unsigned) { nested = walker.Walk(temp_dir_, &single); });
+  single.Wait();
+  EXPECT_EQ(relative(nested), relative(walk));
+
+  // Part of the tree, with the rules of the directories above it
+  EXPECT_EQ(relative(walker.Walk(temp_dir_, temp_dir_ / "src/gen")),
+            (std::vector<std::string>{"src/gen/keep.h"}));
+  EXPECT_TRUE(walker.Walk(temp_dir_, temp_dir_ / "build/obj/o.h")
+                  .files.empty());
+  EXPECT_TRUE(walker.Walk(temp_dir_, temp_dir_ / "gone.h").files.empty());
+  EXPECT_TRUE(walker.Selects("src/gen/g.h"));  // .gitignore is not read
+  EXPECT_FALSE(walker.Selects("third_party/lib/l.h"));
+  EXPECT_FALSE(walker.Selects("src/a_test.cpp"));
+
+  options.only = {"*.cpp", "src/**/*.h"};
+  options.gitignore = false;
+  EXPECT_EQ(relative(SourceWalker(options).Walk(temp_dir_)),
+            (std::vector<std::string>{"src/a.cpp", "src/gen/g.h",
+                                      "src/gen/keep.h"}));
+
+  EXPECT_TRUE(MatchGlob("a/**/b", "a/b"));
+  EXPECT_TRUE(MatchGlob("a/**/b", "a/x/y/b"));
+  EXPECT_FALSE(MatchGlob("a/*/b", "a/x/y/b"));
+  EXPECT_TRUE(MatchGlob("[!x]?.[ch]", "ab.h"));
+  EXPECT_FALSE(MatchGlob("*.h", "dir/a.h"));
+}
+
+TEST_F(FileParserTest, GitHistoryMatchesFreshAnalysis) {
+  const std::string git =
+      "git -C " + temp_dir_.string() +
+      " -c user.name=test -c user.email=test@example.com ";
+  if (std::system((git + "init -q > /dev/null 2>&1").c_str()) != 0) {
+    GTEST_SKIP() << "git is not available";
+  }
+  auto commit = [&](const std::string& tag) {
+    ASSERT_EQ(std::system((git + "add -A && " + git + "commit -qm " + tag +
+                           " && " + git + "tag " + tag)
+                              .c_str()),
+              0);
+  };
+  std::filesystem::create_directory(temp_dir_ / "third_party");
+  CreateTestFile("a.h", "#pragma once\n");
+  CreateTestFile("b.h", "#include \"a.h\"\n");
+  CreateTestFile("c.cpp", "#include \"b.h\"\n");
+  CreateTestFile("third_party/x.h", "#include \"c.h\"\n");
+  CreateTestFile("notes.txt", "");
+  commit("r1");
+  CreateTestFile("a.h", "#include \"b.h\"\n");  // a <-> b
+  CreateTestFile("c.cpp", "#include \"b.h\"\n// edited\n");
+  commit("r2");
+  std::filesystem::remove(temp_dir_ / "b.h");
+  CreateTestFile("d.h", "#pragma once\n");
+  commit("r3");
+
+  WalkOptions options;
+  options.exclude = {"third_party/"};
+  GitHistoryAnalyzer history(temp_dir_.string(), options);
+  std::string error;
+  std::vector<RevisionMetrics> followed;
+  for (const char* revision : {"r1", "r2", "r3"}) {
+    const std::optional<RevisionMetrics> metrics =
+        history.Analyze(revision, &error);
+    ASSERT_TRUE(metrics) << error;
+    followed.push_back(*metrics);
+  }
+  EXPECT_FALSE(history.Analyze("no-such-revision", &error));
+
+  EXPECT_EQ(followed[0].files, 3);
+  EXPECT_EQ(followed[0].cyclic_components, 0);
+  EXPECT_EQ(followed[1].changed_files, 2);
+  EXPECT_EQ(followed[1].parsed_blobs, 1);  // a.h now has c.cpp's old blob
+  EXPECT_EQ(followed[1].cyclic_components, 1);
+  EXPECT_EQ(followed[1].largest_component, 2);
+  EXPECT_EQ(followed[2].changed_files, 2);
+  EXPECT_EQ(followed[2].parsed_blobs, 0);  // d.h has the blob a.h had
+  EXPECT_EQ(followed[2].cyclic_components, 0);
+  EXPECT_EQ(history.CachedBlobs(), 4);
+
+  for (const auto& expected : followed) {
+    const std::optional<RevisionMetrics> fresh =
+        GitHistoryAnalyzer(temp_dir_.string(), options)
+            .Analyze(expected.revision, &error);
+    ASSERT_TRUE(fresh) << error;
+    EXPECT_EQ(fresh->files, expected.files);
+    EXPECT_EQ(fresh->nodes, expected.nodes);
+    EXPECT_EQ(fresh->edges, expected.edges);
+    EXPECT_EQ(fresh->components, expected.components);
+    EXPECT_EQ(fresh->cyclic_components, expected.cyclic_components);
+    EXPECT_EQ(fresh->largest_component, expected.largest_component);
+    EXPECT_EQ(fresh->max_depth, expected.max_depth);
+    EXPECT_EQ(fresh->simplified_edges, expected.simplified_edges);
+  }
+}
+
+TEST_F(FileParserTest, WatcherReportsChangesBelowDirectories) {
+  using std::chrono::milliseconds;
+  std::filesystem::create_directory(temp_dir_ / "sub");
+  FileWatcher watcher(milliseconds(5));
+  ASSERT_TRUE(watcher.AddDirectory(temp_dir_.string()));
+  EXPECT_FALSE(watcher.WaitForChanges(milliseconds(0)));
+
+  CreateTestFile("sub/a.h", "struct A {};\n");
+  auto batch = watcher.WaitForChanges(milliseconds(2000));
+  ASSERT_TRUE(batch);
+  EXPECT_EQ(batch->paths,
+            std::vector<std::string>{(temp_dir_ / "sub/a.h").string()});
+
+  // Directories created later are watched too
+  std::filesystem::create_directory(temp_dir_ / "new");
+  batch = watcher.WaitForChanges(milliseconds(2000));
+  ASSERT_TRUE(batch);
+  EXPECT_EQ(batch->paths,
+            std::vector<std::string>{(temp_dir_ / "new").string()});
+  CreateTestFile("new/b.h", "struct B {};\n");
+  std::filesystem::remove(temp_dir_ / "sub/a.h");
+  batch = watcher.WaitForChanges(milliseconds(2000));
+  ASSERT_TRUE(batch);
+  EXPECT_EQ(batch->paths, (std::vector<std::string>{
+                              (temp_dir_ / "new/b.h").string(),
+                              (temp_dir_ / "sub/a.h").string()}));
+}
+
+TEST(StringArenaTest, InternsEachStringOnce) {
+  StringArena arena;
+  std::string temp = "common.h";
+  const auto first = arena.Intern(temp);
+  temp = "changed";  // the arena must own its copy
+  const auto second = arena.Intern("common.h");
+
+  EXPECT_EQ(first, "common.h");
+  EXPECT_EQ(first.data(), second.data());
+  EXPECT_NE(arena.Intern("other.h").data(), first.data());
+  EXPECT_EQ(arena.Size(), 2);
+  EXPECT_EQ(arena.BytesUsed(), std::string_view("common.h").size() +
+                                   std::string_view("other.h").size());
+}
+
+TEST(DirectiveScannerTest, SkipsCommentsAndLiterals) {
+  const std::string source = R"src(
+#include "a.h"
+  #  include <sub/b.hpp>
+#include <vector>
+// #include "commented.h"
+/* class Hidden {};
+#include "block.h" */
+const char* s = "#include \"string.h\" struct InString";
+const char* r = R"x(
+#include "raw.h"
+class InRaw )" )x";
+int n = 1'000'000; char q = '"';
+#include "c.hu"
+template <class T> struct Visible : public subclass_base {};
+enum class Color { kRed };
+)src";
+
+  const auto directives = ScanDirectives(source);
+  ASSERT_EQ(directives.included_headers.size(), 3);
+  EXPECT_EQ(directives.included_headers[0], "a.h");
+  EXPECT_EQ(directives.included_headers[1], "sub/b.hpp");
+  EXPECT_EQ(directives.included_headers[2], "c.hu");
+  ASSERT_EQ(directives.defined_classes.size(), 3);
+  EXPECT_EQ(directives.defined_classes[0], "T");
+  EXPECT_EQ(directives.defined_classes[1], "Visible");
+  EXPECT_EQ(directives.defined_classes[2], "Color");
+}
+
+TEST(DirectiveScannerTest, IncludesOnlyProfileMatchesFullScan) {
+  const std::string sources[] = {
+      // Stops at the first declaration
+      "// header\n#pragma once\n#define A \\\n  \"x\"\n/* c */\n"
+      "#include \"a.h\"\nclass C {};\n",
+      // An include after code is still found
+      "#include \"a.h\"\nint x;\n#include \"late.h\"\nstruct S {};\n",
+      // Lookalikes after code are lexed away
+      "#include <a.h>\nint x; /*\n#include \"no.h\" */\n"
+      "const char* r = R\"(\n#include \"raw.h\")\";\n",
+      // A comment opened on a directive line
+      "#define B 1 /* spans\n#include \"no.h\" */\n#include \"b.h\"\n",
+  };
+  for (const auto& source : sources) {
+    const auto full = ScanDirectives(source, ScanProfile::kFull);
+    const auto fast = ScanDirectives(source, ScanProfile::kIncludesOnly);
+    EXPECT_EQ(fast.included_headers, full.included_headers) << source;
+    EXPECT_EQ(fast.angled_includes, full.angled_includes) << source;
+    EXPECT_TRUE(fast.defined_classes.empty());
+  }
+  EXPECT_EQ(ScanDirectives(sources[1], ScanProfile::kIncludesOnly)
+                .included_headers,
+            (std::vector<std::string_view>{"a.h", "late.h"}));
+}
+
+TEST(DirectiveScannerTest, FindsCandidatesAtEveryAlignment) {
+  // Shift the interesting bytes across the vector-width boundaries
+  for (size_t pad = 0; pad < 70; ++pad) {
+    const std::string source = std::string(pad, ' ') + "int x;\n" +
+                               std::string(pad, 'x') + "\n#include \"h" +
+                               std::to_string(pad) + ".h\"\nstruct S" +
+                               std::to_string(pad) + ";";
+    const auto directives = ScanDirectives(source);
+    ASSERT_EQ(directives.included_headers.size(), 1) << "pad " << pad;
+    EXPECT_EQ(directives.included_headers[0], "h" + std::to_string(pad) + ".h");
+    ASSERT_EQ(directives.defined_classes.size(), 1) << "pad " << pad;
+    EXPECT_EQ(directives.defined_classes[0], "S" + std::to_string(pad));
+    EXPECT_EQ(ScanDirectives(source, ScanProfile::kIncludesOnly)
+                  .included_headers,
+              directives.included_headers)
+        << "pad " << pad;
+  }
+}
+
+TEST(HeaderResolverTest, ResolvesByPathIndex) {
+  std::vector<File> files = {
+      {"src/net/socket.h", {}},     // 0
+      {"src/os/socket.h", {}},      // 1
+      {"src/net/conn.cpp", {}},     // 2
+      {"include/api/types.h", {}},  // 3
+      {"lib/api/types.h", {}},      // 4
+      {"src/xsocket.h", {}},        // 5
+      {"tools/main.cpp", {}},       // 6
+  };
+  const HeaderResolver resolver(files, {"lib"});
+
+  // Relative to the including file first
+  auto res = resolver.Resolve(files[2], "socket.h");
+  EXPECT_EQ(res.file_idx, 0);
+  EXPECT_EQ(res.candidate_count, 1);
+  res = resolver.Resolve(files[2], "../os/socket.h");
+  EXPECT_EQ(res.file_idx, 1);
+
+  // Longest matching path suffix, never a partial file name
+  res = resolver.Resolve(files[6], "os/socket.h");
+  EXPECT_EQ(res.file_idx, 1);
+  EXPECT_EQ(res.candidate_count, 1);
+  res = resolver.Resolve(files[6], "socket.h");
+  EXPECT_EQ(res.file_idx, 0);
+  EXPECT_EQ(res.candidate_count, 2);  // ambiguous, first one wins
+  EXPECT_FALSE(resolver.Resolve(files[6], "ocket.h").file_idx);
+  EXPECT_FALSE(resolver.Resolve(files[6], "missing.h").file_idx);
+
+  // Search paths take precedence over suffix matching
+  res = resolver.Resolve(files[6], "api/types.h");
+  EXPECT_EQ(res.file_idx, 4);
+  EXPECT_EQ(res.candidate_count, 1);
+}
+
+TEST(CsrGraphTest, BuildsSortedUniqueRowsAndReverse) {
+  const auto graph =
+      CsrGraph::FromEdges(4, {{2, 0}, {0, 3}, {0, 1}, {2, 0}, {1, 3}});
+  ASSERT_EQ(graph.NumNodes(), 4);
+  ASSERT_EQ(graph.NumEdges(), 4);
+  EXPECT_EQ(std::vector<NodeId>(graph.Neighbors(0).begin(),
+                                graph.Neighbors(0).end()),
+            (std::vector<NodeId>{1, 3}));
+  EXPECT_TRUE(graph.Neighbors(3).empty());
+  EXPECT_TRUE(graph.HasEdge(2, 0));
+  EXPECT_FALSE(graph.HasEdge(0, 2));
+
+  const auto reversed = graph.Reversed();
+  ASSERT_EQ(reversed.NumEdges(), 4);
+  EXPECT_EQ(std::vector<NodeId>(reversed.Neighbors(3).begin(),
+                                reversed.Neighbors(3).end()),
+            (std::vector<NodeId>{0, 1}));
+  EXPECT_EQ(reversed.Neighbors(0).size(), 1);
+  EXPECT_EQ(reversed.Neighbors(0)[0], 2);
+}
+
+TEST(CsrGraphTest, PatchMatchesRebuild) {
+  auto same = [](const CsrGraph& a, const CsrGraph& b) {
+    return std::ranges::equal(a.Offsets(), b.Offsets()) &&
+           std::ranges::equal(a.Targets(), b.Targets());
+  };
+  std::mt19937 rng(11);
+  for (int round = 0; round < 50; ++round) {
+    const size_t old_size = 40 + rng() % 20;
+    const size_t pre_size = old_size + rng() % 4;  // with added nodes
+    std::vector<CsrGraph::Edge> edges;
+    for (int i = 0; i < 150; ++i) {
+      edges.emplace_back(rng() % old_size, rng() % old_size);
+    }
+    const auto old_graph = CsrGraph::FromEdges(old_size, edges);
+    std::vector<NodeId> removed;
+    for (int i = 0; i < 5; ++i) {
+      removed.push_back(rng() % pre_size);
+    }
+    const auto compaction = PlanIdCompaction(pre_size, removed);
+    auto alive = [&](NodeId node) {
+      return compaction.Map(node) != IdCompaction::kRemoved;
+    };
+
+    // Old ids: a few random nodes get new rows, and whoever names a removed
+    // or moved node is rewritten
+    std::map<NodeId, std::vector<NodeId>> new_rows;
+    for (NodeId node = old_size; node < pre_size; ++node) {
+      new_rows[node];
+    }
+    for (int i = 0; i < 4; ++i) {
+      new_rows[rng() % old_size];
+    }
+    for (NodeId node = 0; node < old_size; ++node) {
+      for (const NodeId dep : old_graph.Neighbors(node)) {
+        if (compaction.Map(dep) != dep) {
+          new_rows[node];
+        }
+      }
+    }
+    for (auto& [node, row] : new_rows) {
+      if (node < old_size && rng() % 2 == 0) {
+        const auto deps = old_graph.Neighbors(node);
+        row.assign(deps.begin(), deps.end());
+      }
+      for (int i = 0; i < 3; ++i) {
+        row.push_back(rng() % pre_size);
+      }
+      std::erase_if(row, [&](NodeId dep) { return !alive(dep); });
+    }
+
+    std::unordered_map<NodeId, std::vector<NodeId>> rows;
+    for (const auto& [node, row] : new_rows) {
+      if (alive(node)) {
+        auto& mapped = rows[compaction.Map(node)];
+        for (const NodeId dep : row) {
+          mapped.push_back(compaction.Map(dep));
+        }
+        std::sort(mapped.begin(), mapped.end());
+        mapped.erase(std::unique(mapped.begin(), mapped.end()), mapped.end());
+      }
+    }
+    const auto expected = CsrGraph::FromRows(
+        compaction.new_size, [&](NodeId node, std::vector<NodeId>& row) {
+          if (const auto it = rows.find(node); it != rows.end()) {
+            row = it->second;
+          } else if (compaction.Origin(node) < old_size) {
+            const auto deps = old_graph.Neighbors(compaction.Origin(node));
+            row.assign(deps.begin(), deps.end());
+          }
+        });
+    auto patched = old_graph;
+    auto reversed = old_graph.Reversed();
+    PatchReverse(reversed, patched, compaction, rows);
+    patched.Patch(compaction, rows);
+    ASSERT_TRUE(same(patched, expected)) << "round " << round;
+    EXPECT_TRUE(same(reversed, expected.Reversed())) << "round " << round;
+  }
+}
+
+TEST(ReachabilityTest, ReductionMatchesNaivePruning) {
+  std::mt19937 rng(42);
+  for (const NodeId num_nodes : {1u, 60u, 700u}) {
+    // Random DAG, relabelled so that ids are not already in dependency order
+    std::vector<NodeId> label(num_nodes);
+    std::iota(label.begin(), label.end(), 0);
+    std::shuffle(label.begin(), label.end(), rng);
+    std::vector<CsrGraph::Edge> edges;
+    for (NodeId from = 0; from < num_nodes; ++from) {
+      for (NodeId to = 0; to < from; ++to) {
+        if (rng() % 100 < 3) {
+          edges.emplace_back(label[from], label[to]);
+        }
+      }
+    }
+    const auto dag = CsrGraph::FromEdges(num_nodes, edges);
+    std::vector<NodeId> order(label.begin(), label.end());
+
+    // Reference: plain DFS reachability per node
+    std::vector<std::set<NodeId>> reach(num_nodes);
+    std::function<void(NodeId, std::set<NodeId>&)> collect =
+        [&](NodeId node, std::set<NodeId>& out) {
+          for (const auto dep : dag.Neighbors(node)) {
+            if (out.insert(dep).second) {
+              collect(dep, out);
+            }
+          }
+        };
+    for (NodeId node = 0; node < num_nodes; ++node) {
+      collect(node, reach[node]);
+    }
+
+    const ReachabilityIndex index(dag, order);
+    const auto reduced = TransitiveReduction(dag, order);
+    for (NodeId node = 0; node < num_nodes; ++node) {
+      ASSERT_EQ(index.Count(node), reach[node].size());
+      std::vector<NodeId> listed;
+      index.ForEach(node, [&](NodeId id) { listed.push_back(id); });
+      ASSERT_EQ(listed, std::vector<NodeId>(reach[node].begin(),
+                                            reach[node].end()));
+
+      std::set<NodeId> transitive;
+      for (const auto dep : dag.Neighbors(node)) {
+        transitive.insert(reach[dep].begin(), reach[dep].end());
+      }
+      for (const auto dep : dag.Neighbors(node)) {
+        EXPECT_TRUE(index.Reaches(node, dep));
+        EXPECT_EQ(reduced.HasEdge(node, dep), transitive.count(dep) == 0);
+      }
+    }
+    if (num_nodes == 700) {
+      EXPECT_GT(index.DenseRowCount(), 0);
+      EXPECT_LT(index.DenseRowCount(), num_nodes);
+    }
+
+    // The level-parallel variant gives the same answer
+    ThreadPool pool(4);
+    const auto levels = ComputeHeightLevels(dag, &pool);
+    EXPECT_EQ(levels, ComputeHeightLevels(dag));
+    const auto parallel_reduced = TransitiveReduction(dag, levels, &pool);
+    ASSERT_EQ(parallel_reduced.Offsets().size(), reduced.Offsets().size());
+    EXPECT_TRUE(std::equal(parallel_reduced.Offsets().begin(),
+                           parallel_reduced.Offsets().end(),
+                           reduced.Offsets().begin()));
+    EXPECT_TRUE(std::equal(parallel_reduced.Targets().begin(),
+                           parallel_reduced.Targets().end(),
+                           reduced.Targets().begin(),
+                           reduced.Targets().end()));
+    const auto reversed = dag.Reversed();
+    const auto parallel_reversed = dag.Reversed(&pool);
+    EXPECT_TRUE(std::equal(parallel_reversed.Targets().begin(),
+                           parallel_reversed.Targets().end(),
+                           reversed.Targets().begin(),
+                           reversed.Targets().end()));
+  }
 }
 
 class SCCBuilderTest : public FileParserTest {};
@@ -134,6 +878,33 @@ TEST_F(SCCBuilderTest, SccNoDepsCase) {
   ASSERT_EQ(scc2[0], "D");
 }
 
+TEST_F(SCCBuilderTest, DeepChainDoesNotRecurse) {
+  // A chain far deeper than any native call stack could recurse through,
+  // closed into one big cycle for its first half
+  constexpr NodeId kChainLength = 200'000;
+  NameTable names;
+  std::vector<CsrGraph::Edge> edges;
+  for (NodeId i = 0; i < kChainLength; ++i) {
+    names.Intern("n" + std::to_string(i));
+    if (i + 1 < kChainLength) {
+      edges.emplace_back(i, i + 1);
+    }
+  }
+  edges.emplace_back(kChainLength / 2 - 1, 0);
+  const FileDepGraph file_deps(std::move(names),
+                               CsrGraph::FromEdges(kChainLength, edges));
+
+  SCCBuilder scc{file_deps};
+  const auto& scc_vec{scc.GetSCCComponents()};
+
+  // The second half are singletons, finished first (deepest first)
+  ASSERT_EQ(scc_vec.size(), kChainLength / 2 + 1);
+  EXPECT_EQ(scc_vec.front().member_ids, std::vector<NodeId>{kChainLength - 1});
+  EXPECT_EQ(scc_vec.back().member_ids.size(), kChainLength / 2);
+  EXPECT_EQ(scc.GetComponentIndex("n0"), scc.GetComponentIndex("n42"));
+  EXPECT_EQ(scc.GetSCCDeps().NumEdges(), kChainLength / 2);
+}
+
 TEST_F(SCCBuilderTest, TwoSccWithDep) {
   // Create files where SCC 1 depends on SCC 2
   std::vector<File> files = {
@@ -185,7 +956,783 @@ TEST_F(SCCBuilderTest, TwoSccWithDep) {
               std::find(sorted_sccs.begin(), sorted_sccs.end(), 0));
 }
 
+TEST(DependencyAnalyzerTest, ParallelAnalysisMatchesSerial) {
+  // Layered random project with a few include cycles
+  std::mt19937 rng(7);
+  std::vector<std::string> names;
+  for (int i = 0; i < 400; ++i) {
+    names.push_back("src/m" + std::to_string(i) + ".h");
+  }
+  std::vector<std::vector<std::string>> includes(names.size());
+  for (size_t i = 0; i < names.size(); ++i) {
+    for (int k = 0; k < 4 && i > 0; ++k) {
+      includes[i].push_back("m" + std::to_string(rng() % i) + ".h");
+    }
+    if (i % 37 == 5) {
+      includes[i - 3].push_back("m" + std::to_string(i) + ".h");
+    }
+  }
+  std::vector<File> files;
+  for (size_t i = 0; i < names.size(); ++i) {
+    File file{names[i], {}};
+    file.included_headers.assign(includes[i].begin(), includes[i].end());
+    files.push_back(std::move(file));
+  }
+
+  const DependencyAnalyzer serial(files);
+  ThreadPool pool(4);
+  AnalyzerOptions options;
+  options.pool = &pool;
+  const DependencyAnalyzer parallel(files, options);
+
+  const auto& serial_components = serial.GetStronglyConnectedComponents();
+  const auto& parallel_components = parallel.GetStronglyConnectedComponents();
+  ASSERT_EQ(serial_components.size(), parallel_components.size());
+  for (size_t i = 0; i < serial_components.size(); ++i) {
+    EXPECT_EQ(serial_components[i].members, parallel_components[i].members);
+  }
+  EXPECT_LT(serial_components.size(), names.size());
+  EXPECT_EQ(serial.GetTopologicalSortedSCCs(),
+            parallel.GetTopologicalSortedSCCs());
+  EXPECT_EQ(serial.GenerateMermaidGraph(), parallel.GenerateMermaidGraph());
+}
+
+// Analysis results keyed by names instead of ids, so that two analyzers of
+// the same files compare equal however they numbered things
+struct CanonicalAnalysis {
+  std::map<std::string, std::set<std::string>> file_deps;
+  std::map<std::string, std::set<std::string>> component_deps;
+  std::map<std::string, std::set<std::string>> simplified_deps;
+  std::map<std::string, std::set<std::string>> reaches;
+  std::map<std::string, int> depths;
+  bool operator==(const CanonicalAnalysis&) const = default;
+};
+
+CanonicalAnalysis Canonicalize(const DependencyAnalyzer& analyzer) {
+  CanonicalAnalysis canonical;
+  const auto& file_deps = analyzer.GetFileDependencies();
+  for (NodeId file = 0; file < file_deps.size(); ++file) {
+    auto& deps = canonical.file_deps[std::string(file_deps.Names().Name(file))];
+    for (const NodeId dep : file_deps.Graph().Neighbors(file)) {
+      deps.emplace(file_deps.Names().Name(dep));
+    }
+  }
+  const auto& components = analyzer.GetStronglyConnectedComponents();
+  auto key = [&](SccIdx component_idx) {
+    auto members = components[component_idx].members;
+    std::sort(members.begin(), members.end());
+    std::string joined;
+    for (const auto& member : members) {
+      joined += member + "|";
+    }
+    return joined;
+  };
+  const auto& component_deps = analyzer.GetComponentDeps();
+  const auto& simplified = analyzer.GetSimplifiedComponentDeps();
+  const auto& reachability = analyzer.GetComponentReachability();
+  EXPECT_EQ(component_deps.NumNodes(), components.size());
+  EXPECT_EQ(simplified.NumNodes(), components.size());
+  EXPECT_EQ(reachability.NumNodes(), components.size());
+  for (SccIdx component_idx = 0; component_idx < components.size();
+       ++component_idx) {
+    auto& all_deps = canonical.component_deps[key(component_idx)];
+    for (const SccIdx dep : component_deps.Neighbors(component_idx)) {
+      all_deps.insert(key(dep));
+    }
+    auto& deps = canonical.simplified_deps[key(component_idx)];
+    for (const SccIdx dep : simplified.Neighbors(component_idx)) {
+      deps.insert(key(dep));
+    }
+    auto& reached = canonical.reaches[key(component_idx)];
+    reachability.ForEach(component_idx,
+                         [&](SccIdx dep) { reached.insert(key(dep)); });
+    canonical.depths[key(component_idx)] =
+        analyzer.GetComponentDepths()[component_idx];
+  }
+
+  // Any valid order will do: dependents before their dependencies
+  const auto& sorted = analyzer.GetTopologicalSortedSCCs();
+  EXPECT_EQ(sorted.size(), components.size());
+  std::vector<size_t> position(components.size(), sorted.size());
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    EXPECT_EQ(position[sorted[i]], sorted.size()) << "listed twice";
+    position[sorted[i]] = i;
+  }
+  for (SccIdx component_idx = 0; component_idx < components.size();
+       ++component_idx) {
+    for (const SccIdx dep : simplified.Neighbors(component_idx)) {
+      EXPECT_LT(position[component_idx], position[dep]);
+    }
+  }
+
+  // The keyword index follows the renumbered and renamed components
+  for (const char* keyword : {"", "m", "m1", "m12", "m4|m", "1|m2"}) {
+    std::vector<SccIdx> scanned;
+    for (SccIdx component_idx = 0; component_idx < components.size();
+         ++component_idx) {
+      if (components[component_idx].name.find(keyword) != std::string::npos) {
+        scanned.push_back(component_idx);
+      }
+    }
+    EXPECT_EQ(analyzer.FindComponents(keyword), scanned) << keyword;
+  }
+  return canonical;
+}
+
+TEST(DependencyAnalyzerTest, ApplyDeltaMatchesRebuild) {
+  // The file list a rebuild would see: removals drop out, modifications stay
+  // in place and additions go last
+  struct SourceFile {
+    std::string name;
+    std::vector<std::string> includes;
+  };
+  std::vector<SourceFile> sources;
+  std::mt19937 rng(11);
+  auto random_includes = [&](int module) {
+    std::vector<std::string> includes;
+    const int count = rng() % 4;
+    for (int i = 0; i < count; ++i) {
+      // Mostly downwards, sometimes upwards to close cycles
+      const int target = rng() % 8 == 0 ? module + 1 + rng() % 10
+                                        : module - 1 - rng() % 10;
+      if (target >= 0) {
+        includes.push_back((rng() % 5 == 0 ? "lib/m" : "m") +
+                           std::to_string(target) + ".h");
+      }
+    }
+    return includes;
+  };
+  auto file_name = [&](int module) {
+    switch (rng() % 3) {
+      case 0:
+        return "src/m" + std::to_string(module) + ".h";
+      case 1:
+        return "src/m" + std::to_string(module) + ".cpp";
+      default:
+        return "lib/m" + std::to_string(module) + ".h";
+    }
+  };
+  auto to_files = [](const std::vector<SourceFile>& list) {
+    std::vector<File> files;
+    for (const auto& source : list) {
+      File file{source.name, {}};
+      file.included_headers.assign(source.includes.begin(),
+                                   source.includes.end());
+      files.push_back(std::move(file));
+    }
+    return files;
+  };
+  auto module_of = [](const std::string& name) {
+    const size_t begin = name.rfind('m') + 1;
+    return std::stoi(name.substr(begin, name.rfind('.') - begin));
+  };
+
+  for (int module = 0; module < 60; ++module) {
+    const auto name = file_name(module);
+    if (std::none_of(sources.begin(), sources.end(),
+                     [&](const auto& source) { return source.name == name; })) {
+      sources.push_back({name, random_includes(module)});
+    }
+  }
+  DependencyAnalyzer analyzer(to_files(sources));
+  ASSERT_EQ(Canonicalize(analyzer),
+            Canonicalize(DependencyAnalyzer(to_files(sources))));
+
+  for (int round = 0; round < 150; ++round) {
+    std::vector<SourceFile> added, modified;
+    FileDelta delta;
+    const int ops = 1 + rng() % 3;
+    for (int op = 0; op < ops && !sources.empty(); ++op) {
+      const size_t victim = rng() % sources.size();
+      switch (rng() % 3) {
+        case 0: {
+          sources[victim].includes =
+              random_includes(module_of(sources[victim].name));
+          modified.push_back(sources[victim]);
+          break;
+        }
+        case 1: {
+          const int module = rng() % 70;
+          const auto name = file_name(module);
+          if (std::none_of(
+                  sources.begin(), sources.end(),
+                  [&](const auto& source) { return source.name == name; }) &&
+              std::find(delta.removed.begin(), delta.removed.end(), name) ==
+                  delta.removed.end()) {
+            sources.push_back({name, random_includes(module)});
+            added.push_back(sources.back());
+          }
+          break;
+        }
+        default:
+          const auto& victim_name = sources[victim].name;
+          auto is_victim = [&](const auto& s) { return s.name == victim_name; };
+          if (std::none_of(added.begin(), added.end(), is_victim) &&
+              std::none_of(modified.begin(), modified.end(), is_victim)) {
+            delta.removed.push_back(sources[victim].name);
+            sources.erase(sources.begin() + victim);
+          }
+          break;
+      }
+    }
+    const auto added_files = to_files(added);
+    const auto modified_files = to_files(modified);
+    delta.added = added_files;
+    delta.modified = modified_files;
+    analyzer.ApplyDelta(delta);
+
+    const DependencyAnalyzer rebuilt(to_files(sources));
+    ASSERT_EQ(Canonicalize(analyzer), Canonicalize(rebuilt))
+        << "round " << round;
+  }
+}
+
+TEST(KeywordIndexTest, MatchesSubstringScan) {
+  std::mt19937 rng(11);
+  auto random_name = [&] {
+    std::string name;
+    for (size_t length = rng() % 12; length > 0; --length) {
+      name += "ab|c"[rng() % 4];
+    }
+    return name;
+  };
+  KeywordIndex index;
+  std::vector<std::optional<std::string>> names(50);
+  auto check = [&] {
+    for (int i = 0; i < 40; ++i) {
+      const std::string keyword = random_name().substr(0, rng() % 6);
+      std::vector<NodeId> scanned;
+      for (NodeId id = 0; id < names.size(); ++id) {
+        if (names[id] && names[id]->find(keyword) != std::string::npos) {
+          scanned.push_back(id);
+        }
+      }
+      ASSERT_EQ(index.Find(keyword), scanned) << keyword;
+    }
+  };
+  for (int round = 0; round < 300; ++round) {
+    const auto id = static_cast<NodeId>(rng() % names.size());
+    if (rng() % 3 == 0) {
+      index.Erase(id);
+      names[id].reset();
+    } else {
+      names[id] = random_name();
+      index.Set(id, *names[id]);
+    }
+    if (round % 50 == 49) {
+      // Drop a few ids, moving the highest live ones into the holes
+      std::vector<NodeId> removed;
+      for (NodeId victim = 0; victim < names.size(); victim += 7) {
+        removed.push_back(victim);
+      }
+      const auto compaction = PlanIdCompaction(names.size(), removed);
+      index.Remap(compaction, names.size());
+      std::vector<std::optional<std::string>> remapped(compaction.new_size);
+      for (NodeId old_id = 0; old_id < names.size(); ++old_id) {
+        const NodeId new_id = compaction.Map(old_id);
+        if (new_id != IdCompaction::kRemoved) {
+          remapped[new_id] = names[old_id];
+        }
+      }
+      names = std::move(remapped);
+      names.resize(50);
+    }
+    check();
+  }
+}
+
+TEST(RenderCacheTest, EvictsLeastRecentlyUsed) {
+  RenderCache cache(20);
+  int renders = 0;
+  auto render = [&](const std::string& key) {
+    return *cache.GetOrRender(key, [&] {
+      ++renders;
+      return std::string(5, key[0]);
+    });
+  };
+  EXPECT_EQ(render("a"), "aaaaa");  // 6 bytes with its key
+  render("b");
+  render("c");
+  render("a");  // hit, a is now the most recent
+  render("d");  // over 20 bytes: evicts b
+  EXPECT_EQ(renders, 4);
+  render("a");
+  render("c");
+  EXPECT_EQ(renders, 4);
+  render("b");
+  EXPECT_EQ(renders, 5);
+  EXPECT_EQ(cache.GetStats().hits, 3);
+  EXPECT_EQ(cache.GetStats().misses, 5);
+  EXPECT_DOUBLE_EQ(cache.GetStats().HitRate(), 3.0 / 8);
+
+  // Too large to keep, but still returned
+  EXPECT_EQ(*cache.GetOrRender("big", [] { return std::string(100, 'x'); }),
+            std::string(100, 'x'));
+  cache.Clear();
+  render("a");
+  EXPECT_EQ(renders, 6);
+}
+
+TEST(JsonTest, ParsesAndSerializes) {
+  const auto value = ParseJson(R"( {"id": -1.5e2,
+      "list": [true, false, null, "a\"\u00e9\ud83d\ude00"],
+      "nested": {"k": []}} )");
+  ASSERT_TRUE(value);
+  ASSERT_TRUE(value->Find("id") && value->Find("id")->AsNumber());
+  EXPECT_EQ(*value->Find("id")->AsNumber(), -150);
+  EXPECT_EQ(value->Find("missing"), nullptr);
+  std::string out;
+  AppendJson(out, *value);
+  EXPECT_EQ(out,
+            "{\"id\":-150,\"list\":[true,false,null,"
+            "\"a\\\"\u00e9\U0001F600\"],\"nested\":{\"k\":[]}}");
+  EXPECT_EQ(ParseJson(out)->Find("list")->AsArray()->size(), 4);
+
+  for (const char* malformed :
+       {"", "{", "[1,]", "01", "1.", "\"\\x\"", "\"\\ud800\"", "{} {}",
+        "{\"a\" 1}", "nul"}) {
+    EXPECT_FALSE(ParseJson(malformed)) << malformed;
+  }
+  EXPECT_FALSE(ParseJson(std::string(1000, '[') + std::string(1000, ']')));
+}
+
+TEST(QueryEngineTest, AnswersQueriesInRequestOrder) {
+  std::vector<File> files = {
+      {"a.cpp", {"b.h", "c.h"}}, {"b.h", {"c.h"}}, {"c.h", {"d.h"}},
+      {"d.h", {"c.h"}},          {"e.h", {"b.h"}},
+  };
+  const DependencyAnalyzer analyzer(files);
+  const QueryEngine engine(analyzer);
+
+  auto result = [&](std::string_view request) {
+    const auto response = ParseJson(engine.Answer(request));
+    EXPECT_TRUE(response && response->Find("result")) << request;
+    return response ? *response->Find("result") : JsonValue{};
+  };
+  auto strings = [](const JsonValue& value) {
+    std::vector<std::string> out;
+    for (const auto& element : *value.AsArray()) {
+      out.push_back(*element.AsString());
+    }
+    return out;
+  };
+
+  EXPECT_EQ(strings(*result(R"({"query":"dependencies","file":"a"})")
+                         .Find("files")),
+            (std::vector<std::string>{"b", "c"}));
+  EXPECT_EQ(strings(*result(R"({"query":"dependents","file":"c",)"
+                            R"("transitive":true})")
+                         .Find("files")),
+            (std::vector<std::string>{"a", "b", "d", "e"}));
+  const auto depth = result(R"({"query":"depth","file":"d"})");
+  EXPECT_EQ(*depth.Find("depth")->AsNumber(), 0);
+  EXPECT_EQ(*result(R"({"query":"depth","file":"a"})")
+                 .Find("depth")
+                 ->AsNumber(),
+            2);
+
+  // a -> b -> {c, d}; the reduced graph drops a -> {c, d}
+  const auto subgraph = result(R"({"query":"subgraph","keyword":"b"})");
+  EXPECT_EQ(subgraph.Find("components")->AsArray()->size(), 2);
+  EXPECT_EQ(subgraph.Find("edges")->AsArray()->size(), 1);
+  EXPECT_EQ(result(R"({"query":"subgraph","keyword":"a"})")
+                .Find("edges")
+                ->AsArray()
+                ->size(),
+            2);
+
+  for (const char* bad :
+       {"not json", R"({"query":"depth"})", R"({"query":"depth","file":"z"})",
+        R"({"query":"what"})"}) {
+    const auto response = ParseJson(engine.Answer(bad));
+    ASSERT_TRUE(response) << bad;
+    EXPECT_TRUE(response->Find("error")) << bad;
+  }
+
+  // Concurrent answers still come back in request order
+  std::vector<std::string> requests;
+  for (int i = 0; i < 2000; ++i) {
+    requests.push_back(R"({"id":)" + std::to_string(i) +
+                       (i % 3 ? R"(,"query":"subgraph","keyword":""})"
+                              : R"(,"query":"dependents","file":"d"})"));
+  }
+  requests.insert(requests.begin() + 10, "");  // skipped, not answered
+  ThreadPool pool(4);
+  size_t next_request = 0;
+  std::string output;
+  const size_t answered = engine.Serve(
+      [&](std::string& line) {
+        if (next_request == requests.size()) {
+          return false;
+        }
+        line = requests[next_request++];
+        return true;
+      },
+      [&](std::string_view lines) { output += lines; }, &pool);
+  EXPECT_EQ(answered, 2000);
+  std::istringstream lines(output);
+  std::string line;
+  int expected_id = 0;
+  while (std::getline(lines, line)) {
+    const auto response = ParseJson(line);
+    ASSERT_TRUE(response && response->Find("result"));
+    EXPECT_EQ(*response->Find("id")->AsNumber(), expected_id++);
+  }
+  EXPECT_EQ(expected_id, 2000);
+
+  // A regular file at the socket path is left alone
+  const std::string not_a_socket =
+      (std::filesystem::temp_directory_path() / "cpp_deps_not_a_socket")
+          .string();
+  std::ofstream(not_a_socket) << "keep";
+  EXPECT_FALSE(ServeUnixSocket(engine, not_a_socket, nullptr));
+  EXPECT_TRUE(std::filesystem::is_regular_file(not_a_socket));
+  std::filesystem::remove(not_a_socket);
+}
+
+TEST(GraphExporterTest, StreamsEveryFormat) {
+  std::vector<File> files = {
+      {"a.cpp", {"b.h", "c.h"}}, {"b.h", {"c.h"}}, {"c.h", {"d.h"}},
+      {"d.h", {"c.h"}},          {"e.h", {"b.h"}}, {"w&\"x.h", {"a.cpp"}},
+  };
+  const DependencyAnalyzer analyzer(files);
+  auto count = [](const std::string& text, std::string_view needle) {
+    size_t found = 0;
+    for (size_t pos = text.find(needle); pos != std::string::npos;
+         pos = text.find(needle, pos + 1)) {
+      ++found;
+    }
+    return found;
+  };
+  auto export_graph = [&](ExportFormat format, std::string_view keyword,
+                          ExportStats* stats = nullptr) {
+    std::ostringstream out;
+    const ExportStats exported = ExportGraph(analyzer, keyword, format, out);
+    if (stats) {
+      *stats = exported;
+    }
+    return out.str();
+  };
+
+  // w -> a -> b -> {c, d}, e -> b
+  ExportStats stats;
+  const std::string mermaid = export_graph(ExportFormat::kMermaid, "", &stats);
+  EXPECT_EQ(stats.nodes, 5);
+  EXPECT_EQ(stats.edges, 4);
+  EXPECT_TRUE(mermaid.starts_with("```mermaid\ngraph LR\n"));
+  EXPECT_TRUE(mermaid.ends_with("```\n"));
+  EXPECT_EQ(count(mermaid, " --> "), 4);
+  EXPECT_EQ(mermaid, analyzer.GenerateMermaidGraph());
+
+  const std::string dot = export_graph(ExportFormat::kDot, "");
+  EXPECT_TRUE(dot.starts_with("digraph dependencies {"));
+  EXPECT_EQ(count(dot, " -> "), 4);
+  EXPECT_NE(dot.find(R"(label="w&\"x")"), std::string::npos);
+
+  const auto json = ParseJson(export_graph(ExportFormat::kJson, ""));
+  ASSERT_TRUE(json);
+  EXPECT_EQ(json->Find("components")->AsArray()->size(), 5);
+  EXPECT_EQ(json->Find("edges")->AsArray()->size(), 4);
+  const auto json_b = ParseJson(export_graph(ExportFormat::kJson, "b"));
+  ASSERT_TRUE(json_b);
+  EXPECT_EQ(json_b->Find("components")->AsArray()->size(), 2);
+  EXPECT_EQ(json_b->Find("edges")->AsArray()->size(), 1);
+  const auto json_none = ParseJson(export_graph(ExportFormat::kJson, "zz"));
+  ASSERT_TRUE(json_none);
+  EXPECT_TRUE(json_none->Find("edges")->AsArray()->empty());
+
+  const std::string graphml = export_graph(ExportFormat::kGraphml, "");
+  EXPECT_EQ(count(graphml, "<node "), 5);
+  EXPECT_EQ(count(graphml, "<edge "), 4);
+  EXPECT_NE(graphml.find("w&amp;&quot;x"), std::string::npos);
+  EXPECT_TRUE(graphml.ends_with("</graphml>\n"));
+
+  EXPECT_EQ(ParseExportFormat("graphml"), ExportFormat::kGraphml);
+  EXPECT_FALSE(ParseExportFormat("svg"));
+}
+
+TEST(FdOutputStreamTest, WritesThroughSmallBuffer) {
+  FILE* file = std::tmpfile();
+  ASSERT_NE(file, nullptr);
+  std::string expected;
+  {
+    FdOutputStream out(fileno(file), 16);
+    for (int i = 0; i < 100; ++i) {
+      const std::string chunk(static_cast<size_t>(i % 40), 'a' + i % 26);
+      out << i << chunk;
+      expected += std::to_string(i) + chunk;
+    }
+    out.flush();
+    EXPECT_EQ(out.BytesWritten(), expected.size());
+  }
+  std::rewind(file);
+  std::string written(expected.size() + 1, '\0');
+  written.resize(std::fread(written.data(), 1, written.size(), file));
+  std::fclose(file);
+  EXPECT_EQ(written, expected);
+}
+
+TEST(GraphSnapshotTest, MapsWhatTheAnalyzerSaved) {
+  std::vector<File> files = {
+      {"a.cpp", {"b.h", "c.h"}}, {"b.h", {"c.h"}}, {"c.h", {"d.h"}},
+      {"d.h", {"c.h", "e.h"}},   {"e.h", {"d.h"}}, {"f.h", {"a.cpp"}},
+  };
+  const DependencyAnalyzer analyzer(files);
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "cpp_deps_snapshot.bin")
+          .string();
+  ASSERT_TRUE(GraphSnapshot::Save(analyzer, path));
+
+  GraphSnapshot snapshot;
+  ASSERT_TRUE(snapshot.Open(path));
+  const auto& names = analyzer.GetFileDependencies().Names();
+  const auto& file_deps = analyzer.GetFileDependencies().Graph();
+  ASSERT_EQ(snapshot.NumFiles(), names.Size());
+  for (NodeId file = 0; file < names.Size(); ++file) {
+    EXPECT_EQ(snapshot.FileName(file), names.Name(file));
+    EXPECT_EQ(snapshot.FindFile(names.Name(file)), file);
+    EXPECT_TRUE(std::ranges::equal(snapshot.FileDeps().Neighbors(file),
+                                   file_deps.Neighbors(file)));
+    EXPECT_EQ(snapshot.ComponentOf(file), analyzer.GetComponentOf(file));
+  }
+  EXPECT_FALSE(snapshot.FindFile("zz"));
+
+  const auto& components = analyzer.GetStronglyConnectedComponents();
+  ASSERT_EQ(snapshot.NumComponents(), components.size());
+  for (SccIdx i = 0; i < components.size(); ++i) {
+    EXPECT_EQ(snapshot.ComponentName(i), components[i].name);
+    EXPECT_TRUE(std::ranges::equal(snapshot.ComponentMembers(i),
+                                   components[i].member_ids));
+    EXPECT_TRUE(std::ranges::equal(snapshot.ComponentDeps().Neighbors(i),
+                                   analyzer.GetComponentDeps().Neighbors(i)));
+    EXPECT_TRUE(std::ranges::equal(
+        snapshot.SimplifiedComponentDeps().Neighbors(i),
+        analyzer.GetSimplifiedComponentDeps().Neighbors(i)));
+  }
+  EXPECT_TRUE(std::ranges::equal(snapshot.TopologicalOrder(),
+                                 analyzer.GetTopologicalSortedSCCs()));
+  EXPECT_TRUE(std::ranges::equal(snapshot.ComponentDepths(),
+                                 analyzer.GetComponentDepths()));
+  for (const char* keyword : {"", "d", "c|d", "f"}) {
+    EXPECT_EQ(snapshot.FindComponents(keyword),
+              analyzer.FindComponents(keyword));
+    std::ostringstream from_snapshot;
+    ExportGraph(snapshot, keyword, ExportFormat::kMermaid, from_snapshot);
+    EXPECT_EQ(from_snapshot.str(), analyzer.GenerateMermaidGraph(keyword));
+  }
+
+  // A flipped byte fails the checksum, a cut file the size check
+  const size_t size = snapshot.SizeBytes();
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(static_cast<std::streamoff>(size - 3));
+    file.put('\x7f');
+  }
+  EXPECT_FALSE(snapshot.Open(path));
+  EXPECT_FALSE(snapshot.IsOpen());
+  EXPECT_EQ(snapshot.NumComponents(), 0);
+  std::filesystem::resize_file(path, size / 2);
+  EXPECT_FALSE(snapshot.Open(path, /*verify_checksum=*/false));
+  std::filesystem::remove(path);
+  EXPECT_FALSE(snapshot.Open(path));
+}
+
+TEST(ImpactAnalyzerTest, ReachesEveryTransitiveDependent) {
+  // c and d form a cycle, so a change to d also affects c's dependents. A
+  // file without any include edge is no graph node, so it comes out unknown.
+  std::vector<File> files = {
+      {"a.cpp", {"b.h", "c.h"}}, {"b.h", {"c.h"}}, {"c.h", {"d.h"}},
+      {"d.h", {"c.h", "e.h"}},   {"e.h", {}},      {"f.cpp", {"e.h"}},
+      {"g.h", {}},
+  };
+  const DependencyAnalyzer analyzer(files);
+  const ImpactAnalyzer impact(analyzer);
+  const auto& names = analyzer.GetFileDependencies().Names();
+  auto affected = [&](std::vector<std::string> changed) {
+    const ImpactResult result = impact.Analyze(changed);
+    std::set<std::string> found;
+    for (const NodeId file : result.files) {
+      found.emplace(names.Name(file));
+    }
+    std::set<SccIdx> components;
+    for (const NodeId file : result.files) {
+      components.insert(analyzer.GetComponentOf(file));
+    }
+    EXPECT_EQ(components,
+              std::set<SccIdx>(result.components.begin(),
+                               result.components.end()));
+    return found;
+  };
+  EXPECT_EQ(affected({"d.h"}), (std::set<std::string>{"a", "b", "c", "d"}));
+  EXPECT_EQ(affected({"src/e.h"}),
+            (std::set<std::string>{"a", "b", "c", "d", "e", "f"}));
+  EXPECT_EQ(affected({"b", "a.cpp"}), (std::set<std::string>{"a", "b"}));
+  EXPECT_TRUE(affected({}).empty());
+
+  const ImpactResult result = impact.Analyze(
+      std::vector<std::string>{"a.cpp", "a.h", "g.h"});
+  EXPECT_EQ(result.changed_files, std::vector<NodeId>{*names.Find("a")});
+  EXPECT_EQ(result.unknown_files, std::vector<std::string>{"g.h"});
+
+  const QueryEngine engine(analyzer);
+  EXPECT_EQ(engine.Answer(R"({"id":1,"query":"impact","files":["c.h","x"]})"),
+            R"({"id":1,"result":{"files":["a","b","c","d"],)"
+            R"("components":["a","b","d|c"],"unknown":["x"]}})");
+  EXPECT_NE(engine.Answer(R"({"query":"impact","files":[1]})").find("error"),
+            std::string::npos);
+}
+
+TEST(IncludeCostTest, SumsClosuresAndFanIn) {
+  // c and d form a cycle; sizes are (bytes, lines)
+  std::vector<File> files = {
+      {"a.cpp", {"b.h", "c.h"}, {}, 100, 10},
+      {"b.h", {"c.h"}, {}, 20, 2},
+      {"c.h", {"d.h"}, {}, 30, 3},
+      {"d.h", {"c.h", "e.h"}, {}, 40, 4},
+      {"e.h", {}, {}, 50, 5},
+      {"e.cpp", {"e.h"}, {}, 60, 6},
+  };
+  ThreadPool pool(2);
+  AnalyzerOptions options;
+  options.pool = &pool;
+  const DependencyAnalyzer analyzer(files, options);
+  const auto costs = ComputeIncludeCosts(analyzer, &pool);
+  const auto& names = analyzer.GetFileDependencies().Names();
+  auto cost = [&](std::string_view stem) { return costs[*names.Find(stem)]; };
+
+  EXPECT_EQ(cost("a").closure.files, 6);
+  EXPECT_EQ(cost("a").closure.bytes, 300);
+  EXPECT_EQ(cost("a").closure.lines, 30);
+  EXPECT_EQ(cost("a").fan_in, 0);
+  EXPECT_EQ(cost("b").closure.bytes, 200);
+  EXPECT_EQ(cost("b").fan_in, 1);
+  // e.h and e.cpp share the stem e
+  EXPECT_EQ(cost("e").own.files, 2);
+  EXPECT_EQ(cost("e").closure.bytes, 110);
+  EXPECT_EQ(cost("e").fan_in, 4);
+  for (const auto stem : {"c", "d"}) {
+    EXPECT_EQ(cost(stem).closure.bytes, 180);
+    EXPECT_EQ(cost(stem).fan_in, 3);
+  }
+  EXPECT_EQ(costs, ComputeIncludeCosts(analyzer));
+
+  std::stringstream report;
+  WriteIncludeCostReport(analyzer, costs, 2, report);
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(report, line);) {
+    lines.push_back(line);
+  }
+  // c and d: 3 * 180 = 540 bytes, ahead of e's 4 * 110 = 440
+  ASSERT_EQ(lines.size(), 3);
+  EXPECT_NE(lines[1].find(" c "), std::string::npos);
+  EXPECT_NE(lines[2].find(" d "), std::string::npos);
+}
+
+TEST(LayerRulesTest, ReportsChainsThroughUnlayeredFiles) {
+  // core reaches service through util, which is in no layer, and service
+  // and app include each other
+  const std::vector<File> files = {
+      {"core/a.cpp", {"../util/u.h", "c.h"}, {}, 0, 0},
+      {"core/c.h", {}, {}, 0, 0},
+      {"util/u.h", {"../service/s.h"}, {}, 0, 0},
+      {"service/s.h", {"../core/c.h"}, {}, 0, 0},
+      {"service/x.h", {"../app/y.h"}, {}, 0, 0},
+      {"app/y.h", {"../service/x.h", "../core/c.h"}, {}, 0, 0},
+  };
+  const DependencyAnalyzer analyzer(files);
+  std::string error;
+  const std::optional<LayerRules> rules = LayerRules::Parse(
+      "# layers\n"
+      "layer core core/\n"
+      "layer service service/*.h\n"
+      "layer app app/\n"
+      "forbid core -> service app\n"
+      "allow service -> core\n"
+      "no-cycles-between layers\n",
+      &error);
+  ASSERT_TRUE(rules) << error;
+
+  auto describe = [&](const LayerRules& checked) {
+    std::vector<std::string> lines;
+    for (const auto& violation : CheckLayerRules(analyzer, checked)) {
+      lines.push_back(violation.Describe());
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+  };
+  EXPECT_EQ(describe(*rules),
+            (std::vector<std::string>{
+                "core -> service: core/a.cpp -> util/u.h -> service/s.h",
+                "cycle between app and service: "
+                "app/y.h -> service/x.h -> app/y.h",
+                "service -> app: service/x.h -> app/y.h"}));
+
+  const auto by_directory =
+      LayerRules::Parse("no-cycles-between directories 1\n", &error);
+  ASSERT_TRUE(by_directory) << error;
+  EXPECT_EQ(describe(*by_directory),
+            (std::vector<std::string>{"cycle between app and service: "
+                                      "app/y.h -> service/x.h -> app/y.h"}));
+
+  // A glob without '/' matches file names at any depth
+  const auto by_name = LayerRules::Parse(
+      "layer sources *.cpp\nlayer headers *.h\nforbid sources -> headers\n",
+      &error);
+  ASSERT_TRUE(by_name) << error;
+  EXPECT_EQ(describe(*by_name),
+            (std::vector<std::string>{"sources -> headers: "
+                                      "core/a.cpp -> util/u.h"}));
+  EXPECT_TRUE(SourceWalker::GlobCovers("core", "src/core/a/b.h"));
+  EXPECT_TRUE(SourceWalker::GlobCovers("src/core/", "src/core/a/b.h"));
+  EXPECT_FALSE(SourceWalker::GlobCovers("core/", "src/core.h"));
+  EXPECT_FALSE(SourceWalker::GlobCovers("/a.h", "src/a.h"));
+
+  EXPECT_FALSE(LayerRules::Parse("layer a a/\nforbid a -> b\n", &error));
+  EXPECT_EQ(error, "line 2: unknown layer b");
+  EXPECT_FALSE(LayerRules::Parse("layers a a/\n", &error));
+}
+
+TEST(ProfilerTest, RecordsPhasesAndCountersOnlyWhenEnabled) {
+  std::vector<File> files = {
+      {"a.cpp", {"b.h", "missing.h"}}, {"b.h", {"c.h"}}, {"c.h", {"b.h"}},
+  };
+  Profiler::Reset();
+  DependencyAnalyzer{files};
+  EXPECT_EQ(Profiler::Get(Profiler::kIncludesSeen), 0);
+
+  Profiler::Enable();
+  DependencyAnalyzer{files};
+  Profiler::Disable();
+  EXPECT_EQ(Profiler::Get(Profiler::kIncludesSeen), 4);
+  EXPECT_EQ(Profiler::Get(Profiler::kIncludesResolved), 3);
+  EXPECT_EQ(Profiler::Get(Profiler::kIncludesUnresolved), 1);
+  EXPECT_EQ(Profiler::Get(Profiler::kSccCount), 2);
+  EXPECT_EQ(Profiler::Get(Profiler::kLargestScc), 2);
+
+  std::ostringstream trace;
+  Profiler::WriteChromeTrace(trace);
+  const auto json = ParseJson(trace.str());
+  ASSERT_TRUE(json);
+  std::set<std::string> phases;
+  for (const auto& event : *json->Find("traceEvents")->AsArray()) {
+    if (*event.Find("ph")->AsString() == "X") {
+      phases.insert(*event.Find("name")->AsString());
+      EXPECT_GE(*event.Find("dur")->AsNumber(), 0);
+    }
+  }
+  EXPECT_EQ(phases, (std::set<std::string>{
+                        "BuildFileDependencies", "SCCBuilder", "DepthLevels",
+                        "PruneTransitiveDependencies", "TopologicalSort",
+                        "KeywordIndex"}));
+  EXPECT_EQ(*json->Find("otherData")->Find("includes seen")->AsNumber(), 4);
+
+  std::ostringstream summary;
+  Profiler::WriteSummary(summary);
+  EXPECT_NE(summary.str().find("SCCBuilder"), std::string::npos);
+  Profiler::Reset();
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}